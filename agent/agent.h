@@ -130,6 +130,10 @@ struct
 
   /* This global option enables the ssh-agent subsystem.  */
   int ssh_support;
+
+  /* The S2K count to use for protecting keys.  If 0 the count is
+     calibrated at runtime.  */
+  unsigned long s2k_count;
 } opt;
 
 
@@ -285,6 +289,8 @@ gpg_error_t agent_print_status (ctrl_t ctrl, const char *keyword,
      JNLIB_GCC_A_PRINTF(3,4);
 void bump_key_eventcounter (void);
 void bump_card_eventcounter (void);
+unsigned int get_key_eventcounter (void);
+unsigned int get_card_eventcounter (void);
 void start_command_handler (ctrl_t, gnupg_fd_t, gnupg_fd_t);
 gpg_error_t pinentry_loopback (ctrl_t, const char *keyword,
 	                       unsigned char **buffer, size_t *size,
@@ -307,6 +313,7 @@ gpg_error_t ssh_search_control_file (ssh_control_file_t cf,
                                      int *r_ttl, int *r_confirm);
 
 void start_command_handler_ssh (ctrl_t, gnupg_fd_t);
+void ssh_clear_card_identity_cache (void);
 
 /*-- findkey.c --*/
 int agent_write_private_key (const unsigned char *grip,
@@ -392,6 +399,7 @@ gpg_error_t agent_protect_and_store (ctrl_t ctrl, gcry_sexp_t s_skey,
 /*-- protect.c --*/
 unsigned long get_standard_s2k_count (void);
 unsigned char get_standard_s2k_count_rfc4880 (void);
+void get_s2k_stats (unsigned long *r_count, unsigned long long *r_usec);
 int agent_protect (const unsigned char *plainkey, const char *passphrase,
                    unsigned char **result, size_t *resultlen,
 		   unsigned long s2k_count);
@@ -415,6 +423,15 @@ gpg_error_t s2k_hash_passphrase (const char *passphrase, int hashalgo,
                                  unsigned char *key, size_t keylen);
 
 
+/*-- stats.c --*/
+unsigned long long stats_now (void);
+void stats_note_command (const char *name, unsigned long long start);
+void stats_note_cache (int hit);
+void stats_note_key_file_read (void);
+void stats_note_scd (unsigned long long start);
+void stats_print (estream_t fp);
+
+
 /*-- trustlist.c --*/
 void initialize_module_trustlist (void);
 gpg_error_t agent_istrusted (ctrl_t ctrl, const char *fpr, int *r_disabled);
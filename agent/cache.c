@@ -423,6 +423,7 @@ agent_get_cache (const char *key, cache_mode_t cache_mode)
           r->accessed = gnupg_get_time ();
           if (DBG_CACHE)
             log_debug ("... hit\n");
+          stats_note_cache (1);
           if (r->pw->totallen < 32)
             err = gpg_error (GPG_ERR_INV_LENGTH);
           else if ((err = init_encryption ()))
@@ -455,6 +456,7 @@ agent_get_cache (const char *key, cache_mode_t cache_mode)
     }
   if (DBG_CACHE)
     log_debug ("... miss\n");
+  stats_note_cache (0);
 
   return NULL;
 }
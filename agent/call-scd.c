@@ -64,6 +64,9 @@ struct scd_local_s
   int locked;           /* This flag is used to assert proper use of
                            start_scd and unlock_scd. */
 
+  unsigned long long started; /* Time start_scd was called; used for
+                                 the statistics.  */
+
 };
 
 
@@ -110,6 +113,17 @@ static assuan_context_t primary_scd_ctx;
    any connection. */
 static int primary_scd_ctx_reusable;
 
+/* The maximum number of idle socket connections to the SCdaemon we
+   keep for reuse.  */
+#define MAX_IDLE_SCD_CTX 8
+
+/* Socket connections to the SCdaemon which have been reset and are
+   not in use by any connection.  They are handed out by start_scd
+   instead of connecting anew.  Access is protected by
+   START_SCD_LOCK.  */
+static assuan_context_t idle_scd_ctx[MAX_IDLE_SCD_CTX];
+static int n_idle_scd_ctx;
+
 
 
 /* Local prototypes.  */
@@ -144,10 +158,11 @@ initialize_module_call_scd (void)
 void
 agent_scd_dump_state (void)
 {
-  log_info ("agent_scd_dump_state: primary_scd_ctx=%p pid=%ld reusable=%d\n",
+  log_info ("agent_scd_dump_state: primary_scd_ctx=%p pid=%ld reusable=%d"
+            " idle=%d\n",
             primary_scd_ctx,
             (long)assuan_get_pid (primary_scd_ctx),
-            primary_scd_ctx_reusable);
+            primary_scd_ctx_reusable, n_idle_scd_ctx);
   if (socket_name)
     log_info ("agent_scd_dump_state: socket='%s'\n", socket_name);
 }
@@ -171,6 +186,7 @@ unlock_scd (ctrl_t ctrl, int rc)
         rc = gpg_error (GPG_ERR_INTERNAL);
     }
   ctrl->scd_local->locked = 0;
+  stats_note_scd (ctrl->scd_local->started);
   return rc;
 }
 
@@ -226,6 +242,7 @@ start_scd (ctrl_t ctrl)
       return gpg_error (GPG_ERR_INTERNAL);
     }
   ctrl->scd_local->locked++;
+  ctrl->scd_local->started = stats_now ();
 
   if (ctrl->scd_local->ctx)
     return 0; /* Okay, the context is fine.  We used to test for an
@@ -256,6 +273,16 @@ start_scd (ctrl_t ctrl)
       goto leave;
     }
 
+  /* Next try to reuse an idle socket connection.  */
+  if (primary_scd_ctx && n_idle_scd_ctx)
+    {
+      ctx = idle_scd_ctx[--n_idle_scd_ctx];
+      idle_scd_ctx[n_idle_scd_ctx] = NULL;
+      if (opt.verbose)
+        log_info ("new connection to SCdaemon established (pooled)\n");
+      goto leave;
+    }
+
   rc = assuan_new (&ctx);
   if (rc)
     {
@@ -491,6 +518,14 @@ agent_scd_check_aliveness (void)
                 }
             }
 
+          /* The idle connections are useless as well.  */
+          while (n_idle_scd_ctx)
+            {
+              n_idle_scd_ctx--;
+              assuan_release (idle_scd_ctx[n_idle_scd_ctx]);
+              idle_scd_ctx[n_idle_scd_ctx] = NULL;
+            }
+
           primary_scd_ctx = NULL;
           primary_scd_ctx_reusable = 0;
 
@@ -507,6 +542,44 @@ agent_scd_check_aliveness (void)
 
 
 
+/* Release the socket connection CTX to the SCdaemon or, if possible,
+   put it into the pool of idle connections.  */
+static void
+release_scd_ctx (assuan_context_t ctx)
+{
+  int rc;
+
+  /* As with the primary connection a RESTART is required so that the
+     next user of this connection does not inherit the state of the
+     current session.  If that fails the connection is not reused.  */
+  if (assuan_transact (ctx, "RESTART", NULL, NULL, NULL, NULL, NULL, NULL))
+    {
+      assuan_release (ctx);
+      return;
+    }
+
+  rc = npth_mutex_lock (&start_scd_lock);
+  if (rc)
+    {
+      log_error ("failed to acquire the start_scd lock: %s\n",
+                 strerror (rc));
+      assuan_release (ctx);
+      return;
+    }
+
+  /* Only pool the connection if the SCdaemon has not been restarted
+     in the meantime.  */
+  if (primary_scd_ctx && n_idle_scd_ctx < MAX_IDLE_SCD_CTX)
+    idle_scd_ctx[n_idle_scd_ctx++] = ctx;
+  else
+    assuan_release (ctx);
+
+  rc = npth_mutex_unlock (&start_scd_lock);
+  if (rc)
+    log_error ("failed to release the start_scd lock: %s\n", strerror (rc));
+}
+
+
 /* Reset the SCD if it has been used.  Actually it is not a reset but
    a cleanup of resources used by the current connection. */
 int
@@ -526,8 +599,8 @@ agent_reset_scd (ctrl_t ctrl)
                  primary connection as a kind of virtual EOF; we don't
                  have another way to tell it that the next command
                  should be viewed as if a new connection has been
-                 made.  For the non-primary connections this is not
-                 needed as we simply close the socket.  We don't check
+                 made.  For the non-primary connections this is done
+                 by release_scd_ctx before pooling them.  We don't check
                  for an error here because the RESTART may fail for
                  example if the scdaemon has already been terminated.
                  Anyway, we need to set the reusable flag to make sure
@@ -537,7 +610,7 @@ agent_reset_scd (ctrl_t ctrl)
               primary_scd_ctx_reusable = 1;
             }
           else
-            assuan_release (ctrl->scd_local->ctx);
+            release_scd_ctx (ctrl->scd_local->ctx);
           ctrl->scd_local->ctx = NULL;
         }
 
@@ -207,6 +207,52 @@ struct ssh_control_file_s
 };
 
 
+/* The information used to detect changes which require to rebuild
+   the list of identities taken from the sshcontrol file.  */
+struct ssh_identity_stamp_s
+{
+  time_t now;               /* The time the stamp was taken.  */
+  unsigned int keycounter;  /* The key event counter.  */
+  time_t ctl_mtime;         /* Modification time of sshcontrol.  */
+  off_t ctl_size;           /* Size of sshcontrol.  */
+  ino_t ctl_ino;            /* Inode of sshcontrol.  */
+  time_t dir_mtime;         /* Modification time of the key directory.  */
+};
+
+
+/* Parsing the sshcontrol file and reading all listed private keys is
+   expensive; thus we keep the encoded public keys returned by the
+   request_identities command in a cache.  The cache is only read and
+   replaced by code which does not do any context switches and thus no
+   mutex is required.  Code which may switch context, like the file
+   reading in control_file_identities, works on local copies and
+   stores the result afterwards.  */
+static struct
+{
+  int valid;                          /* The cache is valid.  */
+  struct ssh_identity_stamp_s stamp;  /* The stamp at creation time.  */
+  u32 count;                          /* Number of identities in BLOBS.  */
+  void *blobs;                        /* The encoded identities.  */
+  size_t blobslen;                    /* Length of BLOBS.  */
+} identity_cache;
+
+/* A cache for the identity of the current card.  It is valid as long
+   as the card event counter does not change and it is cleared by
+   ssh_clear_card_identity_cache after the keys on the card may have
+   been changed.  card_identity asks scdaemon while other threads may
+   run; thus it updates the cache only if it has not been cleared in
+   the meantime.  */
+static struct
+{
+  int valid;                 /* The cache is valid.  */
+  unsigned int cardcounter;  /* The card event counter.  */
+  void *blob;                /* The encoded identity or NULL if the
+                                card has no usable key.  */
+  size_t bloblen;            /* Length of BLOB.  */
+  unsigned int generation;   /* Incremented by each clear.  */
+} card_identity_cache;
+
+
 /* Prototypes.  */
 static gpg_error_t ssh_handler_request_identities (ctrl_t ctrl,
 						   estream_t request,
@@ -2573,57 +2619,169 @@ card_key_available (ctrl_t ctrl, gcry_sexp_t *r_pk, char **cardsn)
 */
 
 
-/* Handler for the "request_identities" command.  */
+/* Fill STAMP with the information required to detect changes of the
+   sshcontrol file or of the private key directory.  Returns true on
+   success.  */
+static int
+get_identity_stamp (struct ssh_identity_stamp_s *stamp)
+{
+  struct stat st;
+  char *fname;
+  int okay;
+
+  memset (stamp, 0, sizeof *stamp);
+  stamp->now = time (NULL);
+  stamp->keycounter = get_key_eventcounter ();
+
+  fname = make_filename_try (opt.homedir, SSH_CONTROL_FILE_NAME, NULL);
+  okay = (fname && !stat (fname, &st));
+  xfree (fname);
+  if (!okay)
+    return 0;
+  stamp->ctl_mtime = st.st_mtime;
+  stamp->ctl_size = st.st_size;
+  stamp->ctl_ino = st.st_ino;
+
+  fname = make_filename_try (opt.homedir, GNUPG_PRIVATE_KEYS_DIR, NULL);
+  okay = (fname && !stat (fname, &st));
+  xfree (fname);
+  if (!okay)
+    return 0;
+  stamp->dir_mtime = st.st_mtime;
+
+  return 1;
+}
+
+
+/* Return true if the stamps A and B describe the same state.  */
+static int
+identity_stamp_equal (const struct ssh_identity_stamp_s *a,
+                      const struct ssh_identity_stamp_s *b)
+{
+  return (a->keycounter == b->keycounter
+          && a->ctl_mtime == b->ctl_mtime
+          && a->ctl_size == b->ctl_size
+          && a->ctl_ino == b->ctl_ino
+          && a->dir_mtime == b->dir_mtime);
+}
+
+
+/* Forget the cached identity of the current card.  This is called
+   after a key has been generated or written on the card or the card
+   has been learned again.  */
+void
+ssh_clear_card_identity_cache (void)
+{
+  es_free (card_identity_cache.blob);
+  card_identity_cache.blob = NULL;
+  card_identity_cache.bloblen = 0;
+  card_identity_cache.valid = 0;
+  card_identity_cache.generation++;
+}
+
+
+/* Write the public key of the authentication key of the current card
+   to STREAM and store the number of written keys (0 or 1) at
+   R_COUNT.  The result is cached until the card event counter
+   changes.  */
 static gpg_error_t
-ssh_handler_request_identities (ctrl_t ctrl,
-                                estream_t request, estream_t response)
+card_identity (ctrl_t ctrl, estream_t stream, u32 *r_count)
 {
-  ssh_key_type_spec_t spec;
-  char *key_fname = NULL;
-  char *fnameptr;
-  u32 key_counter;
-  estream_t key_blobs;
-  gcry_sexp_t key_secret;
-  gcry_sexp_t key_public;
   gpg_error_t err;
-  int ret;
-  ssh_control_file_t cf = NULL;
+  unsigned int cardcounter;
+  gcry_sexp_t key_public;
   char *cardsn;
-  gpg_error_t ret_err;
-
-  (void)request;
+  estream_t blobstream;
+  void *blob;
+  size_t bloblen;
+  unsigned int generation;
 
-  /* Prepare buffer stream.  */
+  *r_count = 0;
 
-  key_secret = NULL;
-  key_public = NULL;
-  key_counter = 0;
-  err = 0;
+  cardcounter = get_card_eventcounter ();
+  generation = card_identity_cache.generation;
+  if (card_identity_cache.valid
+      && card_identity_cache.cardcounter == cardcounter)
+    {
+      if (!card_identity_cache.blob)
+        return 0;
+      err = stream_write_data (stream, card_identity_cache.blob,
+                               card_identity_cache.bloblen);
+      if (!err)
+        *r_count = 1;
+      return err;
+    }
 
-  key_blobs = es_fopenmem (0, "r+b");
-  if (! key_blobs)
+  err = card_key_available (ctrl, &key_public, &cardsn);
+  if (err)
     {
-      err = gpg_error_from_syserror ();
-      goto out;
+      /* Remember that there is no card or no reader but do not cache
+         other, possible transient, errors.  */
+      if ((gpg_err_code (err) == GPG_ERR_CARD_NOT_PRESENT
+           || gpg_err_code (err) == GPG_ERR_ENODEV)
+          && card_identity_cache.generation == generation)
+        {
+          es_free (card_identity_cache.blob);
+          card_identity_cache.blob = NULL;
+          card_identity_cache.bloblen = 0;
+          card_identity_cache.cardcounter = cardcounter;
+          card_identity_cache.valid = 1;
+        }
+      return 0;
     }
 
-  /* First check whether a key is currently available in the card
-     reader - this should be allowed even without being listed in
-     sshcontrol. */
+  blobstream = es_fopenmem (0, "r+b");
+  if (!blobstream)
+    err = gpg_error_from_syserror ();
+  else
+    err = ssh_send_key_public (blobstream, key_public, cardsn);
+  gcry_sexp_release (key_public);
+  xfree (cardsn);
+  if (err)
+    {
+      es_fclose (blobstream);
+      return err;
+    }
+  if (es_fclose_snatch (blobstream, &blob, &bloblen))
+    return gpg_error_from_syserror ();
 
-  if (!opt.disable_scdaemon
-      && !card_key_available (ctrl, &key_public, &cardsn))
+  err = stream_write_data (stream, blob, bloblen);
+  if (err)
     {
-      err = ssh_send_key_public (key_blobs, key_public, cardsn);
-      gcry_sexp_release (key_public);
-      key_public = NULL;
-      xfree (cardsn);
-      if (err)
-        goto out;
+      es_free (blob);
+      return err;
+    }
+  *r_count = 1;
 
-      key_counter++;
+  if (card_identity_cache.generation != generation)
+    {
+      es_free (blob);
+      return 0;
     }
+  es_free (card_identity_cache.blob);
+  card_identity_cache.blob = blob;
+  card_identity_cache.bloblen = bloblen;
+  card_identity_cache.cardcounter = cardcounter;
+  card_identity_cache.valid = 1;
+
+  return 0;
+}
+
+
+/* Write the public keys of all registered and non-disabled keys from
+   the sshcontrol file to STREAM and store the number of written keys
+   at R_COUNT.  */
+static gpg_error_t
+control_file_identities (estream_t stream, u32 *r_count)
+{
+  ssh_key_type_spec_t spec;
+  char *key_fname = NULL;
+  char *fnameptr;
+  gcry_sexp_t key_secret = NULL;
+  ssh_control_file_t cf = NULL;
+  gpg_error_t err;
 
+  *r_count = 0;
 
   /* Prepare buffer for key name construction.  */
   {
@@ -2695,16 +2853,143 @@ ssh_handler_request_identities (ctrl_t ctrl,
           goto out;
       }
 
-      err = ssh_send_key_public (key_blobs, key_secret, NULL);
+      err = ssh_send_key_public (stream, key_secret, NULL);
       if (err)
         goto out;
       gcry_sexp_release (key_secret);
       key_secret = NULL;
 
-      key_counter++;
+      (*r_count)++;
     }
   err = 0;
 
+ out:
+  gcry_sexp_release (key_secret);
+  close_control_file (cf);
+  xfree (key_fname);
+  return err;
+}
+
+
+/* Write the public keys of all keys listed in sshcontrol to STREAM
+   and store their number at R_COUNT.  This is the cached version of
+   control_file_identities: The list is only rebuilt if the sshcontrol
+   file, the private key directory, or the set of private keys managed
+   by the agent have changed.  */
+static gpg_error_t
+cached_control_file_identities (estream_t stream, u32 *r_count)
+{
+  gpg_error_t err;
+  struct ssh_identity_stamp_s stamp;
+  int stamp_okay;
+  estream_t blobstream;
+  void *blobs;
+  size_t blobslen;
+  u32 count;
+
+  *r_count = 0;
+
+  stamp_okay = get_identity_stamp (&stamp);
+  if (stamp_okay && identity_cache.valid
+      && identity_stamp_equal (&stamp, &identity_cache.stamp))
+    {
+      if (identity_cache.blobslen)
+        {
+          err = stream_write_data (stream, identity_cache.blobs,
+                                   identity_cache.blobslen);
+          if (err)
+            return err;
+        }
+      *r_count = identity_cache.count;
+      return 0;
+    }
+
+  blobstream = es_fopenmem (0, "r+b");
+  if (!blobstream)
+    return gpg_error_from_syserror ();
+  err = control_file_identities (blobstream, &count);
+  if (err)
+    {
+      es_fclose (blobstream);
+      return err;
+    }
+  if (es_fclose_snatch (blobstream, &blobs, &blobslen))
+    return gpg_error_from_syserror ();
+
+  if (blobslen)
+    {
+      err = stream_write_data (stream, blobs, blobslen);
+      if (err)
+        {
+          es_free (blobs);
+          return err;
+        }
+    }
+  *r_count = count;
+
+  /* Do not cache the list if one of the files has been modified
+     within the current second: A change later in the same second
+     would not be detected by comparing the time stamps.  */
+  if (stamp_okay
+      && stamp.ctl_mtime < stamp.now && stamp.dir_mtime < stamp.now)
+    {
+      es_free (identity_cache.blobs);
+      identity_cache.blobs = blobs;
+      identity_cache.blobslen = blobslen;
+      identity_cache.count = count;
+      identity_cache.stamp = stamp;
+      identity_cache.valid = 1;
+    }
+  else
+    es_free (blobs);
+
+  return 0;
+}
+
+
+/* Handler for the "request_identities" command.  */
+static gpg_error_t
+ssh_handler_request_identities (ctrl_t ctrl,
+                                estream_t request, estream_t response)
+{
+  u32 key_counter;
+  u32 count;
+  estream_t key_blobs;
+  gpg_error_t err;
+  int ret;
+  gpg_error_t ret_err;
+
+  (void)request;
+
+  /* Prepare buffer stream.  */
+
+  key_counter = 0;
+  err = 0;
+
+  key_blobs = es_fopenmem (0, "r+b");
+  if (! key_blobs)
+    {
+      err = gpg_error_from_syserror ();
+      goto out;
+    }
+
+  /* First check whether a key is currently available in the card
+     reader - this should be allowed even without being listed in
+     sshcontrol. */
+  if (!opt.disable_scdaemon)
+    {
+      err = card_identity (ctrl, key_blobs, &count);
+      if (err)
+        goto out;
+      key_counter += count;
+    }
+
+  /* Then look at all the registered and non-disabled keys. */
+  err = cached_control_file_identities (key_blobs, &count);
+  if (err)
+    goto out;
+  key_counter += count;
+
   ret = es_fseek (key_blobs, 0, SEEK_SET);
   if (ret)
     {
@@ -2715,9 +3000,6 @@ ssh_handler_request_identities (ctrl_t ctrl,
  out:
   /* Send response.  */
 
-  gcry_sexp_release (key_secret);
-  gcry_sexp_release (key_public);
-
   if (!err)
     {
       ret_err = stream_write_byte (response, SSH_RESPONSE_IDENTITIES_ANSWER);
@@ -2732,8 +3014,6 @@ ssh_handler_request_identities (ctrl_t ctrl,
     }
 
   es_fclose (key_blobs);
-  close_control_file (cf);
-  xfree (key_fname);
 
   return ret_err;
 }
@@ -82,6 +82,10 @@ struct server_local_s
   /* Flags to suppress I/O logging during a command.  */
   int pause_io_logging;
 
+  /* The time the current command has been received or 0 if no
+     command is being processed.  */
+  unsigned long long cmd_start;
+
   /* If this flags is set to true the agent will be terminated after
      the end of the current session.  */
   int stopme;
@@ -532,6 +536,23 @@ bump_card_eventcounter (void)
 }
 
 
+/* Return the current value of the key event counter.  This is used
+   by modules which cache data derived from the private key store.  */
+unsigned int
+get_key_eventcounter (void)
+{
+  return eventcounter.key;
+}
+
+
+/* Return the current value of the card event counter.  */
+unsigned int
+get_card_eventcounter (void)
+{
+  return eventcounter.card;
+}
+
+
 
 
 static const char hlp_istrusted[] =
@@ -1597,6 +1618,7 @@ cmd_learn (assuan_context_t ctx, char *line)
   int rc;
 
   rc = agent_handle_learn (ctrl, has_option (line, "--send")? ctx : NULL);
+  ssh_clear_card_identity_cache ();
   return leave_cmd (ctx, rc);
 }
 
@@ -1850,6 +1872,12 @@ cmd_scd (assuan_context_t ctx, char *line)
 
   rc = divert_generic_cmd (ctrl, line, ctx);
 
+  /* These commands may change the keys on the card.  */
+  if (has_leading_keyword (line, "GENKEY")
+      || has_leading_keyword (line, "LEARN")
+      || has_leading_keyword (line, "WRITEKEY"))
+    ssh_clear_card_identity_cache ();
+
   return rc;
 }
 
@@ -2369,6 +2397,7 @@ cmd_keytocard (assuan_context_t ctx, char *line)
   snprintf (keydata+keydatalen-1, 30, "(10:created-at10:%010lu))", timestamp);
   keydatalen += 10 + 19 - 1;
   err = divert_writekey (ctrl, force, serialno, id, keydata, keydatalen);
+  ssh_clear_card_identity_cache ();
   if (err)
     {
       xfree (keydata);
@@ -2648,6 +2677,7 @@ static const char hlp_getinfo[] =
   "  ssh_socket_name - Return the name of the ssh socket.\n"
   "  scd_running - Return OK if the SCdaemon is already running.\n"
   "  s2k_count   - Return the calibrated S2K count.\n"
+  "  stats       - Return operation statistics.\n"
   "  std_session_env - List the standard session environment.\n"
   "  std_startup_env - List the standard startup environment.\n"
   "  cmd_has_option\n"
@@ -2699,6 +2729,27 @@ cmd_getinfo (assuan_context_t ctx, char *line)
       snprintf (numbuf, sizeof numbuf, "%lu", get_standard_s2k_count ());
       rc = assuan_send_data (ctx, numbuf, strlen (numbuf));
     }
+  else if (!strcmp (line, "stats"))
+    {
+      estream_t fp;
+      void *buf;
+      size_t buflen;
+
+      fp = es_fopenmem (0, "w+b");
+      if (!fp)
+        rc = gpg_error_from_syserror ();
+      else
+        {
+          stats_print (fp);
+          if (es_fclose_snatch (fp, &buf, &buflen))
+            rc = gpg_error_from_syserror ();
+          else
+            {
+              rc = assuan_send_data (ctx, buf, buflen);
+              es_free (buf);
+            }
+        }
+    }
   else if (!strcmp (line, "std_session_env")
            || !strcmp (line, "std_startup_env"))
     {
@@ -2875,13 +2926,21 @@ post_cmd_notify (assuan_context_t ctx, gpg_error_t err)
 
   /* Switch off any I/O monitor controlled logging pausing. */
   ctrl->server_local->pause_io_logging = 0;
+
+  if (ctrl->server_local->cmd_start)
+    {
+      stats_note_command (assuan_get_command_name (ctx),
+                          ctrl->server_local->cmd_start);
+      ctrl->server_local->cmd_start = 0;
+    }
 }
 
 
 /* This function is called by libassuan for all I/O.  We use it here
    to disable logging for the GETEVENTCOUNTER commands.  This is so
    that the debug output won't get cluttered by this primitive
-   command.  */
+   command.  It is also used to take the start time of a command for
+   the statistics.  */
 static unsigned int
 io_monitor (assuan_context_t ctx, void *hook, int direction,
             const char *line, size_t linelen)
@@ -2890,6 +2949,12 @@ io_monitor (assuan_context_t ctx, void *hook, int direction,
 
   (void) hook;
 
+  /* The first line received while no command is active is a new
+     command; lines received later are responses to inquiries.  */
+  if (ctx && direction == ASSUAN_IO_FROM_PEER
+      && !ctrl->server_local->cmd_start)
+    ctrl->server_local->cmd_start = stats_now ();
+
   /* Note that we only check for the uppercase name.  This allows to
      see the logging for debugging if using a non-upercase command
      name. */
@@ -543,6 +543,7 @@ read_key_file (const unsigned char *grip, gcry_sexp_t *result)
       xfree (fname);
       return rc;
     }
+  stats_note_key_file_read ();
 
   if (fstat (es_fileno (fp), &st))
     {
@@ -607,6 +608,8 @@ remove_key_file (const unsigned char *grip)
   fname = make_filename (opt.homedir, GNUPG_PRIVATE_KEYS_DIR, hexgrip, NULL);
   if (gnupg_remove (fname))
     err = gpg_error_from_syserror ();
+  else
+    bump_key_eventcounter ();
   xfree (fname);
   return err;
 }
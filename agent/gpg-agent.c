@@ -110,6 +110,7 @@ enum cmd_and_opt_values
   oCheckPassphrasePattern,
   oMaxPassphraseDays,
   oEnablePassphraseHistory,
+  oS2KCount,
   oUseStandardSocket,
   oNoUseStandardSocket,
   oFakedSystemTime,
@@ -125,6 +126,8 @@ enum cmd_and_opt_values
   oPuttySupport,
   oDisableScdaemon,
   oDisableCheckOwnSocket,
+  oListenBacklog,
+  oMaxConnections,
   oWriteEnvFile
 };
 
@@ -161,6 +164,8 @@ static ARGPARSE_OPTS opts[] = {
                                N_("|PGM|use PGM as the SCdaemon program") },
   { oDisableScdaemon, "disable-scdaemon", 0, N_("do not use the SCdaemon") },
   { oDisableCheckOwnSocket, "disable-check-own-socket", 0, "@" },
+  { oListenBacklog, "listen-backlog", 1, "@" },
+  { oMaxConnections, "max-connections", 1, "@" },
   { oFakedSystemTime, "faked-system-time", 2, "@" }, /* (epoch time) */
 
   { oBatch,      "batch",       0, "@" },
@@ -188,6 +193,7 @@ static ARGPARSE_OPTS opts[] = {
   { oCheckPassphrasePattern, "check-passphrase-pattern", 2, "@" },
   { oMaxPassphraseDays, "max-passphrase-days", 4, "@" },
   { oEnablePassphraseHistory, "enable-passphrase-history", 0, "@" },
+  { oS2KCount, "s2k-count", 4, "@" },
 
   { oIgnoreCacheForSigning, "ignore-cache-for-signing", 0,
                                N_("do not use the PIN cache when signing")},
@@ -218,6 +224,7 @@ static ARGPARSE_OPTS opts[] = {
 #define MIN_PASSPHRASE_LEN    (8)
 #define MIN_PASSPHRASE_NONALPHA (1)
 #define MAX_PASSPHRASE_DAYS   (0)
+#define DEFAULT_LISTEN_BACKLOG (64)
 
 /* The timer tick used for housekeeping stuff.  For Windows we use a
    longer period as the SetWaitableTimer seems to signal earlier than
@@ -266,6 +273,14 @@ static int check_own_socket_running;
 /* Flags to indicate that check_own_socket shall not be called.  */
 static int disable_check_own_socket;
 
+/* The size of the queue for pending connections on our sockets.  */
+static int listen_backlog = DEFAULT_LISTEN_BACKLOG;
+
+/* The maximum number of concurrent connections or 0 for no limit.
+   If this number is reached, new connections are left in the listen
+   queue until an active connection terminates.  */
+static int max_connections;
+
 /* It is possible that we are currently running under setuid permissions */
 static int maybe_setuid = 1;
 
@@ -307,6 +322,11 @@ static pid_t parent_pid = (pid_t)(-1);
 /* Number of active connections.  */
 static int active_connections;
 
+/* Number of connection threads; only used to enforce MAX_CONNECTIONS.
+   This is not the same as ACTIVE_CONNECTIONS, which is used by the
+   shutdown logic.  */
+static int open_connections;
+
 
 /*
    Local prototypes.
@@ -522,6 +542,7 @@ parse_rereadable_options (ARGPARSE_ARGS *pargs, int reread)
       opt.check_passphrase_pattern = NULL;
       opt.max_passphrase_days = MAX_PASSPHRASE_DAYS;
       opt.enable_passhrase_history = 0;
+      opt.s2k_count = 0;
       opt.ignore_cache_for_signing = 0;
       opt.allow_mark_trusted = 1;
       opt.disable_scdaemon = 0;
@@ -580,6 +601,8 @@ parse_rereadable_options (ARGPARSE_ARGS *pargs, int reread)
       opt.enable_passhrase_history = 1;
       break;
 
+    case oS2KCount: opt.s2k_count = pargs->r.ret_ulong; break;
+
     case oIgnoreCacheForSigning: opt.ignore_cache_for_signing = 1; break;
 
     case oAllowMarkTrusted: opt.allow_mark_trusted = 1; break;
@@ -847,6 +870,17 @@ main (int argc, char **argv )
 #        endif
           break;
 
+        case oListenBacklog:
+          listen_backlog = pargs.r.ret_int;
+          if (listen_backlog < 1)
+            listen_backlog = 1;
+          break;
+        case oMaxConnections:
+          max_connections = pargs.r.ret_int;
+          if (max_connections < 0)
+            max_connections = 0;
+          break;
+
         case oWriteEnvFile: /* dummy */ break;
 
         default : pargs.err = configfp? 1:2; break;
@@ -1543,7 +1577,7 @@ create_server_socket (char *name, int is_ssh, assuan_sock_nonce_t *nonce)
       agent_exit (2);
     }
 
-  if (listen (FD2INT(fd), 5 ) == -1)
+  if (listen (FD2INT(fd), listen_backlog) == -1)
     {
       log_error (_("listen() failed: %s\n"), strerror (errno));
       assuan_sock_close (fd);
@@ -1726,6 +1760,11 @@ handle_signal (int signo)
       agent_sigusr2_action ();
       break;
 
+    case SIGCONT:
+      /* Used by connection_terminated to wake up the main loop;
+         nothing else to do.  */
+      break;
+
     case SIGTERM:
       if (!shutdown_pending)
         log_info ("SIGTERM received - shutting down ...\n");
@@ -1963,6 +2002,21 @@ putty_message_thread (void *arg)
 #endif /*HAVE_W32_SYSTEM*/
 
 
+/* This function needs to be called by the connection threads right
+   before they terminate.  If the connection limit had been reached,
+   the main loop is not anymore waiting for new connections; thus we
+   wake it up.  */
+static void
+connection_terminated (void)
+{
+  open_connections--;
+#ifndef HAVE_W32_SYSTEM
+  if (max_connections && open_connections + 1 >= max_connections)
+    kill (getpid (), SIGCONT);
+#endif
+}
+
+
 /* This is the standard connection thread's main function.  */
 static void *
 start_connection_thread (void *arg)
@@ -1973,6 +2027,7 @@ start_connection_thread (void *arg)
     {
       log_error ("handler 0x%lx nonce check FAILED\n",
                  (unsigned long) npth_self());
+      connection_terminated ();
       return NULL;
     }
 
@@ -1988,6 +2043,7 @@ start_connection_thread (void *arg)
 
   agent_deinit_default_ctrl (ctrl);
   xfree (ctrl);
+  connection_terminated ();
   return NULL;
 }
 
@@ -1999,7 +2055,10 @@ start_connection_thread_ssh (void *arg)
   ctrl_t ctrl = arg;
 
   if (check_nonce (ctrl, &socket_nonce_ssh))
-    return NULL;
+    {
+      connection_terminated ();
+      return NULL;
+    }
 
   agent_init_default_ctrl (ctrl);
   if (opt.verbose)
@@ -2013,6 +2072,7 @@ start_connection_thread_ssh (void *arg)
 
   agent_deinit_default_ctrl (ctrl);
   xfree (ctrl);
+  connection_terminated ();
   return NULL;
 }
 
@@ -2049,6 +2109,7 @@ handle_connections (gnupg_fd_t listen_fd, gnupg_fd_t listen_fd_ssh)
   npth_sigev_add (SIGHUP);
   npth_sigev_add (SIGUSR1);
   npth_sigev_add (SIGUSR2);
+  npth_sigev_add (SIGCONT);
   npth_sigev_add (SIGINT);
   npth_sigev_add (SIGTERM);
   npth_sigev_fini ();
@@ -2110,8 +2171,14 @@ handle_connections (gnupg_fd_t listen_fd, gnupg_fd_t listen_fd_ssh)
 	}
 
       /* POSIX says that fd_set should be implemented as a structure,
-         thus a simple assignment is fine to copy the entire set.  */
-      read_fdset = fdset;
+         thus a simple assignment is fine to copy the entire set.  If
+         the connection limit has been reached we do not watch the
+         listening sockets; the pending connections are kept in the
+         listen queue until an active connection terminates.  */
+      if (max_connections && open_connections >= max_connections)
+        FD_ZERO (&read_fdset);
+      else
+        read_fdset = fdset;
 
       npth_clock_gettime (&curtime);
       if (!(npth_timercmp (&curtime, &abstime, <)))
@@ -2184,12 +2251,14 @@ handle_connections (gnupg_fd_t listen_fd, gnupg_fd_t listen_fd_ssh)
 	      npth_t thread;
 
               ctrl->thread_startup.fd = fd;
+              open_connections++;
 	      ret = npth_create (&thread, &tattr,
                                  start_connection_thread, ctrl);
               if (ret)
                 {
                   log_error ("error spawning connection handler: %s\n",
 			     strerror (ret));
+                  open_connections--;
                   assuan_sock_close (fd);
                   xfree (ctrl);
                 }
@@ -2229,12 +2298,14 @@ handle_connections (gnupg_fd_t listen_fd, gnupg_fd_t listen_fd_ssh)
 
               agent_init_default_ctrl (ctrl);
               ctrl->thread_startup.fd = fd;
+              open_connections++;
               ret = npth_create (&thread, &tattr,
                                  start_connection_thread_ssh, ctrl);
 	      if (ret)
                 {
                   log_error ("error spawning ssh connection handler: %s\n",
 			     strerror (ret));
+                  open_connections--;
                   assuan_sock_close (fd);
                   xfree (ctrl);
                 }
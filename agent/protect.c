@@ -27,6 +27,7 @@
 #include <ctype.h>
 #include <assert.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/stat.h>
 #ifdef HAVE_W32_SYSTEM
 # ifdef HAVE_WINSOCK2_H
@@ -37,6 +38,14 @@
 # include <sys/times.h>
 #endif
 
+#ifdef WITHOUT_NPTH /* Give the Makefile a chance to build without Pth.  */
+# undef USE_NPTH
+#endif
+
+#ifdef USE_NPTH
+# include <npth.h>
+#endif
+
 #include "agent.h"
 
 #include "cvt-openpgp.h"
@@ -75,6 +84,8 @@ struct calibrate_time_s
 {
 #ifdef HAVE_W32_SYSTEM
   FILETIME creation_time, exit_time, kernel_time, user_time;
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_THREAD_CPUTIME_ID)
+  struct timespec ts;
 #else
   clock_t ticks;
 #endif
@@ -88,6 +99,14 @@ hash_passphrase (const char *passphrase, int hashalgo,
                  unsigned char *key, size_t keylen);
 
 
+/* Statistics about the S2K computations.  */
+static struct
+{
+  unsigned long count;       /* Number of S2K computations.  */
+  unsigned long long usec;   /* CPU time used for them.  */
+} s2k_stats;
+
+
 
 /* Get the process time and store it in DATA.  */
 static void
@@ -101,6 +120,11 @@ calibrate_get_time (struct calibrate_time_s *data)
 # endif
                    &data->creation_time, &data->exit_time,
                    &data->kernel_time, &data->user_time);
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_THREAD_CPUTIME_ID)
+  /* Other threads may run S2K computations at the same time; thus we
+     need to measure only the time used by this thread.  */
+  if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &data->ts))
+    data->ts.tv_sec = data->ts.tv_nsec = 0;
 #else
   struct tms tmp;
 
@@ -110,6 +134,7 @@ calibrate_get_time (struct calibrate_time_s *data)
 }
 
 
+/* Return the time elapsed since STARTTIME in microseconds.  */
 static unsigned long
 calibrate_elapsed_time (struct calibrate_time_s *starttime)
 {
@@ -128,11 +153,15 @@ calibrate_elapsed_time (struct calibrate_time_s *starttime)
           + stoptime.kernel_time.dwLowDateTime);
     t2 += (((unsigned long long)stoptime.user_time.dwHighDateTime << 32)
            + stoptime.user_time.dwLowDateTime);
-    return (unsigned long)((t2 - t1)/10000);
+    return (unsigned long)((t2 - t1)/10);
   }
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_THREAD_CPUTIME_ID)
+  return (unsigned long)((stoptime.ts.tv_sec - starttime->ts.tv_sec) * 1000000
+                         + (stoptime.ts.tv_nsec / 1000)
+                         - (starttime->ts.tv_nsec / 1000));
 #else
   return (unsigned long)((((double) (stoptime.ticks - starttime->ticks))
-                          /CLOCKS_PER_SEC)*10000000);
+                          /CLOCKS_PER_SEC)*10000000000.0);
 #endif
 }
 
@@ -151,7 +180,7 @@ calibrate_s2k_count_one (unsigned long count)
                         3, "saltsalt", count, keybuf, sizeof keybuf);
   if (rc)
     BUG ();
-  return calibrate_elapsed_time (&starttime);
+  return calibrate_elapsed_time (&starttime) / 1000;
 }
 
 
@@ -189,12 +218,17 @@ calibrate_s2k_count (void)
 
 
 
-/* Return the standard S2K count.  */
+/* Return the standard S2K count.  If the count has been configured
+   using --s2k-count that value is used instead of running the
+   calibration.  */
 unsigned long
 get_standard_s2k_count (void)
 {
   static unsigned long count;
 
+  if (opt.s2k_count)
+    return opt.s2k_count < 65536 ? 65536 : opt.s2k_count;
+
   if (!count)
     count = calibrate_s2k_count ();
 
@@ -203,6 +237,16 @@ get_standard_s2k_count (void)
 }
 
 
+/* Store the number of S2K computations done so far at R_COUNT and
+   the CPU time used for them in microseconds at R_USEC.  */
+void
+get_s2k_stats (unsigned long *r_count, unsigned long long *r_usec)
+{
+  *r_count = s2k_stats.count;
+  *r_usec = s2k_stats.usec;
+}
+
+
 /* Same as get_standard_s2k_count but return the count in the encoding
    as described by rfc4880.  */
 unsigned char
@@ -1144,14 +1188,34 @@ hash_passphrase (const char *passphrase, int hashalgo,
   /* The key derive function does not support a zero length string for
      the passphrase in the S2K modes.  Return a better suited error
      code than GPG_ERR_INV_DATA.  */
+  gpg_error_t err;
+  struct calibrate_time_s starttime;
+
   if (!passphrase || !*passphrase)
     return gpg_error (GPG_ERR_NO_PASSPHRASE);
-  return gcry_kdf_derive (passphrase, strlen (passphrase),
-                          s2kmode == 3? GCRY_KDF_ITERSALTED_S2K :
-                          s2kmode == 1? GCRY_KDF_SALTED_S2K :
-                          s2kmode == 0? GCRY_KDF_SIMPLE_S2K : GCRY_KDF_NONE,
-                          hashalgo, s2ksalt, 8, s2kcount,
-                          keylen, key);
+
+  calibrate_get_time (&starttime);
+
+#ifdef USE_NPTH
+  /* The iterated S2K is the most expensive part of protecting or
+     unprotecting a key.  Libgcrypt is thread-safe and thus we release
+     the global lock while hashing so that other connections (for
+     example several concurrent IMPORT_KEY commands) are able to run
+     on other CPU cores.  */
+  npth_unprotect ();
+#endif
+  err = gcry_kdf_derive (passphrase, strlen (passphrase),
+                         s2kmode == 3? GCRY_KDF_ITERSALTED_S2K :
+                         s2kmode == 1? GCRY_KDF_SALTED_S2K :
+                         s2kmode == 0? GCRY_KDF_SIMPLE_S2K : GCRY_KDF_NONE,
+                         hashalgo, s2ksalt, 8, s2kcount,
+                         keylen, key);
+#ifdef USE_NPTH
+  npth_protect ();
+#endif
+  s2k_stats.count++;
+  s2k_stats.usec += calibrate_elapsed_time (&starttime);
+  return err;
 }
 
 
@@ -0,0 +1,212 @@
+/* stats.c - Operational statistics for gpg-agent
+ * Copyright (C) 2014 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This module collects counters and latency histograms which may be
+   retrieved using "GETINFO stats".  All functions are called with the
+   nPth lock held and are assured not to do any context switches;
+   thus no extra locking is required.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <npth.h>
+
+#include "agent.h"
+
+/* The upper limits in microseconds of the buckets of the latency
+   histograms.  The last bucket takes all larger values.  */
+static const unsigned long histogram_limits[] =
+  { 1000, 10000, 100000, 1000000, 10000000 };
+#define N_BUCKETS (DIM (histogram_limits) + 1)
+
+/* A latency histogram.  */
+struct histogram_s
+{
+  unsigned long count;         /* Number of recorded events.  */
+  unsigned long long usec;     /* Total time of all events.  */
+  unsigned long bucket[N_BUCKETS];
+};
+
+/* Statistics for one Assuan command.  */
+struct command_stats_s
+{
+  char name[24];               /* The command name.  */
+  struct histogram_s hist;
+};
+
+/* The maximum number of different commands we keep track of.  This is
+   larger than the number of commands gpg-agent implements.  */
+#define MAX_COMMANDS 64
+
+static struct command_stats_s command_stats[MAX_COMMANDS];
+static int n_command_stats;
+
+/* The scdaemon round-trip times.  */
+static struct histogram_s scd_stats;
+
+/* Passphrase cache hits and misses.  */
+static unsigned long cache_hits;
+static unsigned long cache_misses;
+
+/* Number of private key files read.  */
+static unsigned long key_file_reads;
+
+
+
+/* Return the current time in microseconds.  */
+unsigned long long
+stats_now (void)
+{
+  struct timespec ts;
+
+  npth_clock_gettime (&ts);
+  return ((unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+
+/* Return the number of microseconds elapsed since START which must
+   have been taken using stats_now.  */
+static unsigned long
+elapsed_since (unsigned long long start)
+{
+  unsigned long long now = stats_now ();
+
+  /* The clock may have been set back.  */
+  return now > start? (unsigned long)(now - start) : 0;
+}
+
+
+static void
+histogram_add (struct histogram_s *hist, unsigned long usec)
+{
+  int i;
+
+  for (i=0; i < DIM (histogram_limits); i++)
+    if (usec < histogram_limits[i])
+      break;
+  hist->bucket[i]++;
+  hist->count++;
+  hist->usec += usec;
+}
+
+
+/* Print the histogram HIST to FP.  */
+static void
+histogram_print (estream_t fp, struct histogram_s *hist)
+{
+  int i;
+
+  es_fprintf (fp, " %lu %llu", hist->count, hist->usec / 1000);
+  for (i=0; i < N_BUCKETS; i++)
+    es_fprintf (fp, " %lu", hist->bucket[i]);
+}
+
+
+
+/* Record that the Assuan command NAME has been processed.  START is
+   the time the command was received.  */
+void
+stats_note_command (const char *name, unsigned long long start)
+{
+  int i;
+
+  if (!name || !*name)
+    return;
+
+  for (i=0; i < n_command_stats; i++)
+    if (!strcmp (command_stats[i].name, name))
+      break;
+  if (i == n_command_stats)
+    {
+      if (n_command_stats == MAX_COMMANDS)
+        return;
+      n_command_stats++;
+      strncpy (command_stats[i].name, name, sizeof command_stats[i].name - 1);
+    }
+  histogram_add (&command_stats[i].hist, elapsed_since (start));
+}
+
+
+/* Record a lookup of the passphrase cache.  HIT is true if a
+   passphrase was found.  */
+void
+stats_note_cache (int hit)
+{
+  if (hit)
+    cache_hits++;
+  else
+    cache_misses++;
+}
+
+
+/* Record that a private key file has been read.  */
+void
+stats_note_key_file_read (void)
+{
+  key_file_reads++;
+}
+
+
+/* Record an operation with the scdaemon which was started at START.  */
+void
+stats_note_scd (unsigned long long start)
+{
+  histogram_add (&scd_stats, elapsed_since (start));
+}
+
+
+/* Write all statistics to FP.  Each line starts with a keyword
+   followed by space separated values.  Times are given in
+   milliseconds.  The lines are:
+
+     command NAME COUNT TIME H0 H1 H2 H3 H4 H5
+     scd COUNT TIME H0 H1 H2 H3 H4 H5
+     cache HITS MISSES
+     keyfile READS
+     s2k COUNT TIME
+
+   The Hn values are the histogram buckets for times less than 1ms,
+   10ms, 100ms, 1s, 10s and the rest.  The S2K time is the CPU time
+   spent in the S2K function.  */
+void
+stats_print (estream_t fp)
+{
+  int i;
+  unsigned long s2k_count;
+  unsigned long long s2k_usec;
+
+  for (i=0; i < n_command_stats; i++)
+    {
+      es_fprintf (fp, "command %s", command_stats[i].name);
+      histogram_print (fp, &command_stats[i].hist);
+      es_putc ('\n', fp);
+    }
+
+  es_fputs ("scd", fp);
+  histogram_print (fp, &scd_stats);
+  es_putc ('\n', fp);
+
+  es_fprintf (fp, "cache %lu %lu\n", cache_hits, cache_misses);
+  es_fprintf (fp, "keyfile %lu\n", key_file_reads);
+
+  get_s2k_stats (&s2k_count, &s2k_usec);
+  es_fprintf (fp, "s2k %lu %llu\n", s2k_count, s2k_usec / 1000);
+}
@@ -46,6 +46,9 @@
     under Windows.  This is useful if the socket layer has already
     been initialized elsewhere.  This also avoids the installation of
     an exit handler to cleanup the socket layer.
+
+  - With HTTP_TESTING hooks for the module test t-http-connect are
+    provided.
 */
 
 #ifdef HAVE_CONFIG_H
@@ -72,6 +75,7 @@
 # include <netinet/in.h>
 # include <arpa/inet.h>
 # include <netdb.h>
+# include <fcntl.h>
 #endif /*!HAVE_W32_SYSTEM*/
 
 #ifdef WITHOUT_NPTH /* Give the Makefile a chance to build without Pth.  */
@@ -223,6 +227,26 @@ struct cookie_s
      the content length.  */
   longcounter_t content_length;
   unsigned int content_length_valid:1;
+
+  /* True if the connection shall be put into the connection pool
+     after the entire body has been read.  */
+  unsigned int keep_alive:1;
+
+  /* True while reading the header of a keep-alive connection.  The
+     state of the scanner for the end of the header is kept in
+     HEADER_STATE.  */
+  unsigned int in_header:1;
+  int header_state;
+
+  /* The server and port used as key for the connection pool.  */
+  char *pool_host;
+  unsigned short pool_port;
+
+  /* True if data has been read from the connection.  */
+  unsigned int got_data:1;
+
+  /* If not NULL, a copy of all written data is stored there.  */
+  estream_t sent;
 };
 typedef struct cookie_s *cookie_t;
 
@@ -265,6 +289,9 @@ struct http_context_s
   my_socket_t sock;
   unsigned int in_data:1;
   unsigned int is_http_0_9:1;
+  unsigned int keepalive:1;  /* Ask the server to keep the connection.  */
+  estream_t sent;        /* Copy of the request sent over a connection
+                            taken from the pool or NULL.  */
   estream_t fp_read;
   estream_t fp_write;
   void *write_cookie;
@@ -286,6 +313,80 @@ static gpg_error_t (*tls_callback) (http_t, http_session_t, int);
 static strlist_t tls_ca_certlist;
 
 
+/* The maximum number of idle connections in the connection pool.  */
+#define CONNPOOL_SIZE      16
+
+/* The maximum number of idle connections to the same server.  */
+#define CONNPOOL_PER_HOST   4
+
+/* The number of seconds an idle connection is kept.  Servers usually
+   close idle connections after a few seconds, thus a larger value
+   would only waste file descriptors.  */
+#define CONNPOOL_IDLE_TIME  5
+
+/* The connection pool.  Plain HTTP connections for which the server
+   agreed to keep them open are stored here after the response has
+   been read and are then used for the next request to the same
+   server.  A connection is removed from the pool before it is used.
+   The pool functions only use a select with a zero timeout and close,
+   which do not release the nPth lock; thus no locking is required.  */
+static struct
+{
+  struct my_socket_s *sock;  /* NULL if the slot is not used.  */
+  char *host;                /* The server as used for connecting.  */
+  unsigned short port;
+  time_t idle_since;
+} connpool[CONNPOOL_SIZE];
+
+
+/* The number of seconds a resolved host name is kept in the DNS
+   cache.  The system resolver does not tell us the TTL of the DNS
+   records, thus we use a short fixed time.  */
+#define DNS_CACHE_TTL      300
+
+/* The number of seconds a name which does not exist is kept in the
+   DNS cache.  */
+#define DNS_CACHE_NEG_TTL   30
+
+/* The maximum number of entries in the DNS cache.  */
+#define DNS_CACHE_SIZE      64
+
+#ifdef HAVE_GETADDRINFO
+/* The DNS cache.  It is shared by all users of this module; for
+   example the HKP engine and the CRL and OCSP fetchers of dirmngr.
+   getaddrinfo is called without releasing the nPth lock, as it was
+   done before there was a cache.  Thus the slot selected in
+   http_getaddrinfo can't be taken by another thread while the name is
+   resolved and no locking is required.  */
+static struct
+{
+  char *name;            /* The host name or NULL if not used.  */
+  struct addrinfo *ai;   /* Our copy of the addresses or NULL.  */
+  int ec;                /* The error code from getaddrinfo.  */
+  time_t expires;        /* Do not use the entry after this time.  */
+} dns_cache[DNS_CACHE_SIZE];
+
+#ifdef HTTP_TESTING
+/* The resolver used by http_getaddrinfo; the test replaces it to
+   check the DNS cache.  */
+int (*_http_test_getaddrinfo) (const char *, const char *,
+                               const struct addrinfo *,
+                               struct addrinfo **) = getaddrinfo;
+# define my_getaddrinfo(a,b,c,d)  _http_test_getaddrinfo ((a),(b),(c),(d))
+#else
+# define my_getaddrinfo(a,b,c,d)  getaddrinfo ((a),(b),(c),(d))
+#endif
+#endif /*HAVE_GETADDRINFO*/
+
+/* The maximum number of addresses connect_server tries for one
+   host.  */
+#define MAX_CONNECT_ATTEMPTS  16
+
+/* The number of milliseconds to wait for a pending connection
+   attempt before the next address is tried as well (see RFC-8305).  */
+#define CONNECT_ATTEMPT_DELAY 250
+
+
 
 #if defined(HAVE_W32_SYSTEM) && !defined(HTTP_NO_WSASTARTUP)
 
@@ -396,6 +497,290 @@ _my_socket_unref (int lnr, my_socket_t so,
 #define my_socket_unref(a,b,c) _my_socket_unref (__LINE__,(a),(b),(c))
 
 
+/* Release the connection pool slot IDX.  */
+static void
+connpool_release (int idx)
+{
+  my_socket_unref (connpool[idx].sock, NULL, NULL);
+  connpool[idx].sock = NULL;
+  xfree (connpool[idx].host);
+  connpool[idx].host = NULL;
+}
+
+
+/* Close all idle connections which have been idle for too long.  */
+static void
+connpool_expire (void)
+{
+  time_t now = gnupg_get_time ();
+  int idx;
+
+  for (idx=0; idx < CONNPOOL_SIZE; idx++)
+    if (connpool[idx].sock
+        && (now < connpool[idx].idle_since
+            || now - connpool[idx].idle_since > CONNPOOL_IDLE_TIME))
+      connpool_release (idx);
+}
+
+
+/* Return true if the idle socket FD may still be used.  An idle
+   connection must not have any data to read; if it is readable the
+   server has closed it or sent garbage.  */
+static int
+connpool_check_idle (int fd)
+{
+  fd_set rfds;
+  struct timeval tv;
+
+#ifndef HAVE_W32_SYSTEM
+  if (fd >= FD_SETSIZE)
+    return 0;  /* Can't check it; open_read_stream won't pool it.  */
+#endif
+
+  FD_ZERO (&rfds);
+  FD_SET (fd, &rfds);
+  tv.tv_sec = 0;
+  tv.tv_usec = 0;
+  return !select (fd+1, &rfds, NULL, NULL, &tv);
+}
+
+
+/* Take an idle connection to SERVER and PORT from the pool.  Returns
+   the socket object or NULL if there is none.  */
+static my_socket_t
+connpool_get (const char *server, unsigned short port)
+{
+  my_socket_t so;
+  int idx;
+
+  connpool_expire ();
+  for (idx=0; idx < CONNPOOL_SIZE; idx++)
+    {
+      if (!connpool[idx].sock || connpool[idx].port != port
+          || strcmp (connpool[idx].host, server))
+        continue;
+      if (!connpool_check_idle (connpool[idx].sock->fd))
+        {
+          connpool_release (idx);
+          continue;
+        }
+      /* Transfer the reference to the caller.  */
+      so = connpool[idx].sock;
+      connpool[idx].sock = NULL;
+      xfree (connpool[idx].host);
+      connpool[idx].host = NULL;
+      return so;
+    }
+  return NULL;
+}
+
+
+/* Put the connection SO to SERVER and PORT into the pool.  */
+static void
+connpool_put (const char *server, unsigned short port, my_socket_t so)
+{
+  int idx, freeidx, count;
+
+  connpool_expire ();
+  freeidx = -1;
+  count = 0;
+  for (idx=0; idx < CONNPOOL_SIZE; idx++)
+    {
+      if (!connpool[idx].sock)
+        {
+          if (freeidx == -1)
+            freeidx = idx;
+        }
+      else if (connpool[idx].port == port
+               && !strcmp (connpool[idx].host, server))
+        count++;
+    }
+  if (freeidx == -1 || count >= CONNPOOL_PER_HOST)
+    return;
+
+  connpool[freeidx].host = xtrystrdup (server);
+  if (!connpool[freeidx].host)
+    return;
+  connpool[freeidx].sock = my_socket_ref (so);
+  connpool[freeidx].port = port;
+  connpool[freeidx].idle_since = gnupg_get_time ();
+}
+
+
+/* Close all idle connections of the connection pool.  */
+void
+http_connpool_flush (void)
+{
+  int idx;
+
+  for (idx=0; idx < CONNPOOL_SIZE; idx++)
+    if (connpool[idx].sock)
+      connpool_release (idx);
+}
+
+
+
+#ifdef HAVE_GETADDRINFO
+/* Release a list of addresses as returned by http_getaddrinfo.  */
+void
+http_freeaddrinfo (struct addrinfo *ai)
+{
+  struct addrinfo *next;
+
+  for (; ai; ai = next)
+    {
+      next = ai->ai_next;
+      xfree (ai->ai_canonname);
+      xfree (ai);
+    }
+}
+
+
+/* Store a copy of the address list AI at R_AI.  Returns 0 on success
+   or EAI_MEMORY.  */
+static int
+copy_addrinfo (const struct addrinfo *ai, struct addrinfo **r_ai)
+{
+  struct addrinfo *node, **tail;
+
+  *r_ai = NULL;
+  tail = r_ai;
+  for (; ai; ai = ai->ai_next)
+    {
+      /* The address is stored right after the node.  */
+      node = xtrycalloc (1, sizeof *node + ai->ai_addrlen);
+      if (!node)
+        goto oom;
+      node->ai_flags = ai->ai_flags;
+      node->ai_family = ai->ai_family;
+      node->ai_socktype = ai->ai_socktype;
+      node->ai_protocol = ai->ai_protocol;
+      node->ai_addrlen = ai->ai_addrlen;
+      node->ai_addr = (struct sockaddr *)(node + 1);
+      memcpy (node->ai_addr, ai->ai_addr, ai->ai_addrlen);
+      if (ai->ai_canonname
+          && !(node->ai_canonname = xtrystrdup (ai->ai_canonname)))
+        {
+          xfree (node);
+          goto oom;
+        }
+      *tail = node;
+      tail = &node->ai_next;
+    }
+  return 0;
+
+ oom:
+  http_freeaddrinfo (*r_ai);
+  *r_ai = NULL;
+  return EAI_MEMORY;
+}
+
+
+/* Release the DNS cache slot IDX.  */
+static void
+dns_cache_release (int idx)
+{
+  xfree (dns_cache[idx].name);
+  dns_cache[idx].name = NULL;
+  http_freeaddrinfo (dns_cache[idx].ai);
+  dns_cache[idx].ai = NULL;
+}
+
+
+/* Resolve the host NAME like getaddrinfo with the socket type
+   SOCK_STREAM and the flag AI_CANONNAME but use a cache.  On success
+   0 is returned and a list of addresses is stored at R_AI; the port
+   numbers of these addresses are not set.  The list must be released
+   with http_freeaddrinfo.  On error an EAI error code is returned.  */
+int
+http_getaddrinfo (const char *name, struct addrinfo **r_ai)
+{
+  struct addrinfo hints, *res;
+  time_t now = gnupg_get_time ();
+  int idx, freeidx, ec;
+
+  *r_ai = NULL;
+
+  freeidx = -1;
+  for (idx=0; idx < DNS_CACHE_SIZE; idx++)
+    {
+      if (dns_cache[idx].name
+          && (now < dns_cache[idx].expires - DNS_CACHE_TTL
+              || now > dns_cache[idx].expires))
+        dns_cache_release (idx);  /* Expired or clock set back.  */
+
+      if (!dns_cache[idx].name)
+        {
+          if (freeidx == -1 || dns_cache[freeidx].name)
+            freeidx = idx;
+        }
+      else if (!ascii_strcasecmp (dns_cache[idx].name, name))
+        {
+          if (dns_cache[idx].ec)
+            return dns_cache[idx].ec;
+          return copy_addrinfo (dns_cache[idx].ai, r_ai);
+        }
+      else if (freeidx == -1
+               || (dns_cache[freeidx].name
+                   && dns_cache[idx].expires < dns_cache[freeidx].expires))
+        freeidx = idx;  /* Candidate for replacement.  */
+    }
+
+  memset (&hints, 0, sizeof hints);
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_CANONNAME;
+  ec = my_getaddrinfo (name, NULL, &hints, &res);
+  if (ec && ec != EAI_NONAME)
+    return ec; /* Do not cache temporary errors.  */
+
+  if (dns_cache[freeidx].name)
+    dns_cache_release (freeidx);
+  dns_cache[freeidx].name = xtrystrdup (name);
+  if (!ec)
+    {
+      ec = copy_addrinfo (res, r_ai);
+      if (!ec && dns_cache[freeidx].name)
+        ec = copy_addrinfo (res, &dns_cache[freeidx].ai);
+      freeaddrinfo (res);
+      if (ec)
+        {
+          http_freeaddrinfo (*r_ai);
+          *r_ai = NULL;
+          dns_cache_release (freeidx);
+          return ec;
+        }
+      dns_cache[freeidx].ec = 0;
+      dns_cache[freeidx].expires = now + DNS_CACHE_TTL;
+    }
+  else
+    {
+      dns_cache[freeidx].ec = ec;
+      dns_cache[freeidx].expires = now + DNS_CACHE_NEG_TTL;
+    }
+  return ec;
+}
+
+
+/* Remove all entries from the DNS cache.  */
+void
+http_dns_cache_flush (void)
+{
+  int idx;
+
+  for (idx=0; idx < DNS_CACHE_SIZE; idx++)
+    if (dns_cache[idx].name)
+      dns_cache_release (idx);
+}
+#else /*!HAVE_GETADDRINFO*/
+/* Without getaddrinfo there is no DNS cache.  */
+void
+http_dns_cache_flush (void)
+{
+}
+#endif /*!HAVE_GETADDRINFO*/
+
+
 #if defined (USE_NPTH) && defined(HTTP_USE_GNUTLS)
 static ssize_t
 my_npth_read (gnutls_transport_ptr_t ptr, void *buffer, size_t size)
@@ -844,6 +1229,100 @@ http_start_data (http_t hd)
 }
 
 
+/* Create the cookie and the stream for reading the response.  */
+static gpg_error_t
+open_read_stream (http_t hd)
+{
+  gpg_error_t err;
+  cookie_t cookie;
+
+  cookie = xtrycalloc (1, sizeof *cookie);
+  if (!cookie)
+    return gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
+  cookie->sock = my_socket_ref (hd->sock);
+  cookie->session = http_session_ref (hd->session);
+  cookie->use_tls = hd->uri->use_tls;
+  /* A connection is only kept if we are able to select on it; see
+     connpool_check_idle and cookie_read.  */
+  if (hd->keepalive
+#ifndef HAVE_W32_SYSTEM
+      && hd->sock->fd < FD_SETSIZE
+#endif
+      )
+    {
+      cookie->pool_host = xtrystrdup (*hd->uri->host? hd->uri->host
+                                      /**/           : "localhost");
+      cookie->pool_port = hd->uri->port? hd->uri->port : 80;
+      if (cookie->pool_host)
+        cookie->keep_alive = cookie->in_header = 1;
+    }
+
+  hd->read_cookie = cookie;
+  hd->fp_read = es_fopencookie (cookie, "r", cookie_functions);
+  if (!hd->fp_read)
+    {
+      err = gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
+      my_socket_unref (cookie->sock, NULL, NULL);
+      http_session_unref (cookie->session);
+      xfree (cookie->pool_host);
+      xfree (cookie);
+      hd->read_cookie = NULL;
+      return err;
+    }
+  return 0;
+}
+
+
+/* Send the request recorded in HD->SENT again on a new connection.
+   This is used if a connection taken from the pool turned out to be
+   closed by the server.  */
+static gpg_error_t
+resend_request (http_t hd)
+{
+  gpg_error_t err;
+  void *data;
+  size_t datalen;
+  int sock;
+  int hnf;
+
+  es_fclose (hd->fp_read);
+  hd->fp_read = NULL;
+  hd->read_cookie = NULL;
+  my_socket_unref (hd->sock, NULL, NULL);
+  hd->sock = NULL;
+
+  if (es_fclose_snatch (hd->sent, &data, &datalen))
+    {
+      hd->sent = NULL;
+      return gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
+    }
+  hd->sent = NULL;
+
+  sock = connect_server (*hd->uri->host? hd->uri->host : "localhost",
+                         hd->uri->port? hd->uri->port : 80,
+                         hd->flags, NULL, &hnf);
+  if (sock == -1)
+    {
+      es_free (data);
+      return gpg_err_make (default_errsource,
+                           (hnf? GPG_ERR_UNKNOWN_HOST
+                               : gpg_err_code_from_syserror ()));
+    }
+  hd->sock = my_socket_new (sock);
+  if (!hd->sock)
+    {
+      err = gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
+      sock_close (sock);
+      es_free (data);
+      return err;
+    }
+
+  err = write_server (sock, data, datalen);
+  es_free (data);
+  return err;
+}
+
+
 gpg_error_t
 http_wait_response (http_t hd)
 {
@@ -871,27 +1350,29 @@ http_wait_response (http_t hd)
     shutdown (hd->sock->fd, 1);
   hd->in_data = 0;
 
-  /* Create a new cookie and a stream for reading.  */
-  cookie = xtrycalloc (1, sizeof *cookie);
-  if (!cookie)
-    return gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
-  cookie->sock = my_socket_ref (hd->sock);
-  cookie->session = http_session_ref (hd->session);
-  cookie->use_tls = hd->uri->use_tls;
+  err = open_read_stream (hd);
+  if (err)
+    return err;
 
-  hd->read_cookie = cookie;
-  hd->fp_read = es_fopencookie (cookie, "r", cookie_functions);
-  if (!hd->fp_read)
+  err = parse_response (hd);
+
+  /* A connection from the pool may have been closed by the server
+     before it received our request.  If nothing has been received
+     send the request again on a new connection.  */
+  cookie = hd->read_cookie;
+  if (err && hd->sent && !cookie->got_data)
     {
-      err = gpg_err_make (default_errsource, gpg_err_code_from_syserror ());
-      my_socket_unref (cookie->sock, NULL, NULL);
-      http_session_unref (cookie->session);
-      xfree (cookie);
-      hd->read_cookie = NULL;
-      return err;
+      err = resend_request (hd);
+      if (!err)
+        err = open_read_stream (hd);
+      if (!err)
+        err = parse_response (hd);
+    }
+  if (hd->sent)
+    {
+      es_fclose (hd->sent);
+      hd->sent = NULL;
     }
-
-  err = parse_response (hd);
 
   if (!err)
     err = es_onclose (hd->fp_read, 1, fp_onclose_notification, hd);
@@ -943,6 +1424,8 @@ http_close (http_t hd, int keep_read_stream)
     es_fclose (hd->fp_read);
   if (hd->fp_write)
     es_fclose (hd->fp_write);
+  if (hd->sent)
+    es_fclose (hd->sent);
   http_session_unref (hd->session);
   http_release_parsed_uri (hd->uri);
   while (hd->headers)
@@ -1504,7 +1987,23 @@ send_request (http_t hd, const char *httphost, const char *auth,
     }
   else
     {
-      sock = connect_server (server, port, hd->flags, srvtag, &hnf);
+      /* Connections are only kept for plain HTTP without a proxy.
+         For a connection from the pool the request is recorded so
+         that it can be sent again if the server has closed the
+         connection in the meantime; see http_wait_response.  */
+      if ((hd->flags & HTTP_FLAG_KEEPALIVE)
+          && !(hd->flags & HTTP_FLAG_SHUTDOWN)
+          && !hd->uri->use_tls && !srvtag)
+        {
+          hd->keepalive = 1;
+          hd->sock = connpool_get (server, port);
+          if (hd->sock)
+            hd->sent = es_fopenmem (0, "w+b");
+        }
+      if (hd->sock)
+        sock = hd->sock->fd;
+      else
+        sock = connect_server (server, port, hd->flags, srvtag, &hnf);
     }
 
   if (sock == -1)
@@ -1514,7 +2013,8 @@ send_request (http_t hd, const char *httphost, const char *auth,
                            (hnf? GPG_ERR_UNKNOWN_HOST
                                : gpg_err_code_from_syserror ()));
     }
-  hd->sock = my_socket_new (sock);
+  if (!hd->sock)
+    hd->sock = my_socket_new (sock);
   if (!hd->sock)
     {
       xfree (proxy_authstr);
@@ -1654,13 +2154,14 @@ send_request (http_t hd, const char *httphost, const char *auth,
         snprintf (portstr, sizeof portstr, ":%u", port);
 
       request = es_bsprintf
-        ("%s %s%s HTTP/1.0\r\nHost: %s%s\r\n%s",
+        ("%s %s%s HTTP/1.0\r\nHost: %s%s\r\n%s%s",
          hd->req_type == HTTP_REQ_GET ? "GET" :
          hd->req_type == HTTP_REQ_HEAD ? "HEAD" :
          hd->req_type == HTTP_REQ_POST ? "POST" : "OOPS",
          *p == '/' ? "" : "/", p,
          httphost? httphost : server,
          portstr,
+         hd->keepalive? "Connection: keep-alive\r\n":"",
          authstr? authstr:"");
     }
   xfree (p);
@@ -1689,6 +2190,7 @@ send_request (http_t hd, const char *httphost, const char *auth,
     hd->write_cookie = cookie;
     cookie->use_tls = hd->uri->use_tls;
     cookie->session = http_session_ref (hd->session);
+    cookie->sent = hd->sent;
 
     hd->fp_write = es_fopencookie (cookie, "w", cookie_functions);
     if (!hd->fp_write)
@@ -1934,6 +2436,11 @@ parse_response (http_t hd)
   size_t maxlen, len;
   cookie_t cookie = hd->read_cookie;
   const char *s;
+  int keep_alive, is_http_1_1;
+
+  /* The connection may only be kept if the response allows it.  */
+  keep_alive = cookie->keep_alive;
+  cookie->keep_alive = 0;
 
   /* Delete old header lines.  */
   while (hd->headers)
@@ -1966,7 +2473,10 @@ parse_response (http_t hd)
   if ((p = strchr (line, '/')))
     *p++ = 0;
   if (!p || strcmp (line, "HTTP"))
-    return 0; /* Assume http 0.9. */
+    {
+      cookie->in_header = 0;
+      return 0; /* Assume http 0.9. */
+    }
 
   if ((p2 = strpbrk (p, " \t")))
     {
@@ -1974,7 +2484,11 @@ parse_response (http_t hd)
       p2 += strspn (p2, " \t");
     }
   if (!p2)
-    return 0; /* Also assume http 0.9. */
+    {
+      cookie->in_header = 0;
+      return 0; /* Also assume http 0.9. */
+    }
+  is_http_1_1 = !strcmp (p, "1.1");
   p = p2;
   /* TODO: Add HTTP version number check. */
   if ((p2 = strpbrk (p, " \t")))
@@ -1983,6 +2497,7 @@ parse_response (http_t hd)
       || !isdigit ((unsigned int)p[2]) || p[3])
     {
       /* Malformed HTTP status code - assume http 0.9. */
+      cookie->in_header = 0;
       hd->is_http_0_9 = 1;
       hd->status_code = 200;
       return 0;
@@ -2026,6 +2541,16 @@ parse_response (http_t hd)
         }
     }
 
+  /* HTTP/1.1 keeps the connection by default; HTTP/1.0 servers need
+     to confirm it.  Without a content length we can't tell the end
+     of the body and thus the connection can't be reused.  */
+  if (keep_alive && cookie->content_length_valid && !cookie->in_header)
+    {
+      s = http_get_header (hd, "Connection");
+      if (s? !ascii_strcasecmp (s, "keep-alive") : is_http_1_1)
+        cookie->keep_alive = 1;
+    }
+
   return 0;
 }
 
@@ -2106,6 +2631,239 @@ start_server ()
 }
 #endif
 
+#ifdef HAVE_GETADDRINFO
+#ifndef HAVE_W32_SYSTEM
+/* Start a non-blocking connect to the address AI.  Returns the socket
+   or -1 on error with ERRNO set.  True is stored at R_CONNECTED if
+   the connection has already been established.  */
+static int
+start_connect (struct addrinfo *ai, int *r_connected)
+{
+  int sock, save_errno;
+
+  *r_connected = 0;
+  sock = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+  if (sock == -1)
+    {
+      save_errno = errno;
+      log_error ("error creating socket: %s\n", strerror (errno));
+      gpg_err_set_errno (save_errno);
+      return -1;
+    }
+
+  if (sock >= FD_SETSIZE)
+    {
+      /* We can't select on this socket; thus connect in the
+         traditional way.  */
+      if (my_connect (sock, ai->ai_addr, ai->ai_addrlen))
+        goto fail;
+      *r_connected = 1;
+      return sock;
+    }
+
+  if (fcntl (sock, F_SETFL, fcntl (sock, F_GETFL) | O_NONBLOCK) == -1)
+    goto fail;
+  if (!connect (sock, ai->ai_addr, ai->ai_addrlen))
+    *r_connected = 1;
+  else if (errno != EINPROGRESS)
+    goto fail;
+  return sock;
+
+ fail:
+  save_errno = errno;
+  sock_close (sock);
+  gpg_err_set_errno (save_errno);
+  return -1;
+}
+#endif /*!HAVE_W32_SYSTEM*/
+
+
+/* Connect to one of the addresses from the list AILIST using PORT.
+   As suggested by RFC-8305 the address families are alternated and a
+   new attempt is started every CONNECT_ATTEMPT_DELAY milliseconds
+   while earlier attempts are still pending.  Thus a dead address does
+   not delay the connection for the full TCP timeout.  The first
+   established connection is used.  Returns the socket or -1 with the
+   errno of the last failure stored at R_ERRNO.  */
+static int
+connect_addrlist (struct addrinfo *ailist, unsigned short port,
+                  unsigned int flags, int *r_errno)
+{
+  struct addrinfo *ai, *addrs[MAX_CONNECT_ATTEMPTS];
+  struct addrinfo *v6addrs[MAX_CONNECT_ATTEMPTS];
+  struct addrinfo *v4addrs[MAX_CONNECT_ATTEMPTS];
+  int n_v6, n_v4, naddrs, i, i6, i4;
+  int sock = -1;
+#ifndef HAVE_W32_SYSTEM
+  int socks[MAX_CONNECT_ATTEMPTS];
+  int nstarted, npending, connected, maxfd, n;
+  fd_set wfds;
+  struct timeval tv;
+  int soerr;
+  socklen_t soerrlen;
+#endif
+
+  /* Collect the usable addresses and set the port.  */
+  n_v6 = n_v4 = 0;
+  for (ai = ailist; ai; ai = ai->ai_next)
+    {
+      if (ai->ai_family == AF_INET6 && !(flags & HTTP_FLAG_IGNORE_IPv6))
+        {
+          if (n_v6 < DIM (v6addrs))
+            {
+              ((struct sockaddr_in6 *)ai->ai_addr)->sin6_port = htons (port);
+              v6addrs[n_v6++] = ai;
+            }
+        }
+      else if (ai->ai_family == AF_INET && !(flags & HTTP_FLAG_IGNORE_IPv4))
+        {
+          if (n_v4 < DIM (v4addrs))
+            {
+              ((struct sockaddr_in *)ai->ai_addr)->sin_port = htons (port);
+              v4addrs[n_v4++] = ai;
+            }
+        }
+    }
+
+  /* Interleave the families starting with the one preferred by the
+     resolver.  */
+  naddrs = i6 = i4 = 0;
+  for (ai = ailist; ai; ai = ai->ai_next)
+    if ((ai->ai_family == AF_INET6 && n_v6)
+        || (ai->ai_family == AF_INET && n_v4))
+      break;
+  while (naddrs < DIM (addrs) && (i6 < n_v6 || i4 < n_v4))
+    {
+      if (ai && ai->ai_family == AF_INET6)
+        {
+          if (i6 < n_v6)
+            addrs[naddrs++] = v6addrs[i6++];
+          if (i4 < n_v4 && naddrs < DIM (addrs))
+            addrs[naddrs++] = v4addrs[i4++];
+        }
+      else
+        {
+          if (i4 < n_v4)
+            addrs[naddrs++] = v4addrs[i4++];
+          if (i6 < n_v6 && naddrs < DIM (addrs))
+            addrs[naddrs++] = v6addrs[i6++];
+        }
+    }
+
+#ifdef HAVE_W32_SYSTEM
+  /* Windows uses a different API for non-blocking sockets; we simply
+     try one address after the other.  */
+  for (i=0; i < naddrs; i++)
+    {
+      sock = socket (addrs[i]->ai_family, addrs[i]->ai_socktype,
+                     addrs[i]->ai_protocol);
+      if (sock == -1)
+        {
+          *r_errno = errno;
+          log_error ("error creating socket: %s\n", strerror (errno));
+          continue;
+        }
+      if (!my_connect (sock, addrs[i]->ai_addr, addrs[i]->ai_addrlen))
+        return sock;
+      *r_errno = errno;
+      sock_close (sock);
+      sock = -1;
+    }
+#else /*!HAVE_W32_SYSTEM*/
+  nstarted = npending = 0;
+  while (sock == -1 && (nstarted < naddrs || npending))
+    {
+      if (nstarted < naddrs)
+        {
+          i = nstarted++;
+          socks[i] = start_connect (addrs[i], &connected);
+          if (socks[i] == -1)
+            {
+              *r_errno = errno;
+              continue;  /* Try the next address right away.  */
+            }
+          if (connected)
+            {
+              sock = socks[i];
+              socks[i] = -1;
+              break;
+            }
+          npending++;
+        }
+
+      /* Wait until one of the pending attempts completes or it is
+         time to start the next one.  */
+      FD_ZERO (&wfds);
+      maxfd = -1;
+      for (i=0; i < nstarted; i++)
+        if (socks[i] != -1)
+          {
+            FD_SET (socks[i], &wfds);
+            if (socks[i] > maxfd)
+              maxfd = socks[i];
+          }
+      tv.tv_sec = 0;
+      tv.tv_usec = CONNECT_ATTEMPT_DELAY * 1000;
+      n = my_select (maxfd+1, NULL, &wfds, NULL,
+                     nstarted < naddrs? &tv : NULL);
+      if (n == -1)
+        {
+          if (errno == EINTR)
+            continue;
+          *r_errno = errno;
+          break;
+        }
+
+      for (i=0; n > 0 && i < nstarted; i++)
+        if (socks[i] != -1 && FD_ISSET (socks[i], &wfds))
+          {
+            soerrlen = sizeof soerr;
+            if (getsockopt (socks[i], SOL_SOCKET, SO_ERROR,
+                            &soerr, &soerrlen))
+              soerr = errno;
+            if (!soerr && sock == -1)
+              {
+                sock = socks[i];
+                socks[i] = -1;
+              }
+            else if (soerr)
+              {
+                *r_errno = soerr;
+                sock_close (socks[i]);
+                socks[i] = -1;
+                npending--;
+              }
+          }
+    }
+
+  /* Cancel all other attempts.  */
+  for (i=0; i < nstarted; i++)
+    if (socks[i] != -1)
+      sock_close (socks[i]);
+
+  /* The caller expects a blocking socket.  */
+  if (sock != -1)
+    fcntl (sock, F_SETFL, fcntl (sock, F_GETFL) & ~O_NONBLOCK);
+#endif /*!HAVE_W32_SYSTEM*/
+
+  if (!naddrs)
+    *r_errno = EADDRNOTAVAIL;
+  return sock;
+}
+
+
+#ifdef HTTP_TESTING
+/* Make connect_addrlist available to t-http-connect.  */
+int
+_http_test_connect_addrlist (struct addrinfo *ailist, unsigned short port,
+                             unsigned int flags, int *r_errno)
+{
+  return connect_addrlist (ailist, port, flags, r_errno);
+}
+#endif /*HTTP_TESTING*/
+#endif /*HAVE_GETADDRINFO*/
+
+
 /* Actually connect to a server.  Returns the file descriptor or -1 on
    error.  ERRNO is set on error. */
 static int
@@ -2191,42 +2949,16 @@ connect_server (const char *server, unsigned short port,
   connected = 0;
   for (srv=0; srv < srvcount && !connected; srv++)
     {
-      struct addrinfo hints, *res, *ai;
-      char portstr[35];
+      struct addrinfo *res;
 
-      snprintf (portstr, sizeof portstr, "%hu", port);
-      memset (&hints, 0, sizeof (hints));
-      hints.ai_socktype = SOCK_STREAM;
-      if (getaddrinfo (serverlist[srv].target, portstr, &hints, &res))
+      if (http_getaddrinfo (serverlist[srv].target, &res))
         continue; /* Not found - try next one. */
       hostfound = 1;
 
-      for (ai = res; ai && !connected; ai = ai->ai_next)
-        {
-          if (ai->ai_family == AF_INET && (flags & HTTP_FLAG_IGNORE_IPv4))
-            continue;
-          if (ai->ai_family == AF_INET6 && (flags & HTTP_FLAG_IGNORE_IPv6))
-            continue;
-
-          if (sock != -1)
-            sock_close (sock);
-          sock = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
-          if (sock == -1)
-            {
-              int save_errno = errno;
-              log_error ("error creating socket: %s\n", strerror (errno));
-              freeaddrinfo (res);
-              xfree (serverlist);
-              errno = save_errno;
-              return -1;
-            }
-
-          if (my_connect (sock, ai->ai_addr, ai->ai_addrlen))
-            last_errno = errno;
-          else
-            connected = 1;
-        }
-      freeaddrinfo (res);
+      sock = connect_addrlist (res, port, flags, &last_errno);
+      if (sock != -1)
+        connected = 1;
+      http_freeaddrinfo (res);
     }
 #else /* !HAVE_GETADDRINFO */
   connected = 0;
@@ -2359,6 +3091,35 @@ write_server (int sock, const char *data, size_t length)
 
 
 
+/* Helper for cookie_read to find the end of a response header.
+   STATE carries the state between calls and must be initialized to
+   0.  Returns the number of bytes up to and including the empty line
+   ending the header or 0 if that line is not within BUFFER.  */
+static size_t
+scan_header_end (int *state, const char *buffer, size_t length)
+{
+  size_t n;
+
+  for (n=0; n < length; n++)
+    {
+      if (buffer[n] == '\n')
+        {
+          if (*state)
+            {
+              *state = 0;
+              return n + 1;
+            }
+          *state = 1;
+        }
+      else if (buffer[n] == '\r' && *state == 1)
+        *state = 2;
+      else
+        *state = 0;
+    }
+  return 0;
+}
+
+
 /* Read handler for estream.  */
 static ssize_t
 cookie_read (void *cookie, void *buffer, size_t size)
@@ -2402,6 +3163,34 @@ cookie_read (void *cookie, void *buffer, size_t size)
   else
 #endif /*HTTP_USE_GNUTLS*/
     {
+      if (c->in_header)
+        {
+          /* The connection will be kept open and thus we must not
+             read beyond the header: The content length applies only
+             to the body.  Peek at the data to limit the read to the
+             end of the header.  */
+          fd_set rfds;
+          int state = c->header_state;
+          size_t n;
+
+#ifndef HAVE_W32_SYSTEM
+          if (c->sock->fd < FD_SETSIZE)
+#endif
+            {
+              FD_ZERO (&rfds);
+              FD_SET (c->sock->fd, &rfds);
+              if (my_select (c->sock->fd+1, &rfds, NULL, NULL, NULL) == -1)
+                return -1;
+            }
+          do
+            nread = recv (c->sock->fd, buffer, size, MSG_PEEK);
+          while (nread == -1 && errno == EINTR);
+          if (nread <= 0)
+            return nread;
+          n = scan_header_end (&state, buffer, nread);
+          size = n? n : nread;
+        }
+
       do
         {
 #ifdef USE_NPTH
@@ -2414,8 +3203,15 @@ cookie_read (void *cookie, void *buffer, size_t size)
 #endif
         }
       while (nread == -1 && errno == EINTR);
+
+      if (c->in_header && nread > 0
+          && scan_header_end (&c->header_state, buffer, nread))
+        c->in_header = 0;
     }
 
+  if (nread > 0)
+    c->got_data = 1;
+
   if (c->content_length_valid && nread > 0)
     {
       if (nread < c->content_length)
@@ -2468,13 +3264,17 @@ cookie_write (void *cookie, const void *buffer_arg, size_t size)
   else
 #endif /*HTTP_USE_GNUTLS*/
     {
-      if ( write_server (c->sock->fd, buffer, size) )
+      if (c->sent)
+        es_write (c->sent, buffer, size, NULL);
+      if ( write_server (c->sock->fd, buffer, size) && !c->sent )
         {
           gpg_err_set_errno (EIO);
           nwritten = -1;
         }
       else
-        nwritten = size;
+        nwritten = size; /* A connection from the pool may have been
+                            closed by the server; the request is then
+                            sent again by http_wait_response.  */
     }
 
   return nwritten;
@@ -2514,6 +3314,12 @@ cookie_close (void *cookie)
   if (!c)
     return 0;
 
+  /* If the entire body has been read the connection may be reused.  */
+  if (c->keep_alive && c->sock && !c->in_header
+      && c->content_length_valid && !c->content_length)
+    connpool_put (c->pool_host, c->pool_port, c->sock);
+  xfree (c->pool_host);
+
 #ifdef HTTP_USE_GNUTLS
   if (c->use_tls && c->session && c->session->tls_session)
     my_socket_unref (c->sock, send_gnutls_bye, c->session->tls_session);
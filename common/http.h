@@ -79,7 +79,8 @@ enum
     HTTP_FLAG_FORCE_TLS = 16,    /* Force the use opf TLS.  */
     HTTP_FLAG_IGNORE_CL = 32,    /* Ignore content-length.  */
     HTTP_FLAG_IGNORE_IPv4 = 64,  /* Do not use IPv4.  */
-    HTTP_FLAG_IGNORE_IPv6 = 128  /* Do not use IPv6.  */
+    HTTP_FLAG_IGNORE_IPv6 = 128, /* Do not use IPv6.  */
+    HTTP_FLAG_KEEPALIVE = 256    /* Keep the connection for reuse.  */
   };
 
 
@@ -145,6 +146,23 @@ const char *http_get_header (http_t hd, const char *name);
 const char **http_get_header_names (http_t hd);
 gpg_error_t http_verify_server_credentials (http_session_t sess);
 
+void http_connpool_flush (void);
+
+struct addrinfo;
+int http_getaddrinfo (const char *name, struct addrinfo **r_ai);
+void http_freeaddrinfo (struct addrinfo *ai);
+void http_dns_cache_flush (void);
+
+#ifdef HTTP_TESTING
+/* Hooks for t-http-connect.  */
+extern int (*_http_test_getaddrinfo) (const char *, const char *,
+                                      const struct addrinfo *,
+                                      struct addrinfo **);
+int _http_test_connect_addrlist (struct addrinfo *ailist,
+                                 unsigned short port, unsigned int flags,
+                                 int *r_errno);
+#endif /*HTTP_TESTING*/
+
 char *http_escape_string (const char *string, const char *specials);
 char *http_escape_data (const void *data, size_t datalen, const char *specials);
 
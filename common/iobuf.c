@@ -184,7 +184,8 @@ fd_cache_strcmp (const char *a, const char *b)
 }
 
 /*
- * Invalidate (i.e. close) a cached iobuf
+ * Invalidate (i.e. close) a cached iobuf.  If FNAME is NULL all
+ * cached iobufs are closed.
  */
 static int
 fd_cache_invalidate (const char *fname)
@@ -192,13 +193,13 @@ fd_cache_invalidate (const char *fname)
   close_cache_t cc;
   int rc = 0;
 
-  assert (fname);
   if (DBG_IOBUF)
-    log_debug ("fd_cache_invalidate (%s)\n", fname);
+    log_debug ("fd_cache_invalidate (%s)\n", fname? fname : "[all]");
 
   for (cc = close_cache; cc; cc = cc->next)
     {
-      if (cc->fp != GNUPG_INVALID_FD && !fd_cache_strcmp (cc->fname, fname))
+      if (cc->fp != GNUPG_INVALID_FD
+          && (!fname || !fd_cache_strcmp (cc->fname, fname)))
 	{
 	  if (DBG_IOBUF)
 	    log_debug ("                did (%s)\n", cc->fname);
@@ -1533,7 +1534,7 @@ iobuf_ioctl (iobuf_t a, iobuf_ioctl_t cmd, int intval, void *ptrval)
       if (DBG_IOBUF)
 	log_debug ("iobuf-*.*: ioctl '%s' invalidate\n",
 		   ptrval ? (char *) ptrval : "?");
-      if (!a && !intval && ptrval)
+      if (!a && !intval)
 	{
 	  if (fd_cache_invalidate (ptrval))
             return -1;
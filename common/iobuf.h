@@ -50,7 +50,7 @@
 typedef enum
   {
     IOBUF_IOCTL_KEEP_OPEN        = 1, /* Uses intval.  */
-    IOBUF_IOCTL_INVALIDATE_CACHE = 2, /* Uses ptrval.  */
+    IOBUF_IOCTL_INVALIDATE_CACHE = 2, /* Uses ptrval; NULL for all.  */
     IOBUF_IOCTL_NO_CACHE         = 3, /* Uses intval.  */
     IOBUF_IOCTL_FSYNC            = 4  /* Uses ptrval.  */
   } iobuf_ioctl_t;
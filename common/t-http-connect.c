@@ -0,0 +1,441 @@
+/* t-http-connect.c - Module test for the connect code of http.c
+ * Copyright (C) 2015 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* This test uses listeners on the loopback interface to check that
+   connect_addrlist skips refused and hanging addresses, and a fake
+   resolver to check the DNS cache of http_getaddrinfo.  It requires
+   that http.c has been compiled with HTTP_TESTING.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+
+#include "util.h"
+#include "logging.h"
+#include "http.h"
+
+#define PGM "t-http-connect"
+
+#define pass()  do { ; } while(0)
+#define fail(a)  do { fprintf (stderr, "%s:%d: test %d failed\n",\
+                               __FILE__,__LINE__, (a));          \
+                     errcount++;                                 \
+                   } while(0)
+
+static int verbose;
+static int errcount;
+
+
+#ifdef HAVE_GETADDRINFO
+
+/* Return a listening socket bound to the address ADDR of FAMILY and
+   the port at R_PORT.  If *R_PORT is 0 a free port is used and stored
+   at R_PORT.  Returns -1 on error.  */
+static int
+make_listener (int family, const char *addr, unsigned short *r_port,
+               int backlog)
+{
+  struct sockaddr_in sin;
+  struct sockaddr_in6 sin6;
+  struct sockaddr *sa;
+  socklen_t salen;
+  int fd, one = 1;
+
+  fd = socket (family, SOCK_STREAM, 0);
+  if (fd == -1)
+    return -1;
+  if (family == AF_INET6)
+    {
+      setsockopt (fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof one);
+      memset (&sin6, 0, sizeof sin6);
+      sin6.sin6_family = AF_INET6;
+      sin6.sin6_port = htons (*r_port);
+      inet_pton (AF_INET6, addr, &sin6.sin6_addr);
+      sa = (struct sockaddr *)&sin6;
+      salen = sizeof sin6;
+    }
+  else
+    {
+      memset (&sin, 0, sizeof sin);
+      sin.sin_family = AF_INET;
+      sin.sin_port = htons (*r_port);
+      inet_pton (AF_INET, addr, &sin.sin_addr);
+      sa = (struct sockaddr *)&sin;
+      salen = sizeof sin;
+    }
+  if (bind (fd, sa, salen) || listen (fd, backlog)
+      || getsockname (fd, sa, &salen))
+    {
+      close (fd);
+      return -1;
+    }
+  *r_port = ntohs (family == AF_INET6? sin6.sin6_port : sin.sin_port);
+  return fd;
+}
+
+
+/* Prepend a node for the address ADDR of FAMILY to the list NEXT.
+   The node is allocated like those of http_getaddrinfo so that the
+   list can be released with http_freeaddrinfo.  */
+static struct addrinfo *
+make_ai (int family, const char *addr, struct addrinfo *next)
+{
+  struct addrinfo *ai;
+  size_t salen;
+
+  salen = (family == AF_INET6? sizeof (struct sockaddr_in6)
+           /**/               : sizeof (struct sockaddr_in));
+  ai = xcalloc (1, sizeof *ai + salen);
+  ai->ai_family = family;
+  ai->ai_socktype = SOCK_STREAM;
+  ai->ai_addrlen = salen;
+  ai->ai_addr = (struct sockaddr *)(ai + 1);
+  ai->ai_addr->sa_family = family;
+  if (family == AF_INET6)
+    inet_pton (AF_INET6, addr,
+               &((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr);
+  else
+    inet_pton (AF_INET, addr, &((struct sockaddr_in *)ai->ai_addr)->sin_addr);
+  ai->ai_next = next;
+  return ai;
+}
+
+
+/* Return true if SOCK is connected to the address ADDR of FAMILY.  */
+static int
+peer_is (int sock, int family, const char *addr)
+{
+  struct sockaddr_storage ss;
+  socklen_t sslen = sizeof ss;
+  char buffer[INET6_ADDRSTRLEN];
+
+  if (getpeername (sock, (struct sockaddr *)&ss, &sslen)
+      || ss.ss_family != family)
+    return 0;
+  if (family == AF_INET6)
+    inet_ntop (AF_INET6, &((struct sockaddr_in6 *)&ss)->sin6_addr,
+               buffer, sizeof buffer);
+  else
+    inet_ntop (AF_INET, &((struct sockaddr_in *)&ss)->sin_addr,
+               buffer, sizeof buffer);
+  return !strcmp (buffer, addr);
+}
+
+
+/* Return the number of milliseconds since START.  */
+static long
+elapsed_ms (const struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday (&now, NULL);
+  return ((now.tv_sec - start->tv_sec) * 1000
+          + (now.tv_usec - start->tv_usec) / 1000);
+}
+
+
+/* Connect to a list with the refused address DEAD followed by the
+   live address LIVE and check that the live one is used.  */
+static void
+test_refused (int dead_family, const char *dead,
+              int live_family, const char *live)
+{
+  unsigned short port = 0;
+  struct addrinfo *ailist;
+  int lfd, sock, err = 0;
+
+  lfd = make_listener (live_family, live, &port, 5);
+  if (lfd == -1)
+    {
+      fail (1);
+      return;
+    }
+  ailist = make_ai (dead_family, dead, make_ai (live_family, live, NULL));
+
+  sock = _http_test_connect_addrlist (ailist, port, 0, &err);
+  if (verbose)
+    printf ("%s -> %s: sock=%d err=%s\n", dead, live, sock, strerror (err));
+  if (sock == -1 || !peer_is (sock, live_family, live))
+    fail (2);
+
+  if (sock != -1)
+    close (sock);
+  close (lfd);
+  http_freeaddrinfo (ailist);
+}
+
+
+/* Check that the error of the last address is returned if no address
+   can be connected.  */
+static void
+test_all_refused (void)
+{
+  unsigned short port = 0;
+  struct addrinfo *ailist;
+  int lfd, sock, err = 0;
+
+  /* Get a port which is only used on 127.0.0.1.  */
+  lfd = make_listener (AF_INET, "127.0.0.1", &port, 5);
+  if (lfd == -1)
+    {
+      fail (1);
+      return;
+    }
+  ailist = make_ai (AF_INET, "127.0.0.2", make_ai (AF_INET, "127.0.0.3",
+                                                  NULL));
+  sock = _http_test_connect_addrlist (ailist, port, 0, &err);
+  if (verbose)
+    printf ("all refused: sock=%d err=%s\n", sock, strerror (err));
+  if (sock != -1)
+    {
+      fail (2);
+      close (sock);
+    }
+  else if (err != ECONNREFUSED)
+    fail (3);
+
+  close (lfd);
+  http_freeaddrinfo (ailist);
+}
+
+
+/* Check that a connection attempt which does not complete does not
+   delay the connection to the next address for longer than the
+   stagger delay.  A listener whose queue is full drops new SYNs and
+   thus the connect hangs.  */
+static void
+test_hanging (void)
+{
+  unsigned short port = 0;
+  struct addrinfo *ailist;
+  int lfd, hfd, sock, err = 0;
+  int fillers[8];
+  int nfillers, pending;
+  fd_set wfds;
+  struct timeval tv, start;
+  struct sockaddr_in sin;
+  long ms;
+
+  lfd = make_listener (AF_INET, "127.0.0.1", &port, 5);
+  if (lfd == -1)
+    {
+      fail (1);
+      return;
+    }
+  hfd = make_listener (AF_INET, "127.0.0.3", &port, 0);
+  if (hfd == -1)
+    {
+      fail (2);
+      close (lfd);
+      return;
+    }
+
+  /* Fill the queue until a connect stays pending.  */
+  memset (&sin, 0, sizeof sin);
+  sin.sin_family = AF_INET;
+  sin.sin_port = htons (port);
+  inet_pton (AF_INET, "127.0.0.3", &sin.sin_addr);
+  pending = 0;
+  for (nfillers=0; !pending && nfillers < DIM (fillers); nfillers++)
+    {
+      fillers[nfillers] = socket (AF_INET, SOCK_STREAM, 0);
+      if (fillers[nfillers] == -1)
+        break;
+      fcntl (fillers[nfillers], F_SETFL, O_NONBLOCK);
+      if (connect (fillers[nfillers], (struct sockaddr *)&sin, sizeof sin)
+          && errno != EINPROGRESS)
+        continue;
+      FD_ZERO (&wfds);
+      FD_SET (fillers[nfillers], &wfds);
+      tv.tv_sec = 0;
+      tv.tv_usec = 100000;
+      if (!select (fillers[nfillers]+1, NULL, &wfds, NULL, &tv))
+        pending = 1;
+    }
+
+  if (!pending)
+    {
+      if (verbose)
+        printf ("hanging: skipped - can't get a pending connect\n");
+    }
+  else
+    {
+      ailist = make_ai (AF_INET, "127.0.0.3",
+                        make_ai (AF_INET, "127.0.0.1", NULL));
+      gettimeofday (&start, NULL);
+      sock = _http_test_connect_addrlist (ailist, port, 0, &err);
+      ms = elapsed_ms (&start);
+      if (verbose)
+        printf ("hanging: sock=%d after %ldms\n", sock, ms);
+      /* A SYN is retransmitted after one second; the live address
+         must have been used before that.  */
+      if (sock == -1 || !peer_is (sock, AF_INET, "127.0.0.1"))
+        fail (3);
+      else if (ms >= 1000)
+        fail (4);
+      if (sock != -1)
+        close (sock);
+      http_freeaddrinfo (ailist);
+    }
+
+  while (nfillers--)
+    if (fillers[nfillers] != -1)
+      close (fillers[nfillers]);
+  close (hfd);
+  close (lfd);
+}
+
+
+static void
+test_connect_addrlist (void)
+{
+  unsigned short port = 0;
+  int fd;
+  int have_ipv6;
+
+  test_refused (AF_INET, "127.0.0.2", AF_INET, "127.0.0.1");
+  test_all_refused ();
+  test_hanging ();
+
+  fd = make_listener (AF_INET6, "::1", &port, 1);
+  have_ipv6 = (fd != -1);
+  if (fd != -1)
+    close (fd);
+  if (!have_ipv6)
+    {
+      if (verbose)
+        printf ("IPv6 tests skipped - no ::1\n");
+      return;
+    }
+  test_refused (AF_INET6, "::1", AF_INET, "127.0.0.1");
+  test_refused (AF_INET, "127.0.0.1", AF_INET6, "::1");
+}
+
+
+/* The fake resolver for the DNS cache test.  */
+static int fake_calls;
+static int fake_result;
+
+static int
+fake_getaddrinfo (const char *node, const char *service,
+                  const struct addrinfo *hints, struct addrinfo **res)
+{
+  struct addrinfo myhints;
+
+  (void)node;
+  (void)hints;
+
+  fake_calls++;
+  if (fake_result)
+    return fake_result;
+  memset (&myhints, 0, sizeof myhints);
+  myhints.ai_family = AF_INET;
+  myhints.ai_socktype = SOCK_STREAM;
+  myhints.ai_flags = AI_NUMERICHOST;
+  return getaddrinfo ("127.0.0.1", service, &myhints, res);
+}
+
+
+/* Resolve NAME and check that the result is EXPECTED and that the
+   resolver has been called CALLS times in total.  */
+static void
+check_lookup (const char *name, int expected, int calls)
+{
+  struct addrinfo *ai = NULL;
+  int ec;
+
+  ec = http_getaddrinfo (name, &ai);
+  if (verbose)
+    printf ("lookup '%s': %s (%d calls)\n",
+            name, ec? gai_strerror (ec) : "ok", fake_calls);
+  if (ec != expected)
+    fail (1);
+  else if (fake_calls != calls)
+    fail (2);
+  else if (!ec && (!ai || ai->ai_family != AF_INET
+                   || ((struct sockaddr_in *)ai->ai_addr)->sin_addr.s_addr
+                   != htonl (INADDR_LOOPBACK)))
+    fail (3);
+  else if (ec && ai)
+    fail (4);
+  http_freeaddrinfo (ai);
+}
+
+
+static void
+test_dns_cache (void)
+{
+  _http_test_getaddrinfo = fake_getaddrinfo;
+  http_dns_cache_flush ();
+
+  /* A positive result is cached; the names are case insensitive.  */
+  fake_result = 0;
+  check_lookup ("a.test", 0, 1);
+  check_lookup ("a.test", 0, 1);
+  check_lookup ("A.Test", 0, 1);
+
+  /* A non-existent name is cached.  */
+  fake_result = EAI_NONAME;
+  check_lookup ("b.test", EAI_NONAME, 2);
+  check_lookup ("b.test", EAI_NONAME, 2);
+
+  /* A temporary error is not cached.  */
+  fake_result = EAI_AGAIN;
+  check_lookup ("c.test", EAI_AGAIN, 3);
+  check_lookup ("c.test", EAI_AGAIN, 4);
+  fake_result = 0;
+  check_lookup ("c.test", 0, 5);
+  check_lookup ("c.test", 0, 5);
+
+  /* Flushing the cache forces a new lookup.  */
+  http_dns_cache_flush ();
+  check_lookup ("a.test", 0, 6);
+  check_lookup ("b.test", 0, 7);
+
+  http_dns_cache_flush ();
+  _http_test_getaddrinfo = getaddrinfo;
+}
+#endif /*HAVE_GETADDRINFO*/
+
+
+int
+main (int argc, char **argv)
+{
+  gpgrt_init ();
+  log_set_prefix (PGM, 1 | 4);
+  if (argc > 1 && !strcmp (argv[1], "--verbose"))
+    verbose = 1;
+
+#ifdef HAVE_GETADDRINFO
+  test_connect_addrlist ();
+  test_dns_cache ();
+#endif /*HAVE_GETADDRINFO*/
+
+  return !!errcount;
+}
@@ -33,7 +33,12 @@
 #include "certcache.h"
 
 
-#define MAX_EXTRA_CACHED_CERTS 1000
+/* The number of independently locked shards of the cache.  */
+#define CERT_CACHE_SHARDS 16
+
+/* The initial number of buckets of a shard's hash table.  Must be a
+   power of 2.  */
+#define CERT_CACHE_INITIAL_BUCKETS 16
 
 /* Constants used to classify search patterns.  */
 enum pattern_class
@@ -53,19 +58,33 @@ enum pattern_class
   };
 
 
+/* The hash tables kept for each shard of the cache.  */
+enum cert_index
+  {
+    INDEX_FPR = 0,     /* The fingerprint.  */
+    INDEX_SUBJECT,     /* The subject DN.  */
+    INDEX_SN,          /* The issuer DN and the serial number.  */
+    INDEX_KEYID,       /* The subjectKeyIdentifier.  */
+    N_CERT_INDEXES
+  };
+
 /* A certificate cache item.  This consists of a the KSBA cert object
-   and some meta data for easier lookup.  We use a hash table to keep
-   track of all items and use the (randomly distributed) first byte of
-   the fingerprint directly as the hash which makes it pretty easy. */
+   and some meta data for easier lookup.  */
 struct cert_item_s
 {
-  struct cert_item_s *next; /* Next item with the same hash value. */
-  ksba_cert_t cert;         /* The KSBA cert object or NULL is this is
-                               not a valid item.  */
+  /* Next item in the same bucket of each of the hash tables and the
+     full hash value of this item for each table.  */
+  struct cert_item_s *next[N_CERT_INDEXES];
+  unsigned int hash[N_CERT_INDEXES];
+  struct cert_item_s *lru_prev; /* The next more recently used item.  */
+  struct cert_item_s *lru_next; /* The next less recently used item.  */
+  ksba_cert_t cert;         /* The KSBA cert object.  */
   unsigned char fpr[20];    /* The fingerprint of this object. */
   char *issuer_dn;          /* The malloced issuer DN.  */
   ksba_sexp_t sn;           /* The malloced serial number  */
   char *subject_dn;         /* The malloced subject DN - maybe NULL.  */
+  ksba_sexp_t keyid;        /* The malloced subjectKeyIdentifier - maybe
+                               NULL.  */
   struct
   {
     unsigned int loaded:1;  /* It has been explicitly loaded.  */
@@ -74,73 +93,210 @@ struct cert_item_s
 };
 typedef struct cert_item_s *cert_item_t;
 
-/* The actual cert cache consisting of 256 slots for items indexed by
-   the first byte of the fingerprint.  */
-static cert_item_t cert_cache[256];
+/* One shard of the certificate cache.  The fingerprint is a SHA-1
+   hash and thus randomly distributed; we use its first byte to select
+   the shard and the next four bytes as the hash value into the
+   shard's fingerprint table.  The other tables allow to find a
+   certificate by its subject, issuer and serial number or
+   subjectKeyIdentifier without looking at all items; such a lookup
+   needs to check the respective table of each shard.  All tables of
+   a shard have the same size, which is doubled whenever the shard
+   holds more than twice as many items as buckets.  Items cached at
+   runtime are also kept in a list ordered by their last use, so that
+   the least recently used one can be dropped if the cache is full.
+   Explicitly loaded certificates are never dropped and are not in
+   that list.  */
+struct cert_shard_s
+{
+  /* The lock for this shard.  In general locking is not needed but it
+     would take extra efforts to make sure that no indirect use of npth
+     functions is done, so we simply lock it always.  Note: We can't
+     use static initialization, as that is not available through
+     w32-pth.  */
+  npth_rwlock_t lock;
+  cert_item_t *table[N_CERT_INDEXES]; /* The malloced hash tables.  */
+  unsigned int tablesize;   /* Number of buckets; a power of 2.  */
+  cert_item_t lru_first;    /* The most recently used item.  */
+  cert_item_t lru_last;     /* The least recently used item.  */
+  unsigned int nloaded;     /* Number of explicitly loaded certs.  */
+  unsigned int nextra;      /* Number of certs cached at runtime.  */
+};
+typedef struct cert_shard_s *cert_shard_t;
 
-/* This is the global cache_lock variable. In general looking is not
-   needed but it would take extra efforts to make sure that no
-   indirect use of npth functions is done, so we simply lock it
-   always.  Note: We can't use static initialization, as that is not
-   available through w32-pth.  */
-static npth_rwlock_t cert_cache_lock;
+/* The actual cert cache.  */
+static struct cert_shard_s cert_cache[CERT_CACHE_SHARDS];
 
 /* Flag to track whether the cache has been initialized.  */
 static int initialization_done;
 
-/* Total number of certificates loaded during initialization and
-   cached during operation.  */
-static unsigned int total_loaded_certificates;
-static unsigned int total_extra_certificates;
 
 
-
+/* Return the shard for the fingerprint FPR.  */
+static inline cert_shard_t
+fpr_to_shard (const unsigned char *fpr)
+{
+  return cert_cache + (fpr[0] % CERT_CACHE_SHARDS);
+}
+
+/* Return the hash value of the fingerprint FPR.  */
+static inline unsigned int
+hash_fpr (const unsigned char *fpr)
+{
+  return ((fpr[1] << 24) | (fpr[2] << 16) | (fpr[3] << 8) | fpr[4]);
+}
+
+/* The start value for hash_buffer.  */
+#define HASH_INITIAL 2166136261U
+
+/* Update the FNV-1a hash value HASH with the LENGTH bytes at BUFFER
+   and return the new value.  */
+static unsigned int
+hash_buffer (unsigned int hash, const void *buffer, size_t length)
+{
+  const unsigned char *p = buffer;
+
+  for (; length; length--, p++)
+    hash = (hash ^ *p) * 16777619;
+  return hash;
+}
+
+/* Return the hash value of the string STRING.  */
+static unsigned int
+hash_string (const char *string)
+{
+  return hash_buffer (HASH_INITIAL, string, strlen (string));
+}
+
+/* Return the hash value of the canonical S-expression SEXP combined
+   with HASH.  */
+static unsigned int
+hash_sexp (unsigned int hash, ksba_const_sexp_t sexp)
+{
+  return hash_buffer (hash, sexp, gcry_sexp_canon_len (sexp, 0, NULL, NULL));
+}
+
+/* Return the hash value used for the INDEX_SN table.  */
+static unsigned int
+hash_issuer_sn (const char *issuer_dn, ksba_const_sexp_t sn)
+{
+  return hash_sexp (hash_string (issuer_dn), sn);
+}
+
+/* Return true if the item CI is in the hash table INDEX.  */
+static inline int
+item_in_index (cert_item_t ci, int index)
+{
+  switch (index)
+    {
+    case INDEX_SUBJECT: return !!ci->subject_dn;
+    case INDEX_KEYID: return !!ci->keyid;
+    default: return 1;
+    }
+}
+
+/* Return the first item of SHARD in the bucket of table INDEX for
+   the hash value HASH.  The shard needs to be locked.  */
+static inline cert_item_t
+first_in_bucket (cert_shard_t shard, int index, unsigned int hash)
+{
+  if (!shard->tablesize)
+    return NULL;
+  return shard->table[index][hash & (shard->tablesize - 1)];
+}
+
+
 /* Helper to do the cache locking.  */
 static void
 init_cache_lock (void)
 {
-  int err;
+  static int done;
+  int err, i;
 
-  err = npth_rwlock_init (&cert_cache_lock, NULL);
-  if (err)
-    log_fatal (_("can't initialize certificate cache lock: %s\n"),
-	       strerror (err));
+  if (done)
+    return;
+  done = 1;
+  for (i=0; i < CERT_CACHE_SHARDS; i++)
+    {
+      err = npth_rwlock_init (&cert_cache[i].lock, NULL);
+      if (err)
+        log_fatal (_("can't initialize certificate cache lock: %s\n"),
+                   strerror (err));
+    }
 }
 
 static void
-acquire_cache_read_lock (void)
+acquire_cache_read_lock (cert_shard_t shard)
 {
   int err;
 
-  err = npth_rwlock_rdlock (&cert_cache_lock);
+  err = npth_rwlock_rdlock (&shard->lock);
   if (err)
     log_fatal (_("can't acquire read lock on the certificate cache: %s\n"),
                strerror (err));
 }
 
 static void
-acquire_cache_write_lock (void)
+acquire_cache_write_lock (cert_shard_t shard)
 {
   int err;
 
-  err = npth_rwlock_wrlock (&cert_cache_lock);
+  err = npth_rwlock_wrlock (&shard->lock);
   if (err)
     log_fatal (_("can't acquire write lock on the certificate cache: %s\n"),
                strerror (err));
 }
 
 static void
-release_cache_lock (void)
+release_cache_lock (cert_shard_t shard)
 {
   int err;
 
-  err = npth_rwlock_unlock (&cert_cache_lock);
+  err = npth_rwlock_unlock (&shard->lock);
   if (err)
     log_fatal (_("can't release lock on the certificate cache: %s\n"),
                strerror (err));
 }
 
 
+/* Return the item with the fingerprint FPR from SHARD or NULL.  The
+   shard needs to be locked.  */
+static cert_item_t
+find_cache_item (cert_shard_t shard, const unsigned char *fpr)
+{
+  cert_item_t ci;
+
+  for (ci = first_in_bucket (shard, INDEX_FPR, hash_fpr (fpr));
+       ci; ci = ci->next[INDEX_FPR])
+    if (!memcmp (ci->fpr, fpr, 20))
+      return ci;
+  return NULL;
+}
+
+
+/* Mark the item CI of SHARD as used by moving it to the front of the
+   LRU list.  This is also called while holding only the read lock;
+   that is okay because nPth does not switch threads here.  */
+static void
+touch_cache_item (cert_shard_t shard, cert_item_t ci)
+{
+  if (ci->flags.loaded || shard->lru_first == ci)
+    return;
+
+  /* Unlink.  */
+  ci->lru_prev->lru_next = ci->lru_next;
+  if (ci->lru_next)
+    ci->lru_next->lru_prev = ci->lru_prev;
+  else
+    shard->lru_last = ci->lru_prev;
+
+  /* Insert at the front.  */
+  ci->lru_prev = NULL;
+  ci->lru_next = shard->lru_first;
+  shard->lru_first->lru_prev = ci;
+  shard->lru_first = ci;
+}
+
+
 /* Return false if both serial numbers match.  Can't be used for
    sorting. */
 static int
@@ -205,106 +361,154 @@ cert_compute_fpr (ksba_cert_t cert, unsigned char *digest)
 }
 
 
-/* Cleanup one slot.  This releases all resourses but keeps the actual
-   slot in the cache marked for reuse. */
+/* Release the cache item CI and all its resources.  */
 static void
-clean_cache_slot (cert_item_t ci)
+release_cache_item (cert_item_t ci)
 {
-  ksba_cert_t cert;
-
-  if (!ci->cert)
-    return; /* Already cleaned.  */
+  if (!ci)
+    return;
 
   ksba_free (ci->sn);
-  ci->sn = NULL;
   ksba_free (ci->issuer_dn);
-  ci->issuer_dn = NULL;
   ksba_free (ci->subject_dn);
-  ci->subject_dn = NULL;
-  cert = ci->cert;
-  ci->cert = NULL;
+  ksba_free (ci->keyid);
+  ksba_cert_release (ci->cert);
+  xfree (ci);
+}
 
-  ksba_cert_release (cert);
+
+/* Insert the item CI into all hash tables of SHARD.  The shard needs
+   to be locked for writing.  */
+static void
+link_cache_item (cert_shard_t shard, cert_item_t ci)
+{
+  cert_item_t *bucket;
+  int index;
+
+  for (index=0; index < N_CERT_INDEXES; index++)
+    if (item_in_index (ci, index))
+      {
+        bucket = &shard->table[index][ci->hash[index]
+                                      & (shard->tablesize - 1)];
+        ci->next[index] = *bucket;
+        *bucket = ci;
+      }
 }
 
 
-/* Put the certificate CERT into the cache.  It is assumed that the
-   cache is locked while this function is called. If FPR_BUFFER is not
-   NULL the fingerprint of the certificate will be stored there.
-   FPR_BUFFER neds to point to a buffer of at least 20 bytes. The
-   fingerprint will be stored on success or when the function returns
-   gpg_err_code(GPG_ERR_DUP_VALUE). */
-static gpg_error_t
-put_cert (ksba_cert_t cert, int is_loaded, int is_trusted, void *fpr_buffer)
+/* Remove the item CI from SHARD and release it.  The shard needs to
+   be locked for writing.  */
+static void
+drop_cache_item (cert_shard_t shard, cert_item_t ci)
 {
-  unsigned char help_fpr_buffer[20], *fpr;
-  cert_item_t ci;
+  cert_item_t *ciptr;
+  int index;
+
+  for (index=0; index < N_CERT_INDEXES; index++)
+    if (item_in_index (ci, index))
+      for (ciptr = &shard->table[index][ci->hash[index]
+                                        & (shard->tablesize - 1)];
+           *ciptr; ciptr = &(*ciptr)->next[index])
+        if (*ciptr == ci)
+          {
+            *ciptr = ci->next[index];
+            break;
+          }
 
-  fpr = fpr_buffer? fpr_buffer : &help_fpr_buffer;
+  if (ci->flags.loaded)
+    shard->nloaded--;
+  else
+    {
+      if (ci->lru_prev)
+        ci->lru_prev->lru_next = ci->lru_next;
+      else
+        shard->lru_first = ci->lru_next;
+      if (ci->lru_next)
+        ci->lru_next->lru_prev = ci->lru_prev;
+      else
+        shard->lru_last = ci->lru_prev;
+      shard->nextra--;
+    }
 
-  /* If we already reached the caching limit, drop a couple of certs
-     from the cache.  Our dropping strategy is simple: We keep a
-     static index counter and use this to start looking for
-     certificates, then we drop 5 percent of the oldest certificates
-     starting at that index.  For a large cache this is a fair way of
-     removing items. An LRU strategy would be better of course.
-     Because we append new entries to the head of the list and we want
-     to remove old ones first, we need to do this from the tail.  The
-     implementation is not very efficient but compared to the long
-     time it takes to retrieve a certifciate from an external resource
-     it seems to be reasonable. */
-  if (!is_loaded && total_extra_certificates >= MAX_EXTRA_CACHED_CERTS)
+  release_cache_item (ci);
+}
+
+
+/* Change the size of the hash tables of SHARD to NEWSIZE buckets,
+   which must be a power of 2.  The shard needs to be locked for
+   writing.  On error the old tables are kept.  */
+static gpg_error_t
+resize_cache_tables (cert_shard_t shard, unsigned int newsize)
+{
+  gpg_error_t err;
+  cert_item_t *oldtable[N_CERT_INDEXES];
+  unsigned int oldsize = shard->tablesize;
+  cert_item_t ci, ci2;
+  unsigned int i;
+  int index;
+
+  for (index=0; index < N_CERT_INDEXES; index++)
     {
-      static int idx;
-      cert_item_t ci_mark;
-      int i;
-      unsigned int drop_count;
-
-      drop_count = MAX_EXTRA_CACHED_CERTS / 20;
-      if (drop_count < 2)
-        drop_count = 2;
-
-      log_info (_("dropping %u certificates from the cache\n"), drop_count);
-      assert (idx < 256);
-      for (i=idx; drop_count; i = ((i+1)%256))
+      oldtable[index] = shard->table[index];
+      shard->table[index] = xtrycalloc (newsize, sizeof (cert_item_t));
+      if (!shard->table[index])
         {
-          ci_mark = NULL;
-          for (ci = cert_cache[i]; ci; ci = ci->next)
-            if (ci->cert && !ci->flags.loaded)
-              ci_mark = ci;
-          if (ci_mark)
+          err = gpg_error_from_syserror ();
+          while (index >= 0)
             {
-              clean_cache_slot (ci_mark);
-              drop_count--;
-              total_extra_certificates--;
+              xfree (shard->table[index]);
+              shard->table[index] = oldtable[index];
+              index--;
             }
+          return err;
         }
-      if (i==idx)
-        idx++;
-      else
-        idx = i;
-      idx %= 256;
     }
+  shard->tablesize = newsize;
+
+  for (i=0; i < oldsize; i++)
+    for (ci = oldtable[INDEX_FPR][i]; ci; ci = ci2)
+      {
+        ci2 = ci->next[INDEX_FPR];
+        link_cache_item (shard, ci);
+      }
+
+  for (index=0; index < N_CERT_INDEXES; index++)
+    xfree (oldtable[index]);
+  return 0;
+}
+
+
+/* Return the number of runtime cached certificates a shard may hold.  */
+static unsigned int
+max_extra_per_shard (void)
+{
+  unsigned int n = opt.max_cached_certs / CERT_CACHE_SHARDS;
 
+  return n < 2? 2 : n;
+}
+
+
+/* Put the certificate CERT into the cache.  The function takes care
+   of locking.  If FPR_BUFFER is not NULL the fingerprint of the
+   certificate will be stored there.  FPR_BUFFER neds to point to a
+   buffer of at least 20 bytes. The fingerprint will be stored on
+   success or when the function returns gpg_err_code(GPG_ERR_DUP_VALUE). */
+static gpg_error_t
+put_cert (ksba_cert_t cert, int is_loaded, int is_trusted, void *fpr_buffer)
+{
+  unsigned char help_fpr_buffer[20], *fpr;
+  gpg_error_t err;
+  cert_shard_t shard;
+  cert_item_t ci, ci2;
+  unsigned int drop_count;
+
+  fpr = fpr_buffer? fpr_buffer : &help_fpr_buffer;
   cert_compute_fpr (cert, fpr);
-  for (ci=cert_cache[*fpr]; ci; ci = ci->next)
-    if (ci->cert && !memcmp (ci->fpr, fpr, 20))
-      return gpg_error (GPG_ERR_DUP_VALUE);
-  /* Try to reuse an existing entry.  */
-  for (ci=cert_cache[*fpr]; ci; ci = ci->next)
-    if (!ci->cert)
-      break;
-  if (!ci)
-    { /* No: Create a new entry.  */
-      ci = xtrycalloc (1, sizeof *ci);
-      if (!ci)
-        return gpg_error_from_errno (errno);
-      ci->next = cert_cache[*fpr];
-      cert_cache[*fpr] = ci;
-    }
-  else
-    memset (&ci->flags, 0, sizeof ci->flags);
 
+  /* Prepare the new item before taking the lock.  */
+  ci = xtrycalloc (1, sizeof *ci);
+  if (!ci)
+    return gpg_error_from_syserror ();
   ksba_cert_ref (cert);
   ci->cert = cert;
   memcpy (ci->fpr, fpr, 20);
@@ -312,26 +516,82 @@ put_cert (ksba_cert_t cert, int is_loaded, int is_trusted, void *fpr_buffer)
   ci->issuer_dn = ksba_cert_get_issuer (cert, 0);
   if (!ci->issuer_dn || !ci->sn)
     {
-      clean_cache_slot (ci);
+      release_cache_item (ci);
       return gpg_error (GPG_ERR_INV_CERT_OBJ);
     }
   ci->subject_dn = ksba_cert_get_subject (cert, 0);
+  if (ksba_cert_get_subj_key_id (cert, NULL, &ci->keyid))
+    ci->keyid = NULL;
+  ci->hash[INDEX_FPR] = hash_fpr (fpr);
+  if (ci->subject_dn)
+    ci->hash[INDEX_SUBJECT] = hash_string (ci->subject_dn);
+  ci->hash[INDEX_SN] = hash_issuer_sn (ci->issuer_dn, ci->sn);
+  if (ci->keyid)
+    ci->hash[INDEX_KEYID] = hash_sexp (HASH_INITIAL, ci->keyid);
   ci->flags.loaded  = !!is_loaded;
   ci->flags.trusted = !!is_trusted;
 
+  shard = fpr_to_shard (fpr);
+  acquire_cache_write_lock (shard);
+
+  if (!shard->tablesize)
+    {
+      err = resize_cache_tables (shard, CERT_CACHE_INITIAL_BUCKETS);
+      if (err)
+        {
+          release_cache_lock (shard);
+          release_cache_item (ci);
+          return err;
+        }
+    }
+
+  ci2 = find_cache_item (shard, fpr);
+  if (ci2)
+    {
+      touch_cache_item (shard, ci2);
+      release_cache_lock (shard);
+      release_cache_item (ci);
+      return gpg_error (GPG_ERR_DUP_VALUE);
+    }
+
+  /* If we already reached the caching limit, drop the least recently
+     used certificates of this shard.  */
+  if (!is_loaded && shard->nextra >= max_extra_per_shard ())
+    {
+      drop_count = shard->nextra - max_extra_per_shard () + 1;
+      if (DBG_CACHE)
+        log_debug ("dropping %u certificates from the cache\n", drop_count);
+      while (drop_count-- && shard->lru_last)
+        drop_cache_item (shard, shard->lru_last);
+    }
+
+  link_cache_item (shard, ci);
   if (is_loaded)
-    total_loaded_certificates++;
+    shard->nloaded++;
   else
-    total_extra_certificates++;
+    {
+      ci->lru_next = shard->lru_first;
+      if (shard->lru_first)
+        shard->lru_first->lru_prev = ci;
+      else
+        shard->lru_last = ci;
+      shard->lru_first = ci;
+      shard->nextra++;
+    }
+
+  /* If we are out of core we simply keep the old tables; this only
+     makes the chains longer.  */
+  if (shard->nloaded + shard->nextra > 2 * shard->tablesize)
+    resize_cache_tables (shard, 2 * shard->tablesize);
 
+  release_cache_lock (shard);
   return 0;
 }
 
 
 /* Load certificates from the directory DIRNAME.  All certificates
    matching the pattern "*.crt" or "*.der"  are loaded.  We assume that
-   certificates are DER encoded and not PEM encapsulated. The cache
-   should be in a locked state when calling this fucntion.  */
+   certificates are DER encoded and not PEM encapsulated.  */
 static gpg_error_t
 load_certs_from_dir (const char *dirname, int are_trusted)
 {
@@ -433,7 +693,6 @@ cert_cache_init (void)
   if (initialization_done)
     return;
   init_cache_lock ();
-  acquire_cache_write_lock ();
 
   dname = make_filename (opt.homedir, "trusted-certs", NULL);
   load_certs_from_dir (dname, 1);
@@ -444,55 +703,71 @@ cert_cache_init (void)
   xfree (dname);
 
   initialization_done = 1;
-  release_cache_lock ();
 
   cert_cache_print_stats ();
 }
 
 /* Deinitialize the certificate cache.  With FULL set to true even the
-   unused certificate slots are released. */
+   hash tables are released. */
 void
 cert_cache_deinit (int full)
 {
+  cert_shard_t shard;
   cert_item_t ci, ci2;
-  int i;
+  unsigned int i;
+  int n, index;
 
   if (!initialization_done)
     return;
 
-  acquire_cache_write_lock ();
-
-  for (i=0; i < 256; i++)
-    for (ci=cert_cache[i]; ci; ci = ci->next)
-      clean_cache_slot (ci);
-
-  if (full)
+  for (n=0; n < CERT_CACHE_SHARDS; n++)
     {
-      for (i=0; i < 256; i++)
+      shard = cert_cache + n;
+      acquire_cache_write_lock (shard);
+      for (i=0; i < shard->tablesize; i++)
+        for (ci = shard->table[INDEX_FPR][i]; ci; ci = ci2)
+          {
+            ci2 = ci->next[INDEX_FPR];
+            release_cache_item (ci);
+          }
+      for (index=0; index < N_CERT_INDEXES; index++)
         {
-          for (ci=cert_cache[i]; ci; ci = ci2)
+          if (full)
             {
-              ci2 = ci->next;
-              xfree (ci);
+              xfree (shard->table[index]);
+              shard->table[index] = NULL;
             }
-          cert_cache[i] = NULL;
+          else if (shard->table[index])
+            memset (shard->table[index], 0,
+                    shard->tablesize * sizeof (cert_item_t));
         }
+      if (full)
+        shard->tablesize = 0;
+      shard->lru_first = shard->lru_last = NULL;
+      shard->nloaded = 0;
+      shard->nextra = 0;
+      release_cache_lock (shard);
     }
 
-  total_loaded_certificates = 0;
-  total_extra_certificates = 0;
   initialization_done = 0;
-  release_cache_lock ();
 }
 
 /* Print some statistics to the log file.  */
 void
 cert_cache_print_stats (void)
 {
-  log_info (_("permanently loaded certificates: %u\n"),
-            total_loaded_certificates);
-  log_info (_("    runtime cached certificates: %u\n"),
-            total_extra_certificates);
+  unsigned int nloaded = 0;
+  unsigned int nextra = 0;
+  int n;
+
+  for (n=0; n < CERT_CACHE_SHARDS; n++)
+    {
+      nloaded += cert_cache[n].nloaded;
+      nextra += cert_cache[n].nextra;
+    }
+
+  log_info (_("permanently loaded certificates: %u\n"), nloaded);
+  log_info (_("    runtime cached certificates: %u\n"), nextra);
 }
 
 
@@ -502,9 +777,7 @@ cache_cert (ksba_cert_t cert)
 {
   gpg_error_t err;
 
-  acquire_cache_write_lock ();
   err = put_cert (cert, 0, 0, NULL);
-  release_cache_lock ();
   if (gpg_err_code (err) == GPG_ERR_DUP_VALUE)
     log_info (_("certificate already cached\n"));
   else if (!err)
@@ -524,9 +797,7 @@ cache_cert_silent (ksba_cert_t cert, void *fpr_buffer)
 {
   gpg_error_t err;
 
-  acquire_cache_write_lock ();
   err = put_cert (cert, 0, 0, fpr_buffer);
-  release_cache_lock ();
   if (gpg_err_code (err) == GPG_ERR_DUP_VALUE)
     err = 0;
   if (err)
@@ -545,19 +816,20 @@ cache_cert_silent (ksba_cert_t cert, void *fpr_buffer)
 ksba_cert_t
 get_cert_byfpr (const unsigned char *fpr)
 {
+  cert_shard_t shard = fpr_to_shard (fpr);
   cert_item_t ci;
+  ksba_cert_t cert = NULL;
 
-  acquire_cache_read_lock ();
-  for (ci=cert_cache[*fpr]; ci; ci = ci->next)
-    if (ci->cert && !memcmp (ci->fpr, fpr, 20))
-      {
-        ksba_cert_ref (ci->cert);
-        release_cache_lock ();
-        return ci->cert;
-      }
-
-  release_cache_lock ();
-  return NULL;
+  acquire_cache_read_lock (shard);
+  ci = find_cache_item (shard, fpr);
+  if (ci)
+    {
+      touch_cache_item (shard, ci);
+      ksba_cert_ref (ci->cert);
+      cert = ci->cert;
+    }
+  release_cache_lock (shard);
+  return cert;
 }
 
 /* Return a certificate object for the given fingerprint.  STRING is
@@ -606,24 +878,30 @@ get_cert_byhexfpr (const char *string)
 ksba_cert_t
 get_cert_bysn (const char *issuer_dn, ksba_sexp_t serialno)
 {
-  /* Simple and inefficient implementation.   fixme! */
+  cert_shard_t shard;
   cert_item_t ci;
-  int i;
+  unsigned int hash;
+  int n;
 
-  acquire_cache_read_lock ();
-  for (i=0; i < 256; i++)
+  hash = hash_issuer_sn (issuer_dn, serialno);
+  for (n=0; n < CERT_CACHE_SHARDS; n++)
     {
-      for (ci=cert_cache[i]; ci; ci = ci->next)
-        if (ci->cert && !strcmp (ci->issuer_dn, issuer_dn)
+      shard = cert_cache + n;
+      acquire_cache_read_lock (shard);
+      for (ci = first_in_bucket (shard, INDEX_SN, hash);
+           ci; ci = ci->next[INDEX_SN])
+        if (ci->hash[INDEX_SN] == hash
+            && !strcmp (ci->issuer_dn, issuer_dn)
             && !compare_serialno (ci->sn, serialno))
           {
+            touch_cache_item (shard, ci);
             ksba_cert_ref (ci->cert);
-            release_cache_lock ();
+            release_cache_lock (shard);
             return ci->cert;
           }
+      release_cache_lock (shard);
     }
 
-  release_cache_lock ();
   return NULL;
 }
 
@@ -633,24 +911,30 @@ get_cert_bysn (const char *issuer_dn, ksba_sexp_t serialno)
 ksba_cert_t
 get_cert_byissuer (const char *issuer_dn, unsigned int seq)
 {
-  /* Simple and very inefficient implementation and API.  fixme! */
+  /* Simple and very inefficient implementation and API.  This is
+     only used for listing certificates, thus we do not keep a table
+     for the issuer DN alone.  */
+  cert_shard_t shard;
   cert_item_t ci;
-  int i;
+  unsigned int i;
+  int n;
 
-  acquire_cache_read_lock ();
-  for (i=0; i < 256; i++)
+  for (n=0; n < CERT_CACHE_SHARDS; n++)
     {
-      for (ci=cert_cache[i]; ci; ci = ci->next)
-        if (ci->cert && !strcmp (ci->issuer_dn, issuer_dn))
-          if (!seq--)
-            {
-              ksba_cert_ref (ci->cert);
-              release_cache_lock ();
-              return ci->cert;
-            }
+      shard = cert_cache + n;
+      acquire_cache_read_lock (shard);
+      for (i=0; i < shard->tablesize; i++)
+        for (ci = shard->table[INDEX_FPR][i]; ci; ci = ci->next[INDEX_FPR])
+          if (!strcmp (ci->issuer_dn, issuer_dn))
+            if (!seq--)
+              {
+                ksba_cert_ref (ci->cert);
+                release_cache_lock (shard);
+                return ci->cert;
+              }
+      release_cache_lock (shard);
     }
 
-  release_cache_lock ();
   return NULL;
 }
 
@@ -660,28 +944,69 @@ get_cert_byissuer (const char *issuer_dn, unsigned int seq)
 ksba_cert_t
 get_cert_bysubject (const char *subject_dn, unsigned int seq)
 {
-  /* Simple and very inefficient implementation and API.  fixme! */
+  cert_shard_t shard;
   cert_item_t ci;
-  int i;
+  unsigned int hash;
+  int n;
 
   if (!subject_dn)
     return NULL;
 
-  acquire_cache_read_lock ();
-  for (i=0; i < 256; i++)
+  hash = hash_string (subject_dn);
+  for (n=0; n < CERT_CACHE_SHARDS; n++)
     {
-      for (ci=cert_cache[i]; ci; ci = ci->next)
-        if (ci->cert && ci->subject_dn
+      shard = cert_cache + n;
+      acquire_cache_read_lock (shard);
+      for (ci = first_in_bucket (shard, INDEX_SUBJECT, hash);
+           ci; ci = ci->next[INDEX_SUBJECT])
+        if (ci->hash[INDEX_SUBJECT] == hash
             && !strcmp (ci->subject_dn, subject_dn))
           if (!seq--)
             {
+              touch_cache_item (shard, ci);
               ksba_cert_ref (ci->cert);
-              release_cache_lock ();
+              release_cache_lock (shard);
               return ci->cert;
             }
+      release_cache_lock (shard);
+    }
+
+  return NULL;
+}
+
+
+/* Return the certificate matching SUBJECT_DN and the
+   subjectKeyIdentifier KEYID.  */
+static ksba_cert_t
+get_cert_bysubject_keyid (const char *subject_dn, ksba_sexp_t keyid)
+{
+  cert_shard_t shard;
+  cert_item_t ci;
+  unsigned int hash;
+  int n;
+
+  if (!subject_dn)
+    return NULL;
+
+  hash = hash_sexp (HASH_INITIAL, keyid);
+  for (n=0; n < CERT_CACHE_SHARDS; n++)
+    {
+      shard = cert_cache + n;
+      acquire_cache_read_lock (shard);
+      for (ci = first_in_bucket (shard, INDEX_KEYID, hash);
+           ci; ci = ci->next[INDEX_KEYID])
+        if (ci->hash[INDEX_KEYID] == hash
+            && !cmp_simple_canon_sexp (ci->keyid, keyid)
+            && ci->subject_dn && !strcmp (ci->subject_dn, subject_dn))
+          {
+            touch_cache_item (shard, ci);
+            ksba_cert_ref (ci->cert);
+            release_cache_lock (shard);
+            return ci->cert;
+          }
+      release_cache_lock (shard);
     }
 
-  release_cache_lock ();
   return NULL;
 }
 
@@ -1104,7 +1429,6 @@ ksba_cert_t
 find_cert_bysubject (ctrl_t ctrl, const char *subject_dn, ksba_sexp_t keyid)
 {
   gpg_error_t err;
-  int seq;
   ksba_cert_t cert = NULL;
   cert_fetch_context_t context = NULL;
   ksba_sexp_t subj;
@@ -1117,43 +1441,37 @@ find_cert_bysubject (ctrl_t ctrl, const char *subject_dn, ksba_sexp_t keyid)
      used but the issuer certificate comes without a subject keyId! */
   if (ctrl->ocsp_certs && subject_dn)
     {
+      cert_shard_t shard;
       cert_item_t ci;
       cert_ref_t cr;
-      int i;
-
-      /* For efficiency reasons we won't use get_cert_bysubject here. */
-      acquire_cache_read_lock ();
-      for (i=0; i < 256; i++)
-        for (ci=cert_cache[i]; ci; ci = ci->next)
-          if (ci->cert && ci->subject_dn
-              && !strcmp (ci->subject_dn, subject_dn))
-            for (cr=ctrl->ocsp_certs; cr; cr = cr->next)
-              if (!memcmp (ci->fpr, cr->fpr, 20))
-                {
-                  ksba_cert_ref (ci->cert);
-                  release_cache_lock ();
-                  return ci->cert; /* We use this certificate. */
-                }
-      release_cache_lock ();
+
+      /* For efficiency reasons we won't use get_cert_bysubject here;
+         we look up the fingerprints from the OCSP request instead. */
+      for (cr=ctrl->ocsp_certs; cr; cr = cr->next)
+        {
+          shard = fpr_to_shard (cr->fpr);
+          acquire_cache_read_lock (shard);
+          ci = find_cache_item (shard, cr->fpr);
+          if (ci && ci->subject_dn && !strcmp (ci->subject_dn, subject_dn))
+            {
+              touch_cache_item (shard, ci);
+              ksba_cert_ref (ci->cert);
+              release_cache_lock (shard);
+              return ci->cert; /* We use this certificate. */
+            }
+          release_cache_lock (shard);
+        }
       if (DBG_LOOKUP)
         log_debug ("find_cert_bysubject: certificate not in ocsp_certs\n");
     }
 
 
-  /* First we check whether the certificate is cached.  */
-  for (seq=0; (cert = get_cert_bysubject (subject_dn, seq)); seq++)
-    {
-      if (!keyid)
-        break; /* No keyid requested, so return the first one found. */
-      if (!ksba_cert_get_subj_key_id (cert, NULL, &subj)
-          && !cmp_simple_canon_sexp (keyid, subj))
-        {
-          xfree (subj);
-          break; /* Found matching cert. */
-        }
-      xfree (subj);
-      ksba_cert_release (cert);
-    }
+  /* First we check whether the certificate is cached.  If no keyid
+     has been requested, we return the first one found.  */
+  if (keyid)
+    cert = get_cert_bysubject_keyid (subject_dn, keyid);
+  else
+    cert = get_cert_bysubject (subject_dn, 0);
   if (cert)
     return cert; /* Done.  */
 
@@ -1275,23 +1593,21 @@ gpg_error_t
 is_trusted_cert (ksba_cert_t cert)
 {
   unsigned char fpr[20];
+  cert_shard_t shard;
   cert_item_t ci;
 
   cert_compute_fpr (cert, fpr);
+  shard = fpr_to_shard (fpr);
 
-  acquire_cache_read_lock ();
-  for (ci=cert_cache[*fpr]; ci; ci = ci->next)
-    if (ci->cert && !memcmp (ci->fpr, fpr, 20))
-      {
-        if (ci->flags.trusted)
-          {
-            release_cache_lock ();
-            return 0; /* Yes, it is trusted. */
-          }
-        break;
-      }
+  acquire_cache_read_lock (shard);
+  ci = find_cache_item (shard, fpr);
+  if (ci && ci->flags.trusted)
+    {
+      release_cache_lock (shard);
+      return 0; /* Yes, it is trusted. */
+    }
 
-  release_cache_lock ();
+  release_cache_lock (shard);
   return gpg_error (GPG_ERR_NOT_TRUSTED);
 }
 
@@ -68,6 +68,7 @@
         Field 9:  AuthorityKeyID.issuer, each Name separated by 0x01
         Field 10: AuthorityKeyID.serial
         Field 11: Hex fingerprint of trust anchor if field 1 is 'u'.
+        Field 12: optional URL to retrieve delta CRLs (freshestCRL).
 
    2. Layout of the standard CRL Cache DB file:
 
@@ -80,6 +81,9 @@
       15 bytes  ISO date of revocation (e.g. 19980815T142000)
                 Note that there is no terminating 0 stored.
 
+      If a delta CRL has been retrieved, its items are merged with the
+      base CRL into a new DB file which then replaces the old one.
+
       The filename used is the hexadecimal (using uppercase letters)
       SHA-1 hash value of the issuer DN prefixed with a "crl-" and
       suffixed with a ".db".  Thus the length of the filename is 47.
@@ -101,6 +105,7 @@
 #ifndef HAVE_W32_SYSTEM
 #include <sys/utsname.h>
 #endif
+#include <npth.h>
 #ifdef MKDIR_TAKES_ONE_ARG
 #undef mkdir
 #define mkdir(a,b) mkdir(a)
@@ -113,6 +118,7 @@
 #include "crlfetch.h"
 #include "misc.h"
 #include "cdb.h"
+#include "../common/tlv.h"
 
 /* Change this whenever the format changes */
 #define DBDIR_D (opt.system_daemon? "crls.d" : "dirmngr-cache.d")
@@ -125,10 +131,24 @@
    idea anyway to limit the number of opened cache files. */
 #define MAX_OPEN_DB_FILES 5
 
+/* If a cached CRL expires within this number of seconds, a new CRL
+   is loaded in the background while the cached one is still used.  */
+#define CRL_REFRESH_AHEAD (10*60)
+
+/* Do not start a new background load for the same CRL within this
+   number of seconds.  */
+#define CRL_BACKGROUND_RETRY (5*60)
+
 
 static const char oidstr_crlNumber[] = "2.5.29.20";
 static const char oidstr_issuingDistributionPoint[] = "2.5.29.28";
 static const char oidstr_authorityKeyIdentifier[] = "2.5.29.35";
+static const char oidstr_deltaCRLIndicator[] = "2.5.29.27";
+static const char oidstr_freshestCRL[] = "2.5.29.46";
+
+/* The reason byte used in the DB file of a delta CRL to mark an
+   entry which has been removed from the base CRL.  */
+#define CRL_REASON_REMOVE 0xff
 
 
 /* Definition of one cached item. */
@@ -152,6 +172,7 @@ struct crl_cache_entry_s
   char *crl_number;
   char *authority_issuer;
   char *authority_serialno;
+  char *delta_url;             /* URL to retrieve delta CRLs or NULL.  */
 
   struct cdb *cdb;             /* The cache file handle or NULL if not open. */
 
@@ -159,6 +180,8 @@ struct crl_cache_entry_s
   unsigned int cdb_lru_count;  /* Used for LRU purposes. */
   int dbfile_checked;          /* Set to true if the dbfile_hash value has
                                   been checked one. */
+  time_t bg_load_time;         /* Time the last background load has been
+                                  started or 0.  */
 };
 
 
@@ -181,6 +204,19 @@ static crl_cache_entry_t find_entry (crl_cache_entry_t first,
    right at startup.  */
 static crl_cache_t current_cache;
 
+/* Object to describe a CRL which is being loaded in the background.  */
+struct crl_loader_s
+{
+  struct crl_loader_s *next;
+  char issuer_hash[41];
+  char *delta_url;       /* NULL or URL of delta CRLs (points into URL).  */
+  char url[1];
+};
+typedef struct crl_loader_s *crl_loader_t;
+
+/* The list of running background loads.  */
+static crl_loader_t crl_loaders;
+
 
 
 
@@ -373,6 +409,7 @@ release_one_cache_entry (crl_cache_entry_t entry)
             log_error (_("error closing cache file: %s\n"), strerror(errno));
         }
       xfree (entry->release_ptr);
+      xfree (entry->delta_url);
       xfree (entry->check_trust_anchor);
       xfree (entry);
     }
@@ -608,6 +645,10 @@ open_dir (crl_cache_t *r_cache)
                   if (*p)
                     entry->check_trust_anchor = xtrystrdup (p);
                   break;
+                case 12:
+                  if (*p)
+                    entry->delta_url = unpercent_string (p);
+                  break;
                 default:
                   if (*p)
                     log_info (_("extra field detected in crl record of "
@@ -760,6 +801,9 @@ write_dir_line_crl (estream_t fp, crl_cache_entry_t e)
   es_putc (':', fp);
   if (e->check_trust_anchor && e->user_trust_req)
     es_fputs (e->check_trust_anchor, fp);
+  es_putc (':', fp);
+  if (e->delta_url)
+    write_percented_string (e->delta_url, fp);
   es_putc ('\n', fp);
 }
 
@@ -1252,17 +1296,181 @@ crl_cache_flush (void)
   int rc;
 
   rc = cleanup_cache_dir (0)? -1 : 0;
+  validate_cache_flush ();
 
   return rc;
 }
 
 
+/* Fetch the CRL from URL and insert it into the cache.  */
+static gpg_error_t
+fetch_and_insert_crl (ctrl_t ctrl, const char *url)
+{
+  gpg_error_t err;
+  ksba_reader_t reader;
+
+  err = crl_fetch (ctrl, url, &reader);
+  if (err)
+    return err;
+  err = crl_cache_insert (ctrl, url, reader);
+  crl_close_reader (reader);
+  return err;
+}
+
+
+/* Return true if we have a usable and not expired CRL for
+   ISSUER_HASH.  */
+static int
+crl_is_current (const char *issuer_hash)
+{
+  crl_cache_entry_t entry;
+  gnupg_isotime_t current_time;
+
+  entry = find_entry (get_current_cache ()->entries, issuer_hash);
+  if (!entry || entry->invalid)
+    return 0;
+  gnupg_get_isotime (current_time);
+  return strcmp (entry->next_update, current_time) > 0;
+}
+
+
+/* Update the CRL for ISSUER_HASH using a delta CRL from DELTA_URL.
+   Returns 0 if we have a current CRL afterwards.  */
+static gpg_error_t
+update_with_delta_crl (ctrl_t ctrl, const char *issuer_hash,
+                       const char *delta_url)
+{
+  gpg_error_t err;
+
+  if (opt.verbose)
+    log_info (_("fetching delta CRL from '%s'\n"), delta_url);
+  err = fetch_and_insert_crl (ctrl, delta_url);
+  if (!err && !crl_is_current (issuer_hash))
+    err = gpg_error (GPG_ERR_NO_CRL_KNOWN);
+  if (err)
+    log_info (_("updating CRL using a delta CRL failed: %s"
+                " - loading the full CRL\n"), gpg_strerror (err));
+  return err;
+}
+
+
+/* Thread to load a new CRL as described by ARG into the cache.  */
+static void *
+crl_loader_thread (void *arg)
+{
+  crl_loader_t loader = arg;
+  crl_loader_t l, lprev;
+  struct server_control_s ctrlbuf;
+  gpg_error_t err;
+
+  memset (&ctrlbuf, 0, sizeof ctrlbuf);
+  dirmngr_init_default_ctrl (&ctrlbuf);
+
+  if (opt.verbose)
+    log_info (_("loading CRL for issuer id %s in the background\n"),
+              loader->issuer_hash);
+  err = gpg_error (GPG_ERR_NO_CRL_KNOWN);
+  if (loader->delta_url)
+    err = update_with_delta_crl (&ctrlbuf, loader->issuer_hash,
+                                 loader->delta_url);
+  if (err)
+    err = fetch_and_insert_crl (&ctrlbuf, loader->url);
+  if (err)
+    log_error (_("loading CRL from '%s' in the background failed: %s\n"),
+               loader->url, gpg_strerror (err));
+  else if (opt.verbose)
+    log_info (_("new CRL for issuer id %s is now in use\n"),
+              loader->issuer_hash);
+
+  for (lprev=NULL, l=crl_loaders; l; lprev=l, l=l->next)
+    if (l == loader)
+      {
+        if (lprev)
+          lprev->next = l->next;
+        else
+          crl_loaders = l->next;
+        break;
+      }
+  xfree (loader);
+  return NULL;
+}
+
+
+/* Start to load a new CRL for the cache entry ENTRY in the
+   background.  Until the new CRL has been inserted, the cached one
+   stays in use.  Returns true if a background load is running.  */
+static int
+start_background_load (crl_cache_entry_t entry)
+{
+  crl_loader_t loader;
+  time_t now;
+  npth_attr_t tattr;
+  npth_t thread;
+  int rc;
+
+  for (loader = crl_loaders; loader; loader = loader->next)
+    if (!strcmp (loader->issuer_hash, entry->issuer_hash))
+      return 1;
+
+  /* Only a CRL from a distribution point can be loaded again without
+     having the certificate.  */
+  if (strncmp (entry->url, "ldap:", 5)
+      && strncmp (entry->url, "ldaps:", 6)
+      && strncmp (entry->url, "http:", 5)
+      && strncmp (entry->url, "https:", 6))
+    return 0;
+
+  now = gnupg_get_time ();
+  if (entry->bg_load_time && entry->bg_load_time + CRL_BACKGROUND_RETRY > now)
+    return 0;
+  entry->bg_load_time = now;
+
+  loader = xtrymalloc (sizeof *loader + strlen (entry->url)
+                       + (entry->delta_url? strlen (entry->delta_url)+1 : 0));
+  if (!loader)
+    {
+      log_error (_("error allocating memory: %s\n"), strerror (errno));
+      return 0;
+    }
+  strcpy (loader->issuer_hash, entry->issuer_hash);
+  strcpy (loader->url, entry->url);
+  if (entry->delta_url)
+    {
+      loader->delta_url = loader->url + strlen (loader->url) + 1;
+      strcpy (loader->delta_url, entry->delta_url);
+    }
+  else
+    loader->delta_url = NULL;
+
+  rc = npth_attr_init (&tattr);
+  if (!rc)
+    {
+      npth_attr_setdetachstate (&tattr, NPTH_CREATE_DETACHED);
+      rc = npth_create (&thread, &tattr, crl_loader_thread, loader);
+      npth_attr_destroy (&tattr);
+    }
+  if (rc)
+    {
+      log_error ("error spawning CRL loader thread: %s\n", strerror (rc));
+      xfree (loader);
+      return 0;
+    }
+  npth_setname_np (thread, "crl-loader");
+
+  loader->next = crl_loaders;
+  crl_loaders = loader;
+  return 1;
+}
+
+
 /* Check whether the certificate identified by ISSUER_HASH and
    SN/SNLEN is valid; i.e. not listed in our cache.  With
    FORCE_REFRESH set to true, a new CRL will be retrieved even if the
    cache has not yet expired.  We use a 30 minutes threshold here so
    that invoking this function several times won't load the CRL over
-   and over.  */
+   and over.  Shortly before the CRL expires, a new one is loaded in
+   the background if it can be retrieved again from its URL; the
+   cached CRL is used in the meantime.  */
 static crl_cache_result_t
 cache_isvalid (ctrl_t ctrl, const char *issuer_hash,
                const unsigned char *sn, size_t snlen,
@@ -1324,6 +1532,16 @@ cache_isvalid (ctrl_t ctrl, const char *issuer_hash,
       return CRL_CACHE_CANTUSE;
     }
 
+  /* Get the next CRL before this one expires.  */
+  {
+    gnupg_isotime_t tmptime;
+
+    gnupg_copy_time (tmptime, current_time);
+    add_seconds_to_isotime (tmptime, CRL_REFRESH_AHEAD);
+    if (strcmp (entry->next_update, tmptime) < 0)
+      start_background_load (entry);
+  }
+
   cdb = lock_db_file (cache, entry);
   if (!cdb)
     return CRL_CACHE_DONTKNOW; /* Hmmm, not the best error code. */
@@ -1442,6 +1660,31 @@ crl_cache_isvalid (ctrl_t ctrl, const char *issuer_hash, const char *serialno,
 }
 
 
+/* Store the nextUpdate time of the cached CRL for the issuer of
+   CERT at R_NEXT_UPDATE.  An empty string is stored if no such CRL is
+   cached.  */
+void
+crl_cache_get_next_update (ksba_cert_t cert, ksba_isotime_t r_next_update)
+{
+  crl_cache_t cache = get_current_cache ();
+  crl_cache_entry_t entry;
+  char *issuer, *issuer_hash;
+
+  *r_next_update = 0;
+
+  issuer = ksba_cert_get_issuer (cert, 0);
+  if (!issuer)
+    return;
+  issuer_hash = hashify_data (issuer, strlen (issuer));
+  xfree (issuer);
+
+  entry = find_entry (cache->entries, issuer_hash);
+  if (entry && !entry->invalid)
+    gnupg_copy_time (r_next_update, entry->next_update);
+  xfree (issuer_hash);
+}
+
+
 /* Check whether the certificate CERT is valid; i.e. not listed in our
    cache.  With FORCE_REFRESH set to true, a new CRL will be retrieved
    even if the cache has not yet expired.  We use a 30 minutes
@@ -1679,6 +1922,8 @@ crl_parse_insert (ctrl_t ctrl, ksba_crl_t crl,
   gcry_md_hd_t md = NULL;
   int algo = 0;
   size_t n;
+  unsigned int nitems = 0;
+  struct timespec starttime, endtime;
 
   (void)fname;
 
@@ -1686,6 +1931,8 @@ crl_parse_insert (ctrl_t ctrl, ksba_crl_t crl,
   *thisupdate = *nextupdate = 0;
   *r_trust_anchor = NULL;
 
+  npth_clock_gettime (&starttime);
+
   /* Start of the KSBA parser loop. */
   do
     {
@@ -1746,7 +1993,10 @@ crl_parse_insert (ctrl_t ctrl, ksba_crl_t crl,
             p = serial_to_buffer (serial, &n);
             if (!p)
               BUG ();
-            record[0] = (reason & 0xff);
+            if ((reason & KSBA_CRLREASON_REMOVE_FROM_CRL))
+              record[0] = CRL_REASON_REMOVE;  /* Only in delta CRLs.  */
+            else
+              record[0] = (reason & 0xff);
             memcpy (record+1, rdate, 15);
             rc = cdb_make_add (cdb, p, n, record, 1+15);
             if (rc)
@@ -1759,10 +2009,23 @@ crl_parse_insert (ctrl_t ctrl, ksba_crl_t crl,
               }
 
             ksba_free (serial);
+            nitems++;
           }
           break;
 
         case KSBA_SR_END_ITEMS:
+          if (opt.verbose)
+            {
+              unsigned long msec;
+
+              npth_clock_gettime (&endtime);
+              msec = ((endtime.tv_sec - starttime.tv_sec) * 1000
+                      + (endtime.tv_nsec - starttime.tv_nsec) / 1000000);
+              log_info (_("%u CRL entries processed in %lu ms"
+                          " (%lu entries/s)\n"), nitems, msec,
+                        msec? (unsigned long)(nitems * 1000ULL / msec)
+                            : (unsigned long)nitems);
+            }
           break;
 
         case KSBA_SR_READY:
@@ -1946,6 +2209,272 @@ get_auth_key_id (ksba_crl_t crl, char **serialno)
 
 
 
+/* Return the first LDAP or HTTP URL from the freshestCRL extension
+   of CRL as an allocated string or NULL if there is none.  */
+static char *
+get_freshest_crl_url (ksba_crl_t crl)
+{
+  int idx;
+  const char *oid;
+  int critical;
+  const unsigned char *der, *dp;
+  size_t derlen, dplen, len, nhdr;
+  int class, tag, cons, ndef;
+  char *url;
+  gpg_error_t err;
+
+  for (idx=0; !(err=ksba_crl_get_extension (crl, idx, &oid, &critical,
+                                              &der, &derlen)); idx++)
+    if (!strcmp (oid, oidstr_freshestCRL))
+      break;
+  if (err)
+    return NULL;
+
+  /* FreshestCRL ::= SEQUENCE OF DistributionPoint */
+  if (parse_ber_header (&der, &derlen, &class, &tag, &cons, &ndef,
+                        &len, &nhdr)
+      || class != CLASS_UNIVERSAL || tag != TAG_SEQUENCE || ndef
+      || len > derlen)
+    return NULL;
+  derlen = len;
+  while (derlen)
+    {
+      /* DistributionPoint ::= SEQUENCE {
+              distributionPoint [0] DistributionPointName OPTIONAL, ...} */
+      if (parse_ber_header (&der, &derlen, &class, &tag, &cons, &ndef,
+                            &len, &nhdr)
+          || class != CLASS_UNIVERSAL || tag != TAG_SEQUENCE || ndef
+          || len > derlen)
+        return NULL;
+      dp = der;
+      dplen = len;
+      der += len;
+      derlen -= len;
+
+      /* DistributionPointName ::= CHOICE { fullName [0] GeneralNames, ...}
+         GeneralNames ::= SEQUENCE OF GeneralName  */
+      if (parse_ber_header (&dp, &dplen, &class, &tag, &cons, &ndef,
+                            &len, &nhdr)
+          || class != CLASS_CONTEXT || tag != 0 || ndef || len > dplen)
+        continue;
+      dplen = len;
+      if (parse_ber_header (&dp, &dplen, &class, &tag, &cons, &ndef,
+                            &len, &nhdr)
+          || class != CLASS_CONTEXT || tag != 0 || ndef || len > dplen)
+        continue;
+      dplen = len;
+      while (dplen)
+        {
+          if (parse_ber_header (&dp, &dplen, &class, &tag, &cons, &ndef,
+                                &len, &nhdr)
+              || ndef || len > dplen)
+            break;
+          /* uniformResourceIdentifier [6] IA5String */
+          if (class == CLASS_CONTEXT && tag == 6 && !cons
+              && ((len > 5 && (!memcmp (dp, "ldap:", 5)
+                               || !memcmp (dp, "http:", 5)))
+                  || (len > 6 && (!memcmp (dp, "ldaps:", 6)
+                                  || !memcmp (dp, "https:", 6)))))
+            {
+              url = xtrymalloc (len + 1);
+              if (!url)
+                return NULL;
+              memcpy (url, dp, len);
+              url[len] = 0;
+              return url;
+            }
+          dp += len;
+          dplen -= len;
+        }
+    }
+  return NULL;
+}
+
+
+/* Return the BaseCRLNumber from the deltaCRLIndicator extension
+   DER/DERLEN as an allocated hex string or NULL on error.  */
+static char *
+get_delta_base_number (const unsigned char *der, size_t derlen)
+{
+  int class, tag, cons, ndef;
+  size_t len, nhdr;
+
+  if (parse_ber_header (&der, &derlen, &class, &tag, &cons, &ndef,
+                        &len, &nhdr)
+      || class != CLASS_UNIVERSAL || tag != TAG_INTEGER || cons || ndef
+      || !len || len > derlen)
+    return NULL;
+  return bin2hex (der, len, NULL);
+}
+
+
+/* Compare the CRL numbers A and B given as hex strings.  Returns a
+   value less than, equal to or greater than zero.  */
+static int
+compare_crl_numbers (const char *a, const char *b)
+{
+  size_t alen, blen;
+
+  while (*a == '0')
+    a++;
+  while (*b == '0')
+    b++;
+  alen = strlen (a);
+  blen = strlen (b);
+  if (alen != blen)
+    return alen < blen? -1 : 1;
+  return ascii_strcasecmp (a, b);
+}
+
+
+/* Read the key and the record of the current item of CDB into KEY
+   and RECORD.  KEY has room for KEYSIZE bytes; the length of the key
+   is stored at R_KEYLEN.  */
+static gpg_error_t
+read_cdb_item (struct cdb *cdb, unsigned char *key, size_t keysize,
+               size_t *r_keylen, unsigned char *record)
+{
+  *r_keylen = cdb_keylen (cdb);
+  if (*r_keylen > keysize || cdb_datalen (cdb) != 16)
+    return gpg_error (GPG_ERR_INV_RECORD);
+  if (cdb_read (cdb, key, *r_keylen, cdb_keypos (cdb))
+      || cdb_read (cdb, record, 16, cdb_datapos (cdb)))
+    return gpg_error_from_syserror ();
+  return 0;
+}
+
+
+/* Merge the items of the base CRL from the cache entry BASE with the
+   items of the delta CRL stored in the file DELTA_FNAME and write
+   them to the new file FNAME.  Entries of the base CRL which are
+   listed in the delta CRL are replaced by those, or removed if they
+   have been marked with CRL_REASON_REMOVE.  */
+static gpg_error_t
+merge_delta_crl (crl_cache_t cache, crl_cache_entry_t base,
+                 const char *delta_fname, const char *fname)
+{
+  gpg_error_t err = 0;
+  struct cdb *cdb;
+  struct cdb delta;
+  struct cdb_find cdbfp;
+  struct cdb_make cdbm;
+  int fd_delta = -1;
+  int fd_cdb = -1;
+  int delta_init = 0;
+  unsigned char key[256];
+  unsigned char record[16];
+  size_t keylen;
+  unsigned int nbase = 0, ndelta = 0;
+  int rc, found;
+
+  cdb = lock_db_file (cache, base);
+  if (!cdb)
+    return gpg_error (GPG_ERR_NO_CRL_KNOWN);
+  if (!base->dbfile_checked)
+    {
+      log_error (_("cached CRL for issuer id %s tampered; we need to update\n"),
+                 base->issuer_hash);
+      err = gpg_error (GPG_ERR_NO_CRL_KNOWN);
+      goto leave;
+    }
+
+  fd_delta = open (delta_fname, O_RDONLY);
+  if (fd_delta == -1 || cdb_init (&delta, fd_delta))
+    {
+      err = gpg_error_from_syserror ();
+      log_error (_("error opening cache file '%s': %s\n"),
+                 delta_fname, gpg_strerror (err));
+      goto leave;
+    }
+  delta_init = 1;
+
+  fd_cdb = open (fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_cdb == -1)
+    {
+      err = gpg_error_from_syserror ();
+      log_error (_("error creating temporary cache file '%s': %s\n"),
+                 fname, gpg_strerror (err));
+      goto leave;
+    }
+  cdb_make_start (&cdbm, fd_cdb);
+
+  /* Copy the items of the base CRL which are not in the delta CRL.  */
+  rc = cdb_findinit (&cdbfp, cdb, NULL, 0);
+  while (!err && !rc && (rc = cdb_findnext (&cdbfp)) > 0)
+    {
+      rc = 0;
+      err = read_cdb_item (cdb, key, sizeof key, &keylen, record);
+      if (err)
+        break;
+      found = cdb_find (&delta, key, keylen);
+      if (found < 0)
+        {
+          err = gpg_error_from_syserror ();
+          break;
+        }
+      if (found)
+        continue;  /* Replaced or removed by the delta CRL.  */
+      if (cdb_make_add (&cdbm, key, keylen, record, 16))
+        err = gpg_error_from_syserror ();
+      nbase++;
+    }
+  /* Add the new items from the delta CRL.  */
+  if (!err && !rc)
+    rc = cdb_findinit (&cdbfp, &delta, NULL, 0);
+  while (!err && !rc && (rc = cdb_findnext (&cdbfp)) > 0)
+    {
+      rc = 0;
+      err = read_cdb_item (&delta, key, sizeof key, &keylen, record);
+      if (err)
+        break;
+      if (*record == CRL_REASON_REMOVE)
+        continue;
+      if (cdb_make_add (&cdbm, key, keylen, record, 16))
+        err = gpg_error_from_syserror ();
+      ndelta++;
+    }
+  if (!err && rc < 0)
+    err = gpg_error_from_syserror ();
+  if (err)
+    {
+      log_error (_("error merging delta CRL: %s\n"), gpg_strerror (err));
+      cdb_make_finish (&cdbm);
+      goto leave;
+    }
+
+  if (cdb_make_finish (&cdbm))
+    {
+      err = gpg_error_from_syserror ();
+      log_error (_("error finishing temporary cache file '%s': %s\n"),
+                 fname, gpg_strerror (err));
+      goto leave;
+    }
+  if (close (fd_cdb))
+    {
+      fd_cdb = -1;
+      err = gpg_error_from_syserror ();
+      log_error (_("error closing temporary cache file '%s': %s\n"),
+                 fname, gpg_strerror (err));
+      goto leave;
+    }
+  fd_cdb = -1;
+
+  if (opt.verbose)
+    log_info (_("delta CRL merged: %u items kept, %u items added\n"),
+              nbase, ndelta);
+
+ leave:
+  if (fd_cdb != -1)
+    close (fd_cdb);
+  if (delta_init)
+    cdb_free (&delta);
+  if (fd_delta != -1)
+    close (fd_delta);
+  unlock_db_file (cache, base);
+  return err;
+}
+
+
 /* Insert the CRL retrieved using URL into the cache specified by
    CACHE.  The CRL itself will be read from the stream FP and is
    expected in binary format.
@@ -1982,7 +2511,13 @@ crl_cache_insert (ctrl_t ctrl, const char *url, ksba_reader_t reader)
   int idx;
   const char *oid;
   int critical;
+  const unsigned char *der;
+  size_t derlen;
   char *trust_anchor = NULL;
+  char *delta_base = NULL;
+  char *crl_number = NULL;
+  char *base_url = NULL;
+  char *delta_url = NULL;
 
   /* FIXME: We should acquire a mutex for the URL, so that we don't
      simultaneously enter the same CRL twice.  However this needs to be
@@ -2082,19 +2617,6 @@ crl_cache_insert (ctrl_t ctrl, const char *url, ksba_reader_t reader)
   fd_cdb = -1;
 
 
-  /* Create a checksum. */
-  {
-    unsigned char md5buf[16];
-
-    if (hash_dbfile (fname, md5buf))
-      {
-        err = gpg_error (GPG_ERR_CHECKSUM);
-        goto leave;
-      }
-    checksum = hexify_data (md5buf, 16);
-  }
-
-
   /* Check whether that new CRL is still not expired. */
   gnupg_get_isotime (current_time);
   if (strcmp (nextupdate, current_time) < 0 )
@@ -2114,8 +2636,14 @@ crl_cache_insert (ctrl_t ctrl, const char *url, ksba_reader_t reader)
 
   /* Check for unknown critical extensions. */
   for (idx=0; !(err=ksba_crl_get_extension (crl, idx, &oid, &critical,
-                                              NULL, NULL)); idx++)
+                                              &der, &derlen)); idx++)
     {
+      if (!strcmp (oid, oidstr_deltaCRLIndicator) && !delta_base)
+        {
+          delta_base = get_delta_base_number (der, derlen);
+          if (delta_base)
+            continue;
+        }
       if (!critical
           || !strcmp (oid, oidstr_authorityKeyIdentifier)
           || !strcmp (oid, oidstr_crlNumber) )
@@ -2139,6 +2667,69 @@ crl_cache_insert (ctrl_t ctrl, const char *url, ksba_reader_t reader)
      used as the key for the cache. */
   issuer_hash = hashify_data (issuer, strlen (issuer));
 
+  crl_number = get_crl_number (crl);
+  delta_url = get_freshest_crl_url (crl);
+
+  /* A delta CRL is merged with the cached base CRL.  The base CRL
+     must be at least as new as the BaseCRLNumber given in the delta
+     CRL.  */
+  if (delta_base)
+    {
+      char *mergedfname;
+
+      e = find_entry (cache->entries, issuer_hash);
+      if (!e || e->invalid || !e->crl_number || !crl_number
+          || compare_crl_numbers (e->crl_number, delta_base) < 0)
+        {
+          log_info (_("no suitable base CRL for delta CRL of"
+                      " issuer id %s\n"), issuer_hash);
+          err = gpg_error (GPG_ERR_NO_CRL_KNOWN);
+          goto leave;
+        }
+      if (compare_crl_numbers (crl_number, e->crl_number) <= 0)
+        {
+          log_info (_("delta CRL for issuer id %s is not newer than"
+                      " the cached CRL - ignored\n"), issuer_hash);
+          goto leave;
+        }
+
+      /* Keep the URLs of the base CRL.  */
+      base_url = xtrystrdup (e->url);
+      if (!base_url)
+        {
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+      if (!delta_url && e->delta_url)
+        delta_url = xtrystrdup (e->delta_url);
+      url = base_url;
+
+      mergedfname = strconcat (fname, ".merge", NULL);
+      if (!mergedfname)
+        {
+          err = gpg_error_from_syserror ();
+          goto leave;
+        }
+      err = merge_delta_crl (cache, e, fname, mergedfname);
+      gnupg_remove (fname);
+      xfree (fname);
+      fname = mergedfname;
+      if (err)
+        goto leave;
+    }
+
+  /* Create a checksum. */
+  {
+    unsigned char md5buf[16];
+
+    if (hash_dbfile (fname, md5buf))
+      {
+        err = gpg_error (GPG_ERR_CHECKSUM);
+        goto leave;
+      }
+    checksum = hexify_data (md5buf, 16);
+  }
+
   /* Create an ENTRY. */
   entry = xtrycalloc (1, sizeof *entry);
   if (!entry)
@@ -2165,7 +2756,10 @@ crl_cache_insert (ctrl_t ctrl, const char *url, ksba_reader_t reader)
   gnupg_copy_time (entry->this_update, thisupdate);
   gnupg_copy_time (entry->next_update, nextupdate);
   gnupg_copy_time (entry->last_refresh, current_time);
-  entry->crl_number = get_crl_number (crl);
+  entry->crl_number = crl_number;
+  crl_number = NULL;
+  entry->delta_url = delta_url;
+  delta_url = NULL;
   entry->authority_issuer = get_auth_key_id (crl, &entry->authority_serialno);
   entry->invalid = invalidate_crl;
   entry->user_trust_req = !!trust_anchor;
@@ -2224,6 +2818,9 @@ crl_cache_insert (ctrl_t ctrl, const char *url, ksba_reader_t reader)
   cache->entries = entry;
   entry = NULL;
 
+  /* Cached validation results may depend on the old CRL.  */
+  validate_cache_flush ();
+
   err = update_dir (cache);
   if (err)
     {
@@ -2248,6 +2845,10 @@ crl_cache_insert (ctrl_t ctrl, const char *url, ksba_reader_t reader)
   xfree (issuer_hash);
   xfree (checksum);
   xfree (trust_anchor);
+  xfree (delta_base);
+  xfree (crl_number);
+  xfree (base_url);
+  xfree (delta_url);
   return err ? err : err2;
 }
 
@@ -2270,6 +2871,8 @@ list_one_crl_entry (crl_cache_t cache, crl_cache_entry_t e, estream_t fp)
   es_fprintf (fp, " This Update:\t%s\n", e->this_update );
   es_fprintf (fp, " Next Update:\t%s\n", e->next_update );
   es_fprintf (fp, " CRL Number :\t%s\n", e->crl_number? e->crl_number: "none");
+  if (e->delta_url)
+    es_fprintf (fp, " Delta CRLs :\t%s\n", e->delta_url);
   es_fprintf (fp, " AuthKeyId  :\t%s\n",
               e->authority_serialno? e->authority_serialno:"none");
   if (e->authority_serialno && e->authority_issuer)
@@ -2436,6 +3039,31 @@ crl_cache_reload_crl (ctrl_t ctrl, ksba_cert_t cert)
   char *issuername_uri = NULL;
   int any_dist_point = 0;
   int seq;
+  char *issuer_hash = NULL;
+  crl_cache_entry_t e;
+
+  /* If the cached CRL announces delta CRLs, try to update it with
+     a delta CRL first.  */
+  issuer = ksba_cert_get_issuer (cert, 0);
+  if (issuer)
+    {
+      issuer_hash = hashify_data (issuer, strlen (issuer));
+      ksba_free (issuer);
+      issuer = NULL;
+      e = find_entry (get_current_cache ()->entries, issuer_hash);
+      if (e && e->delta_url && e->crl_number && !e->invalid)
+        {
+          distpoint_uri = xtrystrdup (e->delta_url);
+          if (distpoint_uri
+              && !update_with_delta_crl (ctrl, issuer_hash, distpoint_uri))
+            {
+              err = 0;
+              goto leave;
+            }
+          xfree (distpoint_uri);
+          distpoint_uri = NULL;
+        }
+    }
 
   /* Loop over all distribution points, get the CRLs and put them into
      the cache. */
@@ -2576,5 +3204,6 @@ crl_cache_reload_crl (ctrl_t ctrl, ksba_cert_t cert)
   ksba_name_release (distpoint);
   ksba_name_release (issuername);
   ksba_free (issuer);
+  xfree (issuer_hash);
   return err;
 }
@@ -57,6 +57,9 @@ crl_cache_result_t crl_cache_isvalid (ctrl_t ctrl,
 gpg_error_t crl_cache_cert_isvalid (ctrl_t ctrl, ksba_cert_t cert,
                                     int force_refresh);
 
+void crl_cache_get_next_update (ksba_cert_t cert,
+                                ksba_isotime_t r_next_update);
+
 gpg_error_t crl_cache_insert (ctrl_t ctrl, const char *url,
                               ksba_reader_t reader);
 
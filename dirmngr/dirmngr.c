@@ -59,7 +59,10 @@
 #include "certcache.h"
 #include "crlcache.h"
 #include "crlfetch.h"
+#include "ocsp.h"
+#include "validate.h"
 #include "misc.h"
+#include "http.h"
 #include "ldapserver.h"
 #include "asshelp.h"
 #include "ldap-wrapper.h"
@@ -125,6 +128,7 @@ enum cmd_and_opt_values {
   oOCSPMaxPeriod,
   oOCSPCurrentPeriod,
   oMaxReplies,
+  oMaxCachedCerts,
   oHkpCaCert,
   oFakedSystemTime,
   oForce,
@@ -133,6 +137,8 @@ enum cmd_and_opt_values {
   oLDAPWrapperProgram,
   oHTTPWrapperProgram,
   oIgnoreCertExtension,
+  oListenBacklog,
+  oMaxConnections,
   aTest
 };
 
@@ -204,12 +210,16 @@ static ARGPARSE_OPTS opts[] = {
 
   ARGPARSE_s_i (oMaxReplies, "max-replies",
                 N_("|N|do not return more than N items in one query")),
+  ARGPARSE_s_u (oMaxCachedCerts, "max-cached-certs",
+                N_("|N|cache up to N certificates")),
 
   ARGPARSE_s_s (oHkpCaCert, "hkp-cacert",
                 N_("|FILE|use the CA certificates in FILE for HKP over TLS")),
 
 
   ARGPARSE_s_s (oSocketName, "socket-name", "@"),  /* Only for debugging.  */
+  ARGPARSE_s_i (oListenBacklog, "listen-backlog", "@"),
+  ARGPARSE_s_i (oMaxConnections, "max-connections", "@"),
 
   ARGPARSE_s_u (oFakedSystemTime, "faked-system-time", "@"), /*(epoch time)*/
   ARGPARSE_p_u (oDebug,    "debug", "@"),
@@ -231,7 +241,9 @@ static ARGPARSE_OPTS opts[] = {
 };
 
 #define DEFAULT_MAX_REPLIES 10
+#define DEFAULT_MAX_CACHED_CERTS 1000
 #define DEFAULT_LDAP_TIMEOUT 100 /* arbitrary large timeout */
+#define DEFAULT_LISTEN_BACKLOG 64
 
 /* For the cleanup handler we need to keep track of the socket's name. */
 static const char *socket_name;
@@ -259,6 +271,14 @@ static volatile int shutdown_pending;
 /* Counter for the active connections.  */
 static int active_connections;
 
+/* The size of the queue for pending connections.  */
+static int listen_backlog = DEFAULT_LISTEN_BACKLOG;
+
+/* The maximum number of concurrent connections or 0 for no limit.
+   If this number is reached, new connections are left in the listen
+   queue until an active connection terminates.  */
+static int max_connections;
+
 /* The timer tick used for housekeeping stuff.  For Windows we use a
    longer period as the SetWaitableTimer seems to signal earlier than
    the 2 seconds.  All values are in seconds. */
@@ -478,6 +498,7 @@ parse_rereadable_options (ARGPARSE_ARGS *pargs, int reread)
       opt.ocsp_max_period = 90 * 86400;       /* 90 days.  */
       opt.ocsp_current_period = 3 * 60 * 60;  /* 3 hours. */
       opt.max_replies = DEFAULT_MAX_REPLIES;
+      opt.max_cached_certs = DEFAULT_MAX_CACHED_CERTS;
       while (opt.ocsp_signer)
         {
           fingerprint_list_t tmp = opt.ocsp_signer->next;
@@ -537,6 +558,7 @@ parse_rereadable_options (ARGPARSE_ARGS *pargs, int reread)
     case oOCSPCurrentPeriod: opt.ocsp_current_period = pargs->r.ret_int; break;
 
     case oMaxReplies: opt.max_replies = pargs->r.ret_int; break;
+    case oMaxCachedCerts: opt.max_cached_certs = pargs->r.ret_ulong; break;
 
     case oHkpCaCert:
       http_register_tls_ca (pargs->r.ret_str);
@@ -883,6 +905,17 @@ main (int argc, char **argv)
 
         case oSocketName: socket_name = pargs.r.ret_str; break;
 
+        case oListenBacklog:
+          listen_backlog = pargs.r.ret_int;
+          if (listen_backlog < 1)
+            listen_backlog = 1;
+          break;
+        case oMaxConnections:
+          max_connections = pargs.r.ret_int;
+          if (max_connections < 0)
+            max_connections = 0;
+          break;
+
         default : pargs.err = configfp? 1:2; break;
 	}
     }
@@ -1071,7 +1104,7 @@ main (int argc, char **argv)
         }
       cleanup_socket = 1;
 
-      if (listen (FD2INT (fd), 5) == -1)
+      if (listen (FD2INT (fd), listen_backlog) == -1)
         {
           log_error (_("listen() failed: %s\n"), strerror (errno));
           assuan_sock_close (fd);
@@ -1664,6 +1697,10 @@ dirmngr_sighup_action (void)
   reread_configuration ();
   cert_cache_deinit (0);
   crl_cache_deinit ();
+  ocsp_cache_flush ();
+  validate_cache_flush ();
+  http_connpool_flush ();
+  http_dns_cache_flush ();
   cert_cache_init ();
   crl_cache_init ();
 }
@@ -1689,6 +1726,11 @@ handle_signal (int signo)
       log_info (_("SIGUSR2 received - no action defined\n"));
       break;
 
+    case SIGCONT:
+      /* Used by connection_terminated to wake up the main loop;
+         nothing else to do.  */
+      break;
+
     case SIGTERM:
       if (!shutdown_pending)
         log_info (_("SIGTERM received - shutting down ...\n"));
@@ -1831,6 +1873,21 @@ check_nonce (assuan_fd_t fd, assuan_sock_nonce_t *nonce)
 }
 
 
+/* This function needs to be called by the connection threads right
+   before they terminate.  If the connection limit had been reached,
+   the main loop is not anymore waiting for new connections; thus we
+   wake it up.  */
+static void
+connection_terminated (void)
+{
+  active_connections--;
+#ifndef HAVE_W32_SYSTEM
+  if (max_connections && active_connections + 1 >= max_connections)
+    kill (getpid (), SIGCONT);
+#endif
+}
+
+
 /* Helper to call a connection's main fucntion. */
 static void *
 start_connection_thread (void *arg)
@@ -1844,6 +1901,7 @@ start_connection_thread (void *arg)
   if (check_nonce (fd, &socket_nonce))
     {
       log_error ("handler nonce check FAILED\n");
+      connection_terminated ();
       return NULL;
     }
 
@@ -1851,7 +1909,6 @@ start_connection_thread (void *arg)
   npth_setspecific (my_tlskey_current_fd, argval.aptr);
 #endif
 
-  active_connections++;
   if (opt.verbose)
     log_info (_("handler for fd %d started\n"), FD2INT (fd));
 
@@ -1859,7 +1916,7 @@ start_connection_thread (void *arg)
 
   if (opt.verbose)
     log_info (_("handler for fd %d terminated\n"), FD2INT (fd));
-  active_connections--;
+  connection_terminated ();
 
 #ifndef HAVE_W32_SYSTEM
   argval.afd = ASSUAN_INVALID_FD;
@@ -1896,6 +1953,7 @@ handle_connections (assuan_fd_t listen_fd)
   npth_sigev_add (SIGHUP);
   npth_sigev_add (SIGUSR1);
   npth_sigev_add (SIGUSR2);
+  npth_sigev_add (SIGCONT);
   npth_sigev_add (SIGINT);
   npth_sigev_add (SIGTERM);
   npth_sigev_fini ();
@@ -1925,8 +1983,14 @@ handle_connections (assuan_fd_t listen_fd)
           FD_ZERO (&fdset);
 	}
 
-      /* Take a copy of the fdset.  */
-      read_fdset = fdset;
+      /* Take a copy of the fdset.  If the connection limit has been
+         reached we do not watch the listening socket; the pending
+         connections are kept in the listen queue until an active
+         connection terminates.  */
+      if (max_connections && active_connections >= max_connections)
+        FD_ZERO (&read_fdset);
+      else
+        read_fdset = fdset;
 
       npth_clock_gettime (&curtime);
       if (!(npth_timercmp (&curtime, &abstime, <)))
@@ -1982,11 +2046,13 @@ handle_connections (assuan_fd_t listen_fd)
                         "conn fd=%d", FD2INT(fd));
               threadname[sizeof threadname -1] = 0;
 
+              active_connections++;
               ret = npth_create (&thread, &tattr, start_connection_thread, argval.aptr);
 	      if (ret)
                 {
                   log_error ("error spawning connection handler: %s\n",
                              strerror (ret) );
+                  active_connections--;
                   assuan_sock_close (fd);
                 }
 	      npth_setname_np (thread, threadname);
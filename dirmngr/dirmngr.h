@@ -116,6 +116,8 @@ struct
   int allow_ocsp;     /* Allow using OCSP. */
 
   int max_replies;
+  unsigned int max_cached_certs; /* Maximum number of certificates
+                                    cached at runtime.  */
   unsigned int ldaptimeout;
 
   ldap_server_t ldapservers;
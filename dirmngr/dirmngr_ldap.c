@@ -187,6 +187,38 @@ typedef struct my_opt_s *my_opt_t;
 static void catch_alarm (int dummy);
 #endif
 static int process_url (my_opt_t myopt, const char *url);
+static int run_request (int argc, char **argv, estream_t outstream);
+
+
+#ifdef USE_LDAPWRAPPER
+/* The maximum number of arguments of a request in server mode.  */
+#define MAX_SERVER_ARGS 64
+
+/* Set if we are running as a persistent worker (--server).  */
+static int server_mode;
+
+/* In server mode the LDAP connection of the last request is kept
+   open so that the next request to the same server does not need to
+   connect and bind again.  */
+static struct
+{
+  LDAP *ld;
+  char *host;
+  int port;
+  char *user;
+  char *pass;
+} cached_conn;
+
+static ssize_t frame_writer_write (void *cookie,
+                                   const void *buffer, size_t size);
+static es_cookie_io_functions_t frame_writer_functions =
+  {
+    NULL,
+    frame_writer_write,
+    NULL,
+    NULL
+  };
+#endif /*USE_LDAPWRAPPER*/
 
 
 
@@ -222,6 +254,179 @@ my_strusage (int level)
 #endif /*!USE_LDAPWRAPPER*/
 
 
+#ifdef USE_LDAPWRAPPER
+/* Cookie write function for the output of a request in server mode.
+   Each chunk of data is written as a frame consisting of a 4 byte
+   big endian length followed by the data.  */
+static ssize_t
+frame_writer_write (void *cookie, const void *buffer, size_t size)
+{
+  unsigned char hdr[4];
+
+  (void)cookie;
+
+  if (!buffer || !size)
+    return 0;  /* Flush - nothing to do.  */
+
+  hdr[0] = (size >> 24);
+  hdr[1] = (size >> 16);
+  hdr[2] = (size >> 8);
+  hdr[3] = (size);
+  if (es_write (es_stdout, hdr, 4, NULL)
+      || es_write (es_stdout, buffer, size, NULL))
+    return -1;
+  return size;
+}
+
+
+/* Release the cached LDAP connection.  */
+static void
+release_cached_conn (void)
+{
+  if (cached_conn.ld)
+    ldap_unbind (cached_conn.ld);
+  xfree (cached_conn.host);
+  xfree (cached_conn.user);
+  xfree (cached_conn.pass);
+  memset (&cached_conn, 0, sizeof cached_conn);
+}
+
+
+static int
+str_equal (const char *a, const char *b)
+{
+  if (!a || !b)
+    return a == b;
+  return !strcmp (a, b);
+}
+
+
+/* Return the cached LDAP connection if it has been established to
+   HOST and PORT with the credentials USER and PASS and remove it from
+   the cache.  Return NULL if there is no such connection.  */
+static LDAP *
+take_cached_conn (const char *host, int port,
+                  const char *user, const char *pass)
+{
+  LDAP *ld;
+
+  if (!cached_conn.ld
+      || cached_conn.port != port
+      || !str_equal (cached_conn.host, host)
+      || !str_equal (cached_conn.user, user)
+      || !str_equal (cached_conn.pass, pass))
+    {
+      release_cached_conn ();
+      return NULL;
+    }
+
+  ld = cached_conn.ld;
+  cached_conn.ld = NULL;
+  return ld;
+}
+
+
+/* Store the LDAP connection LD in the cache.  This takes ownership of
+   LD.  */
+static void
+put_cached_conn (LDAP *ld, const char *host, int port,
+                 const char *user, const char *pass)
+{
+  release_cached_conn ();
+  cached_conn.ld = ld;
+  cached_conn.port = port;
+  if (!(cached_conn.host = xtrystrdup (host))
+      || (user && !(cached_conn.user = xtrystrdup (user)))
+      || (pass && !(cached_conn.pass = xtrystrdup (pass))))
+    release_cached_conn ();
+}
+
+
+/* Run as a persistent worker for dirmngr.  Requests are read from
+   stdin: Each argument is given on a line prefixed with a '+' and an
+   empty line terminates the request.  The output of the request is
+   written to stdout as frames (see frame_writer_write) and terminated
+   by a frame of length 0 followed by one status byte which is 0 for
+   success.  Log output goes to stderr as usual.  The process
+   terminates on EOF.  */
+static int
+run_server (void)
+{
+  static char pgmname[] = "dirmngr_ldap";
+  char *argv[MAX_SERVER_ARGS+1];
+  int argc, i;
+  char *line = NULL;
+  size_t linesize = 0;
+  ssize_t n;
+  estream_t outstream;
+  unsigned char trailer[5];
+  int rc;
+
+  server_mode = 1;
+  es_set_binary (es_stdin);
+
+  argv[0] = pgmname;
+  argc = 1;
+  for (;;)
+    {
+      n = es_read_line (es_stdin, &line, &linesize, NULL);
+      if (n <= 0)
+        break;  /* EOF or read error.  */
+      if (line[n-1] == '\n')
+        line[--n] = 0;
+
+      if (n)
+        {
+          if (*line != '+' || argc == MAX_SERVER_ARGS)
+            {
+              log_error ("invalid request line\n");
+              break;
+            }
+          argv[argc] = xtrystrdup (line+1);
+          if (!argv[argc])
+            {
+              log_error ("error copying string: %s\n", strerror (errno));
+              break;
+            }
+          argc++;
+          continue;
+        }
+
+      /* End of request.  */
+      argv[argc] = NULL;
+      outstream = es_fopencookie (NULL, "w", frame_writer_functions);
+      if (!outstream)
+        {
+          log_error ("error creating output stream: %s\n", strerror (errno));
+          break;
+        }
+      log_get_errorcount (1);
+      rc = run_request (argc, argv, outstream);
+#ifndef HAVE_W32_SYSTEM
+      alarm (0);
+#endif
+      if (es_fclose (outstream))
+        break;
+
+      memset (trailer, 0, 4);
+      trailer[4] = rc;
+      if (es_write (es_stdout, trailer, 5, NULL) || es_fflush (es_stdout))
+        break;
+
+      for (i=1; i < argc; i++)
+        xfree (argv[i]);
+      argc = 1;
+    }
+
+  for (i=1; i < argc; i++)
+    xfree (argv[i]);
+  xfree (line);
+  release_cached_conn ();
+  return 0;
+}
+#endif /*USE_LDAPWRAPPER*/
+
+
 int
 #ifdef USE_LDAPWRAPPER
 main (int argc, char **argv)
@@ -229,19 +434,6 @@ main (int argc, char **argv)
 ldap_wrapper_main (char **argv, estream_t outstream)
 #endif
 {
-#ifndef USE_LDAPWRAPPER
-  int argc;
-#endif
-  ARGPARSE_ARGS pargs;
-  int any_err = 0;
-  char *p;
-  int only_search_timeout = 0;
-  struct my_opt_s my_opt_buffer;
-  my_opt_t myopt = &my_opt_buffer;
-  char *malloced_buffer1 = NULL;
-
-  memset (&my_opt_buffer, 0, sizeof my_opt_buffer);
-
 #ifdef USE_LDAPWRAPPER
   set_strusage (my_strusage);
   log_set_prefix ("dirmngr_ldap", JNLIB_LOG_WITH_PREFIX);
@@ -252,12 +444,38 @@ ldap_wrapper_main (char **argv, estream_t outstream)
   init_common_subsystems (&argc, &argv);
 
   es_set_binary (es_stdout);
-  myopt->outstream = es_stdout;
+
+  if (argc == 2 && !strcmp (argv[1], "--server"))
+    return run_server ();
+
+  return run_request (argc, argv, es_stdout);
 #else /*!USE_LDAPWRAPPER*/
-  myopt->outstream = outstream;
+  int argc;
+
   for (argc=0; argv[argc]; argc++)
     ;
+  return run_request (argc, argv, outstream);
 #endif /*!USE_LDAPWRAPPER*/
+}
+
+
+/* Parse the arguments ARGC and ARGV of one request, run the queries
+   and write the results to OUTSTREAM.  */
+static int
+run_request (int argc, char **argv, estream_t outstream)
+{
+  ARGPARSE_ARGS pargs;
+  int any_err = 0;
+  char *p;
+  int only_search_timeout = 0;
+  struct my_opt_s my_opt_buffer;
+  my_opt_t myopt = &my_opt_buffer;
+  char *malloced_buffer1 = NULL;
+
+  memset (&my_opt_buffer, 0, sizeof my_opt_buffer);
+  memset (&pargs, 0, sizeof pargs);
+
+  myopt->outstream = outstream;
 
   /* LDAP defaults */
   myopt->timeout.tv_sec = DEFAULT_LDAP_TIMEOUT;
@@ -336,6 +554,11 @@ ldap_wrapper_main (char **argv, estream_t outstream)
     log_error (_("invalid port number %d\n"), myopt->port);
 
 #ifdef USE_LDAPWRAPPER
+  if (server_mode && (log_get_errorcount (0) || argc < 1))
+    {
+      xfree (malloced_buffer1);
+      return 2;
+    }
   if (log_get_errorcount (0))
     exit (2);
   if (argc < 1)
@@ -567,12 +790,13 @@ print_ldap_entries (my_opt_t myopt, LDAP *ld, LDAPMessage *msg, char *want_attr)
 static int
 fetch_ldap (my_opt_t myopt, const char *url, const LDAPURLDesc *ludp)
 {
-  LDAP *ld;
+  LDAP *ld = NULL;
   LDAPMessage *msg;
   int rc = 0;
   char *host, *dn, *filter, *attrs[2], *attr;
   int port;
   int ret;
+  int from_cache = 0;
 
   host     = myopt->host?   myopt->host   : ludp->lud_host;
   port     = myopt->port?   myopt->port   : ludp->lud_port;
@@ -626,26 +850,41 @@ fetch_ldap (my_opt_t myopt, const char *url, const LDAPURLDesc *ludp)
     log_info (_("WARNING: using first attribute only\n"));
 
 
-  set_timeout (myopt);
-  npth_unprotect ();
-  ld = my_ldap_init (host, port);
-  npth_protect ();
-  if (!ld)
+#ifdef USE_LDAPWRAPPER
+  if (server_mode)
     {
-      log_error (_("LDAP init to '%s:%d' failed: %s\n"),
-                 host, port, strerror (errno));
-      return -1;
+      ld = take_cached_conn (host, port, myopt->user, myopt->pass);
+      from_cache = !!ld;
+      if (from_cache && myopt->verbose > 1)
+        log_info ("using cached connection to '%s:%d'\n", host, port);
     }
-  npth_unprotect ();
-  /* Fixme:  Can we use MYOPT->user or is it shared with other theeads?.  */
-  ret = my_ldap_simple_bind_s (ld, myopt->user, myopt->pass);
-  npth_protect ();
-  if (ret)
+#endif /*USE_LDAPWRAPPER*/
+
+ again:
+  if (!ld)
     {
-      log_error (_("binding to '%s:%d' failed: %s\n"),
-                 host, port, strerror (errno));
-      ldap_unbind (ld);
-      return -1;
+      set_timeout (myopt);
+      npth_unprotect ();
+      ld = my_ldap_init (host, port);
+      npth_protect ();
+      if (!ld)
+        {
+          log_error (_("LDAP init to '%s:%d' failed: %s\n"),
+                     host, port, strerror (errno));
+          return -1;
+        }
+      npth_unprotect ();
+      /* Fixme:  Can we use MYOPT->user or is it shared with other
+         theeads?.  */
+      ret = my_ldap_simple_bind_s (ld, myopt->user, myopt->pass);
+      npth_protect ();
+      if (ret)
+        {
+          log_error (_("binding to '%s:%d' failed: %s\n"),
+                     host, port, strerror (errno));
+          ldap_unbind (ld);
+          return -1;
+        }
     }
 
   set_timeout (myopt);
@@ -656,11 +895,21 @@ fetch_ldap (my_opt_t myopt, const char *url, const LDAPURLDesc *ludp)
                           0,
                           &myopt->timeout, &msg);
   npth_protect ();
+  if (rc == LDAP_SERVER_DOWN && from_cache)
+    {
+      /* The server closed the cached connection in the meantime;
+         try again with a fresh one.  */
+      ldap_unbind (ld);
+      ld = NULL;
+      from_cache = 0;
+      goto again;
+    }
   if (rc == LDAP_SIZELIMIT_EXCEEDED && myopt->multi)
     {
       if (es_fwrite ("E\0\0\0\x09truncated", 14, 1, myopt->outstream) != 1)
         {
           log_error (_("error writing to stdout: %s\n"), strerror (errno));
+          ldap_unbind (ld);
           return -1;
         }
     }
@@ -674,8 +923,8 @@ fetch_ldap (my_opt_t myopt, const char *url, const LDAPURLDesc *ludp)
 #endif
       if (rc != LDAP_NO_SUCH_OBJECT)
         {
-          /* FIXME: Need deinit (ld)?  */
           /* Hmmm: Do we need to released MSG in case of an error? */
+          ldap_unbind (ld);
           return -1;
         }
     }
@@ -683,7 +932,12 @@ fetch_ldap (my_opt_t myopt, const char *url, const LDAPURLDesc *ludp)
   rc = print_ldap_entries (myopt, ld, msg, myopt->multi? NULL:attr);
 
   ldap_msgfree (msg);
-  ldap_unbind (ld);
+#ifdef USE_LDAPWRAPPER
+  if (server_mode)
+    put_cached_conn (ld, host, port, myopt->user, myopt->pass);
+  else
+#endif
+    ldap_unbind (ld);
   return rc;
 }
 
@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <npth.h>
 
 #include "dirmngr.h"
 #include "misc.h"
@@ -31,6 +32,28 @@
 #include "ks-action.h"
 
 
+/* The maximum number of requests KS_GET sends concurrently to one
+   keyserver.  If the keyserver is a pool the requests are spread over
+   its members by the host selection.  */
+#define KS_GET_MAX_JOBS 4
+
+/* A job to fetch the keys for one pattern.  */
+struct ks_get_job_s
+{
+  /* A private copy of the caller's control object without the server
+     part so that the job can't write to the Assuan connection.  */
+  struct server_control_s ctrl;
+  parsed_uri_t uri;
+  const char *pattern;
+  npth_t thread;
+  int running;        /* The thread has been started.  */
+  gpg_error_t err;    /* The result of the fetch.  */
+  estream_t fp;       /* A memory stream with the fetched data.  */
+  char *source;       /* The server actually used.  */
+};
+typedef struct ks_get_job_s *ks_get_job_t;
+
+
 /* Copy all data from IN to OUT.  */
 static gpg_error_t
 copy_stream (estream_t in, estream_t out)
@@ -180,8 +203,97 @@ ks_action_search (ctrl_t ctrl, strlist_t patterns, estream_t outfp)
 }
 
 
+/* Run the job described by JOB_ARG.  This is used as thread
+   function but may also be called directly.  */
+static void *
+ks_get_job (void *job_arg)
+{
+  ks_get_job_t job = job_arg;
+  estream_t infp;
+
+  job->err = ks_hkp_get (&job->ctrl, job->uri, job->pattern,
+                         &infp, &job->source);
+  if (job->err)
+    return NULL;
+
+  /* We need to read the entire response so that the connection may be
+     reused and the output can later be written in order.  */
+  job->fp = es_fopenmem (0, "w+b");
+  if (!job->fp)
+    job->err = gpg_error_from_syserror ();
+  else
+    job->err = copy_stream (infp, job->fp);
+  es_fclose (infp);
+  if (!job->err)
+    es_rewind (job->fp);
+  return NULL;
+}
+
+
+/* Start JOB for PATTERN using the keyserver URI.  If no thread can be
+   created the job is run directly.  */
+static void
+start_ks_get_job (ctrl_t ctrl, ks_get_job_t job,
+                  parsed_uri_t uri, const char *pattern)
+{
+  npth_attr_t tattr;
+  int rc;
+
+  memset (job, 0, sizeof *job);
+  job->ctrl = *ctrl;
+  job->ctrl.refcount = 0;
+  job->ctrl.server_local = NULL;
+  job->uri = uri;
+  job->pattern = pattern;
+
+  rc = npth_attr_init (&tattr);
+  if (!rc)
+    {
+      npth_attr_setdetachstate (&tattr, NPTH_CREATE_JOINABLE);
+      rc = npth_create (&job->thread, &tattr, ks_get_job, job);
+      npth_attr_destroy (&tattr);
+    }
+  if (rc)
+    {
+      log_error ("error spawning ks_get job: %s\n", strerror (rc));
+      ks_get_job (job);
+    }
+  else
+    job->running = 1;
+}
+
+
+/* Wait for JOB to finish.  */
+static void
+wait_ks_get_job (ks_get_job_t job)
+{
+  int rc;
+
+  if (job->running)
+    {
+      rc = npth_join (job->thread, NULL);
+      if (rc)
+        log_error ("error waiting for ks_get job: %s\n", strerror (rc));
+      job->running = 0;
+    }
+}
+
+
+/* Release the resources of the finished JOB.  */
+static void
+release_ks_get_job (ks_get_job_t job)
+{
+  es_fclose (job->fp);
+  job->fp = NULL;
+  xfree (job->source);
+  job->source = NULL;
+}
+
+
 /* Get the requested keys (matching PATTERNS) using all configured
-   keyservers and write the result to the provided output stream.  */
+   keyservers and write the result to the provided output stream.  Up
+   to KS_GET_MAX_JOBS patterns are fetched concurrently but the
+   results are written in the order of PATTERNS.  */
 gpg_error_t
 ks_action_get (ctrl_t ctrl, strlist_t patterns, estream_t outfp)
 {
@@ -189,9 +301,11 @@ ks_action_get (ctrl_t ctrl, strlist_t patterns, estream_t outfp)
   gpg_error_t first_err = 0;
   int any_server = 0;
   int any_data = 0;
-  strlist_t sl;
+  strlist_t next_sl;
   uri_item_t uri;
-  estream_t infp;
+  struct ks_get_job_s jobs[KS_GET_MAX_JOBS];
+  int head, njobs;
+  ks_get_job_t job;
 
   if (!patterns)
     return gpg_error (GPG_ERR_NO_USER_ID);
@@ -207,29 +321,52 @@ ks_action_get (ctrl_t ctrl, strlist_t patterns, estream_t outfp)
       if (uri->parsed_uri->is_http)
         {
           any_server = 1;
-          for (sl = patterns; !err && sl; sl = sl->next)
+
+          /* JOBS is used as a ring buffer: HEAD is the oldest job and
+             NJOBS the number of started jobs.  */
+          head = njobs = 0;
+          next_sl = patterns;
+          while (next_sl || njobs)
             {
-              err = ks_hkp_get (ctrl, uri->parsed_uri, sl->d, &infp);
+              /* Fill up the window.  */
+              for (; next_sl && njobs < KS_GET_MAX_JOBS;
+                   next_sl = next_sl->next)
+                {
+                  start_ks_get_job (ctrl, &jobs[(head+njobs)%KS_GET_MAX_JOBS],
+                                    uri->parsed_uri, next_sl->d);
+                  njobs++;
+                }
+
+              /* Wait for the oldest job and output its result.  */
+              job = &jobs[head];
+              wait_ks_get_job (job);
+              head = (head + 1) % KS_GET_MAX_JOBS;
+              njobs--;
+
               if (err)
+                ;  /* Just collect the remaining jobs.  */
+              else if (job->err)
                 {
                   /* It is possible that a server does not carry a
                      key, thus we only save the error and continue
                      with the next pattern.  FIXME: It is an open
                      question how to return such an error condition to
                      the caller.  */
-                  first_err = err;
-                  err = 0;
+                  first_err = job->err;
                 }
               else
                 {
-                  err = copy_stream (infp, outfp);
+                  err = dirmngr_status (ctrl, "SOURCE", job->source, NULL);
+                  if (!err)
+                    err = copy_stream (job->fp, outfp);
                   /* Reading from the keyserver should never fail, thus
                      return this error.  */
                   if (!err)
                     any_data = 1;
-                  es_fclose (infp);
-                  infp = NULL;
                 }
+              release_ks_get_job (job);
+              if (err)
+                next_sl = NULL;  /* Do not start any more jobs.  */
             }
         }
       if (any_data)
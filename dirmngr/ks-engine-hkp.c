@@ -341,7 +341,7 @@ map_host (ctrl_t ctrl, const char *name, int force_reselect,
   if (idx == -1)
     {
       /* We never saw this host.  Allocate a new entry.  */
-      struct addrinfo hints, *aibuf, *ai;
+      struct addrinfo *aibuf, *ai;
       int *reftbl;
       size_t reftblsize;
       int refidx;
@@ -362,16 +362,13 @@ map_host (ctrl_t ctrl, const char *name, int force_reselect,
       hi = hosttable[idx];
 
       /* Find all A records for this entry and put them into the pool
-         list - if any.  */
-      memset (&hints, 0, sizeof (hints));
-      hints.ai_family = AF_UNSPEC;
-      hints.ai_socktype = SOCK_STREAM;
-      hints.ai_flags = AI_CANONNAME;
-      /* We can't use the the AI_IDN flag because that does the
-         conversion using the current locale.  However, GnuPG always
-         used UTF-8.  To support IDN we would need to make use of the
-         libidn API.  */
-      if (!getaddrinfo (name, NULL, &hints, &aibuf))
+         list - if any.  We use the DNS cache of the http module, so
+         that the addresses need not be resolved again when
+         connecting.  Note that we can't use the the AI_IDN flag
+         because that does the conversion using the current locale.
+         However, GnuPG always used UTF-8.  To support IDN we would
+         need to make use of the libidn API.  */
+      if (!http_getaddrinfo (name, &aibuf))
         {
           int n_v6, n_v4;
 
@@ -490,7 +487,7 @@ map_host (ctrl_t ctrl, const char *name, int force_reselect,
                     }
                 }
             }
-          freeaddrinfo (aibuf);
+          http_freeaddrinfo (aibuf);
         }
       reftbl[refidx] = -1;
       if (refidx && is_pool)
@@ -911,7 +908,7 @@ send_request (ctrl_t ctrl, const char *request, const char *hostportstr,
                    request,
                    httphost,
                    /* fixme: AUTH */ NULL,
-                   httpflags,
+                   httpflags | HTTP_FLAG_KEEPALIVE,
                    /* fixme: proxy*/ NULL,
                    session,
                    NULL,
@@ -1258,9 +1255,11 @@ ks_hkp_search (ctrl_t ctrl, parsed_uri_t uri, const char *pattern,
 
 /* Get the key described key the KEYSPEC string from the keyserver
    identified by URI.  On success R_FP has an open stream to read the
-   data.  */
+   data and R_SOURCE a malloced string with the server actually used.
+   The caller is responsible to emit the SOURCE status line.  */
 gpg_error_t
-ks_hkp_get (ctrl_t ctrl, parsed_uri_t uri, const char *keyspec, estream_t *r_fp)
+ks_hkp_get (ctrl_t ctrl, parsed_uri_t uri, const char *keyspec,
+            estream_t *r_fp, char **r_source)
 {
   gpg_error_t err;
   KEYDB_SEARCH_DESC desc;
@@ -1276,6 +1275,7 @@ ks_hkp_get (ctrl_t ctrl, parsed_uri_t uri, const char *keyspec, estream_t *r_fp)
   unsigned int tries = SEND_REQUEST_RETRIES;
 
   *r_fp = NULL;
+  *r_source = NULL;
 
   /* Remove search type indicator and adjust PATTERN accordingly.
      Note that HKP keyservers like the 0x to be present when searching
@@ -1355,13 +1355,11 @@ ks_hkp_get (ctrl_t ctrl, parsed_uri_t uri, const char *keyspec, estream_t *r_fp)
   if (err)
     goto leave;
 
-  err = dirmngr_status (ctrl, "SOURCE", hostport, NULL);
-  if (err)
-    goto leave;
-
-  /* Return the read stream and close the HTTP context.  */
+  /* Return the read stream and the source.  */
   *r_fp = fp;
   fp = NULL;
+  *r_source = hostport;
+  hostport = NULL;
 
  leave:
   es_fclose (fp);
@@ -37,7 +37,11 @@
       cancellation of a query at any point of time.
 
    4. Given that we are going out to the network and usually get back
-      a long response, the fork/exec overhead is acceptable.
+      a long response, the fork/exec overhead is acceptable.  Anyway,
+      our own wrapper is run in server mode: After a request the
+      process is kept for a while and used for the next request, which
+      saves the fork/exec and allows the wrapper to use its already
+      established LDAP connection.
 
    Note that under WindowsCE the number of processes is strongly
    limited (32 processes including the kernel processes) and thus we
@@ -84,6 +88,12 @@
 
 #define TIMERTICK_INTERVAL 2
 
+/* The maximum number of idle wrapper processes kept for reuse.  */
+#define MAX_IDLE_WRAPPERS 4
+
+/* Idle wrapper processes are terminated after this many seconds.  */
+#define IDLE_WRAPPER_TIMEOUT 60
+
 /* To keep track of the LDAP wrapper state we use this structure.  */
 struct wrapper_context_s
 {
@@ -103,6 +113,12 @@ struct wrapper_context_s
   size_t linesize;/* Allocated size of LINE.  */
   size_t linelen; /* Use size of LINE.  */
   time_t stamp;   /* The last time we noticed ativity.  */
+
+  int infd;       /* Connected with stdin of a persistent wrapper or -1.  */
+  unsigned int persistent:1; /* The wrapper runs in server mode.  */
+  unsigned int idle:1;       /* Persistent wrapper waiting for a request.  */
+  unsigned int end_seen:1;   /* The end of the response has been read.  */
+  size_t frame_left;         /* Bytes left in the current output frame.  */
 };
 
 
@@ -153,11 +169,25 @@ destroy_wrapper (struct wrapper_context_s *ctx)
   ksba_reader_release (ctx->reader);
   SAFE_CLOSE (ctx->fd);
   SAFE_CLOSE (ctx->log_fd);
+  SAFE_CLOSE (ctx->infd);
   xfree (ctx->line);
   xfree (ctx);
 }
 
 
+/* Terminate the wrapper process of CTX.  The reaper thread removes
+   the context after the process has terminated.  */
+static void
+stop_wrapper (struct wrapper_context_s *ctx)
+{
+  ctx->idle = 0;
+  SAFE_CLOSE (ctx->fd);
+  SAFE_CLOSE (ctx->infd);
+  if (ctx->pid != (pid_t)(-1))
+    gnupg_kill_process (ctx->pid);
+}
+
+
 /* Print the content of LINE to thye log stream but make sure to only
    print complete lines.  Using NULL for LINE will flush any pending
    output.  LINE may be modified by this fucntion. */
@@ -260,25 +290,12 @@ ldap_wrapper_thread (void *dummy)
   struct timespec curtime;
   struct timespec timeout;
   int saved_errno;
-  fd_set fdset, read_fdset;
+  fd_set read_fdset;
   int ret;
-  time_t exptime;
+  time_t exptime, idle_exptime;
 
   (void)dummy;
 
-  FD_ZERO (&fdset);
-  nfds = -1;
-  for (ctx = wrapper_list; ctx; ctx = ctx->next)
-    {
-      if (ctx->log_fd != -1)
-	{
-	  FD_SET (ctx->log_fd, &fdset);
-	  if (ctx->log_fd > nfds)
-	    nfds = ctx->log_fd;
-	}
-    }
-  nfds++;
-
   npth_clock_gettime (&abstime);
   abstime.tv_sec += TIMERTICK_INTERVAL;
 
@@ -286,9 +303,19 @@ ldap_wrapper_thread (void *dummy)
     {
       int any_action = 0;
 
-      /* POSIX says that fd_set should be implemented as a structure,
-         thus a simple assignment is fine to copy the entire set.  */
-      read_fdset = fdset;
+      /* The list of wrappers changes all the time, thus we need to
+         build the set of log fds for each round.  */
+      FD_ZERO (&read_fdset);
+      nfds = -1;
+      for (ctx = wrapper_list; ctx; ctx = ctx->next)
+        {
+          if (ctx->log_fd != -1)
+            {
+              FD_SET (ctx->log_fd, &read_fdset);
+              if (ctx->log_fd > nfds)
+                nfds = ctx->log_fd;
+            }
+        }
 
       npth_clock_gettime (&curtime);
       if (!(npth_timercmp (&curtime, &abstime, <)))
@@ -313,15 +340,18 @@ ldap_wrapper_thread (void *dummy)
           continue;
 	}
 
-      if (ret <= 0)
-	/* Interrupt or timeout.  Will be handled when calculating the
-	   next timeout.  */
+      if (ret == -1)
+	/* Interrupt.  Will be handled when calculating the next
+	   timeout.  */
 	continue;
 
       /* All timestamps before exptime should be considered expired.  */
       exptime = time (NULL);
+      idle_exptime = exptime;
       if (exptime > INACTIVITY_TIMEOUT)
         exptime -= INACTIVITY_TIMEOUT;
+      if (idle_exptime > IDLE_WRAPPER_TIMEOUT)
+        idle_exptime -= IDLE_WRAPPER_TIMEOUT;
 
       /* Note that there is no need to lock the list because we always
          add entries at the head (with a pending event status) and
@@ -331,7 +361,8 @@ ldap_wrapper_thread (void *dummy)
       for (ctx = wrapper_list; ctx; ctx = ctx->next)
         {
           /* Check whether there is any logging to be done. */
-          if (nfds && ctx->log_fd != -1 && FD_ISSET (ctx->log_fd, &read_fdset))
+          if (ret > 0 && ctx->log_fd != -1
+              && FD_ISSET (ctx->log_fd, &read_fdset))
             {
               if (read_log_data (ctx))
                 any_action = 1;
@@ -374,8 +405,20 @@ ldap_wrapper_thread (void *dummy)
                 }
             }
 
+          /* Let an idle wrapper terminate by closing its stdin.  */
+          if (ctx->idle && (shutting_down || ctx->stamp < idle_exptime))
+            {
+              if (DBG_LOOKUP)
+                log_info ("ldap wrapper %d idle - stopping\n",
+                          (int)ctx->pid);
+              ctx->idle = 0;
+              SAFE_CLOSE (ctx->infd);
+              SAFE_CLOSE (ctx->fd);
+              any_action = 1;
+            }
+
           /* Check whether we should terminate the process. */
-          if (ctx->pid != (pid_t)(-1)
+          if (ctx->pid != (pid_t)(-1) && !ctx->idle
               && ctx->stamp != (time_t)(-1) && ctx->stamp < exptime)
             {
               gnupg_kill_process (ctx->pid);
@@ -396,12 +439,13 @@ ldap_wrapper_thread (void *dummy)
         {
           log_info ("ldap worker stati:\n");
           for (ctx = wrapper_list; ctx; ctx = ctx->next)
-            log_info ("  c=%p pid=%d/%d rdr=%p ctrl=%p/%d la=%lu rdy=%d\n",
+            log_info ("  c=%p pid=%d/%d rdr=%p ctrl=%p/%d la=%lu rdy=%d"
+                      " idle=%d\n",
                       ctx,
                       (int)ctx->pid, (int)ctx->printable_pid,
                       ctx->reader,
                       ctx->ctrl, ctx->ctrl? ctx->ctrl->refcount:0,
-                      (unsigned long)ctx->stamp, ctx->ready);
+                      (unsigned long)ctx->stamp, ctx->ready, ctx->idle);
         }
 
 
@@ -472,6 +516,225 @@ ldap_wrapper_wait_connections ()
 }
 
 
+/* Wait for data on the stdout of the wrapper of CTX and read up to
+   COUNT bytes into BUFFER.  Returns the number of bytes read, 0 on EOF
+   or -1 on error.  On error CTX->FD_ERROR is set and the file
+   descriptor closed.  */
+static int
+wait_and_read (struct wrapper_context_s *ctx, char *buffer, size_t count)
+{
+  int nfds;
+  struct timespec abstime;
+  struct timespec curtime;
+  struct timespec timeout;
+  int saved_errno;
+  fd_set fdset, read_fdset;
+  int ret;
+  int n;
+  gpg_error_t err;
+
+  FD_ZERO (&fdset);
+  FD_SET (ctx->fd, &fdset);
+  nfds = ctx->fd + 1;
+
+  npth_clock_gettime (&abstime);
+  abstime.tv_sec += TIMERTICK_INTERVAL;
+
+  for (;;)
+    {
+      npth_clock_gettime (&curtime);
+      if (!(npth_timercmp (&curtime, &abstime, <)))
+	{
+	  err = dirmngr_tick (ctx->ctrl);
+          if (err)
+            {
+              ctx->fd_error = err;
+              SAFE_CLOSE (ctx->fd);
+              return -1;
+            }
+	  npth_clock_gettime (&abstime);
+	  abstime.tv_sec += TIMERTICK_INTERVAL;
+	}
+      npth_timersub (&abstime, &curtime, &timeout);
+
+      read_fdset = fdset;
+      ret = npth_pselect (nfds, &read_fdset, NULL, NULL, &timeout, NULL);
+      saved_errno = errno;
+
+      if (ret == -1 && saved_errno != EINTR)
+	{
+          ctx->fd_error = gpg_error_from_errno (errno);
+          SAFE_CLOSE (ctx->fd);
+          return -1;
+        }
+      if (ret > 0)
+        break;
+      /* Timeout.  Will be handled when calculating the next timeout.  */
+    }
+
+  /* This should not block now that select returned with a file
+     descriptor.  So it shouldn't be necessary to use npth_read (and
+     it is slightly dangerous in the sense that a concurrent thread
+     might (accidentially?) change the status of ctx->fd before we
+     read.  FIXME: Set ctx->fd to nonblocking?  */
+  n = read (ctx->fd, buffer, count);
+  if (n < 0)
+    {
+      ctx->fd_error = gpg_error_from_errno (errno);
+      SAFE_CLOSE (ctx->fd);
+      return -1;
+    }
+  if (n > 0 && ctx->stamp != (time_t)(-1))
+    ctx->stamp = time (NULL);
+  return n;
+}
+
+
+/* Read exactly COUNT bytes of framing data from the persistent
+   wrapper of CTX into BUFFER.  Returns 0 on success; on EOF or error
+   the file descriptor is closed and -1 returned.  */
+static int
+read_frame_data (struct wrapper_context_s *ctx,
+                 unsigned char *buffer, size_t count)
+{
+  int n;
+
+  while (count)
+    {
+      n = wait_and_read (ctx, (char*)buffer, count);
+      if (n <= 0)
+        {
+          SAFE_CLOSE (ctx->fd);
+          return -1;
+        }
+      buffer += n;
+      count -= n;
+    }
+  return 0;
+}
+
+
+/* Read the output of the persistent wrapper of CTX into BUFFER which
+   has room for COUNT bytes.  The output is framed (see run_server in
+   dirmngr_ldap.c); the framing is removed here.  Returns the number
+   of bytes read, 0 at the end of the response or -1 on error.  */
+static int
+read_frames (struct wrapper_context_s *ctx, char *buffer, size_t count)
+{
+  unsigned char hdr[4];
+  int n;
+
+  while (!ctx->frame_left)
+    {
+      if (ctx->end_seen)
+        return 0;
+
+      if (read_frame_data (ctx, hdr, 4))
+        return ctx->fd_error? -1 : 0;
+      ctx->frame_left = ((size_t)hdr[0] << 24 | (size_t)hdr[1] << 16
+                         | (size_t)hdr[2] << 8 | hdr[3]);
+      if (!ctx->frame_left)
+        {
+          /* End of the response; read the status byte.  */
+          if (read_frame_data (ctx, hdr, 1))
+            return ctx->fd_error? -1 : 0;
+          ctx->end_seen = 1;
+          if (hdr[0] && DBG_LOOKUP)
+            log_info ("ldap wrapper %d: request returned status %d\n",
+                      ctx->printable_pid, hdr[0]);
+        }
+    }
+
+  n = wait_and_read (ctx, buffer,
+                     count < ctx->frame_left? count : ctx->frame_left);
+  if (!n)
+    SAFE_CLOSE (ctx->fd);  /* Premature EOF.  */
+  else if (n > 0)
+    ctx->frame_left -= n;
+  return n;
+}
+
+
+/* Try to skip the rest of the response of the persistent wrapper of
+   CTX without blocking so that the process can be used again.
+   Returns true if the end of the response has been reached.  */
+static int
+skip_response (struct wrapper_context_s *ctx)
+{
+  char buffer[4096];
+  int maxloops = 16;
+  fd_set fdset;
+  struct timeval tv;
+
+  while (!ctx->end_seen && !ctx->fd_error && ctx->fd != -1 && maxloops--)
+    {
+      FD_ZERO (&fdset);
+      FD_SET (ctx->fd, &fdset);
+      tv.tv_sec = 0;
+      tv.tv_usec = 0;
+      if (select (ctx->fd + 1, &fdset, NULL, NULL, &tv) != 1)
+        break;
+      if (read_frames (ctx, buffer, sizeof buffer) <= 0)
+        break;
+    }
+  return ctx->end_seen && !ctx->fd_error && ctx->fd != -1;
+}
+
+
+/* Return the number of idle wrapper processes.  */
+static int
+count_idle_wrappers (void)
+{
+  struct wrapper_context_s *ctx;
+  int count = 0;
+
+  for (ctx=wrapper_list; ctx; ctx=ctx->next)
+    if (ctx->idle)
+      count++;
+  return count;
+}
+
+
+/* Release the wrapper context CTX after a request.  A persistent
+   wrapper which completed the request is put into the idle state;
+   other wrappers are told to terminate.  */
+static void
+release_wrapper_context (struct wrapper_context_s *ctx)
+{
+  if (DBG_LOOKUP)
+    log_info ("releasing ldap worker c=%p pid=%d/%d rdr=%p ctrl=%p/%d\n",
+              ctx,
+              (int)ctx->pid, (int)ctx->printable_pid,
+              ctx->reader,
+              ctx->ctrl, ctx->ctrl? ctx->ctrl->refcount:0);
+
+  ctx->reader = NULL;
+  if (ctx->ctrl)
+    {
+      ctx->ctrl->refcount--;
+      ctx->ctrl = NULL;
+    }
+  if (ctx->fd_error)
+    log_info (_("reading from ldap wrapper %d failed: %s\n"),
+              ctx->printable_pid, gpg_strerror (ctx->fd_error));
+
+  if (ctx->persistent)
+    {
+      if (ctx->pid != (pid_t)(-1) && !shutting_down
+          && count_idle_wrappers () < MAX_IDLE_WRAPPERS
+          && skip_response (ctx))
+        {
+          ctx->idle = 1;
+          ctx->stamp = time (NULL);
+        }
+      else
+        stop_wrapper (ctx);
+    }
+  else
+    SAFE_CLOSE (ctx->fd);
+}
+
+
 /* This function is to be used to release a context associated with the
    given reader object. */
 void
@@ -485,23 +748,7 @@ ldap_wrapper_release_context (ksba_reader_t reader)
   for (ctx=wrapper_list; ctx; ctx=ctx->next)
     if (ctx->reader == reader)
       {
-        if (DBG_LOOKUP)
-          log_info ("releasing ldap worker c=%p pid=%d/%d rdr=%p ctrl=%p/%d\n",
-                    ctx,
-                    (int)ctx->pid, (int)ctx->printable_pid,
-                    ctx->reader,
-                    ctx->ctrl, ctx->ctrl? ctx->ctrl->refcount:0);
-
-        ctx->reader = NULL;
-        SAFE_CLOSE (ctx->fd);
-        if (ctx->ctrl)
-          {
-            ctx->ctrl->refcount--;
-            ctx->ctrl = NULL;
-          }
-        if (ctx->fd_error)
-          log_info (_("reading from ldap wrapper %d failed: %s\n"),
-                    ctx->printable_pid, gpg_strerror (ctx->fd_error));
+        release_wrapper_context (ctx);
         break;
       }
 }
@@ -535,13 +782,7 @@ reader_callback (void *cb_value, char *buffer, size_t count,  size_t *nread)
 {
   struct wrapper_context_s *ctx = cb_value;
   size_t nleft = count;
-  int nfds;
-  struct timespec abstime;
-  struct timespec curtime;
-  struct timespec timeout;
-  int saved_errno;
-  fd_set fdset, read_fdset;
-  int ret;
+  int n;
 
   /* FIXME: We might want to add some internal buffering because the
      ksba code does not do any buffering for itself (because a ksba
@@ -561,59 +802,14 @@ reader_callback (void *cb_value, char *buffer, size_t count,  size_t *nread)
       return -1;
     }
 
-  FD_ZERO (&fdset);
-  FD_SET (ctx->fd, &fdset);
-  nfds = ctx->fd + 1;
-
-  npth_clock_gettime (&abstime);
-  abstime.tv_sec += TIMERTICK_INTERVAL;
-
   while (nleft > 0)
     {
-      int n;
-      gpg_error_t err;
-
-      npth_clock_gettime (&curtime);
-      if (!(npth_timercmp (&curtime, &abstime, <)))
-	{
-	  err = dirmngr_tick (ctx->ctrl);
-          if (err)
-            {
-              ctx->fd_error = err;
-              SAFE_CLOSE (ctx->fd);
-              return -1;
-            }
-	  npth_clock_gettime (&abstime);
-	  abstime.tv_sec += TIMERTICK_INTERVAL;
-	}
-      npth_timersub (&abstime, &curtime, &timeout);
-
-      read_fdset = fdset;
-      ret = npth_pselect (nfds, &read_fdset, NULL, NULL, &timeout, NULL);
-      saved_errno = errno;
-
-      if (ret == -1 && saved_errno != EINTR)
-	{
-          ctx->fd_error = gpg_error_from_errno (errno);
-          SAFE_CLOSE (ctx->fd);
-          return -1;
-        }
-      if (ret <= 0)
-	/* Timeout.  Will be handled when calculating the next timeout.  */
-	continue;
-
-      /* This should not block now that select returned with a file
-	 descriptor.  So it shouldn't be necessary to use npth_read
-	 (and it is slightly dangerous in the sense that a concurrent
-	 thread might (accidentially?) change the status of ctx->fd
-	 before we read.  FIXME: Set ctx->fd to nonblocking?  */
-      n = read (ctx->fd, buffer, nleft);
+      if (ctx->persistent)
+        n = read_frames (ctx, buffer, nleft);
+      else
+        n = wait_and_read (ctx, buffer, nleft);
       if (n < 0)
-        {
-          ctx->fd_error = gpg_error_from_errno (errno);
-          SAFE_CLOSE (ctx->fd);
-          return -1;
-        }
+        return -1;
       else if (!n)
         {
           if (nleft == count)
@@ -622,18 +818,196 @@ reader_callback (void *cb_value, char *buffer, size_t count,  size_t *nread)
         }
       nleft -= n;
       buffer += n;
-      if (n > 0 && ctx->stamp != (time_t)(-1))
-        ctx->stamp = time (NULL);
     }
   *nread = count - nleft;
 
   return 0;
 }
 
+
+/* Write the request ARGV to the persistent wrapper of CTX.  Returns 0
+   on success.  */
+static gpg_error_t
+send_request (struct wrapper_context_s *ctx, const char *argv[])
+{
+  gpg_error_t err = 0;
+  membuf_t mb;
+  char *request, *p;
+  size_t len;
+  int i, n;
+
+  init_membuf (&mb, 512);
+  for (i=0; argv[i]; i++)
+    {
+      put_membuf (&mb, "+", 1);
+      put_membuf_str (&mb, argv[i]);
+      put_membuf (&mb, "\n", 1);
+    }
+  put_membuf (&mb, "\n", 1);
+  request = get_membuf (&mb, &len);
+  if (!request)
+    return gpg_error_from_syserror ();
+
+  for (p = request; len; p += n, len -= n)
+    {
+      do
+        n = npth_write (ctx->infd, p, len);
+      while (n < 0 && errno == EINTR);
+      if (n < 0)
+        {
+          err = gpg_error_from_syserror ();
+          break;
+        }
+    }
+
+  wipememory (request, p - request + len);
+  xfree (request);
+  return err;
+}
+
+
+/* Start a new wrapper process PGMNAME.  ARGV is a NULL terminated
+   list of arguments.  If PERSISTENT is set, the process is connected
+   to a pipe for its stdin.  On success the new context is linked into
+   the list of wrappers and stored at R_CTX.  */
+static gpg_error_t
+spawn_wrapper (const char *pgmname, const char **argv, int persistent,
+               struct wrapper_context_s **r_ctx)
+{
+  gpg_error_t err;
+  struct wrapper_context_s *ctx;
+  pid_t pid;
+  int inpipe[2], outpipe[2], errpipe[2];
+
+  *r_ctx = NULL;
+
+  ctx = xtrycalloc (1, sizeof *ctx);
+  if (!ctx)
+    {
+      err = gpg_error_from_syserror ();
+      log_error (_("error allocating memory: %s\n"), strerror (errno));
+      return err;
+    }
+
+  inpipe[0] = inpipe[1] = -1;
+  if (persistent)
+    err = gnupg_create_outbound_pipe (inpipe);
+  else
+    err = 0;
+  if (!err)
+    {
+      err = gnupg_create_inbound_pipe (outpipe);
+      if (!err)
+        {
+          err = gnupg_create_inbound_pipe (errpipe);
+          if (err)
+            {
+              close (outpipe[0]);
+              close (outpipe[1]);
+            }
+        }
+      if (err)
+        {
+          SAFE_CLOSE (inpipe[0]);
+          SAFE_CLOSE (inpipe[1]);
+        }
+    }
+  if (err)
+    {
+      log_error (_("error creating a pipe: %s\n"), gpg_strerror (err));
+      xfree (ctx);
+      return err;
+    }
+
+  err = gnupg_spawn_process_fd (pgmname, argv,
+                                inpipe[0], outpipe[1], errpipe[1], &pid);
+  SAFE_CLOSE (inpipe[0]);
+  close (outpipe[1]);
+  close (errpipe[1]);
+  if (err)
+    {
+      SAFE_CLOSE (inpipe[1]);
+      close (outpipe[0]);
+      close (errpipe[0]);
+      xfree (ctx);
+      return err;
+    }
+
+  ctx->pid = pid;
+  ctx->printable_pid = (int) pid;
+  ctx->fd = outpipe[0];
+  ctx->log_fd = errpipe[0];
+  ctx->infd = inpipe[1];
+  ctx->persistent = !!persistent;
+  ctx->stamp = time (NULL);
+
+  /* Hook the context into our list of running wrappers.  */
+  ctx->next = wrapper_list;
+  wrapper_list = ctx;
+
+  *r_ctx = ctx;
+  return 0;
+}
+
+
+/* Hand the request ARGV to a persistent wrapper process.  An idle
+   process is used if available; otherwise a new one is started.
+   Returns the context or NULL if this was not possible.  */
+static struct wrapper_context_s *
+get_persistent_wrapper (const char *pgmname, const char *argv[])
+{
+  static const char *server_argv[] = { "--server", NULL };
+  struct wrapper_context_s *ctx;
+  int i;
+
+  /* Arguments are sent line by line.  */
+  for (i=0; argv[i]; i++)
+    if (strchr (argv[i], '\n'))
+      return NULL;
+
+  for (;;)
+    {
+      for (ctx = wrapper_list; ctx; ctx = ctx->next)
+        if (ctx->idle && !ctx->ready && ctx->pid != (pid_t)(-1))
+          break;
+      if (!ctx)
+        break;
+
+      ctx->idle = 0;
+      ctx->end_seen = 0;
+      ctx->frame_left = 0;
+      ctx->stamp = time (NULL);
+      if (!send_request (ctx, argv))
+        {
+          if (opt.verbose)
+            log_info ("ldap wrapper %d reused\n", (int)ctx->pid);
+          return ctx;
+        }
+      /* The process is probably gone - try the next one.  */
+      stop_wrapper (ctx);
+    }
+
+  if (spawn_wrapper (pgmname, server_argv, 1, &ctx))
+    return NULL;
+  if (send_request (ctx, argv))
+    {
+      stop_wrapper (ctx);
+      return NULL;
+    }
+  if (opt.verbose)
+    log_info ("ldap wrapper %d started in server mode\n", (int)ctx->pid);
+  return ctx;
+}
+
+
 /* Fork and exec the LDAP wrapper and returns a new libksba reader
    object at READER.  ARGV is a NULL terminated list of arguments for
    the wrapper.  The function returns 0 on success or an error code.
 
+   Our own wrapper is run in server mode and is sent the request via
+   its stdin; this includes the password.  Idle wrapper processes are
+   used for subsequent requests.
+
    Special hack to avoid passing a password through the command line
    which is globally visible: If the first element of ARGV is "--pass"
    it will be removed and instead the environment variable
@@ -647,13 +1021,11 @@ gpg_error_t
 ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
 {
   gpg_error_t err;
-  pid_t pid;
   struct wrapper_context_s *ctx;
   int i;
   int j;
   const char **arg_list;
   const char *pgmname;
-  int outpipe[2], errpipe[2];
 
   /* It would be too simple to connect stderr just to our logging
      stream.  The problem is that if we are running multi-threaded
@@ -667,79 +1039,51 @@ ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
   *reader = NULL;
 
   /* Files: We need to prepare stdin and stdout.  We get stderr from
-     the function.  */
+     the function.  A configured wrapper program is not expected to
+     support the server mode.  */
   if (!opt.ldap_wrapper_program || !*opt.ldap_wrapper_program)
-    pgmname = gnupg_module_name (GNUPG_MODULE_NAME_DIRMNGR_LDAP);
-  else
-    pgmname = opt.ldap_wrapper_program;
-
-  /* Create command line argument array.  */
-  for (i = 0; argv[i]; i++)
-    ;
-  arg_list = xtrycalloc (i + 2, sizeof *arg_list);
-  if (!arg_list)
     {
-      err = gpg_error_from_syserror ();
-      log_error (_("error allocating memory: %s\n"), strerror (errno));
-      return err;
+      pgmname = gnupg_module_name (GNUPG_MODULE_NAME_DIRMNGR_LDAP);
+      ctx = get_persistent_wrapper (pgmname, argv);
     }
-  for (i = j = 0; argv[i]; i++, j++)
-    if (!i && argv[i + 1] && !strcmp (*argv, "--pass"))
-      {
-	arg_list[j] = "--env-pass";
-	setenv ("DIRMNGR_LDAP_PASS", argv[1], 1);
-	i++;
-      }
-    else
-      arg_list[j] = (char*) argv[i];
-
-  ctx = xtrycalloc (1, sizeof *ctx);
-  if (!ctx)
+  else
     {
-      err = gpg_error_from_syserror ();
-      log_error (_("error allocating memory: %s\n"), strerror (errno));
-      xfree (arg_list);
-      return err;
+      pgmname = opt.ldap_wrapper_program;
+      ctx = NULL;
     }
 
-  err = gnupg_create_inbound_pipe (outpipe);
-  if (!err)
+  if (!ctx)
     {
-      err = gnupg_create_inbound_pipe (errpipe);
-      if (err)
+      /* Create command line argument array.  */
+      for (i = 0; argv[i]; i++)
+        ;
+      arg_list = xtrycalloc (i + 2, sizeof *arg_list);
+      if (!arg_list)
         {
-          close (outpipe[0]);
-          close (outpipe[1]);
+          err = gpg_error_from_syserror ();
+          log_error (_("error allocating memory: %s\n"), strerror (errno));
+          return err;
         }
-    }
-  if (err)
-    {
-      log_error (_("error creating a pipe: %s\n"), gpg_strerror (err));
-      xfree (arg_list);
-      xfree (ctx);
-      return err;
-    }
+      for (i = j = 0; argv[i]; i++, j++)
+        if (!i && argv[i + 1] && !strcmp (*argv, "--pass"))
+          {
+            arg_list[j] = "--env-pass";
+            setenv ("DIRMNGR_LDAP_PASS", argv[1], 1);
+            i++;
+          }
+        else
+          arg_list[j] = (char*) argv[i];
 
-  err = gnupg_spawn_process_fd (pgmname, arg_list,
-                                -1, outpipe[1], errpipe[1], &pid);
-  xfree (arg_list);
-  close (outpipe[1]);
-  close (errpipe[1]);
-  if (err)
-    {
-      close (outpipe[0]);
-      close (errpipe[0]);
-      xfree (ctx);
-      return err;
+      err = spawn_wrapper (pgmname, arg_list, 0, &ctx);
+      xfree (arg_list);
+      if (err)
+        return err;
+      if (opt.verbose)
+        log_info ("ldap wrapper %d started\n", (int)ctx->pid);
     }
 
-  ctx->pid = pid;
-  ctx->printable_pid = (int) pid;
-  ctx->fd = outpipe[0];
-  ctx->log_fd = errpipe[0];
   ctx->ctrl = ctrl;
   ctrl->refcount++;
-  ctx->stamp = time (NULL);
 
   err = ksba_reader_new (reader);
   if (!err)
@@ -748,18 +1092,14 @@ ldap_wrapper (ctrl_t ctrl, ksba_reader_t *reader, const char *argv[])
     {
       log_error (_("error initializing reader object: %s\n"),
                  gpg_strerror (err));
-      destroy_wrapper (ctx);
+      release_wrapper_context (ctx);
       ksba_reader_release (*reader);
       *reader = NULL;
       return err;
     }
-
-  /* Hook the context into our list of running wrappers.  */
   ctx->reader = *reader;
-  ctx->next = wrapper_list;
-  wrapper_list = ctx;
-  if (opt.verbose)
-    log_info ("ldap wrapper %d started (reader %p)\n",
+  if (DBG_LOOKUP)
+    log_info ("ldap wrapper %d uses reader %p\n",
               (int)ctx->pid, ctx->reader);
 
   /* Need to wait for the first byte so we are able to detect an empty
@@ -47,6 +47,42 @@ static const char oidstr_ocsp[] = "1.3.6.1.5.5.7.48.1";
 static const char oidstr_certHash[] = "1.3.36.8.3.13";
 
 
+/* The maximum number of entries in the OCSP response cache.  */
+#define MAX_OCSP_CACHE_ENTRIES 4096
+
+/* The number of buckets of the OCSP response cache.  */
+#define OCSP_CACHE_BUCKETS 256
+
+/* An entry of the OCSP response cache.  Only verified responses with
+   a status of good or revoked are stored.  The key is the SHA-1 hash
+   of the issuer's public key and the serial number of the target
+   certificate.  */
+struct ocsp_cache_item_s
+{
+  struct ocsp_cache_item_s *next;
+  unsigned char keyhash[20];     /* Hash of the issuer's public key.  */
+  char *serialno;                /* Serial number in hex.  */
+  char *url;                     /* The responder which was asked.  */
+  unsigned int default_responder:1;  /* Answered by the default
+                                        responder.  */
+  ksba_status_t status;
+  ksba_crl_reason_t reason;
+  ksba_isotime_t this_update;
+  ksba_isotime_t next_update;
+  ksba_isotime_t revocation_time;
+  ksba_isotime_t expires;        /* Do not use the entry after this.  */
+};
+typedef struct ocsp_cache_item_s *ocsp_cache_item_t;
+
+/* The OCSP response cache.  It is shared by all connections.  The
+   lookup, insert and purge functions do not call anything which may
+   yield to another thread, so they need no lock.  Code which writes
+   cache entries to a stream must copy them first; see
+   ocsp_cache_list.  */
+static ocsp_cache_item_t ocsp_cache[OCSP_CACHE_BUCKETS];
+static unsigned int ocsp_cache_entries;
+
+
 
 
 /* Read from FP and return a newly allocated buffer in R_BUFFER with the
@@ -165,7 +201,8 @@ do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp, gcry_md_hd_t md,
 
  once_more:
   err = http_open (&http, HTTP_REQ_POST, url, NULL, NULL,
-                   (opt.honor_http_proxy? HTTP_FLAG_TRY_PROXY:0),
+                   (opt.honor_http_proxy? HTTP_FLAG_TRY_PROXY:0)
+                   | HTTP_FLAG_KEEPALIVE,
                    opt.http_proxy, NULL, NULL, NULL);
   if (err)
     {
@@ -296,6 +333,250 @@ do_ocsp_request (ctrl_t ctrl, ksba_ocsp_t ocsp, gcry_md_hd_t md,
 }
 
 
+/* Compute the cache key for CERT which has been issued by
+   ISSUER_CERT.  On success the SHA-1 hash of the issuer's public key
+   is stored at KEYHASH and a malloced hex string with the serial
+   number is stored at R_SERIALNO.  */
+static gpg_error_t
+ocsp_cache_key (ksba_cert_t cert, ksba_cert_t issuer_cert,
+                unsigned char *keyhash, char **r_serialno)
+{
+  ksba_sexp_t sexp;
+  size_t n;
+
+  *r_serialno = NULL;
+
+  sexp = ksba_cert_get_public_key (issuer_cert);
+  n = sexp? gcry_sexp_canon_len (sexp, 0, NULL, NULL) : 0;
+  if (!n)
+    {
+      ksba_free (sexp);
+      return gpg_error (GPG_ERR_INV_CERT_OBJ);
+    }
+  gcry_md_hash_buffer (GCRY_MD_SHA1, keyhash, sexp, n);
+  ksba_free (sexp);
+
+  sexp = ksba_cert_get_serial (cert);
+  *r_serialno = serial_hex (sexp);
+  ksba_free (sexp);
+  if (!*r_serialno)
+    return gpg_error (GPG_ERR_INV_CERT_OBJ);
+  return 0;
+}
+
+
+/* Return the bucket of the OCSP cache for KEYHASH and SERIALNO.  */
+static ocsp_cache_item_t *
+ocsp_cache_bucket (const unsigned char *keyhash, const char *serialno)
+{
+  unsigned int h = keyhash[0];
+  const char *s;
+
+  for (s=serialno; *s; s++)
+    h = (h * 31) + *(const unsigned char *)s;
+  return &ocsp_cache[h % OCSP_CACHE_BUCKETS];
+}
+
+
+static void
+release_ocsp_cache_item (ocsp_cache_item_t item)
+{
+  if (item)
+    {
+      xfree (item->serialno);
+      xfree (item->url);
+      xfree (item);
+    }
+}
+
+
+/* Remove all entries from the OCSP cache which have expired at
+   CURRENT_TIME or, if CURRENT_TIME is NULL, all entries.  */
+static void
+ocsp_cache_purge (const ksba_isotime_t current_time)
+{
+  ocsp_cache_item_t item, *itemp;
+  int i;
+
+  for (i=0; i < OCSP_CACHE_BUCKETS; i++)
+    for (itemp = &ocsp_cache[i]; (item = *itemp); )
+      {
+        if (!current_time || strcmp (item->expires, current_time) < 0)
+          {
+            *itemp = item->next;
+            release_ocsp_cache_item (item);
+            ocsp_cache_entries--;
+          }
+        else
+          itemp = &item->next;
+      }
+}
+
+
+/* Look up the OCSP cache.  Returns the entry or NULL if there is no
+   usable entry.  With FORCE_DEFAULT_RESPONDER set only entries
+   retrieved from the default responder are returned.  */
+static ocsp_cache_item_t
+ocsp_cache_find (const unsigned char *keyhash, const char *serialno,
+                 int force_default_responder)
+{
+  ocsp_cache_item_t item, *itemp;
+  ksba_isotime_t current_time;
+
+  gnupg_get_isotime (current_time);
+  for (itemp = ocsp_cache_bucket (keyhash, serialno); (item = *itemp);
+       itemp = &item->next)
+    {
+      if (memcmp (item->keyhash, keyhash, 20)
+          || strcmp (item->serialno, serialno))
+        continue;
+
+      if (strcmp (item->expires, current_time) < 0)
+        {
+          /* Expired - remove it.  */
+          *itemp = item->next;
+          release_ocsp_cache_item (item);
+          ocsp_cache_entries--;
+          return NULL;
+        }
+      if (force_default_responder && !item->default_responder)
+        return NULL;
+      return item;
+    }
+  return NULL;
+}
+
+
+/* Insert a verified OCSP response into the cache.  */
+static void
+ocsp_cache_insert (const unsigned char *keyhash, const char *serialno,
+                   const char *url, int default_responder,
+                   ksba_status_t status, ksba_crl_reason_t reason,
+                   const ksba_isotime_t this_update,
+                   const ksba_isotime_t next_update,
+                   const ksba_isotime_t revocation_time)
+{
+  ocsp_cache_item_t item, *bucket;
+  ksba_isotime_t current_time, expires, tmp_time;
+
+  if (status != KSBA_STATUS_GOOD && status != KSBA_STATUS_REVOKED)
+    return;
+
+  /* The response may be used until NEXT_UPDATE or, if the responder
+     did not give one, for the current period.  In any case not beyond
+     the maximum period.  */
+  gnupg_copy_time (expires, this_update);
+  if (add_seconds_to_isotime (expires, opt.ocsp_max_period))
+    return;
+  if (*next_update)
+    gnupg_copy_time (tmp_time, next_update);
+  else
+    {
+      gnupg_copy_time (tmp_time, this_update);
+      if (add_seconds_to_isotime (tmp_time, opt.ocsp_current_period))
+        return;
+    }
+  if (strcmp (tmp_time, expires) < 0)
+    gnupg_copy_time (expires, tmp_time);
+  gnupg_get_isotime (current_time);
+  if (strcmp (expires, current_time) < 0)
+    return;
+
+  if (ocsp_cache_entries >= MAX_OCSP_CACHE_ENTRIES)
+    ocsp_cache_purge (current_time);
+  if (ocsp_cache_entries >= MAX_OCSP_CACHE_ENTRIES)
+    {
+      if (opt.verbose)
+        log_info ("OCSP cache is full - response not cached\n");
+      return;
+    }
+
+  item = xtrycalloc (1, sizeof *item);
+  if (!item)
+    return;
+  memcpy (item->keyhash, keyhash, 20);
+  item->serialno = xtrystrdup (serialno);
+  item->url = xtrystrdup (url);
+  if (!item->serialno || !item->url)
+    {
+      release_ocsp_cache_item (item);
+      return;
+    }
+  item->default_responder = !!default_responder;
+  item->status = status;
+  item->reason = reason;
+  gnupg_copy_time (item->this_update, this_update);
+  gnupg_copy_time (item->next_update, next_update);
+  gnupg_copy_time (item->expires, expires);
+  if (status == KSBA_STATUS_REVOKED)
+    gnupg_copy_time (item->revocation_time, revocation_time);
+
+  bucket = ocsp_cache_bucket (keyhash, serialno);
+  item->next = *bucket;
+  *bucket = item;
+  ocsp_cache_entries++;
+}
+
+
+/* Remove all entries from the OCSP response cache.  */
+void
+ocsp_cache_flush (void)
+{
+  ocsp_cache_purge (NULL);
+}
+
+
+/* Print the content of the OCSP response cache to FP.  Writing to FP
+   may yield to other threads which may modify the cache; thus the
+   listing is first formatted into a buffer.  */
+gpg_error_t
+ocsp_cache_list (estream_t fp)
+{
+  ocsp_cache_item_t item;
+  ksba_isotime_t current_time;
+  char hexbuf[41];
+  membuf_t mb;
+  char *buffer;
+  size_t buflen;
+  int i;
+
+  gnupg_get_isotime (current_time);
+  ocsp_cache_purge (current_time);
+
+  init_membuf (&mb, 4096);
+  for (i=0; i < OCSP_CACHE_BUCKETS; i++)
+    for (item = ocsp_cache[i]; item; item = item->next)
+      {
+        put_membuf_str
+          (&mb, "--------------------------------------------------------\n");
+        put_membuf_printf (&mb, "OCSP response (retrieved via %s)\n",
+                           item->url);
+        put_membuf_printf (&mb, " Issuer Key :\t%s\n",
+                           bin2hex (item->keyhash, 20, hexbuf));
+        put_membuf_printf (&mb, " Serial No. :\t%s\n", item->serialno);
+        put_membuf_printf (&mb, " Status     :\t%s\n",
+                           item->status == KSBA_STATUS_GOOD?
+                           "good":"revoked");
+        if (item->status == KSBA_STATUS_REVOKED)
+          put_membuf_printf (&mb, " Revoked at :\t%s\n",
+                             item->revocation_time);
+        put_membuf_printf (&mb, " This Update:\t%s\n", item->this_update);
+        put_membuf_printf (&mb, " Next Update:\t%s\n",
+                           *item->next_update? item->next_update : "none");
+        put_membuf_printf (&mb, " Expires    :\t%s\n", item->expires);
+      }
+
+  buffer = get_membuf (&mb, &buflen);
+  if (!buffer)
+    return gpg_error_from_syserror ();
+  es_write (fp, buffer, buflen, NULL);
+  xfree (buffer);
+
+  return es_ferror (fp)? gpg_error_from_syserror () : 0;
+}
+
+
+
 /* Validate that CERT is indeed valid to sign an OCSP response. If
    SIGNER_FPR_LIST is not NULL we simply check that CERT matches one
    of the fingerprints in this list. */
@@ -536,6 +817,10 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
   char *oid;
   ksba_name_t name;
   fingerprint_list_t default_signer = NULL;
+  unsigned char keyhash[20];
+  char *serialno = NULL;
+  ocsp_cache_item_t item;
+  int times_ok = 1;
 
   /* Get the certificate.  */
   if (cert)
@@ -568,6 +853,29 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
         }
     }
 
+  /* Check whether we have a cached response for this certificate.  */
+  err = ocsp_cache_key (cert, issuer_cert, keyhash, &serialno);
+  if (err)
+    {
+      log_error (_("error getting OCSP cache key: %s\n"), gpg_strerror (err));
+      goto leave;
+    }
+  item = ocsp_cache_find (keyhash, serialno, force_default_responder);
+  if (item)
+    {
+      status = item->status;
+      if (opt.verbose)
+        log_info (_("using cached OCSP status: %s  (this=%s  next=%s)\n"),
+                  status == KSBA_STATUS_GOOD? _("good"): _("revoked"),
+                  item->this_update, item->next_update);
+      if (status == KSBA_STATUS_REVOKED)
+        {
+          validate_cache_forget (cert);
+          err = gpg_error (GPG_ERR_CERT_REVOKED);
+        }
+      goto leave;
+    }
+
   /* Create an OCSP instance.  */
   err = ksba_ocsp_new (&ocsp);
   if (err)
@@ -676,19 +984,7 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
   /* In case the certificate has been revoked, we better invalidate
      our cached validation status. */
   if (status == KSBA_STATUS_REVOKED)
-    {
-      time_t validated_at = 0; /* That is: No cached validation available. */
-      err = ksba_cert_set_user_data (cert, "validated_at",
-                                     &validated_at, sizeof (validated_at));
-      if (err)
-        {
-          log_error ("set_user_data(validated_at) failed: %s\n",
-                     gpg_strerror (err));
-          err = 0; /* The certificate is anyway revoked, and that is a
-                      more important message than the failure of our
-                      cache. */
-        }
-    }
+    validate_cache_forget (cert);
 
 
   if (opt.verbose)
@@ -737,6 +1033,7 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
     {
       log_error (_("OCSP responder returned a status in the future\n"));
       log_info ("used now: %s  this_update: %s\n", current_time, this_update);
+      times_ok = 0;
       if (!err)
         err = gpg_error (GPG_ERR_TIME_CONFLICT);
     }
@@ -750,6 +1047,7 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
       log_error (_("OCSP responder returned a non-current status\n"));
       log_info ("used now: %s  this_update: %s\n",
                 current_time, this_update);
+      times_ok = 0;
       if (!err)
         err = gpg_error (GPG_ERR_TIME_CONFLICT);
     }
@@ -765,11 +1063,18 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
           log_error (_("OCSP responder returned an too old status\n"));
           log_info ("used now: %s  next_update: %s\n",
                     current_time, next_update);
+          times_ok = 0;
           if (!err)
             err = gpg_error (GPG_ERR_TIME_CONFLICT);
         }
     }
 
+  /* Cache the response unless we had a problem with the times.  */
+  if (times_ok)
+    ocsp_cache_insert (keyhash, serialno, url, !!default_signer,
+                       status, reason, this_update, next_update,
+                       revocation_time);
+
 
  leave:
   gcry_md_close (md);
@@ -779,6 +1084,7 @@ ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
   ksba_cert_release (cert);
   ksba_ocsp_release (ocsp);
   xfree (url_buffer);
+  xfree (serialno);
   return err;
 }
 
@@ -28,4 +28,10 @@ gpg_error_t ocsp_isvalid (ctrl_t ctrl, ksba_cert_t cert, const char *cert_fpr,
 /* Release the list of OCSP certificates hold in the CTRL object. */
 void release_ctrl_ocsp_certs (ctrl_t ctrl);
 
+/* Remove all entries from the OCSP response cache.  */
+void ocsp_cache_flush (void);
+
+/* Print the content of the OCSP response cache to FP.  */
+gpg_error_t ocsp_cache_list (estream_t fp);
+
 #endif /*OCSP_H*/
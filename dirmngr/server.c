@@ -1298,6 +1298,44 @@ cmd_listcrls (assuan_context_t ctx, char *line)
 }
 
 
+static const char hlp_listocsp[] =
+  "LISTOCSP\n"
+  "\n"
+  "List the content of the OCSP response cache in a readable format.";
+static gpg_error_t
+cmd_listocsp (assuan_context_t ctx, char *line)
+{
+  gpg_error_t err;
+  estream_t fp;
+
+  (void)line;
+
+  fp = es_fopencookie (ctx, "w", data_line_cookie_functions);
+  if (!fp)
+    err = set_error (GPG_ERR_ASS_GENERAL, "error setting up a data stream");
+  else
+    {
+      err = ocsp_cache_list (fp);
+      es_fclose (fp);
+    }
+  return leave_cmd (ctx, err);
+}
+
+
+static const char hlp_flushocsp[] =
+  "FLUSHOCSP\n"
+  "\n"
+  "Remove all entries from the OCSP response cache.";
+static gpg_error_t
+cmd_flushocsp (assuan_context_t ctx, char *line)
+{
+  (void)line;
+
+  ocsp_cache_flush ();
+  return leave_cmd (ctx, 0);
+}
+
+
 static const char hlp_cachecert[] =
   "CACHECERT\n"
   "\n"
@@ -1884,6 +1922,8 @@ register_commands (assuan_context_t ctx)
     { "LOOKUP",     cmd_lookup,     hlp_lookup },
     { "LOADCRL",    cmd_loadcrl,    hlp_loadcrl },
     { "LISTCRLS",   cmd_listcrls,   hlp_listcrls },
+    { "LISTOCSP",   cmd_listocsp,   hlp_listocsp },
+    { "FLUSHOCSP",  cmd_flushocsp,  hlp_flushocsp },
     { "CACHECERT",  cmd_cachecert,  hlp_cachecert },
     { "VALIDATE",   cmd_validate,   hlp_validate },
     { "KEYSERVER",  cmd_keyserver,  hlp_keyserver },
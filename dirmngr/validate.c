@@ -47,6 +47,41 @@ struct chain_item_s
 typedef struct chain_item_s *chain_item_t;
 
 
+/* The maximum number of entries in the validation cache.  */
+#define MAX_VALIDATION_CACHE_ENTRIES 4096
+
+/* The number of buckets of the validation cache.  */
+#define VALIDATION_CACHE_BUCKETS 256
+
+/* The maximum time in seconds a validation result is cached.  */
+#define VALIDATION_CACHE_MAX_AGE (60*60)
+
+/* An entry of the validation cache.  The key is the fingerprint of
+   the target certificate and the validation mode.  Only the results
+   "good" and "revoked" are stored.  */
+struct validation_cache_item_s
+{
+  struct validation_cache_item_s *next;
+  unsigned char fpr[20];     /* Fingerprint of the target certificate.  */
+  int mode;                  /* The VALIDATE_MODE used.  */
+  gpg_err_code_t result;     /* 0 or GPG_ERR_CERT_REVOKED.  */
+  ksba_isotime_t exptime;    /* The nearest expiration time of the chain.  */
+  ksba_isotime_t expires;    /* Do not use the entry after this.  */
+};
+typedef struct validation_cache_item_s *validation_cache_item_t;
+
+/* The validation cache.  It is shared by all connections.  The cache
+   functions do not call anything which releases the nPth lock and the
+   entry returned by validation_cache_find is only used before the
+   next such call; thus no locking is required.
+
+   Note that sm/certchain.c has a similar validation cache which
+   differs in the key; changes to the purge, find and insert logic
+   should be applied to both copies.  */
+static validation_cache_item_t validation_cache[VALIDATION_CACHE_BUCKETS];
+static unsigned int validation_cache_entries;
+
+
 /* A couple of constants with Object Identifiers.  */
 static const char oid_kp_serverAuth[]     = "1.3.6.1.5.5.7.3.1";
 static const char oid_kp_clientAuth[]     = "1.3.6.1.5.5.7.3.2";
@@ -62,6 +97,147 @@ static gpg_error_t check_cert_sig (ksba_cert_t issuer_cert, ksba_cert_t cert);
 
 
 
+/* Remove all entries from the validation cache which have expired at
+   CURRENT_TIME or, if CURRENT_TIME is NULL, all entries.  */
+static void
+validation_cache_purge (const ksba_isotime_t current_time)
+{
+  validation_cache_item_t item, *itemp;
+  int i;
+
+  for (i=0; i < VALIDATION_CACHE_BUCKETS; i++)
+    for (itemp = &validation_cache[i]; (item = *itemp); )
+      {
+        if (!current_time || strcmp (item->expires, current_time) < 0)
+          {
+            *itemp = item->next;
+            xfree (item);
+            validation_cache_entries--;
+          }
+        else
+          itemp = &item->next;
+      }
+}
+
+
+/* Remove all entries from the validation cache.  This needs to be
+   called whenever the data used for validation changes; for example
+   if a new CRL has been loaded.  */
+void
+validate_cache_flush (void)
+{
+  validation_cache_purge (NULL);
+}
+
+
+/* Remove all entries for CERT from the validation cache.  */
+void
+validate_cache_forget (ksba_cert_t cert)
+{
+  validation_cache_item_t item, *itemp;
+  unsigned char fpr[20];
+
+  cert_compute_fpr (cert, fpr);
+  for (itemp = &validation_cache[*fpr]; (item = *itemp); )
+    {
+      if (!memcmp (item->fpr, fpr, 20))
+        {
+          *itemp = item->next;
+          xfree (item);
+          validation_cache_entries--;
+        }
+      else
+        itemp = &item->next;
+    }
+}
+
+
+/* Look up the validation cache for the certificate with fingerprint
+   FPR validated using MODE.  Returns the entry or NULL.  */
+static validation_cache_item_t
+validation_cache_find (const unsigned char *fpr, int mode)
+{
+  validation_cache_item_t item, *itemp;
+  ksba_isotime_t current_time;
+
+  gnupg_get_isotime (current_time);
+  for (itemp = &validation_cache[*fpr]; (item = *itemp);
+       itemp = &item->next)
+    {
+      if (item->mode != mode || memcmp (item->fpr, fpr, 20))
+        continue;
+
+      if (strcmp (item->expires, current_time) < 0)
+        {
+          /* Expired - remove it.  */
+          *itemp = item->next;
+          xfree (item);
+          validation_cache_entries--;
+          return NULL;
+        }
+      return item;
+    }
+  return NULL;
+}
+
+
+/* Store the validation RESULT for the certificate with fingerprint
+   FPR validated using MODE.  EXPTIME is the nearest expiration time of
+   the certificates in the chain and NEXT_UPDATE the nearest nextUpdate
+   of the CRLs used; both may be empty.  */
+static void
+validation_cache_insert (const unsigned char *fpr, int mode,
+                         gpg_err_code_t result, const ksba_isotime_t exptime,
+                         const ksba_isotime_t next_update)
+{
+  validation_cache_item_t item;
+  ksba_isotime_t current_time, expires;
+
+  gnupg_get_isotime (current_time);
+  gnupg_copy_time (expires, current_time);
+  if (add_seconds_to_isotime (expires, VALIDATION_CACHE_MAX_AGE))
+    return;
+  if (*exptime && strcmp (exptime, expires) < 0)
+    gnupg_copy_time (expires, exptime);
+  if (*next_update && strcmp (next_update, expires) < 0)
+    gnupg_copy_time (expires, next_update);
+  if (strcmp (expires, current_time) <= 0)
+    return;
+
+  /* Update an existing entry.  */
+  for (item = validation_cache[*fpr]; item; item = item->next)
+    if (item->mode == mode && !memcmp (item->fpr, fpr, 20))
+      {
+        item->result = result;
+        gnupg_copy_time (item->exptime, exptime);
+        gnupg_copy_time (item->expires, expires);
+        return;
+      }
+
+  if (validation_cache_entries >= MAX_VALIDATION_CACHE_ENTRIES)
+    validation_cache_purge (current_time);
+  if (validation_cache_entries >= MAX_VALIDATION_CACHE_ENTRIES)
+    {
+      if (opt.verbose)
+        log_info ("validation cache is full - result not cached\n");
+      return;
+    }
+
+  item = xtrycalloc (1, sizeof *item);
+  if (!item)
+    return;
+  memcpy (item->fpr, fpr, 20);
+  item->mode = mode;
+  item->result = result;
+  gnupg_copy_time (item->exptime, exptime);
+  gnupg_copy_time (item->expires, expires);
+  item->next = validation_cache[*fpr];
+  validation_cache[*fpr] = item;
+  validation_cache_entries++;
+}
+
+
+
 /* Check whether CERT contains critical extensions we don't know
    about.  */
 static gpg_error_t
@@ -209,15 +385,20 @@ allowed_ca (ksba_cert_t cert, int *chainlen)
   return 0;
 }
 
-/* Helper for validate_cert_chain.  */
+/* Helper for validate_cert_chain.  The nearest nextUpdate of the
+   CRLs used is stored at R_NEXT_UPDATE.  */
 static gpg_error_t
-check_revocations (ctrl_t ctrl, chain_item_t chain)
+check_revocations (ctrl_t ctrl, chain_item_t chain,
+                   ksba_isotime_t r_next_update)
 {
   gpg_error_t err = 0;
   int any_revoked = 0;
   int any_no_crl = 0;
   int any_crl_too_old = 0;
   chain_item_t ci;
+  ksba_isotime_t next_update;
+
+  *r_next_update = 0;
 
   assert (ctrl->check_revocations_nest_level >= 0);
   assert (chain);
@@ -263,6 +444,11 @@ check_revocations (ctrl_t ctrl, chain_item_t chain)
         case GPG_ERR_CRL_TOO_OLD: any_crl_too_old = 1; err = 0; break;
         default: break;
         }
+
+      crl_cache_get_next_update (ci->cert, next_update);
+      if (*next_update
+          && (!*r_next_update || strcmp (next_update, r_next_update) < 0))
+        gnupg_copy_time (r_next_update, next_update);
     }
   ctrl->check_revocations_nest_level--;
 
@@ -370,6 +556,8 @@ validate_cert_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t r_exptime,
   ksba_cert_t subject_cert = NULL, issuer_cert = NULL;
   ksba_isotime_t current_time;
   ksba_isotime_t exptime;
+  ksba_isotime_t next_update;
+  unsigned char certfpr[20];  /* Fingerprint of CERT.  */
   int any_expired = 0;
   int any_no_policy_match = 0;
   chain_item_t chain;
@@ -378,6 +566,7 @@ validate_cert_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t r_exptime,
   if (r_exptime)
     *r_exptime = 0;
   *exptime = 0;
+  *next_update = 0;
 
   if (r_trust_anchor)
     *r_trust_anchor = NULL;
@@ -410,32 +599,25 @@ validate_cert_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t r_exptime,
   if (err)
     return err;
 
-  /* If we already validated the certificate not too long ago, we can
-     avoid the excessive computations and lookups unless the caller
-     asked for the expiration time.  */
-  if (!r_exptime)
-    {
-      size_t buflen;
-      time_t validated_at;
-
-      err = ksba_cert_get_user_data (cert, "validated_at",
-                                     &validated_at, sizeof (validated_at),
-                                     &buflen);
-      if (err || buflen != sizeof (validated_at) || !validated_at)
-        err = 0; /* Not available or other error. */
-      else
-        {
-          /* If the validation is not older than 30 minutes we are ready. */
-          if (validated_at < gnupg_get_time () + (30*60))
-            {
-              if (opt.verbose)
-                log_info ("certificate is good (cached)\n");
-              /* Note, that we can't jump to leave here as this would
-                 falsely updated the validation timestamp.  */
-              return 0;
-            }
-        }
-    }
+  /* If we already validated the certificate and the certificates and
+     CRLs used are still current, we can avoid the excessive
+     computations and lookups.  */
+  cert_compute_fpr (cert, certfpr);
+  {
+    validation_cache_item_t item;
+
+    item = validation_cache_find (certfpr, mode);
+    if (item)
+      {
+        if (opt.verbose && item->result)
+          log_info ("certificate is revoked (cached)\n");
+        else if (opt.verbose)
+          log_info ("certificate is good (cached)\n");
+        if (r_exptime)
+          gnupg_copy_time (r_exptime, item->exptime);
+        return item->result? gpg_error (item->result) : 0;
+      }
+  }
 
   /* Get the current time. */
   gnupg_get_isotime (current_time);
@@ -759,7 +941,7 @@ validate_cert_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t r_exptime,
          our validity results to avoid double work.  Far worse a
          catch-22 may happen for an improper setup hierachy and we
          need a way to break up such a deadlock. */
-      err = check_revocations (ctrl, chain);
+      err = check_revocations (ctrl, chain, next_update);
     }
 
   if (!err && opt.verbose)
@@ -774,28 +956,18 @@ validate_cert_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t r_exptime,
 
 
  leave:
-  if (!err && !(r_trust_anchor && *r_trust_anchor))
+  if ((!err || gpg_err_code (err) == GPG_ERR_CERT_REVOKED)
+      && !(r_trust_anchor && *r_trust_anchor))
     {
-      /* With no error we can update the validation cache.  We do this
-         for all certificates in the chain.  Note that we can't use
-         the cache if the caller requested to check the trustiness of
-         the root certificate himself.  Adding such a feature would
+      /* We can update the validation cache.  The entry is not used
+         after the nearest expiration time of the chain or the
+         nearest nextUpdate of the CRLs.  Note that we can't use the
+         cache if the caller requested to check the trustiness of the
+         root certificate himself.  Adding such a feature would
          require us to also store the fingerprint of root
          certificate.  */
-      chain_item_t citem;
-      time_t validated_at = gnupg_get_time ();
-
-      for (citem = chain; citem; citem = citem->next)
-        {
-          err = ksba_cert_set_user_data (citem->cert, "validated_at",
-                                         &validated_at, sizeof (validated_at));
-          if (err)
-            {
-              log_error ("set_user_data(validated_at) failed: %s\n",
-                         gpg_strerror (err));
-              err = 0;
-            }
-        }
+      validation_cache_insert (certfpr, mode, gpg_err_code (err),
+                               exptime, next_update);
     }
 
   if (r_exptime)
@@ -41,6 +41,12 @@ gpg_error_t validate_cert_chain (ctrl_t ctrl,
                                  ksba_cert_t cert, ksba_isotime_t r_exptime,
                                  int mode, char **r_trust_anchor);
 
+/* Remove all entries from the validation cache.  */
+void validate_cache_flush (void);
+
+/* Remove all entries for CERT from the validation cache.  */
+void validate_cache_forget (ksba_cert_t cert);
+
 /* Return 0 if the certificate CERT is usable for certification.  */
 gpg_error_t cert_use_cert_p (ksba_cert_t cert);
 
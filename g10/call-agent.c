@@ -264,6 +264,17 @@ check_hijacking (assuan_context_t ctx)
 
 
 
+/* Forget the connection to the agent.  This is used by a forked
+   process which must not share the connection with its parent.  The
+   context is not released because that would end the parent's
+   session; the next request opens a new connection.  */
+void
+agent_detach (void)
+{
+  agent_ctx = NULL;
+}
+
+
 /* Try to connect to the agent via socket or fork it off and work by
    pipes.  Handle the server's initial greeting */
 static int
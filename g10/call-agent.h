@@ -72,6 +72,9 @@ struct agent_card_genkey_s {
 };
 
 
+/* Forget the connection to the agent in a forked process.  */
+void agent_detach (void);
+
 /* Release the card info structure. */
 void agent_release_card_info (struct agent_card_info_s *info);
 
@@ -117,6 +117,22 @@ gpg_dirmngr_deinit_session_data (ctrl_t ctrl)
 }
 
 
+/* Forget all dirmngr connections of CTRL without closing them.  This
+   is used by a forked process; the connections belong to the
+   parent.  */
+void
+gpg_dirmngr_detach (ctrl_t ctrl)
+{
+  dirmngr_local_t dml;
+
+  while ((dml = ctrl->dirmngr_local))
+    {
+      ctrl->dirmngr_local = dml->next;
+      xfree (dml);
+    }
+}
+
+
 /* Try to connect to the Dirmngr via a socket or spawn it if possible.
    Handle the server's initial greeting and set global options.  */
 static gpg_error_t
@@ -20,6 +20,7 @@
 #define GNUPG_G10_CALL_DIRMNGR_H
 
 void gpg_dirmngr_deinit_session_data (ctrl_t ctrl);
+void gpg_dirmngr_detach (ctrl_t ctrl);
 
 gpg_error_t gpg_dirmngr_ks_search (ctrl_t ctrl, const char *searchstr,
                                    gpg_error_t (*cb)(void*, int, char *),
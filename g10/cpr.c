@@ -298,6 +298,21 @@ write_status_buffer (int no, const char *buffer, size_t len, int wrap)
 }
 
 
+/* Write the LENGTH bytes of already formatted status lines in BUFFER
+   to the status stream.  This is used to pass on the status output
+   of a worker process.  */
+void
+write_status_raw (const void *buffer, size_t length)
+{
+  if (!statusfp || !length)
+    return;
+
+  es_write (statusfp, buffer, length, NULL);
+  if (es_fflush (statusfp) && opt.exit_on_status_write_error)
+    g10_exit (0);
+}
+
+
 /* Print the BEGIN_SIGNING status message.  If MD is not NULL it is
    used to retrieve the hash algorithms used for the message. */
 void
@@ -177,14 +177,68 @@ decrypt_message_fd (ctrl_t ctrl, int input_fd, int output_fd)
 }
 
 
+/* Helper for decrypt_messages.  */
+static void
+decrypt_file_cb (ctrl_t ctrl, const char *filename, void *opaque)
+{
+  progress_filter_context_t *pfx = opaque;
+  armor_filter_context_t *afx = NULL;
+  IOBUF fp;
+  char *p, *output;
+  int rc;
+
+  print_file_status(STATUS_FILE_START, filename, 3);
+  output = make_outfile_name(filename);
+  if (!output)
+    goto leave;
+  fp = iobuf_open(filename);
+  if (fp)
+    iobuf_ioctl (fp, IOBUF_IOCTL_NO_CACHE, 1, NULL);
+  if (fp && is_secured_file (iobuf_get_fd (fp)))
+    {
+      iobuf_close (fp);
+      fp = NULL;
+      gpg_err_set_errno (EPERM);
+    }
+  if (!fp)
+    {
+      log_error(_("can't open '%s'\n"), print_fname_stdin(filename));
+      goto leave;
+    }
+
+  handle_progress (pfx, fp, filename);
+
+  if (!opt.no_armor)
+    {
+      if (use_armor_filter(fp))
+        {
+          afx = new_armor_context ();
+          push_armor_filter ( afx, fp );
+        }
+    }
+  rc = proc_packets (ctrl,NULL, fp);
+  iobuf_close(fp);
+  if (rc)
+    log_error("%s: decryption failed: %s\n", print_fname_stdin(filename),
+              g10_errstr(rc));
+  p = get_last_passphrase();
+  set_next_passphrase(p);
+  xfree (p);
+
+ leave:
+  /* Note that we emit file_done even after an error. */
+  write_status( STATUS_FILE_DONE );
+  xfree(output);
+  reset_literals_seen();
+  release_armor_context (afx);
+}
+
+
 void
 decrypt_messages (ctrl_t ctrl, int nfiles, char *files[])
 {
-  IOBUF fp;
-  armor_filter_context_t *afx = NULL;
   progress_filter_context_t *pfx;
-  char *p, *output = NULL;
-  int rc=0,use_stdin=0;
+  int use_stdin=0;
   unsigned int lno=0;
 
   if (opt.outfile)
@@ -230,52 +284,10 @@ decrypt_messages (ctrl_t ctrl, int nfiles, char *files[])
       if(filename==NULL)
 	break;
 
-      print_file_status(STATUS_FILE_START, filename, 3);
-      output = make_outfile_name(filename);
-      if (!output)
-        goto next_file;
-      fp = iobuf_open(filename);
-      if (fp)
-        iobuf_ioctl (fp, IOBUF_IOCTL_NO_CACHE, 1, NULL);
-      if (fp && is_secured_file (iobuf_get_fd (fp)))
-        {
-          iobuf_close (fp);
-          fp = NULL;
-          gpg_err_set_errno (EPERM);
-        }
-      if (!fp)
-        {
-          log_error(_("can't open '%s'\n"), print_fname_stdin(filename));
-          goto next_file;
-        }
-
-      handle_progress (pfx, fp, filename);
-
-      if (!opt.no_armor)
-        {
-          if (use_armor_filter(fp))
-            {
-              afx = new_armor_context ();
-              push_armor_filter ( afx, fp );
-            }
-        }
-      rc = proc_packets (ctrl,NULL, fp);
-      iobuf_close(fp);
-      if (rc)
-        log_error("%s: decryption failed: %s\n", print_fname_stdin(filename),
-                  g10_errstr(rc));
-      p = get_last_passphrase();
-      set_next_passphrase(p);
-      xfree (p);
-
-    next_file:
-      /* Note that we emit file_done even after an error. */
-      write_status( STATUS_FILE_DONE );
-      xfree(output);
-      reset_literals_seen();
+      multifile_run (ctrl, filename, decrypt_file_cb, pfx);
     }
 
+  multifile_wait (ctrl);
   set_next_passphrase(NULL);
-  release_armor_context (afx);
   release_progress_context (pfx);
 }
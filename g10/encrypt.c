@@ -922,10 +922,26 @@ write_pubkey_enc_from_list (PK_LIST pk_list, DEK *dek, iobuf_t out)
 }
 
 
+/* Helper for encrypt_crypt_files.  */
+static void
+encrypt_crypt_file_cb (ctrl_t ctrl, const char *fname, void *opaque)
+{
+  pk_list_t pk_list = opaque;
+  int rc;
+
+  print_file_status (STATUS_FILE_START, fname, 2);
+  if ((rc = encrypt_crypt (ctrl, -1, fname, NULL, 0, pk_list, -1)))
+    log_error ("encryption of '%s' failed: %s\n",
+               print_fname_stdin (fname), g10_errstr (rc));
+  write_status (STATUS_FILE_DONE);
+}
+
+
 void
 encrypt_crypt_files (ctrl_t ctrl, int nfiles, char **files, strlist_t remusr)
 {
   int rc = 0;
+  pk_list_t pk_list;
 
   if (opt.outfile)
     {
@@ -933,6 +949,14 @@ encrypt_crypt_files (ctrl_t ctrl, int nfiles, char **files, strlist_t remusr)
       return;
     }
 
+  /* The recipients are the same for all files; thus we look them up
+     only once.  */
+  if ((rc = build_pk_list (ctrl, remusr, &pk_list, PUBKEY_USAGE_ENC)))
+    {
+      log_error ("encryption failed: %s\n", g10_errstr (rc));
+      return;
+    }
+
   if (!nfiles)
     {
       char line[2048];
@@ -943,27 +967,21 @@ encrypt_crypt_files (ctrl_t ctrl, int nfiles, char **files, strlist_t remusr)
           if (!*line || line[strlen(line)-1] != '\n')
             {
               log_error("input line %u too long or missing LF\n", lno);
-              return;
+              break;
             }
           line[strlen(line)-1] = '\0';
-          print_file_status(STATUS_FILE_START, line, 2);
-          rc = encrypt_crypt (ctrl, -1, line, remusr, 0, NULL, -1);
-          if (rc)
-            log_error ("encryption of '%s' failed: %s\n",
-                       print_fname_stdin(line), g10_errstr(rc) );
-          write_status( STATUS_FILE_DONE );
+          multifile_run (ctrl, line, encrypt_crypt_file_cb, pk_list);
         }
     }
   else
     {
       while (nfiles--)
         {
-          print_file_status(STATUS_FILE_START, *files, 2);
-          if ( (rc = encrypt_crypt (ctrl, -1, *files, remusr, 0, NULL, -1)) )
-            log_error("encryption of '%s' failed: %s\n",
-                      print_fname_stdin(*files), g10_errstr(rc) );
-          write_status( STATUS_FILE_DONE );
+          multifile_run (ctrl, *files, encrypt_crypt_file_cb, pk_list);
           files++;
         }
     }
+
+  multifile_wait (ctrl);
+  release_pk_list (pk_list);
 }
@@ -364,6 +364,7 @@ enum cmd_and_opt_values
     oNoMangleDosFilenames,
     oEnableProgressFilter,
     oMultifile,
+    oJobs,
     oKeyidFormat,
     oExitOnStatusWriteError,
     oLimitCardInsertTries,
@@ -766,6 +767,7 @@ static ARGPARSE_OPTS opts[] = {
   ARGPARSE_s_n (oNoMangleDosFilenames, "no-mangle-dos-filenames", "@"),
   ARGPARSE_s_n (oEnableProgressFilter, "enable-progress-filter", "@"),
   ARGPARSE_s_n (oMultifile, "multifile", "@"),
+  ARGPARSE_s_i (oJobs, "jobs", "@"),
   ARGPARSE_s_s (oKeyidFormat, "keyid-format", "@"),
   ARGPARSE_s_n (oExitOnStatusWriteError, "exit-on-status-write-error", "@"),
   ARGPARSE_s_i (oLimitCardInsertTries, "limit-card-insert-tries", "@"),
@@ -3065,6 +3067,7 @@ main (int argc, char **argv)
           case oNoMangleDosFilenames: opt.mangle_dos_filenames = 0; break;
           case oEnableProgressFilter: opt.enable_progress_filter = 1; break;
 	  case oMultifile: multifile=1; break;
+	  case oJobs: opt.jobs = pargs.r.ret_int; break;
 	  case oKeyidFormat:
 	    if(ascii_strcasecmp(pargs.r.ret_str,"short")==0)
 	      opt.keyid_format=KF_SHORT;
@@ -403,6 +403,24 @@ decrypt_data (ctrl_t ctrl, void *procctx, PKT_encrypted *ed, DEK *dek)
 }
 
 
+/* Stub:
+ * There are no multifile commands, so files are never processed by
+ * worker processes
+ */
+void
+multifile_run (ctrl_t ctrl, const char *fname,
+               multifile_fnc_t fnc, void *opaque)
+{
+  fnc (ctrl, fname, opaque);
+}
+
+void
+multifile_wait (ctrl_t ctrl)
+{
+  (void)ctrl;
+}
+
+
 /* Stub:
  * No interactive commands, so we don't need the helptexts
  */
@@ -57,6 +57,27 @@ struct stats_s {
     ulong not_imported;
     ulong n_sigs_cleaned;
     ulong n_uids_cleaned;
+    struct bulk_s *bulk;  /* Non-NULL with import option bulk-import.  */
+};
+
+
+/* The number of new keys written at once by a bulk import.  */
+#define BULK_BATCH_SIZE 1000
+
+/* The number of slots of the fingerprint table of a batch; this must
+   be larger than BULK_BATCH_SIZE.  */
+#define BULK_TABLE_SIZE 2048
+
+/* The new keys of a bulk import which have not yet been written.  */
+struct bulk_s
+{
+  int nkeys;
+  kbnode_t keyblocks[BULK_BATCH_SIZE];
+  byte fprs[BULK_BATCH_SIZE][MAX_FINGERPRINT_LEN];
+  int non_self;  /* A key has signatures other than self-signatures.  */
+  /* Open addressing hash table with the index plus one of the key
+     with that fingerprint or 0 for an unused slot.  */
+  short table[BULK_TABLE_SIZE];
 };
 
 
@@ -65,9 +86,11 @@ static int import (ctrl_t ctrl,
 		   unsigned char **fpr, size_t *fpr_len, unsigned int options,
 		   import_screener_t screener, void *screener_arg);
 static int read_block( IOBUF a, PACKET **pending_pkt, KBNODE *ret_root );
+static int bulk_flush (ctrl_t ctrl, struct stats_s *stats);
 static void revocation_present (ctrl_t ctrl, kbnode_t keyblock);
 static int import_one (ctrl_t ctrl,
-                       const char *fname, KBNODE keyblock,struct stats_s *stats,
+                       const char *fname, KBNODE *r_keyblock,
+                       struct stats_s *stats,
                        unsigned char **fpr, size_t *fpr_len,
                        unsigned int options, int from_sk, int silent,
                        import_screener_t screener, void *screener_arg);
@@ -110,6 +133,8 @@ parse_import_options(char *str,unsigned int *options,int noisy)
        N_("remove unusable parts from key after import")},
       {"import-minimal",IMPORT_MINIMAL|IMPORT_CLEAN,NULL,
        N_("remove as much as possible from key after import")},
+      {"bulk-import",IMPORT_BULK,NULL,
+       N_("write new keys in batches")},
       /* Aliases for backward compatibility */
       {"allow-local-sigs",IMPORT_LOCAL_SIGS,NULL,NULL},
       {"repair-hkp-subkey-bug",IMPORT_REPAIR_PKS_SUBKEY_BUG,NULL,NULL},
@@ -179,6 +204,8 @@ import_keys_internal (ctrl_t ctrl, iobuf_t inp, char **fnames, int nnames,
 
     if (!stats)
         stats = import_new_stats_handle ();
+    if ((options & IMPORT_BULK))
+        stats->bulk = xcalloc (1, sizeof *stats->bulk);
 
     if (inp) {
       rc = import (ctrl, inp, "[stream]", stats, fpr, fpr_len, options,
@@ -217,6 +244,13 @@ import_keys_internal (ctrl_t ctrl, iobuf_t inp, char **fnames, int nnames,
 	        break;
 	}
     }
+    if (stats->bulk) {
+        int rc2 = bulk_flush (ctrl, stats);
+        if (!rc)
+          rc = rc2;
+        xfree (stats->bulk);
+        stats->bulk = NULL;
+    }
     if (!stats_handle) {
         import_print_stats (stats);
         import_release_stats_handle (stats);
@@ -303,16 +337,23 @@ import (ctrl_t ctrl, IOBUF inp, const char* fname,struct stats_s *stats,
 
     while( !(rc = read_block( inp, &pending_pkt, &keyblock) )) {
 	if( keyblock->pkt->pkttype == PKT_PUBLIC_KEY )
-          rc = import_one (ctrl, fname, keyblock,
+          rc = import_one (ctrl, fname, &keyblock,
                            stats, fpr, fpr_len, options, 0, 0,
                            screener, screener_arg);
-	else if( keyblock->pkt->pkttype == PKT_SECRET_KEY )
-          rc = import_secret_one (ctrl, fname, keyblock, stats,
-                                  opt.batch, options, 0,
-                                  screener, screener_arg);
+	else if( keyblock->pkt->pkttype == PKT_SECRET_KEY ) {
+            /* The public key may be part of the pending batch.  */
+            rc = bulk_flush (ctrl, stats);
+            if (!rc)
+              rc = import_secret_one (ctrl, fname, keyblock, stats,
+                                      opt.batch, options, 0,
+                                      screener, screener_arg);
+        }
 	else if( keyblock->pkt->pkttype == PKT_SIGNATURE
-		 && keyblock->pkt->pkt.signature->sig_class == 0x20 )
-	    rc = import_revoke_cert( fname, keyblock, stats );
+		 && keyblock->pkt->pkt.signature->sig_class == 0x20 ) {
+            rc = bulk_flush (ctrl, stats);
+            if (!rc)
+              rc = import_revoke_cert( fname, keyblock, stats );
+        }
 	else {
 	    log_info( _("skipping block of type %d\n"),
 					    keyblock->pkt->pkttype );
@@ -833,20 +874,191 @@ check_prefs (ctrl_t ctrl, kbnode_t keyblock)
     }
 }
 
+/* Print the diagnostics and status lines for the new key PK with
+   KEYID and the fingerprint FPR which has just been written to the
+   keyring.  */
+static void
+print_new_key (PKT_public_key *pk, u32 *keyid, byte *fpr, int silent)
+{
+  if (!opt.quiet && !silent)
+    {
+      char *p = get_user_id_byfpr_native (fpr);
+      log_info (_("key %s: public key \"%s\" imported\n"),
+                keystr (keyid), p);
+      xfree (p);
+    }
+  if (is_status_enabled ())
+    {
+      char *us = get_long_user_id_string (keyid);
+      write_status_text (STATUS_IMPORTED, us);
+      xfree (us);
+      print_import_ok (pk, 1);
+    }
+}
+
+
+/* Return the slot of the table of BULK for the fingerprint FPR.  This
+   is either the slot holding that fingerprint or the free slot where
+   it would be inserted.  */
+static int
+bulk_slot (struct bulk_s *bulk, const byte *fpr)
+{
+  unsigned int slot;
+  int idx;
+
+  slot = ((fpr[0] << 24) | (fpr[1] << 16) | (fpr[2] << 8) | fpr[3]);
+  for (slot %= BULK_TABLE_SIZE; (idx = bulk->table[slot]);
+       slot = (slot + 1) % BULK_TABLE_SIZE)
+    if (!memcmp (bulk->fprs[idx-1], fpr, MAX_FINGERPRINT_LEN))
+      break;
+  return slot;
+}
+
+
+/* Return true if the key with fingerprint FPR is waiting in the
+   current batch of a bulk import.  */
+static int
+bulk_find (struct stats_s *stats, const byte *fpr)
+{
+  struct bulk_s *bulk = stats->bulk;
+
+  return bulk && bulk->table[bulk_slot (bulk, fpr)];
+}
+
+
+/* Report that the new key KEYBLOCK of a bulk import could not be
+   written.  */
+static void
+bulk_not_imported (struct stats_s *stats, kbnode_t keyblock)
+{
+  PKT_public_key *pk;
+  char *hexfpr;
+
+  pk = find_kbnode (keyblock, PKT_PUBLIC_KEY)->pkt->pkt.public_key;
+  log_error (_("key %s: public key not imported\n"), keystr_from_pk (pk));
+  if (is_status_enabled ())
+    {
+      hexfpr = hexfingerprint (pk);
+      write_status_strings (STATUS_IMPORT_PROBLEM, "4 ", hexfpr, NULL);
+      xfree (hexfpr);
+    }
+  stats->not_imported++;
+}
+
+
+/* Add the new key KEYBLOCK with fingerprint FPR to the current batch
+   of a bulk import.  The batch takes ownership of KEYBLOCK.  If the
+   batch is full it is written first.  */
+static int
+bulk_add (ctrl_t ctrl, struct stats_s *stats, kbnode_t keyblock,
+          const byte *fpr, int non_self)
+{
+  struct bulk_s *bulk = stats->bulk;
+  int rc;
+
+  if (bulk->nkeys == BULK_BATCH_SIZE)
+    {
+      rc = bulk_flush (ctrl, stats);
+      if (rc)
+        {
+          bulk_not_imported (stats, keyblock);
+          release_kbnode (keyblock);
+          return rc;
+        }
+    }
+
+  memcpy (bulk->fprs[bulk->nkeys], fpr, MAX_FINGERPRINT_LEN);
+  bulk->keyblocks[bulk->nkeys++] = keyblock;
+  bulk->table[bulk_slot (bulk, fpr)] = bulk->nkeys;
+  if (non_self)
+    bulk->non_self = 1;
+  return 0;
+}
+
+
+/* Write the current batch of a bulk import to the keyring.  Inserting
+   all new keys with one operation avoids that the keyring is locked
+   and copied for each of them.  The remaining work which import_one
+   does for a new key is done here after the batch has been written.
+   If the batch can't be written, each of its keys is reported as not
+   imported.  */
+static int
+bulk_flush (ctrl_t ctrl, struct stats_s *stats)
+{
+  struct bulk_s *bulk = stats->bulk;
+  KEYDB_HANDLE hd;
+  PKT_public_key *pk;
+  u32 keyid[2];
+  int rc, i;
+
+  if (!bulk || !bulk->nkeys)
+    return 0;
+
+  hd = keydb_new ();
+  rc = keydb_locate_writable (hd, NULL);
+  if (rc)
+    {
+      log_error (_("no writable keyring found: %s\n"), g10_errstr (rc));
+      rc = G10ERR_GENERAL;
+    }
+  else
+    {
+      if (opt.verbose > 1)
+        log_info (_("writing to '%s'\n"), keydb_get_resource_name (hd));
+      rc = keydb_insert_keyblocks (hd, bulk->keyblocks, bulk->nkeys);
+      if (rc)
+        log_error (_("error writing keyring '%s': %s\n"),
+                   keydb_get_resource_name (hd), g10_errstr (rc));
+    }
+  keydb_release (hd);
+
+  if (!rc && bulk->non_self)
+    revalidation_mark ();
+
+  for (i=0; i < bulk->nkeys; i++)
+    {
+      if (rc)
+        bulk_not_imported (stats, bulk->keyblocks[i]);
+      else
+        {
+          pk = find_kbnode (bulk->keyblocks[i],
+                            PKT_PUBLIC_KEY)->pkt->pkt.public_key;
+          keyid_from_pk (pk, keyid);
+          /* See import_one.  */
+          clear_ownertrusts (pk);
+          print_new_key (pk, keyid, bulk->fprs[i], 0);
+          stats->imported++;
+
+          revocation_present (ctrl, bulk->keyblocks[i]);
+          if (have_secret_key_with_kid (keyid))
+            check_prefs (ctrl, bulk->keyblocks[i]);
+        }
+      release_kbnode (bulk->keyblocks[i]);
+    }
+
+  bulk->nkeys = 0;
+  bulk->non_self = 0;
+  memset (bulk->table, 0, sizeof bulk->table);
+  return rc;
+}
+
+
 /****************
  * Try to import one keyblock. Return an error only in serious cases,
  * but never for an invalid keyblock.  It uses log_error to increase
  * the internal errorcount, so that invalid input can be detected by
  * programs which called gpg.  If SILENT is no messages are printed -
- * even most error messages are suppressed.
+ * even most error messages are suppressed.  With a bulk import a new
+ * key is only queued; in this case *R_KEYBLOCK is set to NULL.
  */
 static int
 import_one (ctrl_t ctrl,
-            const char *fname, KBNODE keyblock, struct stats_s *stats,
+            const char *fname, KBNODE *r_keyblock, struct stats_s *stats,
 	    unsigned char **fpr, size_t *fpr_len, unsigned int options,
 	    int from_sk, int silent,
             import_screener_t screener, void *screener_arg)
 {
+    KBNODE keyblock = *r_keyblock;
     PKT_public_key *pk;
     PKT_public_key *pk_orig;
     KBNODE node, uidnode;
@@ -858,6 +1070,7 @@ import_one (ctrl_t ctrl,
     int new_key = 0;
     int mod_key = 0;
     int same_key = 0;
+    int queued = 0;
     int non_self = 0;
     size_t an;
     char pkstrbuf[PUBKEY_STRING_SIZE];
@@ -915,6 +1128,7 @@ import_one (ctrl_t ctrl,
     }
 
     collapse_uids(&keyblock);
+    *r_keyblock = keyblock;
 
     /* Clean the key that we're about to import, to cut down on things
        that we have to clean later.  This has no practical impact on
@@ -957,6 +1171,15 @@ import_one (ctrl_t ctrl,
 	return 0;
     }
 
+    /* A new key from the current batch must be written before we can
+       merge with it.  */
+    if (bulk_find (stats, fpr2))
+      {
+        rc = bulk_flush (ctrl, stats);
+        if (rc)
+          return rc;
+      }
+
     /* do we have this key already in one of our pubrings ? */
     pk_orig = xmalloc_clear( sizeof *pk_orig );
     rc = get_pubkey_byfprint_fast (pk_orig, fpr2, fpr2len);
@@ -973,6 +1196,14 @@ import_one (ctrl_t ctrl,
 	rc = 0;
 	stats->skipped_new_keys++;
       }
+    else if (rc && stats->bulk && !from_sk)
+      {
+        /* Queue this key; it is written and reported by bulk_flush.  */
+        rc = bulk_add (ctrl, stats, keyblock, fpr2, non_self);
+        *r_keyblock = NULL;
+        if (!rc)
+          new_key = queued = 1;
+      }
     else if( rc ) { /* insert this key */
         KEYDB_HANDLE hd = keydb_new ();
 
@@ -1003,20 +1234,7 @@ import_one (ctrl_t ctrl,
         keydb_release (hd);
 
 	/* we are ready */
-	if( !opt.quiet && !silent)
-	  {
-	    char *p = get_user_id_byfpr_native (fpr2);
-	    log_info (_("key %s: public key \"%s\" imported\n"),
-		      keystr(keyid), p);
-	    xfree(p);
-	  }
-	if( is_status_enabled() )
-	  {
-	    char *us = get_long_user_id_string( keyid );
-	    write_status_text( STATUS_IMPORTED, us );
-	    xfree(us);
-            print_import_ok (pk, 1);
-	  }
+        print_new_key (pk, keyid, fpr2, silent);
 	stats->imported++;
 	new_key = 1;
     }
@@ -1181,7 +1399,8 @@ import_one (ctrl_t ctrl,
 
     /* Now that the key is definitely incorporated into the keydb, we
        need to check if a designated revocation is present or if the
-       prefs are not rational so we can warn the user. */
+       prefs are not rational so we can warn the user.  For a queued
+       key this is done by bulk_flush after it has been written.  */
 
     if (mod_key)
       {
@@ -1189,7 +1408,7 @@ import_one (ctrl_t ctrl,
 	if (!from_sk && have_secret_key_with_kid (keyid))
 	  check_prefs (ctrl, keyblock_orig);
       }
-    else if (new_key)
+    else if (new_key && !queued)
       {
 	revocation_present (ctrl, keyblock);
 	if (!from_sk && have_secret_key_with_kid (keyid))
@@ -1631,7 +1850,7 @@ import_secret_one (ctrl_t ctrl, const char *fname, KBNODE keyblock,
       /* Note that this outputs an IMPORT_OK status message for the
 	 public key block, and below we will output another one for
 	 the secret keys.  FIXME?  */
-      import_one (ctrl, fname, pub_keyblock, stats,
+      import_one (ctrl, fname, &pub_keyblock, stats,
 		  NULL, NULL, options, 1, for_migration,
                   screener, screener_arg);
 
@@ -1170,6 +1170,86 @@ keydb_insert_keyblock (KEYDB_HANDLE hd, kbnode_t kb)
 }
 
 
+/* Insert the NKBS keyblocks KBS into the same resource as
+   keydb_insert_keyblock would do.  The resource is locked only once
+   and written only once for all keyblocks.  */
+gpg_error_t
+keydb_insert_keyblocks (KEYDB_HANDLE hd, kbnode_t *kbs, int nkbs)
+{
+  gpg_error_t err;
+  int idx, i;
+
+  if (!hd)
+    return gpg_error (GPG_ERR_INV_ARG);
+
+  keyblock_cache_clear ();
+
+  if (opt.dry_run || nkbs <= 0)
+    return 0;
+
+  if (hd->found >= 0 && hd->found < hd->used)
+    idx = hd->found;
+  else if (hd->current >= 0 && hd->current < hd->used)
+    idx = hd->current;
+  else
+    return gpg_error (GPG_ERR_GENERAL);
+
+  err = lock_all (hd);
+  if (err)
+    return err;
+
+  switch (hd->active[idx].type)
+    {
+    case KEYDB_RESOURCE_TYPE_NONE:
+      err = gpg_error (GPG_ERR_GENERAL); /* oops */
+      break;
+    case KEYDB_RESOURCE_TYPE_KEYRING:
+      err = keyring_insert_keyblocks (hd->active[idx].u.kr, kbs, nkbs);
+      break;
+    case KEYDB_RESOURCE_TYPE_KEYBOX:
+      {
+        iobuf_t *iobufs;
+        const void **images;
+        size_t *imagelens;
+        u32 **sigstatus;
+
+        iobufs = xtrycalloc (nkbs, sizeof *iobufs);
+        images = xtrycalloc (nkbs, sizeof *images);
+        imagelens = xtrycalloc (nkbs, sizeof *imagelens);
+        sigstatus = xtrycalloc (nkbs, sizeof *sigstatus);
+        if (!iobufs || !images || !imagelens || !sigstatus)
+          err = gpg_error_from_syserror ();
+        for (i=0; !err && i < nkbs; i++)
+          {
+            err = build_keyblock_image (kbs[i], &iobufs[i], &sigstatus[i]);
+            if (!err)
+              {
+                images[i] = iobuf_get_temp_buffer (iobufs[i]);
+                imagelens[i] = iobuf_get_temp_length (iobufs[i]);
+              }
+          }
+        if (!err)
+          err = keybox_insert_keyblocks (hd->active[idx].u.kb,
+                                         images, imagelens, sigstatus, nkbs);
+        for (i=0; iobufs && sigstatus && i < nkbs; i++)
+          {
+            xfree (sigstatus[i]);
+            if (iobufs[i])
+              iobuf_close (iobufs[i]);
+          }
+        xfree (iobufs);
+        xfree (images);
+        xfree (imagelens);
+        xfree (sigstatus);
+      }
+      break;
+    }
+
+  unlock_all (hd);
+  return err;
+}
+
+
 /*
  * Delete the current keyblock.
  */
@@ -92,7 +92,7 @@ struct keyring_handle
 
 
 
-static int do_copy (int mode, const char *fname, KBNODE root,
+static int do_copy (int mode, const char *fname, KBNODE *roots, int nroots,
                     off_t start_offset, unsigned int n_packets );
 
 
@@ -529,7 +529,7 @@ keyring_update_keyblock (KEYRING_HANDLE hd, KBNODE kb)
     hd->current.iobuf = NULL;
 
     /* do the update */
-    rc = do_copy (3, hd->found.kr->fname, kb,
+    rc = do_copy (3, hd->found.kr->fname, &kb, 1,
                   hd->found.offset, hd->found.n_packets );
     if (!rc) {
       if (kr_offtbl)
@@ -546,7 +546,16 @@ keyring_update_keyblock (KEYRING_HANDLE hd, KBNODE kb)
 int
 keyring_insert_keyblock (KEYRING_HANDLE hd, KBNODE kb)
 {
-    int rc;
+  return keyring_insert_keyblocks (hd, &kb, 1);
+}
+
+
+/* Insert the NKBS keyblocks KBS.  The keyring is copied only once for
+   all of them.  */
+int
+keyring_insert_keyblocks (KEYRING_HANDLE hd, KBNODE *kbs, int nkbs)
+{
+    int rc, i;
     const char *fname;
 
     if (!hd)
@@ -568,6 +577,8 @@ keyring_insert_keyblock (KEYRING_HANDLE hd, KBNODE kb)
 
     if (!fname)
         return G10ERR_GENERAL;
+    if (nkbs <= 0)
+        return 0;
 
     /* Close this one otherwise we will lose the position for
      * a next search.  Fixme: it would be better to adjust the position
@@ -577,10 +588,11 @@ keyring_insert_keyblock (KEYRING_HANDLE hd, KBNODE kb)
     hd->current.iobuf = NULL;
 
     /* do the insert */
-    rc = do_copy (1, fname, kb, 0, 0 );
+    rc = do_copy (1, fname, kbs, nkbs, 0, 0 );
     if (!rc && kr_offtbl)
       {
-        update_offset_hash_table_from_kb (kr_offtbl, kb, 0);
+        for (i=0; i < nkbs; i++)
+          update_offset_hash_table_from_kb (kr_offtbl, kbs[i], 0);
       }
 
     return rc;
@@ -617,7 +629,7 @@ keyring_delete_keyblock (KEYRING_HANDLE hd)
     hd->current.iobuf = NULL;
 
     /* do the delete */
-    rc = do_copy (2, hd->found.kr->fname, NULL,
+    rc = do_copy (2, hd->found.kr->fname, NULL, 0,
                   hd->found.offset, hd->found.n_packets );
     if (!rc) {
         /* better reset the found info */
@@ -1488,13 +1500,15 @@ keyring_rebuild_cache (void *token,int noisy)
  * mode 1 = insert
  *	2 = delete
  *	3 = update
+ * ROOTS are the NROOTS keyblocks to insert; for an update NROOTS is 1.
  */
 static int
-do_copy (int mode, const char *fname, KBNODE root,
+do_copy (int mode, const char *fname, KBNODE *roots, int nroots,
          off_t start_offset, unsigned int n_packets )
 {
     IOBUF fp, newfp;
     int rc=0;
+    int i;
     char *bakfname = NULL;
     char *tmpfname = NULL;
 
@@ -1526,13 +1540,15 @@ do_copy (int mode, const char *fname, KBNODE root,
 	if( !opt.quiet )
 	    log_info(_("%s: keyring created\n"), fname );
 
-	kbctx=NULL;
-	while ( (node = walk_kbnode( root, &kbctx, 0 )) ) {
-	    if( (rc = build_packet( newfp, node->pkt )) ) {
-		log_error("build_packet(%d) failed: %s\n",
-			    node->pkt->pkttype, g10_errstr(rc) );
-		iobuf_cancel(newfp);
-		return rc;
+	for (i=0; i < nroots; i++) {
+	    kbctx=NULL;
+	    while ( (node = walk_kbnode( roots[i], &kbctx, 0 )) ) {
+		if( (rc = build_packet( newfp, node->pkt )) ) {
+		    log_error("build_packet(%d) failed: %s\n",
+			      node->pkt->pkttype, g10_errstr(rc) );
+		    iobuf_cancel(newfp);
+		    return rc;
+		}
 	    }
 	}
 	if( iobuf_close(newfp) ) {
@@ -1593,7 +1609,8 @@ do_copy (int mode, const char *fname, KBNODE root,
     }
 
     if( mode == 1 || mode == 3 ) { /* insert or update */
-        rc = write_keyblock (newfp, root);
+        for (i=0; i < nroots && !rc; i++)
+          rc = write_keyblock (newfp, roots[i]);
         if (rc) {
           iobuf_close(fp);
           iobuf_cancel(newfp);
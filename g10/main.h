@@ -192,6 +192,7 @@ void write_status_buffer ( int no,
                            const char *buffer, size_t len, int wrap );
 void write_status_text_and_buffer ( int no, const char *text,
                                     const char *buffer, size_t len, int wrap );
+void write_status_raw (const void *buffer, size_t length);
 
 void write_status_begin_signing (gcry_md_hd_t md);
 
@@ -372,6 +373,13 @@ int decrypt_message (ctrl_t ctrl, const char *filename );
 gpg_error_t decrypt_message_fd (ctrl_t ctrl, int input_fd, int output_fd);
 void decrypt_messages (ctrl_t ctrl, int nfiles, char *files[]);
 
+/*-- multifile.c --*/
+typedef void (*multifile_fnc_t) (ctrl_t ctrl, const char *fname,
+                                 void *opaque);
+void multifile_run (ctrl_t ctrl, const char *fname,
+                    multifile_fnc_t fnc, void *opaque);
+void multifile_wait (ctrl_t ctrl);
+
 /*-- plaintext.c --*/
 int hash_datafiles( gcry_md_hd_t md, gcry_md_hd_t md2,
 		    strlist_t files, const char *sigfilename, int textmode );
@@ -0,0 +1,372 @@
+/* multifile.c - Process the files of a multifile command in parallel
+ * Copyright (C) 2015 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* With --jobs N the commands --encrypt-files, --decrypt-files and
+   --verify-files process up to N files at once.  gpg keeps too much
+   global state to use threads; thus each file is processed by a
+   forked child process.  Everything which is the same for all files,
+   like the list of recipients, is prepared by the parent and
+   inherited by the children.  The status output of a child is sent
+   through a pipe to the parent which writes it to the status stream
+   in the order of the files.  The log output is not serialized.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#ifndef HAVE_W32_SYSTEM
+# include <sys/types.h>
+# include <sys/time.h>
+# include <sys/wait.h>
+#endif
+
+#include "gpg.h"
+#include "options.h"
+#include "util.h"
+#include "iobuf.h"
+#include "membuf.h"
+#include "main.h"
+#include "trustdb.h"
+#include "call-agent.h"
+#include "call-dirmngr.h"
+
+/* The maximum number of worker processes.  */
+#define MAX_JOBS 64
+
+#ifndef HAVE_W32_SYSTEM
+
+/* A worker process for one file.  */
+struct job_s
+{
+  struct job_s *next;
+  pid_t pid;          /* The process ID or 0 if it has terminated.  */
+  int fd;             /* The read end of the status pipe or -1.  */
+  membuf_t status;    /* The status output received so far.  */
+  char fname[1];      /* The name of the file.  */
+};
+
+/* The jobs in the order of their files.  A job is removed after its
+   status output has been written.  */
+static struct job_s *job_list;
+
+/* The number of running worker processes.  */
+static int jobs_running;
+
+/* Set after the parent did the preparations for the jobs.  */
+static int jobs_prepared;
+
+
+/* Return the number of worker processes to use.  0 is returned if the
+   files shall be processed one after the other.  */
+static int
+max_jobs (void)
+{
+  /* The workers can't prompt the user.  */
+  if (opt.jobs < 2 || !opt.batch || cpr_enabled ())
+    return 0;
+  return opt.jobs > MAX_JOBS? MAX_JOBS : opt.jobs;
+}
+
+
+/* Write the status output of all finished jobs in order.  */
+static void
+flush_finished_jobs (void)
+{
+  struct job_s *job;
+  void *data;
+  size_t len;
+
+  while ((job = job_list) && !job->pid && job->fd == -1)
+    {
+      job_list = job->next;
+      data = get_membuf (&job->status, &len);
+      if (data)
+        write_status_raw (data, len);
+      xfree (data);
+      xfree (job);
+    }
+}
+
+
+/* Record that the worker process of JOB terminated with STATUS.  */
+static void
+job_finished (struct job_s *job, int status)
+{
+  if (WIFEXITED (status) && !WEXITSTATUS (status))
+    ;
+  else if (WIFEXITED (status) && WEXITSTATUS (status) == 1)
+    g10_errors_seen = 1;
+  else if (WIFEXITED (status))
+    log_inc_errorcount (); /* The child already printed the error.  */
+  else
+    log_error ("processing of '%s' terminated abnormally\n",
+               print_fname_stdin (job->fname));
+  job->pid = 0;
+  jobs_running--;
+}
+
+
+/* Read the status output of JOB.  At EOF the worker process is
+   reaped.  */
+static void
+read_job_status (struct job_s *job)
+{
+  char buffer[4096];
+  ssize_t n;
+  int status;
+
+  n = read (job->fd, buffer, sizeof buffer);
+  if (n > 0)
+    {
+      put_membuf (&job->status, buffer, n);
+      return;
+    }
+  if (n < 0 && (errno == EINTR || errno == EAGAIN))
+    return;
+
+  close (job->fd);
+  job->fd = -1;
+  while (waitpid (job->pid, &status, 0) == -1)
+    if (errno != EINTR)
+      {
+        log_error ("waitpid failed: %s\n", strerror (errno));
+        status = 0xff00;  /* Exit code 255.  */
+        break;
+      }
+  job_finished (job, status);
+}
+
+
+/* Wait for the worker process of JOB to terminate; with NOHANG only
+   check whether it has terminated.  Returns true if the process has
+   been reaped.  */
+static int
+reap_job (struct job_s *job, int nohang)
+{
+  int status;
+  pid_t pid;
+
+  while ((pid = waitpid (job->pid, &status, nohang? WNOHANG : 0)) == -1)
+    if (errno != EINTR)
+      log_fatal ("waitpid failed: %s\n", strerror (errno));
+  if (!pid)
+    return 0;
+  job_finished (job, status);
+  return 1;
+}
+
+
+/* Wait until at least one worker process terminated and write the
+   status output of the finished jobs.  */
+static void
+wait_for_jobs (void)
+{
+  struct job_s *job;
+  fd_set rfds;
+  int max_fd = -1;
+
+  FD_ZERO (&rfds);
+  for (job = job_list; job; job = job->next)
+    if (job->fd != -1)
+      {
+        FD_SET (job->fd, &rfds);
+        if (job->fd > max_fd)
+          max_fd = job->fd;
+      }
+
+  if (max_fd != -1)
+    {
+      if (select (max_fd + 1, &rfds, NULL, NULL, NULL) == -1)
+        {
+          if (errno != EINTR)
+            log_fatal ("select failed: %s\n", strerror (errno));
+        }
+      else
+        {
+          for (job = job_list; job; job = job->next)
+            if (job->fd != -1 && FD_ISSET (job->fd, &rfds))
+              read_job_status (job);
+        }
+    }
+  else if (jobs_running)
+    {
+      /* Without status output we only need to wait for the exit.
+         We must not use waitpid (-1) because that would also reap
+         processes not started by us.  Thus check all jobs and if
+         none has terminated wait for the first one.  */
+      int any = 0;
+
+      for (job = job_list; job; job = job->next)
+        if (job->pid && reap_job (job, 1))
+          any = 1;
+      if (!any)
+        {
+          for (job = job_list; job && !job->pid; job = job->next)
+            ;
+          if (job)
+            reap_job (job, 0);
+        }
+    }
+
+  flush_finished_jobs ();
+}
+
+
+/* Start a worker process which calls FNC for FNAME.  Returns false if
+   no process could be started.  */
+static int
+start_job (ctrl_t ctrl, const char *fname,
+           multifile_fnc_t fnc, void *opaque)
+{
+  struct job_s *job, **jp;
+  int fds[2] = { -1, -1 };
+  pid_t pid;
+  int errcount;
+
+  if (is_status_enabled () && pipe (fds))
+    {
+      log_info ("error creating a pipe: %s\n", strerror (errno));
+      return 0;
+    }
+  if (fds[0] >= FD_SETSIZE)
+    {
+      /* wait_for_jobs can't select on this descriptor.  */
+      log_info ("too many open files to start a job\n");
+      close (fds[0]);
+      close (fds[1]);
+      return 0;
+    }
+
+  /* Flush all streams so that the child does not write buffered
+     data again.  */
+  es_fflush (NULL);
+
+  pid = fork ();
+  if (pid == -1)
+    {
+      log_info ("error forking process: %s\n", strerror (errno));
+      if (fds[0] != -1)
+        {
+          close (fds[0]);
+          close (fds[1]);
+        }
+      return 0;
+    }
+
+  if (!pid)
+    {
+      /* This is the child.  Libgcrypt notices the fork and reseeds
+         its random number generator.  */
+      for (job = job_list; job; job = job->next)
+        if (job->fd != -1)
+          close (job->fd);
+      if (fds[1] != -1)
+        {
+          close (fds[0]);
+          set_status_fd (fds[1]);
+        }
+
+      /* Do not share file offsets, locks and connections with the
+         parent.  */
+      iobuf_ioctl (NULL, IOBUF_IOCTL_INVALIDATE_CACHE, 0, NULL);
+      trustdb_detach ();
+      agent_detach ();
+      gpg_dirmngr_detach (ctrl);
+      /* The locks of the keyrings belong to the parent; thus we
+         must not import keys.  */
+      opt.keyserver_options.options &= ~KEYSERVER_AUTO_KEY_RETRIEVE;
+
+      /* The exit code shall only tell about this file.  */
+      errcount = log_get_errorcount (0);
+      g10_errors_seen = 0;
+
+      fnc (ctrl, fname, opaque);
+
+      es_fflush (NULL);
+      _exit (log_get_errorcount (0) > errcount? 2 : g10_errors_seen? 1 : 0);
+    }
+
+  job = xcalloc (1, sizeof *job + strlen (fname));
+  strcpy (job->fname, fname);
+  job->pid = pid;
+  job->fd = -1;
+  init_membuf (&job->status, 256);
+  if (fds[1] != -1)
+    {
+      close (fds[1]);
+      job->fd = fds[0];
+    }
+
+  for (jp = &job_list; *jp; jp = &(*jp)->next)
+    ;
+  *jp = job;
+  jobs_running++;
+  return 1;
+}
+#endif /*!HAVE_W32_SYSTEM*/
+
+
+/* Call FNC for the file FNAME.  With --jobs this is done by a worker
+   process and the function returns without waiting for the result;
+   multifile_wait must be called after the last file.  OPAQUE is
+   passed to FNC.  */
+void
+multifile_run (ctrl_t ctrl, const char *fname,
+               multifile_fnc_t fnc, void *opaque)
+{
+#ifndef HAVE_W32_SYSTEM
+  int max = max_jobs ();
+
+  if (max)
+    {
+      if (!jobs_prepared)
+        {
+          /* Check the trustdb only once and not in every child.  */
+          check_trustdb_stale ();
+          jobs_prepared = 1;
+        }
+
+      while (jobs_running >= max)
+        wait_for_jobs ();
+      if (start_job (ctrl, fname, fnc, opaque))
+        return;
+
+      /* Fallback to processing the file here.  */
+      multifile_wait (ctrl);
+    }
+#endif /*!HAVE_W32_SYSTEM*/
+
+  fnc (ctrl, fname, opaque);
+}
+
+
+/* Wait until all files passed to multifile_run have been
+   processed.  */
+void
+multifile_wait (ctrl_t ctrl)
+{
+  (void)ctrl;
+
+#ifndef HAVE_W32_SYSTEM
+  while (job_list)
+    wait_for_jobs ();
+#endif /*!HAVE_W32_SYSTEM*/
+}
@@ -251,6 +251,9 @@ struct
 
   int passphrase_repeat;
   int pinentry_mode;
+
+  /* The number of files the multifile commands process at once.  */
+  int jobs;
 } opt;
 
 /* CTRL is used to keep some global variables we currently can't
@@ -322,6 +325,7 @@ EXTERN_UNLESS_MAIN_MODULE int memory_stat_debug_mode;
 #define IMPORT_LOCAL_SIGS                (1<<0)
 #define IMPORT_REPAIR_PKS_SUBKEY_BUG     (1<<1)
 #define IMPORT_FAST                      (1<<2)
+#define IMPORT_BULK                      (1<<3)
 #define IMPORT_MERGE_ONLY                (1<<4)
 #define IMPORT_MINIMAL                   (1<<5)
 #define IMPORT_CLEAN                     (1<<6)
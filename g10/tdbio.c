@@ -605,6 +605,25 @@ tdbio_get_dbname()
 }
 
 
+/* Forget the open trustdb file and its lock.  This is used by a
+   forked process which must neither share the file offset nor the
+   lock with its parent; the trustdb is opened again on the next
+   access.  The caller must have synced the trustdb.  */
+void
+tdbio_detach (void)
+{
+  if (db_fd == -1)
+    return;
+
+  if (cache_is_dirty || is_locked || in_transaction)
+    log_bug ("tdbio: detaching an unsynced trustdb\n");
+
+  close (db_fd);
+  db_fd = -1;
+  lockhandle = NULL;  /* The handle belongs to the parent.  */
+}
+
+
 
 static void
 open_db()
@@ -32,6 +32,7 @@
 #include "packet.h"
 #include "main.h"
 #include "i18n.h"
+#include "tdbio.h"
 #include "trustdb.h"
 
 
@@ -291,6 +292,16 @@ check_or_update_trustdb (void)
 }
 
 
+/* Prepare the trustdb for use by a forked process.  */
+void
+trustdb_detach (void)
+{
+#ifndef NO_TRUST_MODELS
+  tdbio_detach ();
+#endif
+}
+
+
 /*
  * Return the validity information for PK.  If the namehash is not
  * NULL, the validity of the corresponsing user ID is returned,
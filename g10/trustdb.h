@@ -85,6 +85,7 @@ int clear_ownertrusts (PKT_public_key *pk);
 void revalidation_mark (void);
 void check_trustdb_stale (void);
 void check_or_update_trustdb (void);
+void trustdb_detach (void);
 
 unsigned int get_validity (PKT_public_key *pk, PKT_user_id *uid);
 int get_validity_info (PKT_public_key *pk, PKT_user_id *uid);
@@ -184,6 +184,15 @@ verify_one_file (ctrl_t ctrl, const char *name )
     return rc;
 }
 
+/* Helper for verify_files.  */
+static void
+verify_file_cb (ctrl_t ctrl, const char *name, void *opaque)
+{
+    (void)opaque;
+
+    verify_one_file (ctrl, name);
+}
+
 /****************
  * Verify each file given in the files array or read the names of the
  * files from stdin.
@@ -202,20 +211,22 @@ verify_files (ctrl_t ctrl, int nfiles, char **files )
 	    lno++;
 	    if( !*line || line[strlen(line)-1] != '\n' ) {
 		log_error(_("input line %u too long or missing LF\n"), lno );
+		multifile_wait (ctrl);
 		return G10ERR_GENERAL;
 	    }
 	    /* This code does not work on MSDOS but how cares there are
 	     * also no script languages available.  We don't strip any
 	     * spaces, so that we can process nearly all filenames */
 	    line[strlen(line)-1] = 0;
-	    verify_one_file (ctrl, line );
+	    multifile_run (ctrl, line, verify_file_cb, NULL);
 	}
 
     }
     else {  /* take filenames from the array */
 	for(i=0; i < nfiles; i++ )
-            verify_one_file (ctrl, files[i] );
+            multifile_run (ctrl, files[i], verify_file_cb, NULL);
     }
+    multifile_wait (ctrl);
     return 0;
 }
 
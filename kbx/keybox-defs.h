@@ -55,6 +55,8 @@ enum {
 typedef struct keyboxblob *KEYBOXBLOB;
 
 
+struct keybox_index_s;
+
 typedef struct keybox_name *KB_NAME;
 typedef struct keybox_name const *CONST_KB_NAME;
 struct keybox_name
@@ -80,6 +82,12 @@ struct keybox_name
   /* Not yet used.  */
   int did_full_scan;
 
+  /* An index to find blobs by fingerprint, issuer and serial number,
+     subject or mail address without scanning the entire file.  It is
+     built by the first search which can use it.  NULL if not yet
+     built or after an update invalidated it.  */
+  struct keybox_index_s *index;
+
   /* The name of the resource file. */
   char fname[1];
 };
@@ -196,6 +204,10 @@ gpg_err_code_t _keybox_get_flag_location (const unsigned char *buffer,
                                           size_t length,
                                           int what,
                                           size_t *flag_off, size_t *flag_size);
+void _keybox_index_invalidate (KEYBOX_HANDLE hd);
+void _keybox_index_before_update (KEYBOX_HANDLE hd);
+void _keybox_index_after_update (KEYBOX_HANDLE hd,
+                                 KEYBOXBLOB *blobs, int nblobs);
 
 static inline int
 blob_get_type (KEYBOXBLOB blob)
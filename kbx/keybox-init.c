@@ -56,6 +56,7 @@ keybox_register_file (const char *fname, int secret)
   /* kr->lockhd = NULL;*/
   kr->is_locked = 0;
   kr->did_full_scan = 0;
+  kr->index = NULL;
   /* keep a list of all issued pointers */
   kr->next = kb_names;
   kb_names = kr;
@@ -24,6 +24,9 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "../common/stringhelp.h" /* ascii_xxxx() */
 
@@ -41,6 +44,64 @@ struct sn_array_s {
     unsigned char *sn;
 };
 
+/* The types of keys stored in the search index.  */
+enum index_kinds
+  {
+    INDEX_FPR,
+    INDEX_ISSUER_SN,
+    INDEX_SUBJECT,
+    INDEX_MAIL
+  };
+
+/* The initial number of buckets of the search index; this needs to
+   be a power of 2.  */
+#define INDEX_INITIAL_BUCKETS 1024
+
+/* The initial value for hash_buffer.  */
+#define INDEX_HASH_INITIAL 2166136261U
+
+/* An entry of the search index.  It tells that the blob at file
+   offset OFF has a key of type KIND with the hash value HASH.  Two
+   keys may have the same hash value; thus the blob needs to be
+   compared with the search description anyway.  */
+struct index_entry_s
+{
+  struct index_entry_s *next;
+  off_t off;
+  u32 hash;
+  int kind;
+};
+
+/* The entries are allocated in chunks.  */
+struct index_chunk_s
+{
+  struct index_chunk_s *next;
+  unsigned int used;
+  struct index_entry_s entries[1024];
+};
+
+struct keybox_index_s
+{
+  /* The identity of the file the index has been built for.  */
+  dev_t  dev;
+  ino_t  ino;
+  off_t  size;
+  time_t mtime;
+
+  unsigned int nbuckets;    /* Number of buckets; a power of 2.  */
+  unsigned int nentries;    /* Number of entries.  */
+  struct index_entry_s **buckets;
+  struct index_chunk_s *chunks;
+};
+
+
+#if !defined(HAVE_FSEEKO) && !defined(fseeko)
+#define fseeko(a,b,c) fseek ((a), (long)(b), (c))
+#endif
+#if !defined(HAVE_FTELLO) && !defined(ftello)
+#define ftello(a) ((off_t)ftell ((a)))
+#endif
+
 
 
 static inline ulong
@@ -687,6 +748,470 @@ release_sn_array (struct sn_array_s *array, size_t size)
   xfree (array);
 }
 
+
+/*
+
+  The search index
+
+*/
+
+/* Return the identity of the file FP in ST.  Returns 0 on success. */
+static int
+index_fstat (FILE *fp, struct stat *st)
+{
+  return fstat (fileno (fp), st);
+}
+
+
+/* Return true if IDX has been built for the file described by ST.  */
+static int
+index_matches_file (struct keybox_index_s *idx, const struct stat *st)
+{
+  return (idx->dev == st->st_dev
+          && idx->ino == st->st_ino
+          && idx->size == st->st_size
+          && idx->mtime == st->st_mtime);
+}
+
+
+/* Store the identity of the file described by ST in IDX.  */
+static void
+index_set_file (struct keybox_index_s *idx, const struct stat *st)
+{
+  idx->dev   = st->st_dev;
+  idx->ino   = st->st_ino;
+  idx->size  = st->st_size;
+  idx->mtime = st->st_mtime;
+}
+
+
+static void
+index_release (struct keybox_index_s *idx)
+{
+  struct index_chunk_s *chunk;
+
+  if (!idx)
+    return;
+  while ((chunk = idx->chunks))
+    {
+      idx->chunks = chunk->next;
+      xfree (chunk);
+    }
+  xfree (idx->buckets);
+  xfree (idx);
+}
+
+
+/* Hash LEN bytes of BUFFER into the hash value H.  With ICASE set
+   ASCII letters are hashed as lowercase.  */
+static u32
+hash_buffer (u32 h, const void *buffer, size_t len, int icase)
+{
+  const unsigned char *s = buffer;
+  unsigned int c;
+
+  for (; len; len--, s++)
+    {
+      c = *s;
+      if (icase && c >= 'A' && c <= 'Z')
+        c += 'a' - 'A';
+      h = (h ^ c) * 16777619;
+    }
+  return h;
+}
+
+
+/* Double the number of buckets of IDX.  */
+static gpg_error_t
+index_resize (struct keybox_index_s *idx)
+{
+  struct index_entry_s **buckets, *e, *enext;
+  unsigned int nbuckets, i;
+
+  nbuckets = 2 * idx->nbuckets;
+  buckets = xtrycalloc (nbuckets, sizeof *buckets);
+  if (!buckets)
+    return gpg_error_from_syserror ();
+  for (i=0; i < idx->nbuckets; i++)
+    for (e = idx->buckets[i]; e; e = enext)
+      {
+        enext = e->next;
+        e->next = buckets[(e->hash + e->kind) & (nbuckets - 1)];
+        buckets[(e->hash + e->kind) & (nbuckets - 1)] = e;
+      }
+  xfree (idx->buckets);
+  idx->buckets = buckets;
+  idx->nbuckets = nbuckets;
+  return 0;
+}
+
+
+/* Add a key of type KIND with HASH for the blob at file offset OFF
+   to IDX.  */
+static gpg_error_t
+index_add (struct keybox_index_s *idx, int kind, u32 hash, off_t off)
+{
+  struct index_chunk_s *chunk;
+  struct index_entry_s *e;
+  gpg_error_t err;
+  unsigned int bucket;
+
+  if (idx->nentries > 2 * idx->nbuckets)
+    {
+      err = index_resize (idx);
+      if (err)
+        return err;
+    }
+
+  chunk = idx->chunks;
+  if (!chunk || chunk->used == DIM (chunk->entries))
+    {
+      chunk = xtrymalloc (sizeof *chunk);
+      if (!chunk)
+        return gpg_error_from_syserror ();
+      chunk->used = 0;
+      chunk->next = idx->chunks;
+      idx->chunks = chunk;
+    }
+  e = chunk->entries + chunk->used++;
+  e->off = off;
+  e->hash = hash;
+  e->kind = kind;
+  bucket = (hash + kind) & (idx->nbuckets - 1);
+  e->next = idx->buckets[bucket];
+  idx->buckets[bucket] = e;
+  idx->nentries++;
+  return 0;
+}
+
+
+/* Add the keys of BLOB which is stored at file offset OFF to IDX.
+   Note that the keys are computed in the same way as the has_foo
+   functions compare them.  */
+static gpg_error_t
+index_add_blob (struct keybox_index_s *idx, KEYBOXBLOB blob, off_t off)
+{
+  gpg_error_t err;
+  const unsigned char *buffer;
+  size_t length;
+  size_t pos, serialoff, uidoff, len;
+  size_t nkeys, keyinfolen;
+  size_t nuids, uidinfolen;
+  size_t nserial;
+  size_t n;
+  int btype;
+
+  btype = blob_get_type (blob);
+  if (btype != BLOBTYPE_PGP && btype != BLOBTYPE_X509)
+    return 0;
+
+  buffer = _keybox_get_blob_image (blob, &length);
+  if (length < 40)
+    return 0; /* blob too short */
+
+  /*keys*/
+  nkeys = get16 (buffer + 16);
+  keyinfolen = get16 (buffer + 18 );
+  if (keyinfolen < 28)
+    return 0; /* invalid blob */
+  pos = 20;
+  if (pos + keyinfolen*nkeys + 2 > length)
+    return 0; /* out of bounds */
+  for (n=0; n < nkeys; n++)
+    {
+      err = index_add (idx, INDEX_FPR,
+                       hash_buffer (INDEX_HASH_INITIAL,
+                                    buffer + pos + n*keyinfolen, 20, 0),
+                       off);
+      if (err)
+        return err;
+    }
+  pos += keyinfolen*nkeys;
+
+  /*serial*/
+  nserial = get16 (buffer+pos);
+  serialoff = pos + 2;
+  pos += 2 + nserial;
+  if (pos+4 > length)
+    return 0; /* out of bounds */
+
+  /* user ids*/
+  nuids = get16 (buffer + pos);  pos += 2;
+  uidinfolen = get16 (buffer + pos);  pos += 2;
+  if (uidinfolen < 12)
+    return 0; /* invalid blob */
+  if (pos + uidinfolen*nuids > length)
+    return 0; /* out of bounds */
+
+  for (n=0; n < nuids; n++)
+    {
+      uidoff = get32 (buffer + pos + n*uidinfolen);
+      len = get32 (buffer + pos + n*uidinfolen + 4);
+      if (uidoff+len > length)
+        return 0; /* out of bounds */
+
+      if (btype == BLOBTYPE_X509 && !n)
+        {
+          /* For X.509 the first name is the issuer.  */
+          err = index_add (idx, INDEX_ISSUER_SN,
+                           hash_buffer (hash_buffer (INDEX_HASH_INITIAL,
+                                                     buffer + serialoff,
+                                                     nserial, 0),
+                                        buffer + uidoff, len, 0),
+                           off);
+          if (err)
+            return err;
+          continue;
+        }
+      if (btype == BLOBTYPE_X509 && n == 1)
+        {
+          err = index_add (idx, INDEX_SUBJECT,
+                           hash_buffer (INDEX_HASH_INITIAL,
+                                        buffer + uidoff, len, 0),
+                           off);
+          if (err)
+            return err;
+        }
+
+      /* Index the mail address the same way blob_cmp_mail extracts
+         it.  */
+      if (btype == BLOBTYPE_PGP)
+        for ( ;len && buffer[uidoff] != '<'; len--, uidoff++)
+          ;
+      if (len < 4 || buffer[uidoff] != '<' || buffer[uidoff+len-1] != '>')
+        continue; /* not a proper email address */
+      err = index_add (idx, INDEX_MAIL,
+                       hash_buffer (INDEX_HASH_INITIAL,
+                                    buffer + uidoff + 1, len - 2, 1),
+                       off);
+      if (err)
+        return err;
+    }
+
+  return 0;
+}
+
+
+/* Return an index for the file opened at HD or NULL if no index is
+   available.  The index is built if required by reading the entire
+   file; the file position of HD is not changed.  */
+static struct keybox_index_s *
+get_index (KEYBOX_HANDLE hd)
+{
+  /* The index is a cache and thus not covered by the const of the
+     handle's resource.  */
+  KB_NAME kb = (KB_NAME)hd->kb;
+  struct keybox_index_s *idx;
+  struct stat st;
+  KEYBOXBLOB blob = NULL;
+  off_t savedpos;
+  int rc;
+
+  if (index_fstat (hd->fp, &st))
+    return NULL;
+  if (kb->index && index_matches_file (kb->index, &st))
+    return kb->index;
+
+  /* The file has been changed by another process; build a new index
+     from the file HD is using.  */
+  index_release (kb->index);
+  kb->index = NULL;
+
+  savedpos = ftello (hd->fp);
+  if (savedpos == (off_t)-1 || fseeko (hd->fp, 0, SEEK_SET))
+    return NULL;
+
+  idx = xtrycalloc (1, sizeof *idx);
+  if (!idx)
+    goto leave;
+  idx->nbuckets = INDEX_INITIAL_BUCKETS;
+  idx->buckets = xtrycalloc (idx->nbuckets, sizeof *idx->buckets);
+  if (!idx->buckets)
+    {
+      index_release (idx);
+      idx = NULL;
+      goto leave;
+    }
+
+  while (!(rc = _keybox_read_blob (&blob, hd->fp))
+         || (gpg_err_code (rc) == GPG_ERR_TOO_LARGE
+             && gpg_err_source (rc) == GPG_ERR_SOURCE_KEYBOX))
+    {
+      if (!rc)
+        rc = index_add_blob (idx, blob, _keybox_get_blob_fileoffset (blob));
+      _keybox_release_blob (blob);
+      blob = NULL;
+      if (rc && gpg_err_code (rc) != GPG_ERR_TOO_LARGE)
+        break;
+    }
+  if (rc != -1)
+    {
+      /* Read error or out of core - don't use an index.  */
+      index_release (idx);
+      idx = NULL;
+      goto leave;
+    }
+
+  index_set_file (idx, &st);
+  kb->index = idx;
+  kb->did_full_scan = 1;
+
+ leave:
+  if (fseeko (hd->fp, savedpos, SEEK_SET))
+    {
+      /* We can't continue the search at the right place.  */
+      hd->error = gpg_error_from_syserror ();
+      return NULL;
+    }
+  return idx;
+}
+
+
+/* Return the file offset of the first blob at or after POS which may
+   match the key of type KIND with one of the NHASHES hash values in
+   HASHES.  Returns -1 if there is none.  */
+static off_t
+index_next_offset (struct keybox_index_s *idx, int kind,
+                   const u32 *hashes, int nhashes, off_t pos)
+{
+  struct index_entry_s *e;
+  off_t best = -1;
+  int i;
+
+  for (i=0; i < nhashes; i++)
+    for (e = idx->buckets[(hashes[i] + kind) & (idx->nbuckets - 1)];
+         e; e = e->next)
+      if (e->kind == kind && e->hash == hashes[i] && e->off >= pos
+          && (best == -1 || e->off < best))
+        best = e->off;
+  return best;
+}
+
+
+/* Compute the hash values for a search with DESC into HASHES which
+   must have space for 2 values and store the index type at R_KIND.
+   SN and SNLEN are the binary serial number for an issuer/serial
+   search.  Returns the number of hash values; 0 if the index can't be
+   used for DESC.  */
+static int
+index_query (KEYBOX_SEARCH_DESC *desc, const unsigned char *sn, int snlen,
+             int *r_kind, u32 *hashes)
+{
+  const char *name;
+  size_t namelen;
+
+  switch (desc->mode)
+    {
+    case KEYDB_SEARCH_MODE_FPR:
+    case KEYDB_SEARCH_MODE_FPR20:
+      *r_kind = INDEX_FPR;
+      hashes[0] = hash_buffer (INDEX_HASH_INITIAL, desc->u.fpr, 20, 0);
+      return 1;
+
+    case KEYDB_SEARCH_MODE_ISSUER_SN:
+      if (!desc->u.name || !sn || snlen < 0)
+        return 0;
+      *r_kind = INDEX_ISSUER_SN;
+      hashes[0] = hash_buffer (hash_buffer (INDEX_HASH_INITIAL, sn, snlen, 0),
+                               desc->u.name, strlen (desc->u.name), 0);
+      return 1;
+
+    case KEYDB_SEARCH_MODE_SUBJECT:
+      if (!desc->u.name)
+        return 0;
+      *r_kind = INDEX_SUBJECT;
+      hashes[0] = hash_buffer (INDEX_HASH_INITIAL,
+                               desc->u.name, strlen (desc->u.name), 0);
+      return 1;
+
+    case KEYDB_SEARCH_MODE_MAIL:
+      if (!desc->u.name)
+        return 0;
+      *r_kind = INDEX_MAIL;
+      /* has_mail strips a leading '<' only for OpenPGP blobs; thus we
+         need to look for both variants.  */
+      name = desc->u.name;
+      namelen = strlen (name);
+      if (namelen && name[namelen-1] == '>')
+        namelen--;
+      hashes[0] = hash_buffer (INDEX_HASH_INITIAL, name, namelen, 1);
+      if (*name != '<')
+        return 1;
+      name++;
+      namelen = strlen (name);
+      if (namelen && name[namelen-1] == '>')
+        namelen--;
+      hashes[1] = hash_buffer (INDEX_HASH_INITIAL, name, namelen, 1);
+      return 2;
+
+    default:
+      return 0;
+    }
+}
+
+
+/* Release the index of the resource used by HD.  This needs to be
+   called for all updates which move blobs in the file.  */
+void
+_keybox_index_invalidate (KEYBOX_HANDLE hd)
+{
+  KB_NAME kb = (KB_NAME)hd->kb;
+
+  index_release (kb->index);
+  kb->index = NULL;
+}
+
+
+/* Prepare the index of the resource used by HD for an update of the
+   file.  If the file has been changed by another process the index
+   is released.  */
+void
+_keybox_index_before_update (KEYBOX_HANDLE hd)
+{
+  KB_NAME kb = (KB_NAME)hd->kb;
+  struct stat st;
+
+  if (kb->index
+      && (stat (kb->fname, &st) || !index_matches_file (kb->index, &st)))
+    _keybox_index_invalidate (hd);
+}
+
+
+/* Update the index of the resource used by HD after the file has
+   been updated.  If NBLOBS is not 0 the NBLOBS blobs BLOBS have been
+   appended to the file in this order; if NBLOBS is 0 the file has
+   been changed in place without moving any blobs.  */
+void
+_keybox_index_after_update (KEYBOX_HANDLE hd, KEYBOXBLOB *blobs, int nblobs)
+{
+  KB_NAME kb = (KB_NAME)hd->kb;
+  struct stat st;
+  size_t length;
+  off_t off;
+  int i;
+
+  if (!kb->index)
+    return;
+  if (stat (kb->fname, &st))
+    {
+      _keybox_index_invalidate (hd);
+      return;
+    }
+  off = st.st_size;
+  for (i=nblobs-1; i >= 0; i--)
+    {
+      _keybox_get_blob_image (blobs[i], &length);
+      if (off < (off_t)length
+          || index_add_blob (kb->index, blobs[i], off - length))
+        {
+          _keybox_index_invalidate (hd);
+          return;
+        }
+      off -= length;
+    }
+  index_set_file (kb->index, &st);
+}
+
 
 /*
 
@@ -731,6 +1256,10 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
   KEYBOXBLOB blob = NULL;
   struct sn_array_s *sn_array = NULL;
   int pk_no, uid_no;
+  struct keybox_index_s *idx = NULL;
+  int index_kind = 0;
+  u32 index_hashes[2];
+  int nhashes = 0;
 
   if (!hd)
     return gpg_error (GPG_ERR_INV_VALUE);
@@ -846,6 +1375,26 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
         }
     }
 
+  /* If we are looking for a single key of a type we have an index
+     for, use the index to skip directly to the blobs which may match.
+     The blobs are still read in file order and compared as usual, so
+     that the results are the same as with a full scan.  */
+  if (ndesc == 1)
+    nhashes = index_query (desc,
+                           sn_array? sn_array[0].sn : desc[0].sn,
+                           sn_array? sn_array[0].snlen : desc[0].snlen,
+                           &index_kind, index_hashes);
+  if (nhashes)
+    {
+      idx = get_index (hd);
+      if (!idx && hd->error)
+        {
+          if (sn_array)
+            release_sn_array (sn_array, ndesc);
+          return hd->error;
+        }
+    }
+
 
   pk_no = uid_no = 0;
   for (;;)
@@ -853,6 +1402,28 @@ keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
       unsigned int blobflags;
 
       _keybox_release_blob (blob); blob = NULL;
+      if (idx)
+        {
+          off_t off = ftello (hd->fp);
+
+          if (off == (off_t)-1)
+            {
+              rc = gpg_error_from_syserror ();
+              break;
+            }
+          off = index_next_offset (idx, index_kind,
+                                   index_hashes, nhashes, off);
+          if (off == (off_t)-1)
+            {
+              rc = -1; /* No more candidates.  */
+              break;
+            }
+          if (fseeko (hd->fp, off, SEEK_SET))
+            {
+              rc = gpg_error_from_syserror ();
+              break;
+            }
+        }
       rc = _keybox_read_blob (&blob, hd->fp);
       if (gpg_err_code (rc) == GPG_ERR_TOO_LARGE
           && gpg_err_source (rc) == GPG_ERR_SOURCE_KEYBOX)
@@ -213,9 +213,11 @@ rename_tmp_file (const char *bakfname, const char *tmpfname,
 
 /* Perform insert/delete/update operation.  MODE is one of
    FILECOPY_INSERT, FILECOPY_DELETE, FILECOPY_UPDATE.  FOR_OPENPGP
-   indicates that this is called due to an OpenPGP keyblock change.  */
+   indicates that this is called due to an OpenPGP keyblock change.
+   For an insert the NBLOBS blobs BLOBS are appended in this order;
+   for an update BLOBS[0] replaces the blob at START_OFFSET.  */
 static int
-blob_filecopy (int mode, const char *fname, KEYBOXBLOB blob,
+blob_filecopy (int mode, const char *fname, KEYBOXBLOB *blobs, int nblobs,
                int secret, int for_openpgp, off_t start_offset)
 {
   FILE *fp, *newfp;
@@ -224,6 +226,7 @@ blob_filecopy (int mode, const char *fname, KEYBOXBLOB blob,
   char *tmpfname = NULL;
   char buffer[4096];  /* (Must be at least 32 bytes) */
   int nread, nbytes;
+  int i;
 
   /* Open the source file. Because we do a rename, we have to check the
      permissions of the file */
@@ -234,21 +237,23 @@ blob_filecopy (int mode, const char *fname, KEYBOXBLOB blob,
   if (mode == FILECOPY_INSERT && !fp && errno == ENOENT)
     {
       /* Insert mode but file does not exist:
-         Create a new keybox file. */
+         Create a new keybox file.  If not all blobs can be written
+         remove it again so that either all or none are stored. */
       newfp = fopen (fname, "wb");
       if (!newfp )
         return gpg_error_from_syserror ();
 
       rc = _keybox_write_header_blob (newfp, for_openpgp);
-      if (rc)
-        return rc;
+      for (i=0; !rc && i < nblobs; i++)
+        rc = _keybox_write_blob (blobs[i], newfp);
 
-      rc = _keybox_write_blob (blob, newfp);
+      if ( fclose (newfp) && !rc )
+        rc = gpg_error_from_syserror ();
       if (rc)
-        return rc;
-
-      if ( fclose (newfp) )
-        return gpg_error_from_syserror ();
+        {
+          gnupg_remove (fname);
+          return rc;
+        }
 
 /*        if (chmod( fname, S_IRUSR | S_IWUSR )) */
 /*          { */
@@ -338,9 +343,12 @@ blob_filecopy (int mode, const char *fname, KEYBOXBLOB blob,
   /* Do an insert or update. */
   if ( mode == FILECOPY_INSERT || mode == FILECOPY_UPDATE )
     {
-      rc = _keybox_write_blob (blob, newfp);
-      if (rc)
-          return rc;
+      for (i=0; i < (mode == FILECOPY_INSERT? nblobs : 1); i++)
+        {
+          rc = _keybox_write_blob (blobs[i], newfp);
+          if (rc)
+            return rc;
+        }
     }
 
   /* Copy the rest of the packet for an delete or update. */
@@ -419,17 +427,94 @@ keybox_insert_keyblock (KEYBOX_HANDLE hd, const void *image, size_t imagelen,
   _keybox_destroy_openpgp_info (&info);
   if (!err)
     {
-      err = blob_filecopy (FILECOPY_INSERT, fname, blob, hd->secret, 1, 0);
+      _keybox_index_before_update (hd);
+      err = blob_filecopy (FILECOPY_INSERT, fname, &blob, 1, hd->secret, 1, 0);
+      if (!err)
+        _keybox_index_after_update (hd, &blob, 1);
+      else
+        _keybox_index_invalidate (hd);
       _keybox_release_blob (blob);
-      /*    if (!rc && !hd->secret && kb_offtbl) */
-      /*      { */
-      /*        update_offset_hash_table_from_kb (kb_offtbl, kb, 0); */
-      /*      } */
     }
   return err;
 }
 
 
+/* Append the NBLOBS blobs BLOBS to the keybox of HD and update the
+   index.  All blobs are written with one copy of the file.
+   FOR_OPENPGP is passed to blob_filecopy.  */
+static gpg_error_t
+append_blobs (KEYBOX_HANDLE hd, KEYBOXBLOB *blobs, int nblobs,
+              int for_openpgp)
+{
+  gpg_error_t rc;
+
+  _keybox_index_before_update (hd);
+  rc = blob_filecopy (FILECOPY_INSERT, hd->kb->fname, blobs, nblobs,
+                      hd->secret, for_openpgp, 0);
+  if (rc)
+    _keybox_index_invalidate (hd);
+  else
+    _keybox_index_after_update (hd, blobs, nblobs);
+  return rc;
+}
+
+
+/* Insert the NKEYBLOCKS OpenPGP keyblocks given by IMAGES and
+   IMAGELENS into HD.  SIGSTATUS holds the signature status vectors as
+   described for keybox_insert_keyblock.  Unlike keybox_insert_keyblock
+   this writes only one new copy of the file for all keyblocks.  Either
+   all or none of the keyblocks are stored.  */
+gpg_error_t
+keybox_insert_keyblocks (KEYBOX_HANDLE hd, const void **images,
+                         size_t *imagelens, u32 **sigstatus, int nkeyblocks)
+{
+  gpg_error_t err = 0;
+  const char *fname;
+  KEYBOXBLOB *blobs;
+  size_t nparsed;
+  struct _keybox_openpgp_info info;
+  int i, nblobs;
+
+  if (!hd)
+    return gpg_error (GPG_ERR_INV_HANDLE);
+  if (!hd->kb)
+    return gpg_error (GPG_ERR_INV_HANDLE);
+  fname = hd->kb->fname;
+  if (!fname)
+    return gpg_error (GPG_ERR_INV_HANDLE);
+  if (nkeyblocks <= 0)
+    return 0;
+
+  _keybox_close_file (hd);
+
+  blobs = xtrycalloc (nkeyblocks, sizeof *blobs);
+  if (!blobs)
+    return gpg_error_from_syserror ();
+  for (nblobs=0; nblobs < nkeyblocks; nblobs++)
+    {
+      err = _keybox_parse_openpgp (images[nblobs], imagelens[nblobs],
+                                   &nparsed, &info);
+      if (err)
+        break;
+      assert (nparsed <= imagelens[nblobs]);
+      err = _keybox_create_openpgp_blob (&blobs[nblobs], &info,
+                                         images[nblobs], imagelens[nblobs],
+                                         sigstatus[nblobs], hd->ephemeral);
+      _keybox_destroy_openpgp_info (&info);
+      if (err)
+        break;
+    }
+
+  if (!err)
+    err = append_blobs (hd, blobs, nblobs, 1);
+
+  for (i=0; i < nblobs; i++)
+    _keybox_release_blob (blobs[i]);
+  xfree (blobs);
+  return err;
+}
+
+
 /* Update the current key at HD with the given OpenPGP keyblock in
    {IMAGE,IMAGELEN}.  */
 gpg_error_t
@@ -472,7 +557,9 @@ keybox_update_keyblock (KEYBOX_HANDLE hd, const void *image, size_t imagelen)
   /* Update the keyblock.  */
   if (!err)
     {
-      err = blob_filecopy (FILECOPY_UPDATE, fname, blob, hd->secret, 1, off);
+      _keybox_index_invalidate (hd);
+      err = blob_filecopy (FILECOPY_UPDATE, fname, &blob, 1,
+                           hd->secret, 1, off);
       _keybox_release_blob (blob);
     }
   return err;
@@ -505,16 +592,64 @@ keybox_insert_cert (KEYBOX_HANDLE hd, ksba_cert_t cert,
   rc = _keybox_create_x509_blob (&blob, cert, sha1_digest, hd->ephemeral);
   if (!rc)
     {
-      rc = blob_filecopy (FILECOPY_INSERT, fname, blob, hd->secret, 0, 0);
+      _keybox_index_before_update (hd);
+      rc = blob_filecopy (FILECOPY_INSERT, fname, &blob, 1, hd->secret, 0, 0);
+      if (!rc)
+        _keybox_index_after_update (hd, &blob, 1);
+      else
+        _keybox_index_invalidate (hd);
       _keybox_release_blob (blob);
-      /*    if (!rc && !hd->secret && kb_offtbl) */
-      /*      { */
-      /*        update_offset_hash_table_from_kb (kb_offtbl, kb, 0); */
-      /*      } */
     }
   return rc;
 }
 
+/* Insert the NCERTS certificates CERTS into the keybox.  SHA1_DIGESTS
+   holds the 20 byte SHA-1 fingerprints of the certificates, one after
+   the other.  Unlike keybox_insert_cert this writes only one new copy
+   of the file for all certificates.  Either all or none of the
+   certificates are stored.  */
+int
+keybox_insert_certs (KEYBOX_HANDLE hd, ksba_cert_t *certs,
+                     unsigned char *sha1_digests, int ncerts)
+{
+  int rc = 0;
+  const char *fname;
+  KEYBOXBLOB *blobs;
+  int i, nblobs;
+
+  if (!hd)
+    return gpg_error (GPG_ERR_INV_HANDLE);
+  if (!hd->kb)
+    return gpg_error (GPG_ERR_INV_HANDLE);
+  fname = hd->kb->fname;
+  if (!fname)
+    return gpg_error (GPG_ERR_INV_HANDLE);
+  if (ncerts <= 0)
+    return 0;
+
+  _keybox_close_file (hd);
+
+  blobs = xtrycalloc (ncerts, sizeof *blobs);
+  if (!blobs)
+    return gpg_error_from_syserror ();
+  for (nblobs=0; nblobs < ncerts; nblobs++)
+    {
+      rc = _keybox_create_x509_blob (&blobs[nblobs], certs[nblobs],
+                                     sha1_digests + 20*nblobs,
+                                     hd->ephemeral);
+      if (rc)
+        break;
+    }
+
+  if (!rc)
+    rc = append_blobs (hd, blobs, nblobs, 0);
+
+  for (i=0; i < nblobs; i++)
+    _keybox_release_blob (blobs[i]);
+  xfree (blobs);
+  return rc;
+}
+
 int
 keybox_update_cert (KEYBOX_HANDLE hd, ksba_cert_t cert,
                     unsigned char *sha1_digest)
@@ -568,6 +703,7 @@ keybox_set_flags (KEYBOX_HANDLE hd, int what, int idx, unsigned int value)
   off += flag_pos;
 
   _keybox_close_file (hd);
+  _keybox_index_before_update (hd);
   fp = fopen (hd->kb->fname, "r+b");
   if (!fp)
     return gpg_error_from_syserror ();
@@ -604,6 +740,9 @@ keybox_set_flags (KEYBOX_HANDLE hd, int what, int idx, unsigned int value)
         ec = gpg_err_code_from_syserror ();
     }
 
+  /* The blobs did not move; just note the new file time.  */
+  _keybox_index_after_update (hd, NULL, 0);
+
   return gpg_error (ec);
 }
 
@@ -633,6 +772,7 @@ keybox_delete (KEYBOX_HANDLE hd)
   off += 4;
 
   _keybox_close_file (hd);
+  _keybox_index_before_update (hd);
   fp = fopen (hd->kb->fname, "r+b");
   if (!fp)
     return gpg_error_from_syserror ();
@@ -650,6 +790,10 @@ keybox_delete (KEYBOX_HANDLE hd)
         rc = gpg_error_from_syserror ();
     }
 
+  /* The deleted blob is still in the index but it won't match
+     anymore.  */
+  _keybox_index_after_update (hd, NULL, 0);
+
   return rc;
 }
 
@@ -681,6 +825,7 @@ keybox_compress (KEYBOX_HANDLE hd)
     return gpg_error (GPG_ERR_INV_HANDLE);
 
   _keybox_close_file (hd);
+  _keybox_index_invalidate (hd);
 
   /* Open the source file. Because we do a rename, we have to check the
      permissions of the file */
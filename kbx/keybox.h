@@ -94,12 +94,17 @@ int keybox_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
 gpg_error_t keybox_insert_keyblock (KEYBOX_HANDLE hd,
                                     const void *image, size_t imagelen,
                                     u32 *sigstatus);
+gpg_error_t keybox_insert_keyblocks (KEYBOX_HANDLE hd, const void **images,
+                                     size_t *imagelens, u32 **sigstatus,
+                                     int nkeyblocks);
 gpg_error_t keybox_update_keyblock (KEYBOX_HANDLE hd,
                                     const void *image, size_t imagelen);
 
 #ifdef KEYBOX_WITH_X509
 int keybox_insert_cert (KEYBOX_HANDLE hd, ksba_cert_t cert,
                         unsigned char *sha1_digest);
+int keybox_insert_certs (KEYBOX_HANDLE hd, ksba_cert_t *certs,
+                         unsigned char *sha1_digests, int ncerts);
 int keybox_update_cert (KEYBOX_HANDLE hd, ksba_cert_t cert,
                         unsigned char *sha1_digest);
 #endif /*KEYBOX_WITH_X509*/
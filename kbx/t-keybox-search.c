@@ -0,0 +1,411 @@
+/* t-keybox-search.c - Module test for the keybox search index
+ * Copyright (C) 2015 Free Software Foundation, Inc.
+ *
+ * This file is part of GnuPG.
+ *
+ * GnuPG is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GnuPG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* keybox_search uses the in-memory index only if it is called with
+   a single search descriptor.  This test runs each indexed search
+   once with a single descriptor and once with the same descriptor
+   given twice, which forces a full scan, and checks that both return
+   the same certificates in the same order.  The keybox is checked
+   after it has been created, after certificates have been appended
+   to an existing index and after a certificate has been deleted.  */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "../common/util.h"
+#include "keybox.h"
+#include <gcrypt.h>
+
+#define pass()  do { ; } while(0)
+#define fail(a)  do { fprintf (stderr, "%s:%d: test %d failed\n",\
+                               __FILE__,__LINE__, (a));          \
+                     errcount++;                                 \
+                   } while(0)
+
+#define MAX_MATCHES 16
+
+static int verbose;
+static int errcount;
+
+/* The sample certificates; the second part of the list is appended
+   after the index has been built.  */
+static const char *certfiles[] =
+  {
+    "../tests/samplekeys/cert_g10code_pete1.pem",
+    "../tests/samplekeys/cert_g10code_test1.pem",
+    "../tests/samplekeys/cert_g10code_theo1.pem",
+    "../tests/samplekeys/steed-self-signing-nonthority.pem"
+  };
+#define NFIRSTCERTS 2
+
+/* Mail addresses to search for and the index of the certificate
+   they belong to.  For X.509 blobs has_mail only strips a trailing
+   '>' and thus an address in angle brackets never matches; the index
+   must not change that.  */
+static struct
+{
+  const char *name;
+  int certidx;
+} mails[] =
+  {
+    { "peter.panther@kerckhoffs.g10code.de", 0 },
+    { "<peter.panther@kerckhoffs.g10code.de>", -1 },
+    { "Theobald.Tiger@Kerckhoffs.G10code.De", 2 },
+    { "<theobald.tiger@kerckhoffs.g10code.de>", -1 },
+    { "nobody@kerckhoffs.g10code.de", -1 }
+  };
+
+static ksba_cert_t certs[DIM (certfiles)];
+static unsigned char fprs[DIM (certfiles)][20];
+
+
+/* Prepend FNAME with the srcdir environment variable's value and
+   return an allocated filename.  */
+static char *
+prepend_srcdir (const char *fname)
+{
+  static const char *srcdir;
+  char *result;
+
+  if (!srcdir && !(srcdir = getenv ("srcdir")))
+    srcdir = ".";
+
+  result = xmalloc (strlen (srcdir) + 1 + strlen (fname) + 1);
+  strcpy (result, srcdir);
+  strcat (result, "/");
+  strcat (result, fname);
+  return result;
+}
+
+
+/* Read the PEM encoded certificate FNAME into R_CERT and store its
+   fingerprint at FPR.  */
+static void
+read_cert (const char *fname, ksba_cert_t *r_cert, unsigned char *fpr)
+{
+  gpg_error_t err;
+  char *fullname;
+  FILE *fp;
+  char *buffer, *pem;
+  size_t buflen, nread, n;
+  struct b64state state;
+  ksba_cert_t cert;
+
+  fullname = prepend_srcdir (fname);
+  fp = fopen (fullname, "rb");
+  if (!fp)
+    {
+      fprintf (stderr, "%s:%d: can't open '%s': %s\n",
+               __FILE__, __LINE__, fullname, strerror (errno));
+      exit (1);
+    }
+  buflen = 0;
+  buffer = xmalloc (8192);
+  while ((nread = fread (buffer + buflen, 1, 8191 - buflen, fp)))
+    buflen += nread;
+  buffer[buflen] = 0;
+  /* Some of the files have a description in front of the PEM block;
+     skip it.  */
+  pem = strstr (buffer, "-----BEGIN ");
+  if (ferror (fp) || buflen == 8191 || !pem)
+    {
+      fprintf (stderr, "%s:%d: error reading '%s'\n",
+               __FILE__, __LINE__, fullname);
+      exit (1);
+    }
+  fclose (fp);
+
+  err = b64dec_start (&state, "");
+  if (!err)
+    err = b64dec_proc (&state, pem, buflen - (pem - buffer), &n);
+  if (!err)
+    err = b64dec_finish (&state);
+  if (!err)
+    err = ksba_cert_new (&cert);
+  if (!err)
+    err = ksba_cert_init_from_mem (cert, pem, n);
+  if (err)
+    {
+      fprintf (stderr, "%s:%d: error parsing '%s': %s\n",
+               __FILE__, __LINE__, fullname, gpg_strerror (err));
+      exit (1);
+    }
+  gcry_md_hash_buffer (GCRY_MD_SHA1, fpr, pem, n);
+
+  xfree (buffer);
+  xfree (fullname);
+  *r_cert = cert;
+}
+
+
+/* Run the search DESC with NDESC descriptors on HD from the start of
+   the file and store the fingerprints of all matching certificates
+   at FOUND.  Returns the number of matches.  */
+static int
+collect_matches (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, size_t ndesc,
+                 unsigned char found[MAX_MATCHES][20])
+{
+  int rc;
+  int nfound = 0;
+  unsigned long skipped = 0;
+  ksba_cert_t cert;
+  const unsigned char *image;
+  size_t imagelen;
+
+  rc = keybox_search_reset (hd);
+  if (rc)
+    {
+      fprintf (stderr, "%s:%d: keybox_search_reset failed: %s\n",
+               __FILE__, __LINE__, gpg_strerror (rc));
+      exit (1);
+    }
+  while (!(rc = keybox_search (hd, desc, ndesc, NULL, &skipped)))
+    {
+      if (nfound == MAX_MATCHES)
+        {
+          fprintf (stderr, "%s:%d: too many matches\n", __FILE__, __LINE__);
+          exit (1);
+        }
+      rc = keybox_get_cert (hd, &cert);
+      if (rc)
+        {
+          fprintf (stderr, "%s:%d: keybox_get_cert failed: %s\n",
+                   __FILE__, __LINE__, gpg_strerror (rc));
+          exit (1);
+        }
+      image = ksba_cert_get_image (cert, &imagelen);
+      gcry_md_hash_buffer (GCRY_MD_SHA1, found[nfound++], image, imagelen);
+      ksba_cert_release (cert);
+    }
+  if (rc != -1)
+    {
+      fprintf (stderr, "%s:%d: keybox_search failed: %s\n",
+               __FILE__, __LINE__, gpg_strerror (rc));
+      exit (1);
+    }
+  return nfound;
+}
+
+
+/* Run DESC with and without the index and compare the results with
+   each other and with the EXPECTED number of matches.  */
+static void
+check_search (KEYBOX_HANDLE hd, KEYBOX_SEARCH_DESC *desc, int expected,
+              const char *what)
+{
+  KEYBOX_SEARCH_DESC descs[2];
+  unsigned char indexed[MAX_MATCHES][20];
+  unsigned char scanned[MAX_MATCHES][20];
+  int nindexed, nscanned;
+
+  descs[0] = *desc;
+  descs[1] = *desc;
+  nindexed = collect_matches (hd, descs, 1, indexed);
+  nscanned = collect_matches (hd, descs, 2, scanned);
+  if (verbose)
+    printf ("%s: %d/%d matches\n", what, nindexed, nscanned);
+
+  if (nindexed != nscanned
+      || memcmp (indexed, scanned, nindexed * 20))
+    {
+      fprintf (stderr, "%s:%d: results differ for %s\n",
+               __FILE__, __LINE__, what);
+      errcount++;
+    }
+  else if (nindexed != expected)
+    {
+      fprintf (stderr, "%s:%d: %d instead of %d matches for %s\n",
+               __FILE__, __LINE__, nindexed, expected, what);
+      errcount++;
+    }
+}
+
+
+/* Run all searches on HD.  The certificates from index FIRST up to
+   but not including index END are stored in the keybox.  */
+static void
+run_searches (KEYBOX_HANDLE hd, int first, int end)
+{
+  KEYBOX_SEARCH_DESC desc;
+  int i;
+  char *issuer, *subject;
+  ksba_sexp_t serial;
+  const unsigned char *s;
+  char *hexsn;
+  int stored;
+
+  for (i=0; i < DIM (certfiles); i++)
+    {
+      stored = (i >= first && i < end);
+
+      memset (&desc, 0, sizeof desc);
+      desc.mode = KEYDB_SEARCH_MODE_FPR;
+      memcpy (desc.u.fpr, fprs[i], 20);
+      check_search (hd, &desc, stored, "fpr");
+      desc.mode = KEYDB_SEARCH_MODE_FPR20;
+      check_search (hd, &desc, stored, "fpr20");
+
+      issuer = ksba_cert_get_issuer (certs[i], 0);
+      serial = ksba_cert_get_serial (certs[i]);
+      if (!issuer || !serial)
+        {
+          fail (i);
+          continue;
+        }
+      memset (&desc, 0, sizeof desc);
+      desc.mode = KEYDB_SEARCH_MODE_ISSUER_SN;
+      desc.u.name = issuer;
+      s = serial + 1;
+      for (desc.snlen = 0; digitp (s); s++)
+        desc.snlen = 10*desc.snlen + atoi_1 (s);
+      desc.sn = s + 1;
+      check_search (hd, &desc, stored, "issuer+sn");
+
+      /* The same with the serial number given as a hex string.  */
+      hexsn = bin2hex (desc.sn, desc.snlen, NULL);
+      if (!hexsn)
+        fail (i);
+      else
+        {
+          desc.sn = hexsn;
+          desc.snlen = -1;
+          check_search (hd, &desc, stored, "issuer+hexsn");
+          xfree (hexsn);
+        }
+      ksba_free (serial);
+      ksba_free (issuer);
+
+      subject = ksba_cert_get_subject (certs[i], 0);
+      if (!subject)
+        {
+          fail (i);
+          continue;
+        }
+      memset (&desc, 0, sizeof desc);
+      desc.mode = KEYDB_SEARCH_MODE_SUBJECT;
+      desc.u.name = subject;
+      check_search (hd, &desc, stored, "subject");
+      ksba_free (subject);
+    }
+
+  for (i=0; i < DIM (mails); i++)
+    {
+      memset (&desc, 0, sizeof desc);
+      desc.mode = KEYDB_SEARCH_MODE_MAIL;
+      desc.u.name = mails[i].name;
+      stored = (mails[i].certidx >= first && mails[i].certidx < end);
+      check_search (hd, &desc, stored, "mail");
+    }
+
+  /* Searches which never match.  */
+  memset (&desc, 0, sizeof desc);
+  desc.mode = KEYDB_SEARCH_MODE_FPR;
+  memset (desc.u.fpr, 0x42, 20);
+  check_search (hd, &desc, 0, "unknown fpr");
+  memset (&desc, 0, sizeof desc);
+  desc.mode = KEYDB_SEARCH_MODE_SUBJECT;
+  desc.u.name = "CN=Nobody";
+  check_search (hd, &desc, 0, "unknown subject");
+}
+
+
+int
+main (int argc, char **argv)
+{
+  const char *fname = "t-keybox-search.kbx";
+  FILE *fp;
+  void *token;
+  KEYBOX_HANDLE hd;
+  KEYBOX_SEARCH_DESC desc;
+  unsigned long skipped = 0;
+  int i, rc;
+
+  if (argc > 1 && !strcmp (argv[1], "--verbose"))
+    verbose = 1;
+
+  if (!gcry_check_version (NULL))
+    {
+      fprintf (stderr, "%s:%d: libgcrypt initialization failed\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+
+  for (i=0; i < DIM (certfiles); i++)
+    read_cert (certfiles[i], &certs[i], fprs[i]);
+
+  /* The keybox functions do not create the file.  */
+  fp = fopen (fname, "wb");
+  if (!fp || _keybox_write_header_blob (fp, 0) || fclose (fp))
+    {
+      fprintf (stderr, "%s:%d: error creating '%s'\n",
+               __FILE__, __LINE__, fname);
+      exit (1);
+    }
+  token = keybox_register_file (fname, 0);
+  if (!token)
+    {
+      fprintf (stderr, "%s:%d: error registering keybox\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+  hd = keybox_new_x509 (token, 0);
+  if (!hd)
+    {
+      fprintf (stderr, "%s:%d: error creating keybox handle\n",
+               __FILE__, __LINE__);
+      exit (1);
+    }
+
+  /* Store the first certificates one by one and build the index.  */
+  for (i=0; i < NFIRSTCERTS; i++)
+    if (keybox_insert_cert (hd, certs[i], fprs[i]))
+      fail (1);
+  run_searches (hd, 0, NFIRSTCERTS);
+
+  /* Append the other certificates to the indexed keybox.  */
+  if (keybox_insert_certs (hd, certs + NFIRSTCERTS, fprs[NFIRSTCERTS],
+                           DIM (certfiles) - NFIRSTCERTS))
+    fail (2);
+  run_searches (hd, 0, DIM (certfiles));
+
+  /* Delete the first certificate; its stale index entries must not
+     match anymore.  */
+  memset (&desc, 0, sizeof desc);
+  desc.mode = KEYDB_SEARCH_MODE_FPR;
+  memcpy (desc.u.fpr, fprs[0], 20);
+  rc = keybox_search_reset (hd);
+  if (!rc)
+    rc = keybox_search (hd, &desc, 1, NULL, &skipped);
+  if (!rc)
+    rc = keybox_delete (hd);
+  if (rc)
+    fail (3);
+  run_searches (hd, 1, DIM (certfiles));
+
+  keybox_release (hd);
+  for (i=0; i < DIM (certfiles); i++)
+    ksba_cert_release (certs[i]);
+  remove (fname);
+
+  return !!errcount;
+}
@@ -97,6 +97,7 @@ enum cmd_and_opt_values
   oDenyAdmin,
   oDisableApplication,
   oEnablePinpadVarlen,
+  oListenBacklog,
   oDebugDisableTicker
 };
 
@@ -155,6 +156,7 @@ static ARGPARSE_OPTS opts[] = {
   ARGPARSE_s_s (oDisableApplication, "disable-application", "@"),
   ARGPARSE_s_n (oEnablePinpadVarlen, "enable-pinpad-varlen",
                 N_("use variable length input for pinpad")),
+  ARGPARSE_s_i (oListenBacklog, "listen-backlog", "@"),
 
   ARGPARSE_end ()
 };
@@ -184,6 +186,9 @@ static ARGPARSE_OPTS opts[] = {
 #define TIMERTICK_INTERVAL_SEC     (0)
 #define TIMERTICK_INTERVAL_USEC    (500000)
 
+/* The default size of the queue for pending connections.  */
+#define DEFAULT_LISTEN_BACKLOG 64
+
 /* Flag to indicate that a shutdown was requested. */
 static int shutdown_pending;
 
@@ -196,6 +201,9 @@ static int pipe_server;
 /* Name of the communication socket */
 static char *socket_name;
 
+/* The size of the queue for pending connections.  */
+static int listen_backlog = DEFAULT_LISTEN_BACKLOG;
+
 /* We need to keep track of the server's nonces (these are dummies for
    POSIX systems). */
 static assuan_sock_nonce_t socket_nonce;
@@ -589,6 +597,12 @@ main (int argc, char **argv )
 
 	case oEnablePinpadVarlen: opt.enable_pinpad_varlen = 1; break;
 
+        case oListenBacklog:
+          listen_backlog = pargs.r.ret_int;
+          if (listen_backlog < 1)
+            listen_backlog = 1;
+          break;
+
         default:
           pargs.err = configfp? ARGPARSE_PRINT_WARNING:ARGPARSE_PRINT_ERROR;
           break;
@@ -1078,7 +1092,7 @@ create_server_socket (const char *name, assuan_sock_nonce_t *nonce)
       scd_exit (2);
     }
 
-  if (listen (FD2INT(fd), 5 ) == -1)
+  if (listen (FD2INT(fd), listen_backlog) == -1)
     {
       log_error (_("listen() failed: %s\n"),
                  gpg_strerror (gpg_error_from_syserror ()));
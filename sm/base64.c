@@ -376,25 +376,20 @@ simple_reader_cb (void *cb_value, char *buffer, size_t count, size_t *nread)
 {
   struct reader_cb_parm_s *parm = cb_value;
   size_t n;
-  int c = 0;
 
   *nread = 0;
   if (!buffer)
     return -1; /* not supported */
 
-  for (n=0; n < count; n++)
+  n = es_fread (buffer, 1, count, parm->fp);
+  if (n < count)
     {
-      c = es_getc (parm->fp);
-      if (c == EOF)
-        {
-          parm->eof_seen = 1;
-          if (es_ferror (parm->fp))
-            return -1;
-          if (n)
-            break; /* Return what we have before an EOF.  */
-          return -1;
-        }
-      *(byte *)buffer++ = c;
+      parm->eof_seen = 1;
+      if (es_ferror (parm->fp))
+        return -1;
+      if (!n)
+        return -1;
+      /* Return what we have before an EOF.  */
     }
 
   *nread = n;
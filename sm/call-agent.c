@@ -1075,6 +1075,76 @@ gpgsm_agent_keyinfo (ctrl_t ctrl, const char *hexkeygrip, char **r_serialno)
   return err;
 }
 
+/* Status callback for gpgsm_agent_keyinfo_list.  */
+static gpg_error_t
+keyinfo_list_status_cb (void *opaque, const char *line)
+{
+  strlist_t *list = opaque;
+  const char *s, *s2;
+  char *item;
+
+  if (!(s = has_leading_keyword (line, "KEYINFO")))
+    return 0;
+  s2 = strchr (s, ' ');
+  if (!s2 || s2 - s != 40)
+    return 0; /* Not a keygrip.  */
+
+  /* The item is the keygrip, followed by a space and the serial
+     number of the card if the key is stored on a smartcard.  */
+  item = xtrymalloc (strlen (s) + 1);
+  if (!item)
+    return gpg_error_from_syserror ();
+  memcpy (item, s, 40);
+  item[40] = 0;
+  if (s2[1] == 'T' && s2[2] == ' ' && s2[3])
+    {
+      s = s2 + 3;
+      s2 = strchr (s, ' ');
+      if (!s2)
+        s2 = s + strlen (s);
+      if (s2 > s && !memchr (s, ':', s2 - s))
+        {
+          item[40] = ' ';
+          memcpy (item + 41, s, s2 - s);
+          item[41 + (s2 - s)] = 0;
+        }
+    }
+  if (!add_to_strlist_try (list, item))
+    {
+      gpg_error_t err = gpg_error_from_syserror ();
+      xfree (item);
+      return err;
+    }
+  xfree (item);
+  return 0;
+}
+
+/* Return a list of all secret keys known to the agent.  The string of
+   each item is the hex encoded keygrip, optionally followed by a
+   space and the serial number of the smartcard holding the key.  This
+   is used to avoid one request per key when listing many keys.  On
+   error NULL is stored at R_LIST.  */
+gpg_error_t
+gpgsm_agent_keyinfo_list (ctrl_t ctrl, strlist_t *r_list)
+{
+  gpg_error_t err;
+  strlist_t list = NULL;
+
+  *r_list = NULL;
+
+  err = start_agent (ctrl);
+  if (err)
+    return err;
+
+  err = assuan_transact (agent_ctx, "KEYINFO --list", NULL, NULL, NULL, NULL,
+                         keyinfo_list_status_cb, &list);
+  if (err)
+    free_strlist (list);
+  else
+    *r_list = list;
+  return err;
+}
+
 
 
 /* Ask for the passphrase (this is used for pkcs#12 import/export.  On
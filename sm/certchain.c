@@ -60,6 +60,58 @@ struct chain_item_s
 typedef struct chain_item_s *chain_item_t;
 
 
+/* The maximum number of entries in the validation cache.  */
+#define MAX_VALIDATION_CACHE_ENTRIES 1024
+
+/* The maximum number of entries in the signature cache.  */
+#define MAX_SIG_CACHE_ENTRIES 1024
+
+/* The number of buckets of the validation and the signature cache.  */
+#define CHAIN_CACHE_BUCKETS 256
+
+/* An entry of the validation cache.  The key is the fingerprint of
+   the target certificate, the validation flags, the OCSP setting and,
+   if the chain model has been used, the check time.  Only the results
+   "good" and "revoked" are stored.  */
+struct validation_cache_item_s
+{
+  struct validation_cache_item_s *next;
+  unsigned char fpr[20];     /* Fingerprint of the target certificate.  */
+  unsigned int flags;        /* The VALIDATE_FLAGs requested.  */
+  int use_ocsp;              /* The value of CTRL->USE_OCSP.  */
+  ksba_isotime_t checktime;  /* The check time or empty if not used.  */
+  gpg_err_code_t result;     /* 0 or GPG_ERR_CERT_REVOKED.  */
+  unsigned int retflags;     /* The RETFLAGS of the validation.  */
+  int is_qualified;          /* -1 = unknown, 0 = no, 1 = yes.  */
+  ksba_isotime_t exptime;    /* The nearest expiration time of the chain.  */
+  ksba_isotime_t expires;    /* Do not use the entry after this.  */
+};
+typedef struct validation_cache_item_s *validation_cache_item_t;
+
+/* An entry of the signature cache.  It records that the signature of
+   the certificate SUBJECT_FPR has been verified using the public key
+   of the certificate ISSUER_FPR.  */
+struct sig_cache_item_s
+{
+  struct sig_cache_item_s *next;
+  unsigned char subject_fpr[20];
+  unsigned char issuer_fpr[20];
+};
+typedef struct sig_cache_item_s *sig_cache_item_t;
+
+/* The validation cache and the signature cache.  With --server they
+   are kept over all requests of the session.  gpgsm is single
+   threaded and thus no locking is required.
+
+   Note that dirmngr/validate.c has a similar validation cache which
+   differs in the key; changes to the purge, find and insert logic
+   should be applied to both copies.  */
+static validation_cache_item_t validation_cache[CHAIN_CACHE_BUCKETS];
+static unsigned int validation_cache_entries;
+static sig_cache_item_t sig_cache[CHAIN_CACHE_BUCKETS];
+static unsigned int sig_cache_entries;
+
+
 static int is_root_cert (ksba_cert_t cert,
                          const char *issuerdn, const char *subjectdn);
 static int get_regtp_ca_info (ctrl_t ctrl, ksba_cert_t cert, int *chainlen);
@@ -101,6 +153,202 @@ set_already_asked_marktrusted (ksba_cert_t cert)
  marktrusted_info = r;
 }
 
+
+/* Remove all entries from the validation cache which have expired at
+   CURRENT_TIME or, if CURRENT_TIME is NULL, all entries.  */
+static void
+validation_cache_purge (const ksba_isotime_t current_time)
+{
+  validation_cache_item_t item, *itemp;
+  int i;
+
+  for (i=0; i < CHAIN_CACHE_BUCKETS; i++)
+    for (itemp = &validation_cache[i]; (item = *itemp); )
+      {
+        if (!current_time || strcmp (item->expires, current_time) < 0)
+          {
+            *itemp = item->next;
+            xfree (item);
+            validation_cache_entries--;
+          }
+        else
+          itemp = &item->next;
+      }
+}
+
+
+/* Remove all entries from the validation cache.  This needs to be
+   called if the result of a validation may have changed; for example
+   if a certificate has been deleted or a root certificate has been
+   marked as trusted.  The signature cache is not affected.  */
+void
+gpgsm_flush_validation_cache (void)
+{
+  validation_cache_purge (NULL);
+}
+
+
+/* Return true if the validation cache may be used for a validation
+   with LISTMODE and FLAGS.  */
+static int
+use_validation_cache (ctrl_t ctrl, int listmode, unsigned int flags)
+{
+  /* In list mode and for the audit log the details of the chain are
+     required.  A forced CRL refresh must not be bypassed either.  */
+  if (listmode || ctrl->audit || opt.force_crl_refresh)
+    return 0;
+  if (opt.validation_cache_ttl <= 0)
+    return 0;
+  /* No dirmngr means that revocations have not been checked; this is
+     cheap enough anyway.  */
+  if ((flags & VALIDATE_FLAG_NO_DIRMNGR))
+    return 0;
+  return 1;
+}
+
+
+/* Look up the validation cache for the certificate with fingerprint
+   FPR validated using FLAGS at CHECKTIME.  Returns the entry or
+   NULL.  */
+static validation_cache_item_t
+validation_cache_find (ctrl_t ctrl, const unsigned char *fpr,
+                       unsigned int flags, const ksba_isotime_t checktime)
+{
+  validation_cache_item_t item, *itemp;
+  ksba_isotime_t current_time;
+
+  gnupg_get_isotime (current_time);
+  for (itemp = &validation_cache[*fpr]; (item = *itemp);
+       itemp = &item->next)
+    {
+      if (item->flags != flags || item->use_ocsp != !!ctrl->use_ocsp
+          || memcmp (item->fpr, fpr, 20))
+        continue;
+      /* An entry with a check time is only valid for that time.  */
+      if (*item->checktime
+          && (!checktime || strcmp (item->checktime, checktime)))
+        continue;
+
+      if (strcmp (item->expires, current_time) < 0)
+        {
+          /* Expired - remove it.  */
+          *itemp = item->next;
+          xfree (item);
+          validation_cache_entries--;
+          return NULL;
+        }
+      return item;
+    }
+  return NULL;
+}
+
+
+/* Store the validation RESULT for the certificate with fingerprint
+   FPR validated using FLAGS.  CHECKTIME is the time used by the chain
+   model or NULL, RETFLAGS and IS_QUALIFIED are the flags returned by
+   the validation and EXPTIME is the nearest expiration time of the
+   chain which may be empty.  */
+static void
+validation_cache_insert (ctrl_t ctrl, const unsigned char *fpr,
+                         unsigned int flags, const ksba_isotime_t checktime,
+                         gpg_err_code_t result, unsigned int retflags,
+                         int is_qualified, const ksba_isotime_t exptime)
+{
+  validation_cache_item_t item;
+  ksba_isotime_t current_time, expires;
+
+  gnupg_get_isotime (current_time);
+  gnupg_copy_time (expires, current_time);
+  if (add_seconds_to_isotime (expires, opt.validation_cache_ttl))
+    return;
+  if (*exptime && strcmp (exptime, expires) < 0)
+    gnupg_copy_time (expires, exptime);
+  if (strcmp (expires, current_time) <= 0)
+    return;
+
+  item = validation_cache_find (ctrl, fpr, flags, checktime);
+  if (!item)
+    {
+      if (validation_cache_entries >= MAX_VALIDATION_CACHE_ENTRIES)
+        validation_cache_purge (current_time);
+      if (validation_cache_entries >= MAX_VALIDATION_CACHE_ENTRIES)
+        {
+          if (DBG_CACHE)
+            log_debug ("validation cache is full - result not cached\n");
+          return;
+        }
+      item = xtrycalloc (1, sizeof *item);
+      if (!item)
+        return;
+      memcpy (item->fpr, fpr, 20);
+      item->flags = flags;
+      item->use_ocsp = !!ctrl->use_ocsp;
+      item->next = validation_cache[*fpr];
+      validation_cache[*fpr] = item;
+      validation_cache_entries++;
+    }
+  if (checktime)
+    gnupg_copy_time (item->checktime, checktime);
+  else
+    *item->checktime = 0;
+  item->result = result;
+  item->retflags = retflags;
+  item->is_qualified = is_qualified;
+  gnupg_copy_time (item->exptime, exptime);
+  gnupg_copy_time (item->expires, expires);
+}
+
+
+/* Check the signature on CERT using the ISSUER_CERT.  This is a
+   wrapper around gpgsm_check_cert_sig which remembers good
+   signatures; they don't change and thus the public key operation
+   needs to be done only once for each pair of certificates.  */
+static int
+check_cert_sig_cached (ksba_cert_t issuer_cert, ksba_cert_t cert)
+{
+  unsigned char subject_fpr[20], issuer_fpr[20];
+  sig_cache_item_t item;
+  int rc, i;
+
+  gpgsm_get_fingerprint (cert, GCRY_MD_SHA1, subject_fpr, NULL);
+  gpgsm_get_fingerprint (issuer_cert, GCRY_MD_SHA1, issuer_fpr, NULL);
+  for (item = sig_cache[*subject_fpr]; item; item = item->next)
+    if (!memcmp (item->subject_fpr, subject_fpr, 20)
+        && !memcmp (item->issuer_fpr, issuer_fpr, 20))
+      {
+        if (DBG_CACHE)
+          log_debug ("signature cache hit\n");
+        return 0;
+      }
+
+  rc = gpgsm_check_cert_sig (issuer_cert, cert);
+  if (rc)
+    return rc;
+
+  if (sig_cache_entries >= MAX_SIG_CACHE_ENTRIES)
+    {
+      /* Simply start over.  */
+      for (i=0; i < CHAIN_CACHE_BUCKETS; i++)
+        while ((item = sig_cache[i]))
+          {
+            sig_cache[i] = item->next;
+            xfree (item);
+          }
+      sig_cache_entries = 0;
+    }
+  item = xtrymalloc (sizeof *item);
+  if (item)
+    {
+      memcpy (item->subject_fpr, subject_fpr, 20);
+      memcpy (item->issuer_fpr, issuer_fpr, 20);
+      item->next = sig_cache[*subject_fpr];
+      sig_cache[*subject_fpr] = item;
+      sig_cache_entries++;
+    }
+  return 0;
+}
+
+
 /* If LISTMODE is true, print FORMAT using LISTMODE to FP.  If
    LISTMODE is false, use the string to print an log_info or, if
    IS_ERROR is true, and log_error. */
@@ -1207,6 +1455,7 @@ ask_marktrusted (ctrl_t ctrl, ksba_cert_t cert, int listmode)
   if (!rc)
     {
       log_info (_("root certificate has now been marked as trusted\n"));
+      gpgsm_flush_validation_cache ();
       success = 1;
     }
   else if (!listmode)
@@ -1423,7 +1672,7 @@ do_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime_arg,
         {
           if (!istrusted_rc)
             ; /* No need to check the certificate for a trusted one. */
-          else if (gpgsm_check_cert_sig (subject_cert, subject_cert) )
+          else if (check_cert_sig_cached (subject_cert, subject_cert) )
             {
               /* We only check the signature if the certificate is not
                  trusted for better diagnostics. */
@@ -1586,7 +1835,7 @@ do_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime_arg,
           gpgsm_dump_cert ("issuer", issuer_cert);
         }
 
-      rc = gpgsm_check_cert_sig (issuer_cert, subject_cert);
+      rc = check_cert_sig_cached (issuer_cert, subject_cert);
       if (rc)
         {
           do_list (0, listmode, listfp, _("certificate has a BAD signature"));
@@ -1867,7 +2116,11 @@ do_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime_arg,
    creation time of the signature.  If your are verifying a
    certificate, set it nil (i.e. the empty string).  If the creation
    date of the signature is not known use the special date
-   "19700101T000000" which is treated in a special way here. */
+   "19700101T000000" which is treated in a special way here.
+
+   Unless LISTMODE is set, the results "good" and "revoked" are cached
+   for --validation-cache-ttl seconds but not beyond the nearest
+   expiration time of the chain. */
 int
 gpgsm_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime,
                       ksba_isotime_t r_exptime,
@@ -1877,6 +2130,11 @@ gpgsm_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime,
   int rc;
   struct rootca_flags_s rootca_flags;
   unsigned int dummy_retflags;
+  unsigned int req_flags;
+  ksba_isotime_t exptime;
+  unsigned char fpr[20];
+  int use_cache;
+  validation_cache_item_t item;
 
   if (!retflags)
     retflags = &dummy_retflags;
@@ -1887,15 +2145,43 @@ gpgsm_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime,
     flags |= VALIDATE_FLAG_CHAIN_MODEL;
   else if (ctrl->validation_model == 2)
     flags |= VALIDATE_FLAG_STEED;
+  req_flags = flags;
 
   /* If the chain model was forced, set this immediately into
      RETFLAGS.  */
   *retflags = (flags & VALIDATE_FLAG_CHAIN_MODEL);
 
+  use_cache = use_validation_cache (ctrl, listmode, flags);
+  if (use_cache)
+    {
+      gpgsm_get_fingerprint (cert, GCRY_MD_SHA1, fpr, NULL);
+      item = validation_cache_find (ctrl, fpr, flags, checktime);
+      if (item)
+        {
+          if (DBG_CACHE)
+            log_debug ("validation cache hit\n");
+          if (item->is_qualified != -1)
+            {
+              char buf[1];
+
+              buf[0] = !!item->is_qualified;
+              rc = ksba_cert_set_user_data (cert, "is_qualified", buf, 1);
+              if (rc)
+                log_error ("set_user_data(is_qualified) failed: %s\n",
+                           gpg_strerror (rc));
+            }
+          if (r_exptime)
+            gnupg_copy_time (r_exptime, item->exptime);
+          *retflags = item->retflags;
+          rc = item->result? gpg_error (item->result) : 0;
+          goto leave;
+        }
+    }
+
   memset (&rootca_flags, 0, sizeof rootca_flags);
 
   rc = do_validate_chain (ctrl, cert, checktime,
-                          r_exptime, listmode, listfp, flags,
+                          exptime, listmode, listfp, flags,
                           &rootca_flags);
   if (!rc && (flags & VALIDATE_FLAG_STEED))
     {
@@ -1907,12 +2193,38 @@ gpgsm_validate_chain (ctrl_t ctrl, ksba_cert_t cert, ksba_isotime_t checktime,
     {
       do_list (0, listmode, listfp, _("switching to chain model"));
       rc = do_validate_chain (ctrl, cert, checktime,
-                              r_exptime, listmode, listfp,
+                              exptime, listmode, listfp,
                               (flags |= VALIDATE_FLAG_CHAIN_MODEL),
                               &rootca_flags);
       *retflags |= VALIDATE_FLAG_CHAIN_MODEL;
     }
+  if (r_exptime)
+    gnupg_copy_time (r_exptime, exptime);
 
+  /* Results of the chain model are only valid for the check time
+     used.  If that time is not known the current time has been used
+     and we can't cache the result.  */
+  if (use_cache
+      && (!rc || gpg_err_code (rc) == GPG_ERR_CERT_REVOKED)
+      && (!(*retflags & VALIDATE_FLAG_CHAIN_MODEL)
+          || (checktime && *checktime
+              && strcmp (checktime, "19700101T000000"))))
+    {
+      int is_qualified = -1;
+      char buf[1];
+      size_t buflen;
+
+      if (!ksba_cert_get_user_data (cert, "is_qualified",
+                                    &buf, sizeof (buf), &buflen) && buflen)
+        is_qualified = !!*buf;
+      validation_cache_insert (ctrl, fpr, req_flags,
+                               ((*retflags & VALIDATE_FLAG_CHAIN_MODEL)
+                                ? checktime : NULL),
+                               gpg_err_code (rc), *retflags, is_qualified,
+                               exptime);
+    }
+
+ leave:
   if (opt.verbose)
     do_list (0, listmode, listfp, _("validation model used: %s"),
              (*retflags & VALIDATE_FLAG_STEED)?
@@ -1962,7 +2274,7 @@ gpgsm_basic_cert_check (ctrl_t ctrl, ksba_cert_t cert)
 
   if (is_root_cert (cert, issuer, subject))
     {
-      rc = gpgsm_check_cert_sig (cert, cert);
+      rc = check_cert_sig_cached (cert, cert);
       if (rc)
         {
           log_error ("self-signed certificate has a BAD signature: %s\n",
@@ -2003,7 +2315,7 @@ gpgsm_basic_cert_check (ctrl_t ctrl, ksba_cert_t cert)
           goto leave;
         }
 
-      rc = gpgsm_check_cert_sig (issuer_cert, cert);
+      rc = check_cert_sig_cached (issuer_cert, cert);
       if (rc)
         {
           log_error ("certificate has a BAD signature: %s\n",
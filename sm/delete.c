@@ -147,6 +147,9 @@ delete_one (ctrl_t ctrl, const char *username)
     }
   while (duplicates--);
 
+  /* The chains of other certificates may have used this one.  */
+  gpgsm_flush_validation_cache ();
+
  leave:
   keydb_release (kh);
   ksba_cert_release (cert);
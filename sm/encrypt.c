@@ -57,7 +57,8 @@ struct encrypt_cb_parm_s
   int readerror;
   int bufsize;
   unsigned char *buffer;
-  int buflen;
+  int bufpos;     /* Offset of the unencrypted data in BUFFER.  */
+  int buflen;     /* Length of the unencrypted data.  */
 };
 
 
@@ -164,12 +165,13 @@ encode_session_key (DEK dek, gcry_sexp_t * r_data)
 }
 
 
-/* Encrypt the DEK under the key contained in CERT and return it as a
-   canonical S-Exp in encval. */
+/* Encrypt the session key S_DATA as returned by encode_session_key
+   under the key contained in CERT and return it as a canonical S-Exp
+   in encval. */
 static int
-encrypt_dek (const DEK dek, ksba_cert_t cert, unsigned char **encval)
+encrypt_dek (gcry_sexp_t s_data, ksba_cert_t cert, unsigned char **encval)
 {
-  gcry_sexp_t s_ciph, s_data, s_pkey;
+  gcry_sexp_t s_ciph, s_pkey;
   int rc;
   ksba_sexp_t buf;
   size_t len;
@@ -197,19 +199,11 @@ encrypt_dek (const DEK dek, ksba_cert_t cert, unsigned char **encval)
       return rc;
     }
 
-  /* Put the encoded cleartext into a simple list. */
-  s_data = NULL; /* (avoid compiler warning) */
-  rc = encode_session_key (dek, &s_data);
-  if (rc)
-    {
-      log_error ("encode_session_key failed: %s\n", gpg_strerror (rc));
-      return rc;
-    }
-
   /* pass it to libgcrypt */
   rc = gcry_pk_encrypt (&s_ciph, s_data, s_pkey);
-  gcry_sexp_release (s_data);
   gcry_sexp_release (s_pkey);
+  if (rc)
+    return rc;
 
   /* Reformat it. */
   rc = make_canon_sexp (s_ciph, encval, NULL);
@@ -218,7 +212,7 @@ encrypt_dek (const DEK dek, ksba_cert_t cert, unsigned char **encval)
 }
 
 
-
+
 /* do the actual encryption */
 static int
 encrypt_cb (void *cb_value, char *buffer, size_t count, size_t *nread)
@@ -238,45 +232,43 @@ encrypt_cb (void *cb_value, char *buffer, size_t count, size_t *nread)
   if (count < blklen)
     BUG ();
 
-  if (!parm->eof_seen)
-    { /* fillup the buffer */
-      p = parm->buffer;
-      for (n=parm->buflen; n < parm->bufsize; n++)
+  if (!parm->eof_seen && parm->buflen < blklen)
+    { /* Move the rest to the start and fillup the buffer.  */
+      memmove (parm->buffer, parm->buffer + parm->bufpos, parm->buflen);
+      parm->bufpos = 0;
+      n = es_fread (parm->buffer + parm->buflen, 1,
+                    parm->bufsize - parm->buflen, parm->fp);
+      if (n < parm->bufsize - parm->buflen)
         {
-          int c = es_getc (parm->fp);
-          if (c == EOF)
+          if (es_ferror (parm->fp))
             {
-              if (es_ferror (parm->fp))
-                {
-                  parm->readerror = errno;
-                  return -1;
-                }
-              parm->eof_seen = 1;
-              break;
+              parm->readerror = errno;
+              return -1;
             }
-          p[n] = c;
+          parm->eof_seen = 1;
         }
-      parm->buflen = n;
+      parm->buflen += n;
     }
 
+  p = parm->buffer + parm->bufpos;
   n = parm->buflen < count? parm->buflen : count;
   n = n/blklen * blklen;
   if (n)
     { /* encrypt the stuff */
-      gcry_cipher_encrypt (parm->dek->chd, buffer, n, parm->buffer, n);
+      gcry_cipher_encrypt (parm->dek->chd, buffer, n, p, n);
       *nread = n;
-      /* Who cares about cycles, take the easy way and shift the buffer */
+      parm->bufpos += n;
       parm->buflen -= n;
-      memmove (parm->buffer, parm->buffer+n, parm->buflen);
     }
   else if (parm->eof_seen)
     { /* no complete block but eof: add padding */
       /* fixme: we should try to do this also in the above code path */
+      /* The buffer has room for the padding because the EOF was seen
+         before it was full and BUFSIZE is a multiple of BLKLEN.  */
       int i, npad = blklen - (parm->buflen % blklen);
-      p = parm->buffer;
-      for (n=parm->buflen, i=0; n < parm->bufsize && i < npad; n++, i++)
+      for (n=parm->buflen, i=0; i < npad; n++, i++)
         p[n] = npad;
-      gcry_cipher_encrypt (parm->dek->chd, buffer, n, parm->buffer, n);
+      gcry_cipher_encrypt (parm->dek->chd, buffer, n, p, n);
       *nread = n;
       parm->ready = 1;
     }
@@ -305,6 +297,7 @@ gpgsm_encrypt (ctrl_t ctrl, certlist_t recplist, int data_fd, estream_t out_fp)
   KEYDB_HANDLE kh = NULL;
   struct encrypt_cb_parm_s encparm;
   DEK dek = NULL;
+  gcry_sexp_t s_data = NULL;
   int recpno;
   estream_t data_fp = NULL;
   certlist_t cl;
@@ -425,8 +418,9 @@ gpgsm_encrypt (ctrl_t ctrl, certlist_t recplist, int data_fd, estream_t out_fp)
     }
 
   encparm.dek = dek;
-  /* Use a ~8k (AES) or ~4k (3DES) buffer */
-  encparm.bufsize = 500 * dek->ivlen;
+  /* Use a buffer of about DATA_BUFFER_SIZE which is a multiple of
+     the block length.  */
+  encparm.bufsize = DATA_BUFFER_SIZE / dek->ivlen * dek->ivlen;
   encparm.buffer = xtrymalloc (encparm.bufsize);
   if (!encparm.buffer)
     {
@@ -436,13 +430,22 @@ gpgsm_encrypt (ctrl_t ctrl, certlist_t recplist, int data_fd, estream_t out_fp)
 
   audit_log_s (ctrl->audit, AUDIT_SESSION_KEY, dek->algoid);
 
+  /* Put the encoded session key into a simple list.  This is the
+     same for all recipients and thus done only once.  */
+  rc = encode_session_key (dek, &s_data);
+  if (rc)
+    {
+      log_error ("encode_session_key failed: %s\n", gpg_strerror (rc));
+      goto leave;
+    }
+
   /* Gather certificates of recipients, encrypt the session key for
      each and store them in the CMS object */
   for (recpno = 0, cl = recplist; cl; recpno++, cl = cl->next)
     {
       unsigned char *encval;
 
-      rc = encrypt_dek (dek, cl->cert, &encval);
+      rc = encrypt_dek (s_data, cl->cert, &encval);
       if (rc)
         {
           audit_log_cert (ctrl->audit, AUDIT_ENCRYPTED_TO, cl->cert, rc);
@@ -473,6 +476,8 @@ gpgsm_encrypt (ctrl_t ctrl, certlist_t recplist, int data_fd, estream_t out_fp)
           goto leave;
         }
     }
+  gcry_sexp_release (s_data);
+  s_data = NULL;
 
   /* Main control loop for encryption. */
   recpno = 0;
@@ -510,6 +515,7 @@ gpgsm_encrypt (ctrl_t ctrl, certlist_t recplist, int data_fd, estream_t out_fp)
   gpgsm_destroy_writer (b64writer);
   ksba_reader_release (reader);
   keydb_release (kh);
+  gcry_sexp_release (s_data);
   xfree (dek);
   es_fclose (data_fp);
   xfree (encparm.buffer);
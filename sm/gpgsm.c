@@ -68,6 +68,7 @@ enum cmd_and_opt_values {
   aDeleteKey,
   aImport,
   aVerify,
+  aVerifyFiles,
   aListExternalKeys,
   aListChain,
   aSendKeys,
@@ -135,6 +136,7 @@ enum cmd_and_opt_values {
   oDisableTrustedCertCRLCheck,
   oEnableTrustedCertCRLCheck,
   oForceCRLRefresh,
+  oValidationCacheTTL,
 
   oDisableOCSP,
   oEnableOCSP,
@@ -183,6 +185,7 @@ enum cmd_and_opt_values {
   oIgnoreTimeConflict,
   oNoRandomSeedFile,
   oNoCommonCertsImport,
+  oBulkImport,
   oIgnoreCertExtension
  };
 
@@ -198,6 +201,8 @@ static ARGPARSE_OPTS opts[] = {
 /*ARGPARSE_c (aSym, "symmetric", N_("encryption only with symmetric cipher")),*/
   ARGPARSE_c (aDecrypt, "decrypt", N_("decrypt data (default)")),
   ARGPARSE_c (aVerify, "verify",  N_("verify a signature")),
+  ARGPARSE_c (aVerifyFiles, "verify-files",
+              N_("verify the signatures of several files")),
   ARGPARSE_c (aListKeys, "list-keys", N_("list keys")),
   ARGPARSE_c (aListExternalKeys, "list-external-keys",
               N_("list external keys")),
@@ -263,6 +268,7 @@ static ARGPARSE_OPTS opts[] = {
                 "enable-trusted-cert-crl-check", "@"),
 
   ARGPARSE_s_n (oForceCRLRefresh, "force-crl-refresh", "@"),
+  ARGPARSE_s_i (oValidationCacheTTL, "validation-cache-ttl", "@"),
 
   ARGPARSE_s_n (oDisableOCSP, "disable-ocsp", "@"),
   ARGPARSE_s_n (oEnableOCSP,  "enable-ocsp", N_("check validity using OCSP")),
@@ -390,6 +396,7 @@ static ARGPARSE_OPTS opts[] = {
   ARGPARSE_s_n (oIgnoreTimeConflict, "ignore-time-conflict", "@"),
   ARGPARSE_s_n (oNoRandomSeedFile,  "no-random-seed-file", "@"),
   ARGPARSE_s_n (oNoCommonCertsImport, "no-common-certs-import", "@"),
+  ARGPARSE_s_n (oBulkImport, "bulk-import", "@"),
   ARGPARSE_s_s (oIgnoreCertExtension, "ignore-cert-extension", "@"),
 
   /* Command aliases.  */
@@ -432,6 +439,9 @@ static int allow_special_filenames;
 #define DEFAULT_INCLUDE_CERTS -2 /* Include all certs but root. */
 static int default_include_certs = DEFAULT_INCLUDE_CERTS;
 
+/* The default number of seconds validation results are cached.  */
+#define DEFAULT_VALIDATION_CACHE_TTL 300
+
 /* Whether the chain mode shall be used for validation.  */
 static int default_validation_model;
 
@@ -949,6 +959,8 @@ main ( int argc, char **argv)
      remember to update the Gpgconflist entry as well.  */
   opt.def_cipher_algoid = DEFAULT_CIPHER_ALGO;
 
+  opt.validation_cache_ttl = DEFAULT_VALIDATION_CACHE_TTL;
+
   opt.homedir = default_homedir ();
 
 
@@ -1122,6 +1134,7 @@ main ( int argc, char **argv)
         case aSign:
         case aClearsign:
         case aVerify:
+        case aVerifyFiles:
           set_cmd (&cmd, pargs.r_opt);
           break;
 
@@ -1174,6 +1187,9 @@ main ( int argc, char **argv)
         case oForceCRLRefresh:
           opt.force_crl_refresh = 1;
           break;
+        case oValidationCacheTTL:
+          opt.validation_cache_ttl = pargs.r.ret_int;
+          break;
 
         case oDisableOCSP:
           ctrl.use_ocsp = opt.enable_ocsp = 0;
@@ -1390,6 +1406,7 @@ main ( int argc, char **argv)
         case oIgnoreTimeConflict: opt.ignore_time_conflict = 1; break;
         case oNoRandomSeedFile: use_random_seed = 0; break;
         case oNoCommonCertsImport: no_common_certs_import = 1; break;
+        case oBulkImport: opt.bulk_import = 1; break;
 
         case oEnableSpecialFilenames: allow_special_filenames =1; break;
 
@@ -1795,6 +1812,10 @@ main ( int argc, char **argv)
       }
       break;
 
+    case aVerifyFiles:
+      gpgsm_verify_files (&ctrl, argc, argv);
+      break;
+
     case aDecrypt:
       {
         estream_t fp = open_es_fwrite (opt.outfile?opt.outfile:"-");
@@ -37,6 +37,11 @@
 
 #define MAX_DIGEST_LEN 64
 
+/* The size of the buffers used to read the data to be hashed or
+   encrypted.  Large blocks let the hash and cipher functions run at
+   disk speed.  */
+#define DATA_BUFFER_SIZE (64*1024)
+
 struct keyserver_spec
 {
   struct keyserver_spec *next;
@@ -118,6 +123,7 @@ struct
   int no_crl_check;         /* Don't do a CRL check */
   int no_trusted_cert_crl_check; /* Don't run a CRL check for trusted certs. */
   int force_crl_refresh;    /* Force refreshing the CRL. */
+  int validation_cache_ttl; /* Seconds to cache validation results.  */
   int enable_ocsp;          /* Default to use OCSP checks. */
 
   char *policy_file;        /* full pathname of policy file */
@@ -128,6 +134,8 @@ struct
 
   int auto_issuer_key_retrieve; /* try to retrieve a missing issuer key. */
 
+  int bulk_import;          /* Store imported certificates in batches.  */
+
   int qualsig_approval;     /* Set to true if this software has
                                officially been approved to create an
                                verify qualified signatures.  This is a
@@ -322,6 +330,7 @@ int gpgsm_validate_chain (ctrl_t ctrl, ksba_cert_t cert,
                           int listmode, estream_t listfp,
                           unsigned int flags, unsigned int *retflags);
 int gpgsm_basic_cert_check (ctrl_t ctrl, ksba_cert_t cert);
+void gpgsm_flush_validation_cache (void);
 
 /*-- certlist.c --*/
 int gpgsm_cert_use_sign_p (ksba_cert_t cert);
@@ -358,6 +367,7 @@ int gpgsm_delete (ctrl_t ctrl, strlist_t names);
 
 /*-- verify.c --*/
 int gpgsm_verify (ctrl_t ctrl, int in_fd, int data_fd, estream_t out_fp);
+int gpgsm_verify_files (ctrl_t ctrl, int nfiles, char **files);
 
 /*-- sign.c --*/
 int gpgsm_get_default_cert (ctrl_t ctrl, ksba_cert_t *r_cert);
@@ -412,6 +422,7 @@ gpg_error_t gpgsm_agent_get_confirmation (ctrl_t ctrl, const char *desc);
 gpg_error_t gpgsm_agent_send_nop (ctrl_t ctrl);
 gpg_error_t gpgsm_agent_keyinfo (ctrl_t ctrl, const char *hexkeygrip,
                                  char **r_serialno);
+gpg_error_t gpgsm_agent_keyinfo_list (ctrl_t ctrl, strlist_t *r_list);
 gpg_error_t gpgsm_agent_ask_passphrase (ctrl_t ctrl, const char *desc_msg,
                                         int repeat, char **r_passphrase);
 gpg_error_t gpgsm_agent_keywrap_key (ctrl_t ctrl, int forexport,
@@ -42,6 +42,42 @@
 #define MAX_P12OBJ_SIZE 128 /*kb*/
 
 
+/* The number of certificates checked and stored at once by a bulk
+   import.  */
+#define BULK_BATCH_SIZE 1000
+
+/* The states of a fingerprint in the set of a bulk import.  A failed
+   certificate has the state BULK_STATE_FAILED plus the IMPORT_PROBLEM
+   reason.  */
+#define BULK_STATE_FREE   0  /* Unused slot.  */
+#define BULK_STATE_NONE   1  /* Not yet processed.  */
+#define BULK_STATE_QUEUED 2  /* Part of the current batch.  */
+#define BULK_STATE_STORED 3  /* Stored or already in the DB.  */
+#define BULK_STATE_FAILED 4
+
+/* An entry of the fingerprint set of a bulk import.  */
+struct fpr_entry_s
+{
+  unsigned char fpr[20];
+  unsigned char state;
+};
+
+/* The context of a bulk import.  */
+struct bulk_s
+{
+  /* The current batch of certificates and their fingerprints.  */
+  int ncerts;
+  ksba_cert_t certs[BULK_BATCH_SIZE];
+  unsigned char fprs[BULK_BATCH_SIZE][20];
+
+  /* The fingerprints of all certificates seen so far.  This is an
+     open addressing hash table.  */
+  struct fpr_entry_s *fpr_table;
+  unsigned int fpr_size;   /* Number of slots; a power of 2.  */
+  unsigned int fpr_count;  /* Number of used slots.  */
+};
+
+
 struct stats_s {
   unsigned long count;
   unsigned long imported;
@@ -50,6 +86,7 @@ struct stats_s {
   unsigned long secret_read;
   unsigned long secret_imported;
   unsigned long secret_dups;
+  struct bulk_s *bulk;  /* Non-NULL for a bulk import.  */
  };
 
 
@@ -66,6 +103,10 @@ struct rsa_secret_key_s
 
 static gpg_error_t parse_p12 (ctrl_t ctrl, ksba_reader_t reader,
                               struct stats_s *stats);
+static void check_and_store (ctrl_t ctrl, struct stats_s *stats,
+                             ksba_cert_t cert, int depth);
+static gpg_error_t bulk_add (ctrl_t ctrl, struct stats_s *stats,
+                             ksba_cert_t cert);
 
 
 
@@ -163,6 +204,113 @@ print_imported_summary (ctrl_t ctrl, struct stats_s *stats)
 
 
 
+/* Return the IMPORT_PROBLEM reason for a check which failed with
+   error RC.  */
+static int
+check_problem_reason (gpg_error_t rc)
+{
+  /* We keep the test for GPG_ERR_MISSING_CERT only in case
+     GPG_ERR_MISSING_CERT has been used instead of the newer
+     GPG_ERR_MISSING_ISSUER_CERT.  */
+  return (gpg_err_code (rc) == GPG_ERR_MISSING_ISSUER_CERT? 2 :
+          gpg_err_code (rc) == GPG_ERR_MISSING_CERT? 2 :
+          gpg_err_code (rc) == GPG_ERR_BAD_CERT?     1 : 0);
+}
+
+
+/* Return true if RC is a result of check_cert for which the
+   certificate is imported anyway.  */
+static int
+accept_check_result (ctrl_t ctrl, gpg_error_t rc)
+{
+  return (!rc || (!ctrl->with_validation
+                  && (gpg_err_code (rc) == GPG_ERR_MISSING_CERT
+                      || gpg_err_code (rc) == GPG_ERR_MISSING_ISSUER_CERT)));
+}
+
+
+/* Some basic checks, but don't care about missing certificates;
+   this is so that we are able to import entire certificate chains
+   w/o requiring a special order (i.e. root-CA first).  This used
+   to be different but because gpgsm_verify even imports
+   certificates without any checks, it doesn't matter much and the
+   code gets much cleaner.  A housekeeping function to remove
+   certificates w/o an anchor would be nice, though.
+
+   Optionally we do a full validation in addition to the basic test.
+*/
+static gpg_error_t
+check_cert (ctrl_t ctrl, ksba_cert_t cert)
+{
+  gpg_error_t rc;
+
+  rc = gpgsm_basic_cert_check (ctrl, cert);
+  if (!rc && ctrl->with_validation)
+    rc = gpgsm_validate_chain (ctrl, cert, "", NULL, 0, NULL, 0, NULL);
+  return rc;
+}
+
+
+/* Print the diagnostics for the certificate CERT which failed the
+   checks with error RC.  */
+static void
+note_check_failure (ctrl_t ctrl, struct stats_s *stats, ksba_cert_t cert,
+                    gpg_error_t rc)
+{
+  log_error (_("basic certificate checks failed - not imported\n"));
+  if (stats)
+    stats->not_imported++;
+  print_import_problem (ctrl, cert, check_problem_reason (rc));
+}
+
+
+/* Print the diagnostics for the certificate CERT which has just been
+   stored; EXISTED is true if it was already in the DB.  Then walk up
+   the chain and import all certificates up the chain.  This is
+   required in case we already stored parent certificates in the
+   ephemeral keybox.  Do not update the statistics, though. */
+static void
+note_stored (ctrl_t ctrl, struct stats_s *stats, ksba_cert_t cert,
+             int depth, int existed)
+{
+  ksba_cert_t next = NULL;
+
+  if (!existed)
+    {
+      print_imported_status (ctrl, cert, 1);
+      if (stats)
+        stats->imported++;
+    }
+  else
+    {
+      print_imported_status (ctrl, cert, 0);
+      if (stats)
+        stats->unchanged++;
+    }
+
+  if (opt.verbose > 1 && existed)
+    {
+      if (depth)
+        log_info ("issuer certificate already in DB\n");
+      else
+        log_info ("certificate already in DB\n");
+    }
+  else if (opt.verbose && !existed)
+    {
+      if (depth)
+        log_info ("issuer certificate imported\n");
+      else
+        log_info ("certificate imported\n");
+    }
+
+  if (!gpgsm_walk_cert_chain (ctrl, cert, &next))
+    {
+      check_and_store (ctrl, NULL, next, depth+1);
+      ksba_cert_release (next);
+    }
+}
+
+
 static void
 check_and_store (ctrl_t ctrl, struct stats_s *stats,
                  ksba_cert_t cert, int depth)
@@ -180,67 +328,16 @@ check_and_store (ctrl_t ctrl, struct stats_s *stats,
       return;
     }
 
-  /* Some basic checks, but don't care about missing certificates;
-     this is so that we are able to import entire certificate chains
-     w/o requiring a special order (i.e. root-CA first).  This used
-     to be different but because gpgsm_verify even imports
-     certificates without any checks, it doesn't matter much and the
-     code gets much cleaner.  A housekeeping function to remove
-     certificates w/o an anchor would be nice, though.
+  if (stats && stats->bulk && !depth && !bulk_add (ctrl, stats, cert))
+    return;
 
-     Optionally we do a full validation in addition to the basic test.
-  */
-  rc = gpgsm_basic_cert_check (ctrl, cert);
-  if (!rc && ctrl->with_validation)
-    rc = gpgsm_validate_chain (ctrl, cert, "", NULL, 0, NULL, 0, NULL);
-  if (!rc || (!ctrl->with_validation
-              && (gpg_err_code (rc) == GPG_ERR_MISSING_CERT
-                  || gpg_err_code (rc) == GPG_ERR_MISSING_ISSUER_CERT)))
+  rc = check_cert (ctrl, cert);
+  if (accept_check_result (ctrl, rc))
     {
       int existed;
 
       if (!keydb_store_cert (cert, 0, &existed))
-        {
-          ksba_cert_t next = NULL;
-
-          if (!existed)
-            {
-              print_imported_status (ctrl, cert, 1);
-              if (stats)
-                stats->imported++;
-            }
-          else
-            {
-              print_imported_status (ctrl, cert, 0);
-              if (stats)
-                stats->unchanged++;
-            }
-
-          if (opt.verbose > 1 && existed)
-            {
-              if (depth)
-                log_info ("issuer certificate already in DB\n");
-              else
-                log_info ("certificate already in DB\n");
-            }
-          else if (opt.verbose && !existed)
-            {
-              if (depth)
-                log_info ("issuer certificate imported\n");
-              else
-                log_info ("certificate imported\n");
-            }
-
-          /* Now lets walk up the chain and import all certificates up
-             the chain.  This is required in case we already stored
-             parent certificates in the ephemeral keybox.  Do not
-             update the statistics, though. */
-          if (!gpgsm_walk_cert_chain (ctrl, cert, &next))
-            {
-              check_and_store (ctrl, NULL, next, depth+1);
-              ksba_cert_release (next);
-            }
-        }
+        note_stored (ctrl, stats, cert, depth, existed);
       else
         {
           log_error (_("error storing certificate\n"));
@@ -250,19 +347,252 @@ check_and_store (ctrl_t ctrl, struct stats_s *stats,
         }
     }
   else
+    note_check_failure (ctrl, stats, cert, rc);
+}
+
+
+
+/* Return the entry for the fingerprint FPR in the fingerprint set of
+   BULK.  If the fingerprint is not yet in the set and CREATE is true,
+   a new entry with the state BULK_STATE_NONE is created; this may
+   move all entries.  Returns NULL if the fingerprint was not found
+   or the set could not be enlarged.  */
+static struct fpr_entry_s *
+fpr_set_lookup (struct bulk_s *bulk, const unsigned char *fpr, int create)
+{
+  struct fpr_entry_s *entry;
+  unsigned int mask, i;
+
+  if (create && 2 * (bulk->fpr_count + 1) > bulk->fpr_size)
     {
-      log_error (_("basic certificate checks failed - not imported\n"));
-      if (stats)
-        stats->not_imported++;
-      /* We keep the test for GPG_ERR_MISSING_CERT only in case
-         GPG_ERR_MISSING_CERT has been used instead of the newer
-         GPG_ERR_MISSING_ISSUER_CERT.  */
-      print_import_problem
-        (ctrl, cert,
-         gpg_err_code (rc) == GPG_ERR_MISSING_ISSUER_CERT? 2 :
-         gpg_err_code (rc) == GPG_ERR_MISSING_CERT? 2 :
-         gpg_err_code (rc) == GPG_ERR_BAD_CERT?     1 : 0);
+      struct fpr_entry_s *newtbl, *oldtbl = bulk->fpr_table;
+      unsigned int oldsize = bulk->fpr_size;
+      unsigned int newsize = oldsize? 2 * oldsize : 4096;
+
+      newtbl = xtrycalloc (newsize, sizeof *newtbl);
+      if (!newtbl)
+        return NULL;
+      bulk->fpr_table = newtbl;
+      bulk->fpr_size = newsize;
+      bulk->fpr_count = 0;
+      for (i=0; i < oldsize; i++)
+        if (oldtbl[i].state != BULK_STATE_FREE)
+          {
+            entry = fpr_set_lookup (bulk, oldtbl[i].fpr, 1);
+            entry->state = oldtbl[i].state;
+          }
+      xfree (oldtbl);
+    }
+  if (!bulk->fpr_size)
+    return NULL;
+
+  /* A fingerprint is a hash value; thus its first bytes are good
+     enough as the hash of the table.  */
+  mask = bulk->fpr_size - 1;
+  for (i = ((fpr[0] << 24) | (fpr[1] << 16) | (fpr[2] << 8) | fpr[3]) & mask;
+       bulk->fpr_table[i].state != BULK_STATE_FREE;
+       i = (i + 1) & mask)
+    if (!memcmp (bulk->fpr_table[i].fpr, fpr, 20))
+      return bulk->fpr_table + i;
+  if (!create)
+    return NULL;
+
+  entry = bulk->fpr_table + i;
+  memcpy (entry->fpr, fpr, 20);
+  entry->state = BULK_STATE_NONE;
+  bulk->fpr_count++;
+  return entry;
+}
+
+
+/* Set the state of the certificate with index IDX of the current
+   batch to STATE.  */
+static void
+bulk_set_state (struct bulk_s *bulk, int idx, int state)
+{
+  struct fpr_entry_s *entry;
+
+  entry = fpr_set_lookup (bulk, bulk->fprs[idx], 0);
+  if (entry)
+    entry->state = state;
+}
+
+
+/* Store the certificates with the indices IDX[0] to IDX[N-1] of the
+   current batch using one write.  */
+static void
+bulk_store (ctrl_t ctrl, struct stats_s *stats, int *idx, int n)
+{
+  struct bulk_s *bulk = stats->bulk;
+  gpg_error_t err;
+  ksba_cert_t certs[BULK_BATCH_SIZE];
+  int existed[BULK_BATCH_SIZE];
+  int i;
+
+  for (i=0; i < n; i++)
+    certs[i] = bulk->certs[idx[i]];
+  err = keydb_store_certs (certs, n, existed);
+  for (i=0; i < n; i++)
+    {
+      if (err)
+        {
+          bulk_set_state (bulk, idx[i], BULK_STATE_FAILED + 4);
+          log_error (_("error storing certificate\n"));
+          stats->not_imported++;
+          print_import_problem (ctrl, certs[i], 4);
+        }
+      else
+        {
+          bulk_set_state (bulk, idx[i], BULK_STATE_STORED);
+          note_stored (ctrl, stats, certs[i], 0, existed[i]);
+        }
+    }
+}
+
+
+/* Mark the certificate with index IDX of the current batch as failed
+   with error RC and print the diagnostics.  */
+static void
+bulk_fail (ctrl_t ctrl, struct stats_s *stats, int idx, gpg_error_t rc)
+{
+  bulk_set_state (stats->bulk, idx,
+                  BULK_STATE_FAILED + check_problem_reason (rc));
+  note_check_failure (ctrl, stats, stats->bulk->certs[idx], rc);
+}
+
+
+/* Check and store all certificates of the current batch.  Because
+   the input does not need to be ordered, a certificate may come
+   before its issuer.  Certificates which fail only because their
+   issuer is missing are thus checked again after the other
+   certificates of the batch have been stored.  */
+static void
+bulk_flush (ctrl_t ctrl, struct stats_s *stats)
+{
+  struct bulk_s *bulk = stats->bulk;
+  gpg_error_t rc[BULK_BATCH_SIZE];
+  int pending[BULK_BATCH_SIZE];
+  int ready[BULK_BATCH_SIZE];
+  int npending, nready, ndeferred;
+  int i, pass;
+
+  npending = bulk->ncerts;
+  for (i=0; i < npending; i++)
+    pending[i] = i;
+
+  /* The limit on the passes is the same as the limit of the chain
+     length in check_and_store.  */
+  for (pass=0; npending && pass < 50; pass++)
+    {
+      nready = ndeferred = 0;
+      for (i=0; i < npending; i++)
+        {
+          int k = pending[i];
+
+          rc[k] = check_cert (ctrl, bulk->certs[k]);
+          if (!rc[k])
+            ready[nready++] = k;
+          else if (gpg_err_code (rc[k]) == GPG_ERR_MISSING_CERT
+                   || gpg_err_code (rc[k]) == GPG_ERR_MISSING_ISSUER_CERT)
+            pending[ndeferred++] = k;
+          else
+            bulk_fail (ctrl, stats, k, rc[k]);
+        }
+      npending = ndeferred;
+      if (!nready)
+        break;
+      bulk_store (ctrl, stats, ready, nready);
+    }
+
+  /* The issuers of the remaining certificates are missing.  */
+  nready = 0;
+  for (i=0; i < npending; i++)
+    {
+      int k = pending[i];
+
+      if (accept_check_result (ctrl, rc[k]))
+        ready[nready++] = k;
+      else
+        bulk_fail (ctrl, stats, k, rc[k]);
+    }
+  if (nready)
+    bulk_store (ctrl, stats, ready, nready);
+
+  for (i=0; i < bulk->ncerts; i++)
+    ksba_cert_release (bulk->certs[i]);
+  bulk->ncerts = 0;
+}
+
+
+/* Add the certificate CERT to the current batch of the bulk import.
+   Duplicates are detected here.  Returns an error if the certificate
+   could not be added; the caller then processes it directly.  */
+static gpg_error_t
+bulk_add (ctrl_t ctrl, struct stats_s *stats, ksba_cert_t cert)
+{
+  struct bulk_s *bulk = stats->bulk;
+  struct fpr_entry_s *entry;
+  unsigned char fpr[20];
+
+  if (!gpgsm_get_fingerprint (cert, 0, fpr, NULL))
+    return gpg_error (GPG_ERR_GENERAL);
+  entry = fpr_set_lookup (bulk, fpr, 1);
+  if (!entry)
+    return gpg_error_from_syserror ();
+
+  /* For a duplicate within the current batch we need to know what
+     happened to the first one.  */
+  if (entry->state == BULK_STATE_QUEUED)
+    bulk_flush (ctrl, stats);
+  if (entry->state == BULK_STATE_STORED)
+    {
+      print_imported_status (ctrl, cert, 0);
+      stats->unchanged++;
+      if (opt.verbose > 1)
+        log_info ("certificate already in DB\n");
+      return 0;
+    }
+  if (entry->state >= BULK_STATE_FAILED)
+    {
+      stats->not_imported++;
+      print_import_problem (ctrl, cert, entry->state - BULK_STATE_FAILED);
+      return 0;
     }
+
+  ksba_cert_ref (cert);
+  entry->state = BULK_STATE_QUEUED;
+  memcpy (bulk->fprs[bulk->ncerts], fpr, 20);
+  bulk->certs[bulk->ncerts++] = cert;
+  if (bulk->ncerts == BULK_BATCH_SIZE)
+    bulk_flush (ctrl, stats);
+  return 0;
+}
+
+
+/* Start a bulk import for STATS if requested.  */
+static void
+bulk_begin (struct stats_s *stats)
+{
+  if (!opt.bulk_import)
+    return;
+  stats->bulk = xtrycalloc (1, sizeof *stats->bulk);
+  if (!stats->bulk)
+    log_info ("can't allocate bulk import context: %s - disabled\n",
+              gpg_strerror (gpg_error_from_syserror ()));
+}
+
+
+/* Check and store the remaining certificates of a bulk import and
+   release its context.  */
+static void
+bulk_end (ctrl_t ctrl, struct stats_s *stats)
+{
+  if (!stats->bulk)
+    return;
+  bulk_flush (ctrl, stats);
+  xfree (stats->bulk->fpr_table);
+  xfree (stats->bulk);
+  stats->bulk = NULL;
 }
 
 
@@ -517,7 +847,11 @@ gpgsm_import (ctrl_t ctrl, int in_fd, int reimport_mode)
   if (reimport_mode)
     rc = reimport_one (ctrl, &stats, in_fd);
   else
-    rc = import_one (ctrl, &stats, in_fd);
+    {
+      bulk_begin (&stats);
+      rc = import_one (ctrl, &stats, in_fd);
+      bulk_end (ctrl, &stats);
+    }
   print_imported_summary (ctrl, &stats);
   /* If we never printed an error message do it now so that a command
      line invocation will return with an error (log_error keeps a
@@ -536,6 +870,7 @@ gpgsm_import_files (ctrl_t ctrl, int nfiles, char **files,
   struct stats_s stats;
 
   memset (&stats, 0, sizeof stats);
+  bulk_begin (&stats);
 
   if (!nfiles)
     rc = import_one (ctrl, &stats, 0);
@@ -550,6 +885,7 @@ gpgsm_import_files (ctrl_t ctrl, int nfiles, char **files,
             rc = 0;
         }
     }
+  bulk_end (ctrl, &stats);
   print_imported_summary (ctrl, &stats);
   /* If we never printed an error message do it now so that a command
      line invocation will return with an error (log_error keeps a
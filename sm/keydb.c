@@ -783,6 +783,54 @@ keydb_insert_cert (KEYDB_HANDLE hd, ksba_cert_t cert)
 
 
 
+/* Insert the NCERTS certificates CERTS into the resource located
+   with keydb_locate_writable.  This is done with one write to the
+   resource.  */
+gpg_error_t
+keydb_insert_certs (KEYDB_HANDLE hd, ksba_cert_t *certs, int ncerts)
+{
+  gpg_error_t err = gpg_error (GPG_ERR_GENERAL);
+  int idx, i;
+  unsigned char *digests;
+
+  if (!hd)
+    return gpg_error (GPG_ERR_INV_VALUE);
+
+  if (opt.dry_run)
+    return 0;
+
+  if ( hd->found >= 0 && hd->found < hd->used)
+    idx = hd->found;
+  else if ( hd->current >= 0 && hd->current < hd->used)
+    idx = hd->current;
+  else
+    return gpg_error (GPG_ERR_GENERAL);
+
+  if (!hd->locked)
+    return gpg_error (GPG_ERR_NOT_LOCKED);
+
+  digests = xtrymalloc (ncerts? 20 * ncerts : 1);
+  if (!digests)
+    return gpg_error_from_syserror ();
+  for (i=0; i < ncerts; i++)
+    gpgsm_get_fingerprint (certs[i], GCRY_MD_SHA1, digests + 20*i, NULL);
+
+  switch (hd->active[idx].type)
+    {
+    case KEYDB_RESOURCE_TYPE_NONE:
+      err = gpg_error (GPG_ERR_GENERAL);
+      break;
+    case KEYDB_RESOURCE_TYPE_KEYBOX:
+      err = keybox_insert_certs (hd->active[idx].u.kr, certs, digests, ncerts);
+      break;
+    }
+
+  xfree (digests);
+  unlock_all (hd);
+  return err;
+}
+
+
 /* Update the current keyblock with KB.  */
 int
 keydb_update_cert (KEYDB_HANDLE hd, ksba_cert_t cert)
@@ -1151,6 +1199,83 @@ keydb_store_cert (ksba_cert_t cert, int ephemeral, int *existed)
 }
 
 
+/* Store the NCERTS certificates CERTS in the keyDB using one lock and
+   one write.  Certificates which are already stored are not stored
+   again; for them the respective item of the array EXISTED is set to
+   true.  */
+gpg_error_t
+keydb_store_certs (ksba_cert_t *certs, int ncerts, int *existed)
+{
+  gpg_error_t err;
+  KEYDB_HANDLE kh;
+  ksba_cert_t *newcerts;
+  unsigned char fpr[20];
+  int i, nnew;
+
+  for (i=0; i < ncerts; i++)
+    existed[i] = 0;
+  if (!ncerts)
+    return 0;
+
+  newcerts = xtrycalloc (ncerts, sizeof *newcerts);
+  if (!newcerts)
+    return gpg_error_from_syserror ();
+
+  kh = keydb_new (0);
+  if (!kh)
+    {
+      log_error (_("failed to allocate keyDB handle\n"));
+      xfree (newcerts);
+      return gpg_error (GPG_ERR_ENOMEM);
+    }
+
+  err = lock_all (kh);
+  if (err)
+    goto leave;
+
+  for (nnew=i=0; i < ncerts; i++)
+    {
+      if (!gpgsm_get_fingerprint (certs[i], 0, fpr, NULL))
+        {
+          log_error (_("failed to get the fingerprint\n"));
+          err = gpg_error (GPG_ERR_GENERAL);
+          goto leave;
+        }
+      keydb_search_reset (kh);
+      err = keydb_search_fpr (kh, fpr);
+      if (!err)
+        existed[i] = 1;
+      else if (err == -1)
+        newcerts[nnew++] = certs[i];
+      else
+        {
+          log_error (_("problem looking for existing certificate: %s\n"),
+                     gpg_strerror (err));
+          goto leave;
+        }
+    }
+  err = 0;
+  if (!nnew)
+    goto leave;
+
+  err = keydb_locate_writable (kh, 0);
+  if (err)
+    {
+      log_error (_("error finding writable keyDB: %s\n"), gpg_strerror (err));
+      goto leave;
+    }
+
+  err = keydb_insert_certs (kh, newcerts, nnew);
+  if (err)
+    log_error (_("error storing certificate: %s\n"), gpg_strerror (err));
+
+ leave:
+  keydb_release (kh);
+  xfree (newcerts);
+  return err;
+}
+
+
 /* This is basically keydb_set_flags but it implements a complete
    transaction by locating the certificate in the DB and updating the
    flags. */
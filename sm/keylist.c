@@ -48,6 +48,29 @@ struct list_external_parm_s
 };
 
 
+/* The maximum number of chain IDs cached while listing.  */
+#define CHAIN_ID_CACHE_SIZE 64
+
+/* Information cached while listing many certificates.  */
+struct list_cache_s
+{
+  /* True if SECRET_KEYS holds all secret keys of the agent as
+     returned by gpgsm_agent_keyinfo_list.  */
+  int secret_keys_valid;
+  strlist_t secret_keys;
+
+  /* Most certificates share a few issuers.  To avoid looking up the
+     issuer's certificate for each of them we cache the chain IDs by
+     the issuer DN and the authorityKeyIdentifier.  */
+  struct {
+    char *key;       /* Malloced key or NULL for an unused slot.  */
+    char *chain_id;  /* Malloced fingerprint of the issuer's certificate
+                        or NULL if it is not available.  */
+  } chain_ids[CHAIN_ID_CACHE_SIZE];
+  int chain_ids_next;  /* The slot to be used next.  */
+};
+
+
 /* This table is to map Extended Key Usage OIDs to human readable
    names.  */
 struct
@@ -348,10 +371,123 @@ email_kludge (const char *name)
 
 
 
-/* List one certificate in colon mode */
+/* Release the data held by CACHE.  */
+static void
+list_cache_release (struct list_cache_s *cache)
+{
+  int i;
+
+  free_strlist (cache->secret_keys);
+  cache->secret_keys = NULL;
+  cache->secret_keys_valid = 0;
+  for (i=0; i < CHAIN_ID_CACHE_SIZE; i++)
+    {
+      xfree (cache->chain_ids[i].key);
+      cache->chain_ids[i].key = NULL;
+      xfree (cache->chain_ids[i].chain_id);
+      cache->chain_ids[i].chain_id = NULL;
+    }
+}
+
+
+/* Return the item of the secret keys list in CACHE for the keygrip
+   HEXGRIP or NULL if the agent has no such key.  */
+static const char *
+find_secret_key (struct list_cache_s *cache, const char *hexgrip)
+{
+  strlist_t sl;
+
+  if (!hexgrip)
+    return NULL;
+  for (sl = cache->secret_keys; sl; sl = sl->next)
+    if (!strncmp (sl->d, hexgrip, 40) && (!sl->d[40] || sl->d[40] == ' '))
+      return sl->d;
+  return NULL;
+}
+
+
+/* Return a malloced key for the chain ID cache which identifies the
+   issuer of CERT.  That is the issuer DN followed by the hex encoded
+   authorityKeyIdentifier extension.  Returns NULL on error.  */
+static char *
+chain_id_cache_key (ksba_cert_t cert)
+{
+  gpg_error_t err;
+  char *issuer, *key;
+  const char *oid;
+  const unsigned char *der = NULL;
+  size_t off, len = 0;
+  int idx, crit;
+
+  issuer = ksba_cert_get_issuer (cert, 0);
+  if (!issuer)
+    return NULL;
+
+  for (idx=0; !(err=ksba_cert_get_extension (cert, idx,
+                                             &oid, &crit, &off, &len)); idx++)
+    if (!strcmp (oid, "2.5.29.35"))
+      {
+        der = ksba_cert_get_image (cert, NULL);
+        break;
+      }
+  if (!der)
+    len = 0;
+
+  key = xtrymalloc (strlen (issuer) + 1 + 2*len + 1);
+  if (key)
+    {
+      strcpy (stpcpy (key, issuer), "\n");
+      if (der)
+        bin2hex (der + off, len, key + strlen (key));
+    }
+  xfree (issuer);
+  return key;
+}
+
+
+/* Look up the chain ID for the cache key KEY.  Returns the slot or -1
+   if not found.  */
+static int
+chain_id_cache_find (struct list_cache_s *cache, const char *key)
+{
+  int i;
+
+  for (i=0; i < CHAIN_ID_CACHE_SIZE; i++)
+    if (cache->chain_ids[i].key && !strcmp (cache->chain_ids[i].key, key))
+      return i;
+  return -1;
+}
+
+
+/* Store a copy of CHAIN_ID, which may be NULL, for the cache key KEY.  */
+static void
+chain_id_cache_put (struct list_cache_s *cache, const char *key,
+                    const char *chain_id)
+{
+  int i = cache->chain_ids_next;
+  char *keycopy, *idcopy = NULL;
+
+  keycopy = xtrystrdup (key);
+  if (!keycopy)
+    return;
+  if (chain_id && !(idcopy = xtrystrdup (chain_id)))
+    {
+      xfree (keycopy);
+      return;
+    }
+  xfree (cache->chain_ids[i].key);
+  xfree (cache->chain_ids[i].chain_id);
+  cache->chain_ids[i].key = keycopy;
+  cache->chain_ids[i].chain_id = idcopy;
+  cache->chain_ids_next = (i + 1) % CHAIN_ID_CACHE_SIZE;
+}
+
+
+/* List one certificate in colon mode.  CACHE is either NULL or used
+   to cache information over several calls.  */
 static void
 list_cert_colon (ctrl_t ctrl, ksba_cert_t cert, unsigned int validity,
-                 estream_t fp, int have_secret)
+                 estream_t fp, int have_secret, struct list_cache_s *cache)
 {
   int rc;
   int idx;
@@ -367,6 +503,7 @@ list_cert_colon (ctrl_t ctrl, ksba_cert_t cert, unsigned int validity,
   char *chain_id_buffer = NULL;
   int is_root = 0;
   char *kludge_uid;
+  char *cachekey = NULL;
 
   if (ctrl->with_validation)
     valerr = gpgsm_validate_chain (ctrl, cert, "", NULL, 1, NULL, 0, NULL);
@@ -376,25 +513,39 @@ list_cert_colon (ctrl_t ctrl, ksba_cert_t cert, unsigned int validity,
 
   /* We need to get the fingerprint and the chaining ID in advance. */
   fpr = gpgsm_get_fingerprint_hexstring (cert, GCRY_MD_SHA1);
-  {
-    ksba_cert_t next;
+  if (cache && !gpgsm_is_root_cert (cert))
+    cachekey = chain_id_cache_key (cert);
+  if (cachekey && (idx = chain_id_cache_find (cache, cachekey)) != -1)
+    {
+      if (cache->chain_ids[idx].chain_id)
+        chain_id_buffer = xtrystrdup (cache->chain_ids[idx].chain_id);
+      chain_id = chain_id_buffer;
+    }
+  else
+    {
+      ksba_cert_t next;
 
-    rc = gpgsm_walk_cert_chain (ctrl, cert, &next);
-    if (!rc) /* We known the issuer's certificate. */
-      {
-        p = gpgsm_get_fingerprint_hexstring (next, GCRY_MD_SHA1);
-        chain_id_buffer = p;
-        chain_id = chain_id_buffer;
-        ksba_cert_release (next);
-      }
-    else if (rc == -1)  /* We have reached the root certificate. */
-      {
-        chain_id = fpr;
-        is_root = 1;
-      }
-    else
-      chain_id = NULL;
-  }
+      rc = gpgsm_walk_cert_chain (ctrl, cert, &next);
+      if (!rc) /* We known the issuer's certificate. */
+        {
+          p = gpgsm_get_fingerprint_hexstring (next, GCRY_MD_SHA1);
+          chain_id_buffer = p;
+          chain_id = chain_id_buffer;
+          ksba_cert_release (next);
+        }
+      else if (rc == -1)  /* We have reached the root certificate. */
+        {
+          chain_id = fpr;
+          is_root = 1;
+        }
+      else
+        chain_id = NULL;
+
+      if (cachekey
+          && (!rc || gpg_err_code (rc) == GPG_ERR_MISSING_ISSUER_CERT))
+        chain_id_cache_put (cache, cachekey, chain_id);
+    }
+  xfree (cachekey);
 
 
   es_fputs (have_secret? "crs:":"crt:", fp);
@@ -499,11 +650,21 @@ list_cert_colon (ctrl_t ctrl, ksba_cert_t cert, unsigned int validity,
   es_putc (':', fp);
   if (have_secret || ctrl->with_secret)
     {
-      char *cardsn;
+      char *cardsn = NULL;
+      int found;
 
       p = gpgsm_get_keygrip_hexstring (cert);
-      if (!gpgsm_agent_keyinfo (ctrl, p, &cardsn)
-          && (cardsn || ctrl->with_secret))
+      if (cache && cache->secret_keys_valid)
+        {
+          const char *item = find_secret_key (cache, p);
+
+          found = !!item;
+          if (item && item[40] == ' ')
+            cardsn = xtrystrdup (item + 41);
+        }
+      else
+        found = !gpgsm_agent_keyinfo (ctrl, p, &cardsn);
+      if (found && (cardsn || ctrl->with_secret))
         {
           /* Field 14, not used: */
           es_putc (':', fp);
@@ -1329,6 +1490,9 @@ list_internal_keys (ctrl_t ctrl, strlist_t names, estream_t fp,
   const char *lastresname, *resname;
   int have_secret;
   int want_ephemeral = ctrl->with_ephemeral_keys;
+  struct list_cache_s cache;
+
+  memset (&cache, 0, sizeof cache);
 
   hd = keydb_new (0);
   if (!hd)
@@ -1400,6 +1564,16 @@ list_internal_keys (ctrl_t ctrl, strlist_t names, estream_t fp,
      currently we stop at the first match.  To do this we need an
      extra flag to enable this feature so */
 
+  /* Instead of asking the agent for each certificate whether it has
+     the secret key, get the list of all secret keys at once.  If the
+     agent does not support this we fall back to asking for each
+     key.  */
+  if (mode || (ctrl->with_colons && ctrl->with_secret))
+    {
+      if (!gpgsm_agent_keyinfo_list (ctrl, &cache.secret_keys))
+        cache.secret_keys_valid = 1;
+    }
+
   /* Suppress duplicates at least when they follow each other.  */
   lastresname = NULL;
   while (!(rc = keydb_search (hd, desc, ndesc)))
@@ -1448,7 +1622,13 @@ list_internal_keys (ctrl_t ctrl, strlist_t names, estream_t fp,
         }
 
       have_secret = 0;
-      if (mode)
+      if (mode && cache.secret_keys_valid)
+        {
+          char *p = gpgsm_get_keygrip_hexstring (cert);
+          have_secret = !!find_secret_key (&cache, p);
+          xfree (p);
+        }
+      else if (mode)
         {
           char *p = gpgsm_get_keygrip_hexstring (cert);
           if (p)
@@ -1468,7 +1648,7 @@ list_internal_keys (ctrl_t ctrl, strlist_t names, estream_t fp,
           || ((mode & 2) && have_secret)  )
         {
           if (ctrl->with_colons)
-            list_cert_colon (ctrl, cert, validity, fp, have_secret);
+            list_cert_colon (ctrl, cert, validity, fp, have_secret, &cache);
           else if (ctrl->with_chain)
             list_cert_chain (ctrl, hd, cert,
                              raw_mode, fp, ctrl->with_validation);
@@ -1498,6 +1678,7 @@ list_internal_keys (ctrl_t ctrl, strlist_t names, estream_t fp,
   ksba_cert_release (lastcert);
   xfree (desc);
   keydb_release (hd);
+  list_cache_release (&cache);
   return rc;
 }
 
@@ -1524,7 +1705,7 @@ list_external_cb (void *cb_value, ksba_cert_t cert)
     }
 
   if (parm->with_colons)
-    list_cert_colon (parm->ctrl, cert, 0, parm->fp, 0);
+    list_cert_colon (parm->ctrl, cert, 0, parm->fp, 0, NULL);
   else if (parm->with_chain)
     list_cert_chain (parm->ctrl, NULL, cert, parm->raw_mode, parm->fp, 0);
   else
@@ -327,9 +327,111 @@ cram_octet_string (const unsigned char *input, size_t *length,
 
 
 
+/* The number of derived keys we cache.  */
+#define KDF_CACHE_SIZE 8
+
+/* A derived key.  The item is allocated in secure memory with the
+   password, the salt and the key in DATA.  */
+struct kdf_cache_item_s
+{
+  int id;            /* The PKCS#12 KDF id or 0 for PBKDF2.  */
+  int iter;
+  size_t pwlen;
+  size_t saltlen;
+  size_t keylen;
+  unsigned char data[1];
+};
+
+/* A PKCS#12 file often uses the same password, salt and iteration
+   count for several bags.  Because the key derivation is expensive we
+   cache the derived keys.  The cache is cleared at the end of
+   p12_parse and p12_build so that no keys stay in memory.  */
+static struct kdf_cache_item_s *kdf_cache[KDF_CACHE_SIZE];
+static int kdf_cache_next;  /* The slot to be used next.  */
+
+
+/* Wipe and release the cache item ITEM.  */
+static void
+kdf_cache_release (struct kdf_cache_item_s *item)
+{
+  if (!item)
+    return;
+  wipememory (item, (sizeof *item
+                     + item->pwlen + item->saltlen + item->keylen));
+  gcry_free (item);
+}
+
+
+/* Wipe and release all cached keys.  */
+static void
+kdf_cache_flush (void)
+{
+  int i;
+
+  for (i=0; i < KDF_CACHE_SIZE; i++)
+    {
+      kdf_cache_release (kdf_cache[i]);
+      kdf_cache[i] = NULL;
+    }
+  kdf_cache_next = 0;
+}
+
+
+/* Copy the cached key for the given parameters to KEYBUF.  Returns
+   true if a key was found.  */
 static int
-string_to_key (int id, char *salt, size_t saltlen, int iter, const char *pw,
-               int req_keylen, unsigned char *keybuf)
+kdf_cache_get (int id, const char *salt, size_t saltlen, int iter,
+               const char *pw, size_t keylen, unsigned char *keybuf)
+{
+  size_t pwlen = strlen (pw);
+  struct kdf_cache_item_s *item;
+  int i;
+
+  for (i=0; i < KDF_CACHE_SIZE; i++)
+    if ((item = kdf_cache[i])
+        && item->id == id && item->iter == iter
+        && item->pwlen == pwlen && item->saltlen == saltlen
+        && item->keylen == keylen
+        && !memcmp (item->data, pw, pwlen)
+        && !memcmp (item->data + pwlen, salt, saltlen))
+      {
+        memcpy (keybuf, item->data + pwlen + saltlen, keylen);
+        return 1;
+      }
+  return 0;
+}
+
+
+/* Store the key KEYBUF derived with the given parameters in the
+   cache.  */
+static void
+kdf_cache_put (int id, const char *salt, size_t saltlen, int iter,
+               const char *pw, size_t keylen, const unsigned char *keybuf)
+{
+  size_t pwlen = strlen (pw);
+  struct kdf_cache_item_s *item;
+
+  item = gcry_malloc_secure (sizeof *item + pwlen + saltlen + keylen);
+  if (!item)
+    return; /* Out of secure memory; that is not a problem.  */
+  item->id = id;
+  item->iter = iter;
+  item->pwlen = pwlen;
+  item->saltlen = saltlen;
+  item->keylen = keylen;
+  memcpy (item->data, pw, pwlen);
+  memcpy (item->data + pwlen, salt, saltlen);
+  memcpy (item->data + pwlen + saltlen, keybuf, keylen);
+
+  kdf_cache_release (kdf_cache[kdf_cache_next]);
+  kdf_cache[kdf_cache_next] = item;
+  kdf_cache_next = (kdf_cache_next + 1) % KDF_CACHE_SIZE;
+}
+
+
+static int
+do_string_to_key (int id, char *salt, size_t saltlen, int iter,
+                  const char *pw, int req_keylen, unsigned char *keybuf)
 {
   int rc, i, j;
   gcry_md_hd_t md;
@@ -425,6 +527,23 @@ string_to_key (int id, char *salt, size_t saltlen, int iter, const char *pw,
 }
 
 
+/* Derive a key of length REQ_KEYLEN from PW using the PKCS#12 KDF with
+   ID, SALT and ITER and store it at KEYBUF.  */
+static int
+string_to_key (int id, char *salt, size_t saltlen, int iter, const char *pw,
+               int req_keylen, unsigned char *keybuf)
+{
+  int rc;
+
+  if (kdf_cache_get (id, salt, saltlen, iter, pw, req_keylen, keybuf))
+    return 0;
+  rc = do_string_to_key (id, salt, saltlen, iter, pw, req_keylen, keybuf);
+  if (!rc)
+    kdf_cache_put (id, salt, saltlen, iter, pw, req_keylen, keybuf);
+  return rc;
+}
+
+
 static int
 set_key_iv (gcry_cipher_hd_t chd, char *salt, size_t saltlen, int iter,
             const char *pw, int keybytes)
@@ -469,14 +588,18 @@ set_key_iv_pbes2 (gcry_cipher_hd_t chd, char *salt, size_t saltlen, int iter,
   if (!keybuf)
     return -1;
 
-  rc = gcry_kdf_derive (pw, strlen (pw),
-                        GCRY_KDF_PBKDF2, GCRY_MD_SHA1,
-                        salt, saltlen, iter, keylen, keybuf);
-  if (rc)
+  if (!kdf_cache_get (0, salt, saltlen, iter, pw, keylen, keybuf))
     {
-      log_error ("gcry_kdf_derive failed: %s\n", gpg_strerror (rc));
-      gcry_free (keybuf);
-      return -1;
+      rc = gcry_kdf_derive (pw, strlen (pw),
+                            GCRY_KDF_PBKDF2, GCRY_MD_SHA1,
+                            salt, saltlen, iter, keylen, keybuf);
+      if (rc)
+        {
+          log_error ("gcry_kdf_derive failed: %s\n", gpg_strerror (rc));
+          gcry_free (keybuf);
+          return -1;
+        }
+      kdf_cache_put (0, salt, saltlen, iter, pw, keylen, keybuf);
     }
 
   rc = gcry_cipher_setkey (chd, keybuf, keylen);
@@ -1658,6 +1781,7 @@ p12_parse (const unsigned char *buffer, size_t length, const char *pw,
     }
 
   gcry_free (cram_buffer);
+  kdf_cache_flush ();
   return result;
  bailout:
   log_error ("error at \"%s\", offset %u\n",
@@ -1671,6 +1795,7 @@ p12_parse (const unsigned char *buffer, size_t length, const char *pw,
       gcry_free (result);
     }
   gcry_free (cram_buffer);
+  kdf_cache_flush ();
   return NULL;
 }
 
@@ -2507,6 +2632,7 @@ p12_build (gcry_mpi_t *kparms, const void *cert, size_t certlen,
   buffer = create_final (seqlist, pw, &buflen);
 
  failure:
+  kdf_cache_flush ();
   if (pwbuf)
     {
       wipememory (pwbuf, pwbufsize);
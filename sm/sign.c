@@ -35,25 +35,36 @@
 #include "i18n.h"
 
 
-/* Hash the data and return if something was hashed.  Return -1 on error.  */
+/* Hash the data and return if something was hashed.  Return -1 on
+   error.  The data is read unbuffered in large blocks directly into
+   our buffer.  */
 static int
 hash_data (int fd, gcry_md_hd_t md)
 {
   estream_t fp;
-  char buffer[4096];
-  int nread;
+  char *buffer;
+  size_t nread;
   int rc = 0;
 
+  buffer = xtrymalloc (DATA_BUFFER_SIZE);
+  if (!buffer)
+    {
+      log_error ("error allocating buffer: %s\n", strerror (errno));
+      return -1;
+    }
+
   fp = es_fdopen_nc (fd, "rb");
   if (!fp)
     {
       log_error ("fdopen(%d) failed: %s\n", fd, strerror (errno));
+      xfree (buffer);
       return -1;
     }
+  es_setvbuf (fp, NULL, _IONBF, 0);
 
   do
     {
-      nread = es_fread (buffer, 1, DIM(buffer), fp);
+      nread = es_fread (buffer, 1, DATA_BUFFER_SIZE, fp);
       gcry_md_write (md, buffer, nread);
     }
   while (nread);
@@ -63,6 +74,7 @@ hash_data (int fd, gcry_md_hd_t md)
       rc = -1;
     }
   es_fclose (fp);
+  xfree (buffer);
   return rc;
 }
 
@@ -72,22 +84,28 @@ hash_and_copy_data (int fd, gcry_md_hd_t md, ksba_writer_t writer)
 {
   gpg_error_t err;
   estream_t fp;
-  char buffer[4096];
-  int nread;
+  char *buffer;
+  size_t nread;
   int rc = 0;
   int any = 0;
 
+  buffer = xtrymalloc (DATA_BUFFER_SIZE);
+  if (!buffer)
+    return gpg_error_from_syserror ();
+
   fp = es_fdopen_nc (fd, "rb");
   if (!fp)
     {
       gpg_error_t tmperr = gpg_error_from_syserror ();
       log_error ("fdopen(%d) failed: %s\n", fd, strerror (errno));
+      xfree (buffer);
       return tmperr;
     }
+  es_setvbuf (fp, NULL, _IONBF, 0);
 
   do
     {
-      nread = es_fread (buffer, 1, DIM(buffer), fp);
+      nread = es_fread (buffer, 1, DATA_BUFFER_SIZE, fp);
       if (nread)
         {
           any = 1;
@@ -107,6 +125,7 @@ hash_and_copy_data (int fd, gcry_md_hd_t md, ksba_writer_t writer)
       log_error ("read error on fd %d: %s\n", fd, strerror (errno));
     }
   es_fclose (fp);
+  xfree (buffer);
   if (!any)
     {
       /* We can't allow to sign an empty message because it does not
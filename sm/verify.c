@@ -24,6 +24,7 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <time.h>
 #include <assert.h>
 
@@ -34,6 +35,10 @@
 #include "keydb.h"
 #include "i18n.h"
 
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
 static char *
 strtimestamp_r (ksba_isotime_t atime)
 {
@@ -48,26 +53,35 @@ strtimestamp_r (ksba_isotime_t atime)
 
 
 
-/* Hash the data for a detached signature.  Returns 0 on success.  */
+/* Hash the data for a detached signature.  Returns 0 on success.
+   The data is read unbuffered in large blocks directly into our
+   buffer; all algorithms enabled in MD are updated in the same
+   pass.  */
 static gpg_error_t
 hash_data (int fd, gcry_md_hd_t md)
 {
   gpg_error_t err = 0;
   estream_t fp;
-  char buffer[4096];
-  int nread;
+  char *buffer;
+  size_t nread;
+
+  buffer = xtrymalloc (DATA_BUFFER_SIZE);
+  if (!buffer)
+    return gpg_error_from_syserror ();
 
   fp = es_fdopen_nc (fd, "rb");
   if (!fp)
     {
       err = gpg_error_from_syserror ();
       log_error ("fdopen(%d) failed: %s\n", fd, gpg_strerror (err));
+      xfree (buffer);
       return err;
     }
+  es_setvbuf (fp, NULL, _IONBF, 0);
 
   do
     {
-      nread = es_fread (buffer, 1, DIM(buffer), fp);
+      nread = es_fread (buffer, 1, DATA_BUFFER_SIZE, fp);
       gcry_md_write (md, buffer, nread);
     }
   while (nread);
@@ -77,12 +91,13 @@ hash_data (int fd, gcry_md_hd_t md)
       log_error ("read error on fd %d: %s\n", fd, gpg_strerror (err));
     }
   es_fclose (fp);
+  xfree (buffer);
   return err;
 }
 
 
 
-
+
 /* Perform a verify operation.  To verify detached signatures, DATA_FD
    must be different than -1.  With OUT_FP given and a non-detached
    signature, the signed material is written to that stream.  */
@@ -659,3 +674,102 @@ gpgsm_verify (ctrl_t ctrl, int in_fd, int data_fd, estream_t out_fp)
 
   return rc;
 }
+
+
+/* Helper for gpgsm_verify_files to verify the signature in the file
+   FNAME.  If FNAME has the suffix ".p7s" or ".sig" and a file without
+   that suffix exists, FNAME is taken as a detached signature for that
+   file.  */
+static int
+verify_one_file (ctrl_t ctrl, const char *fname)
+{
+  int rc;
+  int in_fd, data_fd = -1;
+  size_t n = strlen (fname);
+
+  in_fd = open (fname, O_RDONLY | O_BINARY);
+  if (in_fd == -1)
+    {
+      rc = gpg_error_from_syserror ();
+      log_error (_("can't open '%s': %s\n"), fname, gpg_strerror (rc));
+      return rc;
+    }
+
+  if (n > 4 && (!strcmp (fname + n - 4, ".p7s")
+                || !strcmp (fname + n - 4, ".sig")))
+    {
+      char *dataname = xtrystrdup (fname);
+
+      if (dataname)
+        {
+          dataname[n - 4] = 0;
+          data_fd = open (dataname, O_RDONLY | O_BINARY);
+          if (data_fd != -1 && opt.verbose)
+            log_info (_("assuming signed data in '%s'\n"), dataname);
+          xfree (dataname);
+        }
+    }
+
+  gpgsm_status2 (ctrl, STATUS_FILE_START, "1", fname, NULL);
+  rc = gpgsm_verify (ctrl, in_fd, data_fd, NULL);
+  gpgsm_status (ctrl, STATUS_FILE_DONE, NULL);
+
+  close (in_fd);
+  if (data_fd != -1)
+    close (data_fd);
+  return rc;
+}
+
+
+/* Verify the signatures in all files given by the NFILES names in
+   FILES.  If NFILES is 0 the names are read from stdin, one per line.
+   This is much faster than running gpgsm for each file because the
+   keybox, the connections to the agent and the dirmngr and the
+   validation caches are kept.  Errors are reported but do not stop
+   the processing; the last error is returned.  */
+int
+gpgsm_verify_files (ctrl_t ctrl, int nfiles, char **files)
+{
+  int rc, lastrc = 0;
+  char line[2048];
+  size_t n;
+
+  if (nfiles)
+    {
+      for (; nfiles; nfiles--, files++)
+        {
+          rc = verify_one_file (ctrl, *files);
+          if (rc)
+            lastrc = rc;
+        }
+      return lastrc;
+    }
+
+  while (es_fgets (line, DIM (line), es_stdin))
+    {
+      n = strlen (line);
+      if (n && line[n-1] == '\n')
+        line[--n] = 0;
+      else if (n == DIM (line) - 1)
+        {
+          log_error (_("input line longer than %d characters\n"),
+                     (int)DIM (line) - 1);
+          return gpg_error (GPG_ERR_TOO_LARGE);
+        }
+      /* Else this is the last line and it is not terminated.  */
+      if (n && line[n-1] == '\r')
+        line[--n] = 0;
+      if (!n)
+        continue;
+      rc = verify_one_file (ctrl, line);
+      if (rc)
+        lastrc = rc;
+    }
+  if (es_ferror (es_stdin))
+    {
+      rc = gpg_error_from_syserror ();
+      log_error ("error reading file names: %s\n", gpg_strerror (rc));
+      return rc;
+    }
+  return lastrc;
+}